@@ -14,10 +14,14 @@ echo "Building code"
 
 rm -f lsim_test lsim_main
 
-DEVS="lsim_devs_addword.c lsim_devs_addbit.c lsim_devs_clk.c lsim_devs_dflipflop.c lsim_devs_gnd.c lsim_devs_led.c lsim_devs_mem.c lsim_devs_nand.c lsim_devs_panel.c lsim_devs_probe.c lsim_devs_reg.c lsim_devs_srlatch.c lsim_devs_swtch.c lsim_devs_vcc.c"
+# "LSIM_STATS=1 ./bld.sh" adds the per-device counters for "stats;".
+OPTS=""
+if [ -n "$LSIM_STATS" ]; then OPTS="-DLSIM_STATS"; fi
 
-gcc -std=c11 -Wall -Wextra -pedantic -Werror -g -o lsim_test lsim_test.c lsim.c lsim_cmd.c lsim_dev.c $DEVS err.c hmap.c cfg.c; if [ $? -ne 0 ]; then exit 1; fi
+DEVS="lsim_devs_addword.c lsim_devs_addbit.c lsim_devs_clk.c lsim_devs_dflipflop.c lsim_devs_gnd.c lsim_devs_led.c lsim_devs_mem.c lsim_devs_module.c lsim_devs_nand.c lsim_devs_panel.c lsim_devs_probe.c lsim_devs_reg.c lsim_devs_srlatch.c lsim_devs_swtch.c lsim_devs_topo.c lsim_devs_vcc.c"
 
-gcc -std=c11 -Wall -Wextra -pedantic -Werror -g -o lsim_main lsim_main.c lsim.c lsim_cmd.c lsim_dev.c $DEVS err.c hmap.c cfg.c; if [ $? -ne 0 ]; then exit 1; fi
+gcc -std=c11 -Wall -Wextra -pedantic -Werror -g $OPTS -o lsim_test lsim_test.c lsim.c lsim_cmd.c lsim_dev.c lsim_state.c lsim_whatif.c lsim_netlist.c lsim_parse_cache.c lsim_module.c lsim_name.c lsim_handle.c lsim_vector.c lsim_cond.c lsim_vcd.c lsim_wave.c lsim_log.c lsim_stats.c $DEVS err.c hmap.c cfg.c -lpthread; if [ $? -ne 0 ]; then exit 1; fi
+
+gcc -std=c11 -Wall -Wextra -pedantic -Werror -g $OPTS -o lsim_main lsim_main.c lsim.c lsim_cmd.c lsim_dev.c lsim_state.c lsim_whatif.c lsim_netlist.c lsim_parse_cache.c lsim_module.c lsim_name.c lsim_handle.c lsim_vector.c lsim_cond.c lsim_vcd.c lsim_wave.c lsim_log.c lsim_stats.c $DEVS err.c hmap.c cfg.c -lpthread; if [ $? -ne 0 ]; then exit 1; fi
 
 echo "Build successful"
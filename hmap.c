@@ -32,7 +32,7 @@ uint32_t hmap_murmur3_32(const void *key, size_t key_len, uint32_t seed) {
   int nblocks = key_len / 4;
   for (int i = 0; i < nblocks; i++) {
     uint32_t k1;
-    memcpy(&k1, &data[i], sizeof(k1));  /* Key might not be mem aligned. */
+    memcpy(&k1, &data[i * 4], sizeof(k1));  /* Key might not be mem aligned. */
 
     k1 *= c1;
     k1 = (k1 << r1) | (k1 >> (32 - r1));
@@ -68,6 +68,94 @@ uint32_t hmap_murmur3_32(const void *key, size_t key_len, uint32_t seed) {
 }  /* hmap_murmur3_32 */
 
 
+/* Grow when more than 7/8 full. */
+#define HMAP_MAX_ENTRIES(table_size) ((table_size) - (table_size) / 8)
+
+/* Old table slots copied per write while growing. The new table starts
+ * under half full, so at this rate the old one is emptied long before the
+ * new one reaches its limit. */
+#define HMAP_MIGRATE_SLOTS 4
+
+
+uint32_t hmap_hash(hmap_t *hmap, const void *key, size_t key_size) {
+  uint32_t hash = hmap_murmur3_32(key, key_size, hmap->seed);
+  return (hash == 0) ? 1 : hash;  /* 0 marks an empty slot. */
+}  /* hmap_hash */
+
+
+const void *hmap_entry_key(const hmap_entry_t *entry) {
+  return (entry->key_size <= HMAP_INLINE_KEY_SIZE) ? (const void *)entry->key.bytes : entry->key.ptr;
+}  /* hmap_entry_key */
+
+
+/* Returns NULL if not found. */
+hmap_entry_t *hmap_find(hmap_entry_t *table, size_t table_size, uint32_t hash, const void *key, size_t key_size) {
+  size_t mask = table_size - 1;
+  size_t pos = hash & mask;
+  size_t dist = 0;
+
+  while (table[pos].hash != 0) {
+    hmap_entry_t *entry = &table[pos];
+    /* Robin Hood: the key would have displaced any entry closer to home. */
+    if (((pos - (entry->hash & mask)) & mask) < dist) {
+      return NULL;
+    }
+    if (entry->hash == hash && entry->key_size == key_size && memcmp(hmap_entry_key(entry), key, key_size) == 0) {
+      return entry;
+    }
+    pos = (pos + 1) & mask;
+    dist++;
+  }
+
+  return NULL;
+}  /* hmap_find */
+
+
+/* "new_entry" must not already be in the table, and the table must have
+ * room for it. */
+void hmap_insert(hmap_entry_t *table, size_t table_size, hmap_entry_t new_entry) {
+  size_t mask = table_size - 1;
+  size_t pos = new_entry.hash & mask;
+  size_t dist = 0;
+
+  while (table[pos].hash != 0) {
+    size_t entry_dist = (pos - (table[pos].hash & mask)) & mask;
+    if (entry_dist < dist) {
+      /* Take the slot from the richer entry and carry it on. */
+      hmap_entry_t displaced = table[pos];
+      table[pos] = new_entry;
+      new_entry = displaced;
+      dist = entry_dist;
+    }
+    pos = (pos + 1) & mask;
+    dist++;
+  }
+
+  table[pos] = new_entry;
+}  /* hmap_insert */
+
+
+/* Copy up to num_slots old table slots into the new table. Copied slots are
+ * left in place (the old table is only read until it's freed), so lookups
+ * into it stay valid. */
+void hmap_migrate(hmap_t *hmap, size_t num_slots) {
+  while (num_slots > 0 && hmap->migrate_pos < hmap->old_table_size) {
+    if (hmap->old_table[hmap->migrate_pos].hash != 0) {
+      hmap_insert(hmap->table, hmap->table_size, hmap->old_table[hmap->migrate_pos]);
+    }
+    hmap->migrate_pos++;
+    num_slots--;
+  }
+
+  if (hmap->migrate_pos == hmap->old_table_size) {
+    free(hmap->old_table);  /* Keys now belong to the new table. */
+    hmap->old_table = NULL;
+    hmap->old_table_size = 0;
+    hmap->migrate_pos = 0;
+  }
+}  /* hmap_migrate */
+
+
 ERR_F hmap_create(hmap_t **rtn_hmap, size_t table_size) {
   ERR_ASSRT(rtn_hmap, HMAP_ERR_PARAM);
   ERR_ASSRT(table_size > 0, HMAP_ERR_PARAM);
@@ -75,10 +163,17 @@ ERR_F hmap_create(hmap_t **rtn_hmap, size_t table_size) {
   hmap_t *hmap = calloc(1, sizeof(hmap_t));
   ERR_ASSRT(hmap, HMAP_ERR_NOMEM);
 
-  (hmap)->table_size = table_size;
+  /* "table_size" is the number of entries expected; the table grows past
+   * that as needed. */
+  size_t num_slots = 16;
+  while (HMAP_MAX_ENTRIES(num_slots) < table_size) {
+    num_slots *= 2;
+  }
+
+  (hmap)->table_size = num_slots;
   (hmap)->seed = 42;  /* Could be made an input parameter. */
   (hmap)->num_entries = 0;
-  (hmap)->table = calloc(table_size, sizeof(hmap_entry_t*));
+  (hmap)->table = calloc(num_slots, sizeof(hmap_entry_t));
   if (!(hmap)->table) {
     free(hmap);
     ERR_THROW(HMAP_ERR_NOMEM, "hmap->table");
@@ -90,20 +185,23 @@ ERR_F hmap_create(hmap_t **rtn_hmap, size_t table_size) {
 
 
 ERR_F hmap_delete(hmap_t *hmap) {
-  uint32_t bucket;
-
-  /* Step to each bucket and delete the list of entries. */
-  for (bucket = 0; bucket < hmap->table_size; bucket++) {
-    hmap_entry_t *entry = hmap->table[bucket];
-    while (entry) {
-      hmap_entry_t *next = entry->next;
-      /* The application is responsible for freeing the value. */
-      free(entry->key);
-      free(entry);
-      entry = next;
+  size_t pos;
+
+  /* The application is responsible for freeing the values. */
+  for (pos = 0; pos < hmap->table_size; pos++) {
+    if (hmap->table[pos].hash != 0 && hmap->table[pos].key_size > HMAP_INLINE_KEY_SIZE) {
+      free(hmap->table[pos].key.ptr);
+    }
+  }
+  /* Old slots below migrate_pos share their keys with the new table. */
+  for (pos = hmap->migrate_pos; pos < hmap->old_table_size; pos++) {
+    if (hmap->old_table[pos].hash != 0 && hmap->old_table[pos].key_size > HMAP_INLINE_KEY_SIZE) {
+      free(hmap->old_table[pos].key.ptr);
     }
   }
 
+  free(hmap->old_table);
+  free(hmap->table);
   free(hmap);
   return ERR_OK;
 }  /* hmap_delete */
@@ -112,64 +210,89 @@ ERR_F hmap_delete(hmap_t *hmap) {
 ERR_F hmap_write(hmap_t *hmap, const void *key, size_t key_size, void *val) {
   ERR_ASSRT(hmap, HMAP_ERR_PARAM);
   ERR_ASSRT(key, HMAP_ERR_PARAM);
+  ERR_ASSRT(key_size <= UINT32_MAX, HMAP_ERR_PARAM);
 
-  uint32_t bucket = hmap_murmur3_32(key, key_size, hmap->seed) % hmap->table_size;
+  uint32_t hash = hmap_hash(hmap, key, key_size);
 
-  /* Search linked list.  */
-  hmap_entry_t *entry = hmap->table[bucket];
-  while (entry) {
-    if (key_size == entry->key_size && memcmp(entry->key, key, key_size) == 0) {
-      entry->value = val;
-      return ERR_OK;
-    }
-    entry = entry->next;
+  if (hmap->old_table) {
+    hmap_migrate(hmap, HMAP_MIGRATE_SLOTS);
+  }
+
+  hmap_entry_t *entry = hmap_find(hmap->table, hmap->table_size, hash, key, key_size);
+  if (entry == NULL && hmap->old_table) {
+    /* Only finds a slot not yet copied; copied ones were found above. */
+    entry = hmap_find(hmap->old_table, hmap->old_table_size, hash, key, key_size);
+  }
+  if (entry) {
+    entry->value = val;
+    return ERR_OK;
   }
 
   /* Not found, create new entry. */
-  hmap_entry_t *new_entry = calloc(1, sizeof(hmap_entry_t));
-  ERR_ASSRT(new_entry, HMAP_ERR_NOMEM);
-
-  new_entry->key = malloc(key_size);
-  if (!new_entry->key) {
-    free(new_entry);
-    ERR_THROW(HMAP_ERR_NOMEM, "new_entry->key");
-  }
-  memcpy(new_entry->key, key, key_size);
-  new_entry->key_size = key_size;
-  new_entry->value = val;
-  new_entry->bucket = bucket;
-
-  /* Insert at head of list for this bucket */
-  new_entry->next = hmap->table[bucket];
-  hmap->table[bucket] = new_entry;
+  if ((size_t)hmap->num_entries + 1 > HMAP_MAX_ENTRIES(hmap->table_size)) {
+    if (hmap->old_table) {  /* Shouldn't happen (see HMAP_MIGRATE_SLOTS). */
+      hmap_migrate(hmap, hmap->old_table_size);
+    }
+    hmap_entry_t *new_table = calloc(hmap->table_size * 2, sizeof(hmap_entry_t));
+    ERR_ASSRT(new_table, HMAP_ERR_NOMEM);
+    hmap->old_table = hmap->table;
+    hmap->old_table_size = hmap->table_size;
+    hmap->migrate_pos = 0;
+    hmap->table = new_table;
+    hmap->table_size *= 2;
+    hmap_migrate(hmap, HMAP_MIGRATE_SLOTS);
+  }
+
+  hmap_entry_t new_entry;
+  memset(&new_entry, 0, sizeof(new_entry));
+  new_entry.hash = hash;
+  new_entry.key_size = (uint32_t)key_size;
+  if (key_size <= HMAP_INLINE_KEY_SIZE) {
+    memcpy(new_entry.key.bytes, key, key_size);
+  }
+  else {
+    new_entry.key.ptr = malloc(key_size);
+    ERR_ASSRT(new_entry.key.ptr, HMAP_ERR_NOMEM);
+    memcpy(new_entry.key.ptr, key, key_size);
+  }
+  new_entry.value = val;
+
+  hmap_insert(hmap->table, hmap->table_size, new_entry);
   hmap->num_entries ++;
 
   return ERR_OK;
 }  /* hmap_write */
 
 
-ERR_F hmap_lookup(hmap_t *hmap, const void *key, size_t key_size, void **rtn_val) {
+/* Like hmap_lookup(), but a missing key isn't an error; *rtn_found says
+ * whether it was there. For callers that expect misses (nothing allocated). */
+ERR_F hmap_lookup_found(hmap_t *hmap, const void *key, size_t key_size, void **rtn_val, int *rtn_found) {
   ERR_ASSRT(hmap, HMAP_ERR_PARAM);
   ERR_ASSRT(key, HMAP_ERR_PARAM);
 
-  uint32_t bucket = hmap_murmur3_32(key, key_size, hmap->seed) % hmap->table_size;
+  uint32_t hash = hmap_hash(hmap, key, key_size);
 
-  /* Search linked list */
-  hmap_entry_t *entry = hmap->table[bucket];
-  while (entry) {
-    if (key_size == entry->key_size && memcmp(entry->key, key, key_size) == 0) {
-      if (rtn_val) {
-        *rtn_val = entry->value;
-      }
-      return ERR_OK;
-    }
-    entry = entry->next;
+  hmap_entry_t *entry = hmap_find(hmap->table, hmap->table_size, hash, key, key_size);
+  if (entry == NULL && hmap->old_table) {
+    entry = hmap_find(hmap->old_table, hmap->old_table_size, hash, key, key_size);
   }
-
   if (rtn_val) {
-    *rtn_val = NULL;
+    *rtn_val = (entry) ? entry->value : NULL;
+  }
+  *rtn_found = (entry != NULL);
+
+  return ERR_OK;
+}  /* hmap_lookup_found */
+
+
+ERR_F hmap_lookup(hmap_t *hmap, const void *key, size_t key_size, void **rtn_val) {
+  int found;
+  ERR(hmap_lookup_found(hmap, key, key_size, rtn_val, &found));
+  if (! found) {
+    ERR_THROW(HMAP_ERR_NOTFOUND, "key '%.*s' not found", (int)key_size, key);
   }
-  ERR_THROW(HMAP_ERR_NOTFOUND, "key '%.*s' not found", (int)key_size, key);
+
+  return ERR_OK;
 }  /* hmap_lookup */
 
 
@@ -191,31 +314,28 @@ ERR_F hmap_slookup(hmap_t *hmap, const char *skey, void **rtn_val) {
 }  /* hmap_slookup */
 
 
+/* Entries are visited in slot order. The application may change an entry's
+ * value, but must not write new keys until the walk is done. */
 ERR_F hmap_next(hmap_t *hmap, hmap_entry_t **in_entry) {
-  uint32_t bucket;
-  hmap_entry_t *next_entry;
+  size_t pos;
 
   ERR_ASSRT(hmap, HMAP_ERR_PARAM);
 
   if (*in_entry == NULL) {
     /* If in_entry is NULL, user want's first entry in table. */
-    bucket = 0;
-    next_entry = hmap->table[bucket];
+    if (hmap->old_table) {
+      hmap_migrate(hmap, hmap->old_table_size);  /* Walk just one table. */
+    }
+    pos = 0;
   } else {
-    /* Next entry in list. */
-    bucket = (*in_entry)->bucket;
-    next_entry = (*in_entry)->next;
+    /* Next entry in table. */
+    pos = (*in_entry - hmap->table) + 1;
   }
 
-  /* next_entry == NULL means we hit the end of a list;
-   * check subsequent buckets till we find a non-empty one. */
-  while (next_entry == NULL && bucket < hmap->table_size) {
-    bucket++;
-    if (bucket < hmap->table_size) {
-      next_entry = hmap->table[bucket];
-    }
+  while (pos < hmap->table_size && hmap->table[pos].hash == 0) {
+    pos++;
   }
 
-  *in_entry = next_entry;  /* If no more entries, it's NULL. */
+  *in_entry = (pos < hmap->table_size) ? &hmap->table[pos] : NULL;  /* If no more entries, it's NULL. */
   return ERR_OK;
 }  /* hmap_next */
@@ -20,22 +20,32 @@ extern "C" {
 #include <stdint.h>
 #include "err.h"
 
-/* Linked list of entries for handling collisions */
+/* Open addressing with Robin Hood probing. Keys up to HMAP_INLINE_KEY_SIZE
+ * bytes are stored in the slot; longer ones are copied to the heap. */
+#define HMAP_INLINE_KEY_SIZE 16
+
 typedef struct hmap_entry_s hmap_entry_t;  /* Forward definition. */
 struct hmap_entry_s {
-    void *key;
-    size_t key_size;
+    uint32_t hash;  /* Cached; 0 means the slot is empty. */
+    uint32_t key_size;
+    union {
+        uint8_t bytes[HMAP_INLINE_KEY_SIZE];  /* key_size <= HMAP_INLINE_KEY_SIZE */
+        void *ptr;
+    } key;
     void *value;
-    hmap_entry_t *next;
-    uint32_t bucket;  /* Bucket that this entry is under. */
 };
 
 typedef struct hmap_s hmap_t;
 struct hmap_s {
-    size_t table_size;
+    size_t table_size;  /* Slots, a power of 2. */
     uint32_t seed;
-    hmap_entry_t **table;
+    hmap_entry_t *table;
     int num_entries;
+    /* While growing, entries are copied from the old table a few slots per
+     * write; old_table slots below migrate_pos are already in table. */
+    hmap_entry_t *old_table;
+    size_t old_table_size;
+    size_t migrate_pos;
 };
 
 
@@ -62,6 +72,8 @@ ERR_F hmap_write(hmap_t *hmap, const void *key, size_t key_size, void *val);
 
 ERR_F hmap_lookup(hmap_t *hmap, const void *key, size_t key_size, void **rtn_val);
 
+ERR_F hmap_lookup_found(hmap_t *hmap, const void *key, size_t key_size, void **rtn_val, int *rtn_found);
+
 ERR_F hmap_swrite(hmap_t *hmap, const char *key, void *val);
 
 ERR_F hmap_slookup(hmap_t *hmap, const char *key, void **rtn_val);
@@ -10,9 +10,13 @@
  * Project home: https://github.com/fordsfords/lsim
  */
 
+#define _GNU_SOURCE  /* For MAP_HUGETLB, MADV_HUGEPAGE. */
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 #include "err.h"
 #include "hmap.h"
 #include "cfg.h"
@@ -20,6 +24,14 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_cmd.h"
+#include "lsim_state.h"
+#include "lsim_netlist.h"
+#include "lsim_parse_cache.h"
+#include "lsim_module.h"
+#include "lsim_name.h"
+#include "lsim_vcd.h"
+#include "lsim_log.h"
+#include "lsim_stats.h"
 
 
 /* Config file definition and defaults. */
@@ -27,10 +39,104 @@ char *lsim_cfg_defaults[] = {
   "device_hash_buckets=10007",
   "max_propagate_cycles=50",  /* For loop detection. */
   "error_reaction=1",  /* 0=abort, 1=exit(1), 2=warn and continue. */
+  "huge_pages=0",  /* 0=malloc, 1=transparent huge pages, 2=MAP_HUGETLB (falls back to 1). */
+  "snapshot_interval=0",  /* Ticklets between snapshots for "back"; 0=disabled. */
+  "snapshot_budget_mb=256",  /* Snapshot memory limit; interval doubles when reached. */
+  "power_cache_dir=",  /* Directory for cached power-up states; empty=disabled. */
+  "parse_cache_dir=",  /* Directory for cached netlists of command files; empty=disabled. */
+  "whatif_procs=0",  /* Max concurrent "whatif" children; 0=number of cores. */
+  "async_output=0",  /* Watch/led messages: 0=printed by the engine, 1=by a writer thread, 2=same, dropped if it falls behind. */
+  "step_stats=0",  /* 1=histograms of cycles, devices run and time per step; printed at exit. */
   NULL
 };
 
 
+/* Allocate zeroed netlist storage. Depending on the "huge_pages" config,
+ * large blocks are backed by 2 MB pages to cut TLB misses in the engine;
+ * blocks under LSIM_HUGE_PAGE_MIN aren't worth rounding up to a huge page.
+ * If huge pages aren't available, falls back quietly to normal pages.
+ * The allocation's record sits just before the returned block. */
+ERR_F lsim_bigalloc(lsim_t *lsim, size_t size, void **rtn_ptr) {
+  ERR_ASSRT(size > 0, LSIM_ERR_PARAM);
+  ERR_ASSRT(size <= SIZE_MAX - LSIM_HUGE_PAGE_SIZE - LSIM_BIGALLOC_HDR_SIZE, LSIM_ERR_PARAM);
+  size_t full_size = LSIM_BIGALLOC_HDR_SIZE + size;
+  lsim_bigalloc_t *bigalloc = NULL;
+  int mapped = 0;
+
+#ifdef __linux__
+  if (lsim->huge_pages > 0 && size >= LSIM_HUGE_PAGE_MIN) {
+    size_t huge_size = (full_size + LSIM_HUGE_PAGE_SIZE - 1) & ~(size_t)(LSIM_HUGE_PAGE_SIZE - 1);
+    void *ptr = MAP_FAILED;
+    if (lsim->huge_pages == 2) {
+      ptr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (ptr == MAP_FAILED) {  /* No reserved huge pages; try transparent. */
+      ptr = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (ptr != MAP_FAILED) {
+        (void)madvise(ptr, huge_size, MADV_HUGEPAGE);  /* Advisory only. */
+      }
+    }
+    if (ptr != MAP_FAILED) {
+      bigalloc = ptr;
+      full_size = huge_size;
+      mapped = 1;
+    }
+  }
+#endif
+
+  if (bigalloc == NULL) {  /* Aligned like a mapping, so blocks stay on cache lines. */
+    void *ptr = NULL;
+    ERR_ASSRT(posix_memalign(&ptr, LSIM_BIGALLOC_HDR_SIZE, full_size) == 0, LSIM_ERR_NOMEM);
+    memset(ptr, 0, full_size);
+    bigalloc = ptr;
+  }
+  bigalloc->ptr = (char *)bigalloc + LSIM_BIGALLOC_HDR_SIZE;
+  bigalloc->size = full_size;
+  bigalloc->mapped = mapped;
+
+  bigalloc->prev = NULL;
+  bigalloc->next = lsim->bigallocs;
+  if (lsim->bigallocs) {
+    lsim->bigallocs->prev = bigalloc;
+  }
+  lsim->bigallocs = bigalloc;
+
+  *rtn_ptr = bigalloc->ptr;
+  return ERR_OK;
+}  /* lsim_bigalloc */
+
+
+ERR_F lsim_bigfree(lsim_t *lsim, void *ptr) {
+  if (ptr == NULL) {
+    return ERR_OK;
+  }
+
+  lsim_bigalloc_t *bigalloc = (lsim_bigalloc_t *)((char *)ptr - LSIM_BIGALLOC_HDR_SIZE);
+  ERR_ASSRT(bigalloc->ptr == ptr, LSIM_ERR_INTERNAL);  /* Not from lsim_bigalloc. */
+
+  if (bigalloc->prev) {
+    bigalloc->prev->next = bigalloc->next;
+  }
+  else {
+    lsim->bigallocs = bigalloc->next;
+  }
+  if (bigalloc->next) {
+    bigalloc->next->prev = bigalloc->prev;
+  }
+#ifdef __linux__
+  if (bigalloc->mapped) {
+    munmap(bigalloc, bigalloc->size);
+  }
+  else
+#endif
+  {
+    free(bigalloc);
+  }
+
+  return ERR_OK;
+}  /* lsim_bigfree */
+
+
 ERR_F lsim_create(lsim_t **rtn_lsim, char *config_file_name) {
   lsim_t *lsim;
   ERR(err_calloc((void **)&lsim, 1, sizeof(lsim_t)));
@@ -51,6 +157,9 @@ ERR_F lsim_create(lsim_t **rtn_lsim, char *config_file_name) {
   ERR_ASSRT(device_hash_buckets > 0, LSIM_ERR_CONFIG);
   ERR(hmap_create(&(lsim->devs), device_hash_buckets));
 
+  ERR(cfg_get_long_val(lsim->cfg, "huge_pages", &lsim->huge_pages));
+  ERR_ASSRT(lsim->huge_pages >= 0 && lsim->huge_pages <= 2, LSIM_ERR_CONFIG);
+
   lsim->power_on = 0;
   lsim->quit = 0;
 
@@ -60,8 +169,34 @@ ERR_F lsim_create(lsim_t **rtn_lsim, char *config_file_name) {
 
 
 ERR_F lsim_delete(lsim_t *lsim) {
+  if (lsim->vcd) {
+    ERR(lsim_vcd_stop(lsim));
+  }
+  if (lsim->log) {
+    ERR(lsim_log_stop(lsim));
+  }
+  ERR(lsim_stats_step_delete(lsim));
   ERR(lsim_dev_delete_all(lsim));
   ERR(hmap_delete(lsim->devs));
+  ERR(lsim_name_delete_all(lsim));
+  free(lsim->out_terminals);
+  free(lsim->in_terminals);
+  free(lsim->handle_outs);
+  free(lsim->handle_ins);
+  free(lsim->out_states);
+  free(lsim->net_states);
+  ERR(lsim_state_history_clear(lsim));
+  ERR(lsim_module_delete_all(lsim));
+  if (lsim->parse_cache) {  /* Left by an error. */
+    lsim->parse_cache->recording = 0;
+    ERR(lsim_parse_cache_close(lsim, NULL, 0));
+  }
+  ERR(lsim_netlist_record_delete(lsim));
+  free(lsim->snapshots);
+  free(lsim->events);
+  while (lsim->bigallocs) {
+    ERR(lsim_bigfree(lsim, lsim->bigallocs->ptr));  /* Terminal chunks. */
+  }
   ERR(cfg_delete(lsim->cfg));
   free(lsim);
 
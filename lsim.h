@@ -46,25 +46,107 @@ ERR_CODE(LSIM_ERR_EXIST);
 ERR_CODE(LSIM_ERR_BADFILE);
 ERR_CODE(LSIM_ERR_LINETOOLONG);
 ERR_CODE(LSIM_ERR_MAXLOOPS);
+ERR_CODE(LSIM_ERR_MISMATCH);
 #undef ERR_CODE
 
 
+#define LSIM_HUGE_PAGE_SIZE (2*1024*1024)
+#define LSIM_HUGE_PAGE_MIN (LSIM_HUGE_PAGE_SIZE / 2)  /* Smaller big allocations use calloc. */
+#define LSIM_BIGALLOC_HDR_SIZE 64  /* Record before each big allocation; keeps blocks cache-line aligned. */
+#define LSIM_TERMINAL_CHUNK_SIZE (LSIM_HUGE_PAGE_SIZE - LSIM_BIGALLOC_HDR_SIZE)  /* Chunk + record = one huge page. */
+#define LSIM_NAME_BUFS 4  /* lsim_name_str() results usable at once. */
+
+
 /* Forward declarations. */
 typedef struct lsim_s lsim_t;
+typedef struct lsim_bigalloc_s lsim_bigalloc_t;
+typedef struct lsim_snapshot_s lsim_snapshot_t;  /* See lsim_state.h. */
+typedef struct lsim_event_s lsim_event_t;  /* See lsim_state.h. */
+typedef struct lsim_netlist_rec_s lsim_netlist_rec_t;  /* See lsim_netlist.h. */
+typedef struct lsim_parse_cache_s lsim_parse_cache_t;  /* See lsim_parse_cache.h. */
+typedef struct lsim_module_s lsim_module_t;  /* See lsim_module.h. */
+typedef struct lsim_name_s lsim_name_t;  /* See lsim_name.h. */
+typedef struct lsim_vcd_s lsim_vcd_t;  /* See lsim_vcd.h. */
+typedef struct lsim_log_s lsim_log_t;  /* See lsim_log.h. */
+typedef struct lsim_step_stats_s lsim_step_stats_t;  /* See lsim_stats.h. */
 
 
 /* Full definitions. */
 
+struct lsim_bigalloc_s {  /* Lives at the start of its own allocation. */
+  lsim_bigalloc_t *next;
+  lsim_bigalloc_t *prev;
+  void *ptr;  /* The caller's block, LSIM_BIGALLOC_HDR_SIZE past this record. */
+  size_t size;  /* Of the whole allocation, record included. */
+  int mapped;  /* 1=mmap (free with munmap), 0=calloc. */
+};
+
 struct lsim_s {
   cfg_t *cfg;
-  hmap_t *devs;
+  hmap_t *devs;  /* Keyed by lsim_name_key_t (see lsim_name.h). */
+  lsim_dev_t **dev_list;  /* Registry of every device, in creation order. */
+  long num_devs;
+  long alloc_devs;
   lsim_dev_t *out_changed_list;
   lsim_dev_t *in_changed_list;
   lsim_dev_t *active_clk_dev;  /* Used by lsim_dev_ticklet. */
+  lsim_dev_out_terminal_t **out_terminals;  /* Registry of every output terminal. */
+  long num_out_terminals;
+  long alloc_out_terminals;
+  lsim_dev_in_terminal_t **in_terminals;  /* Registry of every input terminal. */
+  long num_in_terminals;
+  long alloc_in_terminals;
+  lsim_dev_out_terminal_t **handle_outs;  /* By handle (see lsim_handle.c). */
+  long num_handle_outs;
+  long alloc_handle_outs;
+  lsim_dev_in_terminal_t **handle_ins;
+  long num_handle_ins;
+  long alloc_handle_ins;
+  uint64_t *out_states;  /* Bit per net: value driven by the output terminal. */
+  uint64_t *net_states;  /* Bit per net: value last propagated to the inputs. */
+  long alloc_state_words;
+  uint64_t *cond_nets;  /* Bit per net read by a running "until" (else NULL). */
+  int cond_dirty;  /* One of those nets changed. */
+  lsim_vcd_t *vcd;  /* Non-NULL while dumping a VCD file. */
+  lsim_log_t *log;  /* Non-NULL when the engine's messages go to a writer thread. */
+  lsim_step_stats_t *step_stats;  /* Non-NULL when config "step_stats" is on (from power-up). */
+  long huge_pages;  /* From config "huge_pages". */
+  long max_propagate_cycles;  /* From config, at power-up. */
+  lsim_bigalloc_t *bigallocs;  /* Everything from lsim_bigalloc(). */
+  char *terminal_chunk;  /* Terminals are carved out of this. */
+  size_t terminal_chunk_used;
+  lsim_netlist_rec_t *netlist_rec;  /* Non-NULL when compiling the netlist. */
+  int creating;  /* Inside lsim_netlist_dev_create(). */
+  lsim_parse_cache_t *parse_cache;  /* Non-NULL while running a top-level file. */
+  int file_depth;  /* Nesting of lsim_cmd_file() (includes). */
+  hmap_t *modules;  /* lsim_module_t by name; NULL until one is defined. */
+  lsim_module_t *cur_module;  /* Being compiled into this (scratch) lsim. */
+  char **name_leaves;  /* Interned name components by leaf id (see lsim_name.c). */
+  uint32_t num_name_leaves;
+  uint32_t alloc_name_leaves;
+  uint32_t *name_slots;  /* Open-addressed interning table of leaf ids. */
+  uint32_t num_name_slots;
+  uint32_t num_names;  /* Name nodes created; the last one's id. */
+  lsim_name_t *name_roots;  /* Top-level names, newest first. */
+  char *name_bufs[LSIM_NAME_BUFS];  /* Full names built by lsim_name_str(). */
+  size_t name_buf_sizes[LSIM_NAME_BUFS];
+  int name_buf_next;
   long cur_ticklet;
+  long total_ticklets;  /* Since power-up; not reset by the clock's R0. */
+  long snapshot_interval;  /* From config; doubles when the budget is hit. */
+  size_t snapshot_budget;  /* Bytes, from config "snapshot_budget_mb". */
+  size_t snapshot_bytes;
+  lsim_snapshot_t *snapshots;  /* Ascending by ticklet; [0] is the base. */
+  long num_snapshots;
+  long alloc_snapshots;
+  lsim_event_t *events;  /* Moves and loadmems since the base snapshot. */
+  long num_events;
+  long alloc_events;
+  int replaying;  /* Set by "back"; suppresses output and event logging. */
   long cur_step;
   long total_warnings;
   long cur_cycle;
+  long step_runs;  /* Devices whose logic ran in the current step. */
   int power_on;
   int verbosity_map;
   int quit;
@@ -73,6 +155,8 @@ struct lsim_s {
 /* Globals. */
 extern long global_error_reaction;
 
+ERR_F lsim_bigalloc(lsim_t *lsim, size_t size, void **rtn_ptr);
+ERR_F lsim_bigfree(lsim_t *lsim, void *ptr);
 ERR_F lsim_create(lsim_t **rtn_lsim, char *config_file_name);
 ERR_F lsim_delete(lsim_t *lsim);
 
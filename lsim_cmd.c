@@ -10,10 +10,15 @@
  * Project home: https://github.com/fordsfords/lsim
  */
 
+#define _GNU_SOURCE  /* For read(), open(). */
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "err.h"
 #include "hmap.h"
 #include "cfg.h"
@@ -21,6 +26,17 @@
 #include "lsim_dev.h"
 #include "lsim_devs.h"
 #include "lsim_cmd.h"
+#include "lsim_state.h"
+#include "lsim_whatif.h"
+#include "lsim_netlist.h"
+#include "lsim_parse_cache.h"
+#include "lsim_module.h"
+#include "lsim_vector.h"
+#include "lsim_cond.h"
+#include "lsim_vcd.h"
+#include "lsim_wave.h"
+#include "lsim_log.h"
+#include "lsim_stats.h"
 
 
 ERR_F lsim_valid_name(const char *name) {
@@ -70,7 +86,7 @@ ERR_F lsim_cmd_define_probe(lsim_t *lsim, char *cmd_line) {
   ERR(err_atol(flags_s, &flags));
   ERR_ASSRT(flags >= 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_probe_create(lsim, dev_name, flags));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_PROBE, dev_name, flags, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_probe */
@@ -91,7 +107,7 @@ ERR_F lsim_cmd_define_gnd(lsim_t *lsim, char *cmd_line) {
   char *end_field = semi_colon + 1;
   ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_gnd_create(lsim, dev_name));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_GND, dev_name, 0, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_gnd */
@@ -112,7 +128,7 @@ ERR_F lsim_cmd_define_vcc(lsim_t *lsim, char *cmd_line) {
   char *end_field = semi_colon + 1;
   ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_vcc_create(lsim, dev_name));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_VCC, dev_name, 0, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_vcc */
@@ -141,7 +157,7 @@ ERR_F lsim_cmd_define_swtch(lsim_t *lsim, char *cmd_line) {
   ERR(err_atol(init_state_s, &init_state));
   ERR_ASSRT(init_state == 0 || init_state == 1, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_swtch_create(lsim, dev_name, (int)init_state));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_SWTCH, dev_name, init_state, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_swtch */
@@ -162,7 +178,7 @@ ERR_F lsim_cmd_define_clk(lsim_t *lsim, char *cmd_line) {
   char *end_field = semi_colon + 1;
   ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_clk_create(lsim, dev_name));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_CLK, dev_name, 0, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_clk */
@@ -183,7 +199,7 @@ ERR_F lsim_cmd_define_led(lsim_t *lsim, char *cmd_line) {
   char *end_field = semi_colon + 1;
   ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_led_create(lsim, dev_name));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_LED, dev_name, 0, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_led */
@@ -212,7 +228,7 @@ ERR_F lsim_cmd_define_nand(lsim_t *lsim, char *cmd_line) {
   ERR(err_atol(num_inputs_s, &num_inputs));
   ERR_ASSRT(num_inputs > 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_nand_create(lsim, dev_name, num_inputs));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_NAND, dev_name, num_inputs, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_nand */
@@ -249,7 +265,7 @@ ERR_F lsim_cmd_define_mem(lsim_t *lsim, char *cmd_line) {
   ERR(err_atol(num_data_s, &num_data));
   ERR_ASSRT(num_data > 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_mem_create(lsim, dev_name, num_addr, num_data));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_MEM, dev_name, num_addr, num_data));
 
   return ERR_OK;
 }  /* lsim_cmd_define_mem */
@@ -270,7 +286,7 @@ ERR_F lsim_cmd_define_srlatch(lsim_t *lsim, char *cmd_line) {
   char *end_field = semi_colon + 1;
   ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_srlatch_create(lsim, dev_name));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_SRLATCH, dev_name, 0, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_srlatch */
@@ -291,7 +307,7 @@ ERR_F lsim_cmd_define_dflipflop(lsim_t *lsim, char *cmd_line) {
   char *end_field = semi_colon + 1;
   ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_dflipflop_create(lsim, dev_name));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_DFLIPFLOP, dev_name, 0, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_dflipflop */
@@ -320,7 +336,7 @@ ERR_F lsim_cmd_define_reg(lsim_t *lsim, char *cmd_line) {
   ERR(err_atol(num_bits_s, &num_bits));
   ERR_ASSRT(num_bits > 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_reg_create(lsim, dev_name, num_bits));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_REG, dev_name, num_bits, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_reg */
@@ -349,7 +365,7 @@ ERR_F lsim_cmd_define_panel(lsim_t *lsim, char *cmd_line) {
   ERR(err_atol(num_bits_s, &num_bits));
   ERR_ASSRT(num_bits > 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_panel_create(lsim, dev_name, num_bits));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_PANEL, dev_name, num_bits, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_panel */
@@ -370,7 +386,7 @@ ERR_F lsim_cmd_define_addbit(lsim_t *lsim, char *cmd_line) {
   char *end_field = semi_colon + 1;
   ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_addbit_create(lsim, dev_name));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_ADDBIT, dev_name, 0, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_addbit */
@@ -399,12 +415,33 @@ ERR_F lsim_cmd_define_addword(lsim_t *lsim, char *cmd_line) {
   ERR(err_atol(num_bits_s, &num_bits));
   ERR_ASSRT(num_bits > 0, LSIM_ERR_COMMAND);
 
-  ERR(lsim_devs_addword_create(lsim, dev_name, num_bits));
+  ERR(lsim_netlist_dev_create(lsim, LSIM_DEV_TYPE_ADDWORD, dev_name, num_bits, 0));
 
   return ERR_OK;
 }  /* lsim_cmd_define_addword */
 
 
+/* Instance of a module:
+ * d;module_name;dev_name;
+ * cmd_line points at dev_name. */
+ERR_F lsim_cmd_define_module(lsim_t *lsim, lsim_module_t *module, char *cmd_line) {
+  char *semi_colon;
+
+  char *dev_name = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(dev_name, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';
+  ERR(lsim_valid_name(dev_name));
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_devs_module_create(lsim, dev_name, module));
+
+  return ERR_OK;
+}  /* lsim_cmd_define_module */
+
+
 /* Define device:
  * d;dev_type;...
  * cmd_line points at dev_type. */
@@ -417,51 +454,75 @@ ERR_F lsim_cmd_define(lsim_t *lsim, char *cmd_line) {
 
   char *next_field = semi_colon + 1;
 
-  if (strcmp(dev_type, "probe") == 0) {
-    ERR(lsim_cmd_define_probe(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "gnd") == 0) {
-    ERR(lsim_cmd_define_gnd(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "vcc") == 0) {
-    ERR(lsim_cmd_define_vcc(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "swtch") == 0) {
-    ERR(lsim_cmd_define_swtch(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "clk") == 0) {
-    ERR(lsim_cmd_define_clk(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "led") == 0) {
-    ERR(lsim_cmd_define_led(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "nand") == 0) {
-    ERR(lsim_cmd_define_nand(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "mem") == 0) {
-    ERR(lsim_cmd_define_mem(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "srlatch") == 0) {
-    ERR(lsim_cmd_define_srlatch(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "dflipflop") == 0) {
-    ERR(lsim_cmd_define_dflipflop(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "reg") == 0) {
-    ERR(lsim_cmd_define_reg(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "panel") == 0) {
-    ERR(lsim_cmd_define_panel(lsim, next_field));
-  }
-  else if (strcmp(dev_type, "addbit") == 0) {
-    ERR(lsim_cmd_define_addbit(lsim, next_field));
+  /* Switch on the first letter so that only one or two strcmp()s run. */
+  err_t *err = ERR_OK;
+  int known = 1;
+  switch (dev_type[0]) {
+  case 'a':
+    if (strcmp(dev_type, "addbit") == 0) { err = lsim_cmd_define_addbit(lsim, next_field); }
+    else if (strcmp(dev_type, "addword") == 0) { err = lsim_cmd_define_addword(lsim, next_field); }
+    else { known = 0; }
+    break;
+  case 'c':
+    if (strcmp(dev_type, "clk") == 0) { err = lsim_cmd_define_clk(lsim, next_field); } else { known = 0; }
+    break;
+  case 'd':
+    if (strcmp(dev_type, "dflipflop") == 0) { err = lsim_cmd_define_dflipflop(lsim, next_field); } else { known = 0; }
+    break;
+  case 'g':
+    if (strcmp(dev_type, "gnd") == 0) { err = lsim_cmd_define_gnd(lsim, next_field); } else { known = 0; }
+    break;
+  case 'l':
+    if (strcmp(dev_type, "led") == 0) { err = lsim_cmd_define_led(lsim, next_field); } else { known = 0; }
+    break;
+  case 'm':
+    if (strcmp(dev_type, "mem") == 0) { err = lsim_cmd_define_mem(lsim, next_field); } else { known = 0; }
+    break;
+  case 'n':
+    if (strcmp(dev_type, "nand") == 0) { err = lsim_cmd_define_nand(lsim, next_field); } else { known = 0; }
+    break;
+  case 'p':
+    if (strcmp(dev_type, "probe") == 0) { err = lsim_cmd_define_probe(lsim, next_field); }
+    else if (strcmp(dev_type, "panel") == 0) { err = lsim_cmd_define_panel(lsim, next_field); }
+    else { known = 0; }
+    break;
+  case 'r':
+    if (strcmp(dev_type, "reg") == 0) { err = lsim_cmd_define_reg(lsim, next_field); } else { known = 0; }
+    break;
+  case 's':
+    if (strcmp(dev_type, "swtch") == 0) { err = lsim_cmd_define_swtch(lsim, next_field); }
+    else if (strcmp(dev_type, "srlatch") == 0) { err = lsim_cmd_define_srlatch(lsim, next_field); }
+    else { known = 0; }
+    break;
+  case 'v':
+    if (strcmp(dev_type, "vcc") == 0) { err = lsim_cmd_define_vcc(lsim, next_field); } else { known = 0; }
+    break;
+  default:
+    known = 0;
   }
-  else if (strcmp(dev_type, "addword") == 0) {
-    ERR(lsim_cmd_define_addword(lsim, next_field));
+
+  if (! known && lsim->modules) {  /* Not built in; try the modules. */
+    lsim_module_t *module;
+    err = hmap_slookup(lsim->modules, dev_type, (void **)&module);
+    if (err == ERR_OK) {
+      known = 1;
+      err = lsim_cmd_define_module(lsim, module, next_field);
+    }
+    else if (err->code == HMAP_ERR_NOTFOUND) {
+      err_dispose(err);
+      err = ERR_OK;
+    }
+    else {
+      ERR_RETHROW(err, "d;%s", dev_type);
+    }
   }
-  else {
+
+  if (! known) {
     ERR_THROW(LSIM_ERR_COMMAND, "Unrecognized device type '%s'", dev_type);
   }
+  if (err) {
+    ERR_RETHROW(err, "d;%s", dev_type);
+  }
 
   return ERR_OK;
 }  /* lsim_cmd_define */
@@ -708,6 +769,36 @@ ERR_F lsim_cmd_include(lsim_t *lsim, char *cmd_line) {
 }  /* lsim_cmd_include */
 
 
+/* Module port (only in a module body):
+ * in;port_id;dev_name;in_id;
+ * out;port_id;dev_name;out_id;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_port(lsim_t *lsim, int is_out, char *cmd_line) {
+  char *semi_colon;
+
+  char *port_id = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(port_id, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';
+
+  char *dev_name = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(dev_name, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';
+  ERR(lsim_valid_name(dev_name));
+
+  char *terminal_id = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(terminal_id, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_module_port(lsim, is_out, port_id, dev_name, terminal_id));
+
+  return ERR_OK;
+}  /* lsim_cmd_port */
+
+
 /* Watch:
  * w;device_name;watch_level;
  * cmd_line points past first semi-colon. */
@@ -750,9 +841,517 @@ ERR_F lsim_cmd_quit(lsim_t *lsim, char *cmd_line) {
 }  /* lsim_cmd_quit */
 
 
+/* Save:
+ * save;filename;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_save(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  char *filename = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(filename, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_state_save(lsim, filename));
+
+  return ERR_OK;
+}  /* lsim_cmd_save */
+
+
+/* Restore:
+ * restore;filename;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_restore(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  char *filename = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(filename, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_state_restore(lsim, filename));
+
+  return ERR_OK;
+}  /* lsim_cmd_restore */
+
+
+/* Back:
+ * back;num_ticklets;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_back(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  char *num_ticklets_s = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(num_ticklets_s, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  long num_ticklets;
+  ERR(err_atol(num_ticklets_s, &num_ticklets));
+  ERR_ASSRT(num_ticklets > 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_state_back(lsim, num_ticklets));
+
+  return ERR_OK;
+}  /* lsim_cmd_back */
+
+
+/* Vectors:
+ * vectors;filename;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_vectors(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  char *filename = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(filename, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  long num_vectors;
+  long num_mismatches;
+  ERR(lsim_vector_run(lsim, filename, &num_vectors, &num_mismatches));
+  lsim_log_flush(lsim);
+  printf("Vectors %s: %ld run, %ld mismatched\n", filename, num_vectors, num_mismatches);
+  if (num_mismatches > 0) {
+    ERR_THROW(LSIM_ERR_MISMATCH, "%ld of %ld vectors mismatched", num_mismatches, num_vectors);
+  }
+
+  return ERR_OK;
+}  /* lsim_cmd_vectors */
+
+
+/* Until:
+ * until;max_ticklets;condition;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_until(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  char *max_ticklets_s = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(max_ticklets_s, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  char *condition = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(condition, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  long max_ticklets;
+  ERR(err_atol(max_ticklets_s, &max_ticklets));
+  ERR_ASSRT(max_ticklets > 0, LSIM_ERR_COMMAND);
+
+  lsim_cond_t *cond;
+  ERR(lsim_cond_compile(lsim, condition, &cond));
+  long num_ticklets;
+  int met;
+  err_t *err = lsim_cond_until(lsim, cond, max_ticklets, &num_ticklets, &met);
+  lsim_cond_delete(cond);
+  if (err) {
+    ERR_RETHROW(err, "Until '%s'", condition);
+  }
+
+  lsim_log_flush(lsim);
+  if (met) {
+    printf("Until: met at ticklet %ld (%ld run)\n", lsim->total_ticklets, num_ticklets);
+  }
+  else {
+    printf("Until: not met in %ld ticklets\n", num_ticklets);
+  }
+
+  return ERR_OK;
+}  /* lsim_cmd_until */
+
+
+/* VCD or wave file dump:
+ * vcd;filename;signals;
+ * wave;filename;signals;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_vcd(lsim_t *lsim, int format, char *cmd_line) {
+  char *semi_colon;
+
+  char *filename = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(filename, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  char *signals = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(signals, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_vcd_start(lsim, filename, signals, format));
+
+  return ERR_OK;
+}  /* lsim_cmd_vcd */
+
+
+/* End VCD or wave file dump:
+ * vcdstop;
+ * wavestop;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_vcdstop(lsim_t *lsim, char *cmd_line) {
+  /* Make sure we're at end of line. */
+  char *end_field = cmd_line;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_vcd_stop(lsim));
+
+  return ERR_OK;
+}  /* lsim_cmd_vcdstop */
+
+
+/* Device activity (needs an LSIM_STATS build):
+ * stats;top_n;
+ * statsdump;filename;
+ * statsreset;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_stats(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  char *top_n_s = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(top_n_s, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  long top_n;
+  ERR(err_atol(top_n_s, &top_n));
+  ERR_ASSRT(top_n >= 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_stats_print(lsim, top_n));
+
+  return ERR_OK;
+}  /* lsim_cmd_stats */
+
+
+ERR_F lsim_cmd_statsdump(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  char *filename = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(filename, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_stats_dump(lsim, filename));
+
+  return ERR_OK;
+}  /* lsim_cmd_statsdump */
+
+
+ERR_F lsim_cmd_statsreset(lsim_t *lsim, char *cmd_line) {
+  /* Make sure we're at end of line. */
+  char *end_field = cmd_line;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_stats_reset(lsim));
+
+  return ERR_OK;
+}  /* lsim_cmd_statsreset */
+
+
+ERR_F lsim_cmd_stepstats(lsim_t *lsim, char *cmd_line) {
+  /* Make sure we're at end of line. */
+  char *end_field = cmd_line;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_stats_step_print(lsim));
+
+  return ERR_OK;
+}  /* lsim_cmd_stepstats */
+
+
+ERR_F lsim_cmd_stepstatsdump(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  char *filename = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(filename, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_stats_step_dump(lsim, filename));
+
+  return ERR_OK;
+}  /* lsim_cmd_stepstatsdump */
+
+
+ERR_F lsim_cmd_stepstatsreset(lsim_t *lsim, char *cmd_line) {
+  /* Make sure we're at end of line. */
+  char *end_field = cmd_line;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  ERR(lsim_stats_step_reset(lsim));
+
+  return ERR_OK;
+}  /* lsim_cmd_stepstatsreset */
+
+
+/* Print part of a wave file:
+ * wavequery;filename;first_ticklet;last_ticklet;patterns;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_wavequery(lsim_t *lsim, char *cmd_line) {
+  (void)lsim;
+  char *semi_colon;
+
+  char *filename = cmd_line;
+  ERR_ASSRT(semi_colon = strchr(filename, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  char *first_s = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(first_s, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  char *last_s = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(last_s, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  char *patterns = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(patterns, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  long first_ticklet;
+  ERR(err_atol(first_s, &first_ticklet));
+  long last_ticklet;
+  ERR(err_atol(last_s, &last_ticklet));
+  ERR_ASSRT(first_ticklet >= 0 && first_ticklet <= last_ticklet, LSIM_ERR_COMMAND);
+
+  ERR(lsim_wave_query(filename, patterns, first_ticklet, last_ticklet, stdout));
+
+  return ERR_OK;
+}  /* lsim_cmd_wavequery */
+
+
+/* Whatif:
+ * whatif;script;script;...;
+ * cmd_line points past first semi-colon. */
+ERR_F lsim_cmd_whatif(lsim_t *lsim, char *cmd_line) {
+  char *semi_colon;
+
+  /* Count the scripts. */
+  int num_scripts = 0;
+  char *field = cmd_line;
+  while (strlen(field) != 0) {
+    ERR_ASSRT(semi_colon = strchr(field, ';'), LSIM_ERR_COMMAND);
+    num_scripts++;
+    field = semi_colon + 1;
+  }
+  ERR_ASSRT(num_scripts > 0, LSIM_ERR_COMMAND);
+
+  char **scripts;
+  ERR(err_calloc((void **)&scripts, num_scripts, sizeof(char *)));
+  lsim_whatif_result_t *results;
+  err_t *err = err_calloc((void **)&results, num_scripts, sizeof(lsim_whatif_result_t));
+  if (err) {
+    free(scripts);
+    ERR_RETHROW(err, "whatif");
+  }
+
+  field = cmd_line;
+  int i;
+  for (i = 0; i < num_scripts; i++) {
+    semi_colon = strchr(field, ';');
+    *semi_colon = '\0';  /* Overwrite semicolon. */
+    scripts[i] = field;
+    field = semi_colon + 1;
+  }
+
+  err = lsim_whatif_run(lsim, num_scripts, scripts, results);
+  if (err) {
+    free(scripts);
+    free(results);
+    ERR_RETHROW(err, "whatif");
+  }
+
+  for (i = 0; i < num_scripts; i++) {
+    switch (results[i].status) {
+    case LSIM_WHATIF_STATUS_OK:
+      printf("Whatif %s: ticklet %ld, warnings %ld, leds on %ld\n", scripts[i],
+             (long)results[i].cur_ticklet, (long)results[i].total_warnings, (long)results[i].leds_on);
+      break;
+    case LSIM_WHATIF_STATUS_ERROR:
+      printf("Whatif %s: error %s\n", scripts[i], results[i].error_code);
+      break;
+    default:
+      printf("Whatif %s: died, exit status %d\n", scripts[i], results[i].exit_status);
+    }
+  }
+
+  free(scripts);
+  free(results);
+
+  return ERR_OK;
+}  /* lsim_cmd_whatif */
+
+
 /*******************************************************************************/
 
 
+int lsim_cmd_is_for(const char *line) {
+  return strncmp(line, "for;", 4) == 0;
+}  /* lsim_cmd_is_for */
+
+int lsim_cmd_is_endfor(const char *line) {
+  return strcmp(line, "endfor;") == 0;
+}  /* lsim_cmd_is_endfor */
+
+int lsim_cmd_is_module(const char *line) {
+  return strncmp(line, "module;", 7) == 0;
+}  /* lsim_cmd_is_module */
+
+int lsim_cmd_is_endmodule(const char *line) {
+  return strcmp(line, "endmodule;") == 0;
+}  /* lsim_cmd_is_endmodule */
+
+
+/* Run one command, tokenizing it in place (fields are split by overwriting
+ * semicolons). cmd_line has no line ending; len is its length. */
+ERR_F lsim_cmd_line_inplace(lsim_t *lsim, char *cmd_line, size_t len) {
+  /* Ignore "empty" lines. */
+  if (len == 0 || cmd_line[0] == '#') {
+    return ERR_OK;
+  }
+
+  /* A module body is only a netlist. */
+  if (lsim->cur_module && ! ((cmd_line[1] == ';' && strchr("bcdi", cmd_line[0])) ||
+      strncmp(cmd_line, "in;", 3) == 0 || strncmp(cmd_line, "out;", 4) == 0)) {
+    ERR_THROW(LSIM_ERR_COMMAND, "'%s' not allowed in module %s", cmd_line, lsim->cur_module->name);
+  }
+
+  err_t *err = ERR_OK;
+  int known = 1;
+  switch (cmd_line[0]) {
+  case 'b':
+    if (cmd_line[1] == ';') { err = lsim_cmd_busconn(lsim, &cmd_line[2]); }
+    else if (strncmp(cmd_line, "back;", 5) == 0) { err = lsim_cmd_back(lsim, &cmd_line[5]); }
+    else { known = 0; }
+    break;
+  case 'c':
+    if (cmd_line[1] == ';') { err = lsim_cmd_connect(lsim, &cmd_line[2]); } else { known = 0; }
+    break;
+  case 'd':
+    if (cmd_line[1] == ';') { err = lsim_cmd_define(lsim, &cmd_line[2]); } else { known = 0; }
+    break;
+  case 'e':
+  case 'f':
+    if (lsim_cmd_is_for(cmd_line) || lsim_cmd_is_endfor(cmd_line)) {
+      ERR_THROW(LSIM_ERR_COMMAND, "'%s' only allowed in a command file, matched with for/endfor", cmd_line);
+    }
+    if (lsim_cmd_is_endmodule(cmd_line)) {
+      ERR_THROW(LSIM_ERR_COMMAND, "'%s' only allowed at the top level of a command file, matched with module", cmd_line);
+    }
+    known = 0;
+    break;
+  case 'i':
+    if (cmd_line[1] == ';') { err = lsim_cmd_include(lsim, &cmd_line[2]); }
+    else if (strncmp(cmd_line, "in;", 3) == 0) { err = lsim_cmd_port(lsim, 0, &cmd_line[3]); }
+    else { known = 0; }
+    break;
+  case 'l':
+    if (cmd_line[1] == ';') { err = lsim_cmd_loadmem(lsim, &cmd_line[2]); } else { known = 0; }
+    break;
+  case 'm':
+    if (cmd_line[1] == ';') { err = lsim_cmd_movesw(lsim, &cmd_line[2]); }
+    else if (lsim_cmd_is_module(cmd_line)) {
+      ERR_THROW(LSIM_ERR_COMMAND, "'%s' only allowed at the top level of a command file, matched with endmodule", cmd_line);
+    }
+    else { known = 0; }
+    break;
+  case 'o':
+    if (strncmp(cmd_line, "out;", 4) == 0) { err = lsim_cmd_port(lsim, 1, &cmd_line[4]); } else { known = 0; }
+    break;
+  case 'p':
+    if (cmd_line[1] == ';') { err = lsim_cmd_power(lsim, &cmd_line[2]); } else { known = 0; }
+    break;
+  case 'q':
+    if (cmd_line[1] == ';') { err = lsim_cmd_quit(lsim, &cmd_line[2]); } else { known = 0; }
+    break;
+  case 'r':
+    if (strncmp(cmd_line, "restore;", 8) == 0) { err = lsim_cmd_restore(lsim, &cmd_line[8]); } else { known = 0; }
+    break;
+  case 's':
+    if (strncmp(cmd_line, "save;", 5) == 0) { err = lsim_cmd_save(lsim, &cmd_line[5]); }
+    else if (strncmp(cmd_line, "stats;", 6) == 0) { err = lsim_cmd_stats(lsim, &cmd_line[6]); }
+    else if (strncmp(cmd_line, "statsdump;", 10) == 0) { err = lsim_cmd_statsdump(lsim, &cmd_line[10]); }
+    else if (strncmp(cmd_line, "statsreset;", 11) == 0) { err = lsim_cmd_statsreset(lsim, &cmd_line[11]); }
+    else if (strncmp(cmd_line, "stepstats;", 10) == 0) { err = lsim_cmd_stepstats(lsim, &cmd_line[10]); }
+    else if (strncmp(cmd_line, "stepstatsdump;", 14) == 0) { err = lsim_cmd_stepstatsdump(lsim, &cmd_line[14]); }
+    else if (strncmp(cmd_line, "stepstatsreset;", 15) == 0) { err = lsim_cmd_stepstatsreset(lsim, &cmd_line[15]); }
+    else { known = 0; }
+    break;
+  case 't':
+    if (cmd_line[1] == ';') { err = lsim_cmd_ticklet(lsim, &cmd_line[2]); } else { known = 0; }
+    break;
+  case 'u':
+    if (strncmp(cmd_line, "until;", 6) == 0) { err = lsim_cmd_until(lsim, &cmd_line[6]); } else { known = 0; }
+    break;
+  case 'v':
+    if (cmd_line[1] == ';') { err = lsim_cmd_verbosity(lsim, &cmd_line[2]); }
+    else if (strncmp(cmd_line, "vectors;", 8) == 0) { err = lsim_cmd_vectors(lsim, &cmd_line[8]); }
+    else if (strncmp(cmd_line, "vcd;", 4) == 0) { err = lsim_cmd_vcd(lsim, LSIM_VCD_FORMAT_VCD, &cmd_line[4]); }
+    else if (strncmp(cmd_line, "vcdstop;", 8) == 0) { err = lsim_cmd_vcdstop(lsim, &cmd_line[8]); }
+    else { known = 0; }
+    break;
+  case 'w':
+    if (cmd_line[1] == ';') { err = lsim_cmd_watchdev(lsim, &cmd_line[2]); }
+    else if (strncmp(cmd_line, "whatif;", 7) == 0) { err = lsim_cmd_whatif(lsim, &cmd_line[7]); }
+    else if (strncmp(cmd_line, "wave;", 5) == 0) { err = lsim_cmd_vcd(lsim, LSIM_VCD_FORMAT_WAVE, &cmd_line[5]); }
+    else if (strncmp(cmd_line, "wavestop;", 9) == 0) { err = lsim_cmd_vcdstop(lsim, &cmd_line[9]); }
+    else if (strncmp(cmd_line, "wavequery;", 10) == 0) { err = lsim_cmd_wavequery(lsim, &cmd_line[10]); }
+    else { known = 0; }
+    break;
+  default:
+    known = 0;
+  }
+
+  /* Whatever the command printed while running comes before what's next. */
+  lsim_log_flush(lsim);
+
+  if (! known) {
+    ERR_THROW(LSIM_ERR_COMMAND, "Unrecognized command '%s'", cmd_line);
+  }
+
+  if (err) {
+    /* Put the semicolons back for a useful error message. */
+    size_t i;
+    for (i = 0; i < len; i++) {
+      if (cmd_line[i] == '\0') {
+        cmd_line[i] = ';';
+      }
+    }
+    ERR_RETHROW(err, "Error processing '%s'", cmd_line);
+  }
+
+  return ERR_OK;
+}  /* lsim_cmd_line_inplace */
+
+
 ERR_F lsim_cmd_line(lsim_t *lsim, const char *cmd_line) {
 
   /* Find index of last character that isn't a line ending. */
@@ -771,59 +1370,482 @@ ERR_F lsim_cmd_line(lsim_t *lsim, const char *cmd_line) {
   /* Strip line endings. */
   local_cmd_line[last_c + 1] = '\0';
 
-  err_t *err;
-  if (strstr(local_cmd_line, "b;") == local_cmd_line) {
-    err = lsim_cmd_busconn(lsim, &local_cmd_line[2]);
+  err_t *err = lsim_cmd_line_inplace(lsim, local_cmd_line, last_c + 1);
+  free(local_cmd_line);
+  if (err) {
+    ERR_RETHROW(err, "cmd_line='%s'", cmd_line);
   }
-  else if (strstr(local_cmd_line, "c;") == local_cmd_line) {
-    err = lsim_cmd_connect(lsim, &local_cmd_line[2]);
+
+  return ERR_OK;
+}  /* lsim_cmd_line */
+
+
+/* Loops:
+ * for;var;first;last;
+ *   ...
+ * endfor;
+ * The lines between run once for each value of var from first to last
+ * (inclusive), with each "${expr}" replaced by the value of expr. An expr
+ * is integers and loop variables joined by + - * / % (usual precedence).
+ * Loops nest and are only allowed in command files. The body is read
+ * once; each line is expanded into a scratch buffer as it runs. */
+
+#define LSIM_CMD_MAX_LOOP_DEPTH 16
+
+typedef struct lsim_cmd_var_s {
+  char *name;
+  long value;
+} lsim_cmd_var_t;
+
+/* Lines of an outermost loop or a module, including its first and last. */
+typedef struct lsim_cmd_body_s {
+  char *text;  /* Lines back to back, each '\0'-terminated. */
+  size_t text_len;
+  size_t alloc_text;
+  size_t *offsets;
+  long *line_nums;
+  long num_lines;
+  long alloc_lines;
+  lsim_cmd_var_t vars[LSIM_CMD_MAX_LOOP_DEPTH];
+  int num_vars;
+  char *scratch;  /* Expanded line. */
+  size_t alloc_scratch;
+} lsim_cmd_body_t;
+
+
+ERR_F lsim_cmd_body_add(lsim_cmd_body_t *body, const char *line, size_t len, long line_num) {
+  if (body->num_lines == body->alloc_lines) {
+    long new_alloc = body->alloc_lines ? body->alloc_lines * 2 : 64;
+    size_t *new_offsets = realloc(body->offsets, new_alloc * sizeof(size_t));
+    ERR_ASSRT(new_offsets, LSIM_ERR_NOMEM);
+    body->offsets = new_offsets;
+    long *new_line_nums = realloc(body->line_nums, new_alloc * sizeof(long));
+    ERR_ASSRT(new_line_nums, LSIM_ERR_NOMEM);
+    body->line_nums = new_line_nums;
+    body->alloc_lines = new_alloc;
   }
-  else if (strstr(local_cmd_line, "d;") == local_cmd_line) {
-    err = lsim_cmd_define(lsim, &local_cmd_line[2]);
+  if (body->text_len + len + 1 > body->alloc_text) {
+    size_t new_alloc = body->alloc_text ? body->alloc_text * 2 : 4096;
+    while (new_alloc < body->text_len + len + 1) { new_alloc *= 2; }
+    char *new_text = realloc(body->text, new_alloc);
+    ERR_ASSRT(new_text, LSIM_ERR_NOMEM);
+    body->text = new_text;
+    body->alloc_text = new_alloc;
   }
-  else if (strstr(local_cmd_line, "i;") == local_cmd_line) {
-    err = lsim_cmd_include(lsim, &local_cmd_line[2]);
+
+  body->offsets[body->num_lines] = body->text_len;
+  body->line_nums[body->num_lines] = line_num;
+  body->num_lines++;
+  memcpy(&body->text[body->text_len], line, len);
+  body->text[body->text_len + len] = '\0';
+  body->text_len += len + 1;
+
+  return ERR_OK;
+}  /* lsim_cmd_body_add */
+
+
+void lsim_cmd_body_free(lsim_cmd_body_t *body) {
+  free(body->text);
+  free(body->offsets);
+  free(body->line_nums);
+  free(body->scratch);
+}  /* lsim_cmd_body_free */
+
+
+/* One integer or loop variable of a "${...}" expression. */
+ERR_F lsim_cmd_expr_operand(lsim_cmd_body_t *body, const char **p_pos, long *rtn_value) {
+  const char *pos = *p_pos;
+  while (*pos == ' ') { pos++; }
+
+  if (isdigit((unsigned char)*pos)) {
+    char *end;
+    *rtn_value = strtol(pos, &end, 10);
+    pos = end;
   }
-  else if (strstr(local_cmd_line, "l;") == local_cmd_line) {
-    err = lsim_cmd_loadmem(lsim, &local_cmd_line[2]);
+  else if (isalpha((unsigned char)*pos) || *pos == '_') {
+    const char *name = pos;
+    while (isalnum((unsigned char)*pos) || *pos == '_') { pos++; }
+    size_t name_len = pos - name;
+    int i;
+    for (i = body->num_vars - 1; i >= 0; i--) {  /* Innermost first. */
+      if (strlen(body->vars[i].name) == name_len && strncmp(body->vars[i].name, name, name_len) == 0) {
+        break;
+      }
+    }
+    if (i < 0) {
+      ERR_THROW(LSIM_ERR_COMMAND, "Undefined loop variable '%.*s'", (int)name_len, name);
+    }
+    *rtn_value = body->vars[i].value;
   }
-  else if (strstr(local_cmd_line, "m;") == local_cmd_line) {
-    err = lsim_cmd_movesw(lsim, &local_cmd_line[2]);
+  else ERR_THROW(LSIM_ERR_COMMAND, "Bad expression at '%s'", pos);
+
+  while (*pos == ' ') { pos++; }
+  *p_pos = pos;
+  return ERR_OK;
+}  /* lsim_cmd_expr_operand */
+
+
+/* Evaluate the expression starting at *p_pos, up to the closing '}'. */
+ERR_F lsim_cmd_expr(lsim_cmd_body_t *body, const char **p_pos, long *rtn_value) {
+  const char *pos = *p_pos;
+  long sum = 0;
+  int sign = 1;
+
+  while (1) {
+    long term;
+    ERR(lsim_cmd_expr_operand(body, &pos, &term));
+    while (*pos == '*' || *pos == '/' || *pos == '%') {
+      char op = *pos;
+      pos++;
+      long operand;
+      ERR(lsim_cmd_expr_operand(body, &pos, &operand));
+      if (op == '*') { term *= operand; }
+      else {
+        ERR_ASSRT(operand != 0, LSIM_ERR_COMMAND);  /* Divide by zero. */
+        term = (op == '/') ? (term / operand) : (term % operand);
+      }
+    }
+    sum += sign * term;
+
+    if (*pos == '+') { sign = 1; }
+    else if (*pos == '-') { sign = -1; }
+    else break;
+    pos++;
   }
-  else if (strstr(local_cmd_line, "p;") == local_cmd_line) {
-    err = lsim_cmd_power(lsim, &local_cmd_line[2]);
+  ERR_ASSRT(*pos == '}', LSIM_ERR_COMMAND);
+
+  *p_pos = pos + 1;
+  *rtn_value = sum;
+  return ERR_OK;
+}  /* lsim_cmd_expr */
+
+
+/* Expand "${...}"s of line into body->scratch. */
+ERR_F lsim_cmd_interpolate(lsim_cmd_body_t *body, const char *line, size_t *rtn_len) {
+  size_t len = 0;
+  const char *pos = line;
+
+  while (1) {
+    char num_buf[24];
+    const char *piece;
+    size_t piece_len;
+    const char *dollar = strstr(pos, "${");
+    if (dollar == pos) {
+      pos += 2;
+      long value;
+      ERR(lsim_cmd_expr(body, &pos, &value));
+      piece_len = snprintf(num_buf, sizeof(num_buf), "%ld", value);
+      piece = num_buf;
+    } else {
+      piece = pos;
+      piece_len = dollar ? (size_t)(dollar - pos) : strlen(pos);
+      pos += piece_len;
+    }
+
+    if (len + piece_len + 1 > body->alloc_scratch) {
+      size_t new_alloc = body->alloc_scratch ? body->alloc_scratch * 2 : 1024;
+      while (new_alloc < len + piece_len + 1) { new_alloc *= 2; }
+      char *new_scratch = realloc(body->scratch, new_alloc);
+      ERR_ASSRT(new_scratch, LSIM_ERR_NOMEM);
+      body->scratch = new_scratch;
+      body->alloc_scratch = new_alloc;
+    }
+    memcpy(&body->scratch[len], piece, piece_len);
+    len += piece_len;
+
+    if (*pos == '\0') break;
   }
-  else if (strstr(local_cmd_line, "q;") == local_cmd_line) {
-    err = lsim_cmd_quit(lsim, &local_cmd_line[2]);
+  body->scratch[len] = '\0';
+
+  *rtn_len = len;
+  return ERR_OK;
+}  /* lsim_cmd_interpolate */
+
+
+ERR_F lsim_cmd_loop(lsim_t *lsim, const char *filename, lsim_cmd_body_t *body, long for_index, long *rtn_endfor_index);
+
+/* Run body lines first up to (not including) end. */
+ERR_F lsim_cmd_body_run(lsim_t *lsim, const char *filename, lsim_cmd_body_t *body, long first, long end) {
+  err_t *err = ERR_OK;
+  size_t len;
+  long i;
+  for (i = first; i < end && err == ERR_OK && ! lsim->quit; i++) {
+    const char *line = &body->text[body->offsets[i]];
+    if (line[0] == '\0' || line[0] == '#') {
+      continue;
+    }
+    if (lsim_cmd_is_for(line)) {
+      err = lsim_cmd_loop(lsim, filename, body, i, &i);
+      continue;
+    }
+    if (lsim_cmd_is_module(line)) {
+      err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_COMMAND, "%s:%ld, module definitions must be at the top level", filename, body->line_nums[i]);
+      break;
+    }
+    err = lsim_cmd_interpolate(body, line, &len);
+    if (err == ERR_OK) {
+      if (lsim->verbosity_map & LSIM_VERBOSITY_MAP_TRACE) {
+        printf("Trace: %s:%ld, '%s'\n", filename, body->line_nums[i], body->scratch);
+      }
+      err = lsim_cmd_line_inplace(lsim, body->scratch, len);
+    }
+    if (err) {
+      err = err_rethrow_v(__FILE__, __LINE__, __func__, err, "%s:%ld", filename, body->line_nums[i]);
+    }
   }
-  else if (strstr(local_cmd_line, "t;") == local_cmd_line) {
-    err = lsim_cmd_ticklet(lsim, &local_cmd_line[2]);
+  if (err) {
+    ERR_RETHROW(err, "lsim_cmd_body_run");
   }
-  else if (strstr(local_cmd_line, "v;") == local_cmd_line) {
-    err = lsim_cmd_verbosity(lsim, &local_cmd_line[2]);
+
+  return ERR_OK;
+}  /* lsim_cmd_body_run */
+
+
+/* Run the loop whose for line is body line for_index. Returns the index
+ * of its endfor. */
+ERR_F lsim_cmd_loop(lsim_t *lsim, const char *filename, lsim_cmd_body_t *body, long for_index, long *rtn_endfor_index) {
+  char *semi_colon;
+
+  /* Find the matching endfor. */
+  long endfor_index;
+  int depth = 0;
+  for (endfor_index = for_index + 1; endfor_index < body->num_lines; endfor_index++) {
+    const char *line = &body->text[body->offsets[endfor_index]];
+    if (lsim_cmd_is_for(line)) { depth++; }
+    else if (lsim_cmd_is_endfor(line)) {
+      if (depth == 0) break;
+      depth--;
+    }
   }
-  else if (strstr(local_cmd_line, "w;") == local_cmd_line) {
-    err = lsim_cmd_watchdev(lsim, &local_cmd_line[2]);
+  ERR_ASSRT(endfor_index < body->num_lines, LSIM_ERR_INTERNAL);  /* Checked while reading. */
+  ERR_ASSRT(body->num_vars < LSIM_CMD_MAX_LOOP_DEPTH, LSIM_ERR_COMMAND);  /* Too deep. */
+
+  /* The bounds can use outer loop variables. */
+  size_t len;
+  ERR(lsim_cmd_interpolate(body, &body->text[body->offsets[for_index]] + 4, &len));
+  char *var_name = body->scratch;
+  ERR_ASSRT(semi_colon = strchr(var_name, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';
+  ERR(lsim_valid_name(var_name));
+
+  char *first_s = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(first_s, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  char *last_s = semi_colon + 1;
+  ERR_ASSRT(semi_colon = strchr(last_s, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';  /* Overwrite semicolon. */
+
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  long first;
+  ERR(err_atol(first_s, &first));
+  long last;
+  ERR(err_atol(last_s, &last));
+
+  lsim_cmd_var_t *var = &body->vars[body->num_vars];
+  ERR(err_strdup(&var->name, var_name));  /* Scratch gets reused. */
+  body->num_vars++;
+
+  err_t *err = ERR_OK;
+  long value;
+  for (value = first; value <= last && err == ERR_OK && ! lsim->quit; value++) {
+    var->value = value;
+    err = lsim_cmd_body_run(lsim, filename, body, for_index + 1, endfor_index);
+    if (err) {
+      err = err_rethrow_v(__FILE__, __LINE__, __func__, err, "%s=%ld", var->name, value);
+    }
   }
-  else {
-    free(local_cmd_line);
-    ERR_THROW(LSIM_ERR_COMMAND, "Unrecognized command '%s'", cmd_line);
+
+  body->num_vars--;
+  free(var->name);
+  if (err) {
+    ERR_RETHROW(err, "for loop at %s:%ld", filename, body->line_nums[for_index]);
   }
 
-  free(local_cmd_line);
+  *rtn_endfor_index = endfor_index;
+  return ERR_OK;
+}  /* lsim_cmd_loop */
+
+
+/* Modules:
+ * module;name;
+ *   ...
+ * in;port_id;dev_name;in_id;
+ * out;port_id;dev_name;out_id;
+ * endmodule;
+ * The body (body lines 1 to num_lines-2) is compiled once into a template
+ * (see lsim_module.c); "d;name;dev_name;" then creates an instance. */
+ERR_F lsim_cmd_module(lsim_t *lsim, const char *filename, lsim_cmd_body_t *body) {
+  char *semi_colon;
+
+  size_t len;
+  ERR(lsim_cmd_interpolate(body, &body->text[body->offsets[0]] + 7, &len));
+  char *name = body->scratch;
+  ERR_ASSRT(semi_colon = strchr(name, ';'), LSIM_ERR_COMMAND);
+  *semi_colon = '\0';
+  ERR(lsim_valid_name(name));
 
+  /* Make sure we're at end of line. */
+  char *end_field = semi_colon + 1;
+  ERR_ASSRT(strlen(end_field) == 0, LSIM_ERR_COMMAND);
+
+  lsim_t *scratch;
+  ERR(lsim_module_begin(lsim, name, &scratch));
+  scratch->verbosity_map = lsim->verbosity_map;
+
+  err_t *err = lsim_cmd_body_run(scratch, filename, body, 1, body->num_lines - 1);
   if (err) {
-    /* Improve error reporting. */
-    ERR_RETHROW(err, "Error processing '%s'", cmd_line);
+    err_t *abort_err = lsim_module_abort(lsim, scratch);
+    if (abort_err) { err_dispose(abort_err); }
+    ERR_RETHROW(err, "module at %s:%ld", filename, body->line_nums[0]);
+  }
+  err = lsim_module_end(lsim, scratch);  /* Deletes scratch either way. */
+  if (err) {
+    ERR_RETHROW(err, "module at %s:%ld", filename, body->line_nums[0]);
   }
 
   return ERR_OK;
-}  /* lsim_cmd_line */
+}  /* lsim_cmd_module */
+
+
+/* Input for lsim_cmd_file() is read in blocks of this size. The buffer
+ * grows if a single line doesn't fit. */
+#define LSIM_CMD_FILE_BLOCK (1024*1024)
+
+typedef struct lsim_cmd_file_buf_s {
+  int fd;
+  char *buf;
+  size_t buf_size;  /* Allocated size is one more, for a final '\0'. */
+  size_t buf_len;  /* Bytes read into buf. */
+  size_t line_start;  /* Start of the next line within buf. */
+  int eof;
+} lsim_cmd_file_buf_t;
+
+
+/* Read more input, keeping the partial line at line_start. */
+ERR_F lsim_cmd_file_fill(lsim_cmd_file_buf_t *file_buf) {
+  size_t partial = file_buf->buf_len - file_buf->line_start;
+  memmove(file_buf->buf, &file_buf->buf[file_buf->line_start], partial);
+  file_buf->buf_len = partial;
+  file_buf->line_start = 0;
+
+  if (file_buf->buf_len == file_buf->buf_size) {  /* Very long line. */
+    char *new_buf = realloc(file_buf->buf, file_buf->buf_size * 2 + 1);
+    ERR_ASSRT(new_buf, LSIM_ERR_NOMEM);
+    file_buf->buf = new_buf;
+    file_buf->buf_size *= 2;
+  }
+
+  ssize_t num_read;
+  do {
+    num_read = read(file_buf->fd, &file_buf->buf[file_buf->buf_len], file_buf->buf_size - file_buf->buf_len);
+  } while (num_read < 0 && errno == EINTR);
+  ERR_ASSRT(num_read >= 0, LSIM_ERR_BADFILE);
+
+  if (num_read == 0) {
+    file_buf->eof = 1;
+  }
+  file_buf->buf_len += num_read;
+
+  return ERR_OK;
+}  /* lsim_cmd_file_fill */
+
+
+/* Return the next line with its line ending replaced by '\0'; NULL at
+ * end of input. */
+ERR_F lsim_cmd_file_next_line(lsim_cmd_file_buf_t *file_buf, char **rtn_line, size_t *rtn_len) {
+  char *line_end;
+  while (1) {
+    char *line = &file_buf->buf[file_buf->line_start];
+    size_t avail = file_buf->buf_len - file_buf->line_start;
+    line_end = memchr(line, '\n', avail);
+    if (line_end) { break; }
+    if (file_buf->eof) {
+      if (avail == 0) {
+        *rtn_line = NULL;
+        return ERR_OK;
+      }
+      line_end = &line[avail];  /* Last line has no newline. */
+      break;
+    }
+    ERR(lsim_cmd_file_fill(file_buf));
+  }
+
+  char *line = &file_buf->buf[file_buf->line_start];
+  size_t len = line_end - line;
+  file_buf->line_start += len;
+  if (file_buf->line_start < file_buf->buf_len) {
+    file_buf->line_start++;  /* Past the newline. */
+  }
+
+  while (len > 0 && line[len-1] == '\r') {
+    len--;
+  }
+  line[len] = '\0';
+
+  *rtn_line = line;
+  *rtn_len = len;
+  return ERR_OK;
+}  /* lsim_cmd_file_next_line */
+
+
+/* Read the rest of the loop or module starting at for_line and run it. */
+ERR_F lsim_cmd_file_block(lsim_t *lsim, const char *filename, lsim_cmd_file_buf_t *file_buf, const char *for_line, size_t for_len, int *p_line_num, int cache_top) {
+  lsim_cmd_body_t body;
+  memset(&body, 0, sizeof(body));
+  long for_line_num = *p_line_num;
+  int is_module = lsim_cmd_is_module(for_line);
+
+  /* Keep the lines; the file buffer is reused as they are read. */
+  err_t *err = lsim_cmd_body_add(&body, for_line, for_len, for_line_num);
+  int depth = 0;
+  while (err == ERR_OK) {
+    char *iline;
+    size_t len;
+    err = lsim_cmd_file_next_line(file_buf, &iline, &len);
+    if (err) break;
+    if (iline == NULL) {
+      err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_COMMAND, "%s:%ld: %s without %s", filename, for_line_num,
+                        is_module ? "module" : "for", is_module ? "endmodule" : "endfor");
+      break;
+    }
+    (*p_line_num)++;
+    /* The parse cache can only end its netlist before the loop. */
+    err = lsim_parse_cache_line(lsim, filename, iline, for_line_num, cache_top);
+    if (err == ERR_OK) {
+      err = lsim_cmd_body_add(&body, iline, len, *p_line_num);
+    }
+    if (is_module) {
+      if (lsim_cmd_is_endmodule(iline)) break;
+    }
+    else if (lsim_cmd_is_for(iline)) { depth++; }
+    else if (lsim_cmd_is_endfor(iline)) {
+      if (depth == 0) break;
+      depth--;
+    }
+  }
+
+  if (err == ERR_OK && is_module) {
+    err = lsim_cmd_module(lsim, filename, &body);
+  }
+  else if (err == ERR_OK) {
+    long endfor_index;
+    err = lsim_cmd_loop(lsim, filename, &body, 0, &endfor_index);
+  }
+  lsim_cmd_body_free(&body);
+  if (err) {
+    ERR_RETHROW(err, "lsim_cmd_file_block");
+  }
+
+  return ERR_OK;
+}  /* lsim_cmd_file_block */
 
 
 ERR_F lsim_cmd_file(lsim_t *lsim, const char *filename) {
-  FILE *cmd_file_fp;
-  char iline[1024];
+  lsim_cmd_file_buf_t file_buf;
 
   ERR_ASSRT(lsim, LSIM_ERR_PARAM);
   ERR_ASSRT(filename, LSIM_ERR_PARAM);
@@ -832,36 +1854,68 @@ ERR_F lsim_cmd_file(lsim_t *lsim, const char *filename) {
     return ERR_OK;
   }
 
+  memset(&file_buf, 0, sizeof(file_buf));
   if (strcmp(filename, "-") == 0) {
-    cmd_file_fp = stdin;
+    file_buf.fd = STDIN_FILENO;
   } else {
-    cmd_file_fp = fopen(filename, "r");
+    file_buf.fd = open(filename, O_RDONLY);
+  }
+  ERR_ASSRT(file_buf.fd >= 0, LSIM_ERR_BADFILE);
+  file_buf.buf_size = LSIM_CMD_FILE_BLOCK;
+  file_buf.buf = malloc(file_buf.buf_size + 1);
+  if (file_buf.buf == NULL) {
+    if (file_buf.fd != STDIN_FILENO) { close(file_buf.fd); }
+    ERR_THROW(LSIM_ERR_NOMEM, "cmd file buffer");
   }
-  ERR_ASSRT(cmd_file_fp, LSIM_ERR_BADFILE);
 
-  int line_num = 0;
+  long skip_lines = 0;
+  int cache_top = 0;
   err_t *err = ERR_OK;
-  while (fgets(iline, sizeof(iline), cmd_file_fp)) {
-    line_num++;
-    size_t len = strlen(iline);
-    ERR_ASSRT(len < sizeof(iline) - 1, LSIM_ERR_LINETOOLONG);  /* Line too long. */
+  if (lsim->file_depth == 0) {
+    err = lsim_parse_cache_open(lsim, filename, &skip_lines);
+    cache_top = (lsim->parse_cache != NULL);
+  } else {
+    err = lsim_parse_cache_include(lsim, filename);
+  }
+  lsim->file_depth++;
 
-    while (len > 0 && (iline[len-1] == '\n' || iline[len-1] == '\r')) {
-      len--;
-      iline[len] = '\0';
+  int line_num = 0;
+  while (err == ERR_OK) {
+    char *iline;
+    size_t len;
+    err = lsim_cmd_file_next_line(&file_buf, &iline, &len);
+    if (err || iline == NULL) { break; }
+    line_num++;
+    if (line_num <= skip_lines) {
+      continue;  /* Netlist came from the parse cache. */
     }
+
     if (len > 0) {
       if (lsim->verbosity_map & LSIM_VERBOSITY_MAP_TRACE) {
         printf("Trace: %s:%d, '%s'\n", filename, line_num, iline);
       }
-      err = lsim_cmd_line(lsim, iline);
+      err = lsim_parse_cache_line(lsim, filename, iline, line_num, cache_top);
+      int cmd_line_num = line_num;
+      if (err == ERR_OK && (lsim_cmd_is_for(iline) || lsim_cmd_is_module(iline))) {
+        char *block_line = lsim_cmd_is_for(iline) ? "for;..." : "module;...";
+        err = lsim_cmd_file_block(lsim, filename, &file_buf, iline, len, &line_num, cache_top);
+        iline = block_line;  /* File buffer may have moved. */
+      }
+      else if (err == ERR_OK) {
+        err = lsim_cmd_line_inplace(lsim, iline, len);
+      }
       if (err) {
-        fprintf(stderr, "Error %s:%d '%s':\n", filename, line_num, iline);
+        fprintf(stderr, "Error %s:%d '%s':\n", filename, cmd_line_num, iline);
+        if (lsim->parse_cache && lsim->parse_cache->recording) {
+          err_t *stop_err = lsim_parse_cache_stop(lsim);  /* Don't cache a failed netlist. */
+          if (stop_err) { err_dispose(stop_err); }
+        }
         switch (global_error_reaction) {
         case 0: ERR_ABRT_ON_ERR(err, stderr); break;
         case 1: ERR_EXIT_ON_ERR(err, stderr); break;
         case 2:
           ERR_WARN_ON_ERR(err, stderr);
+          err = ERR_OK;  /* Disposed. */
           break;
         }
       }
@@ -869,10 +1923,21 @@ ERR_F lsim_cmd_file(lsim_t *lsim, const char *filename) {
     if (lsim->quit) { break; }
   }  /* while */
 
-  if (strcmp(filename, "-") == 0) {
-    /* Don't close stdin. */
-  } else {
-    fclose(cmd_file_fp);
+  if (file_buf.fd != STDIN_FILENO) {
+    close(file_buf.fd);
+  }
+  free(file_buf.buf);
+  lsim->file_depth--;
+
+  if (cache_top) {
+    err_t *close_err = lsim_parse_cache_close(lsim, filename, line_num);
+    if (close_err) {
+      if (err) {
+        err_dispose(close_err);
+      } else {
+        err = close_err;
+      }
+    }
   }
 
   if (err) {
@@ -14,6 +14,7 @@
 #define LSIM_CMD_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "err.h"
 #include "hmap.h"
 
@@ -21,6 +22,7 @@
 extern "C" {
 #endif
 
+ERR_F lsim_cmd_line_inplace(lsim_t *lsim, char *cmd_line, size_t len);
 ERR_F lsim_cmd_line(lsim_t *lsim, const char *cmd_line);
 ERR_F lsim_cmd_file(lsim_t *lsim, const char *cmd_file_name);
 
@@ -0,0 +1,355 @@
+/* lsim_cond.c - conditions over nets, for "until". */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_cond.h"
+
+
+/* A condition is C-like: signals "dev_name:out_id" (one bit) or
+ * "dev_name:out_id[num_bits]" (bits 0..num_bits-1, as in "b;"),
+ * numbers, "ticklet" (since power-up), parentheses, unary ! and ~, and
+ * the binary operators below with C's precedence. It's compiled once to
+ * postfix ops; names are resolved then, not per evaluation. */
+
+typedef struct lsim_cond_binop_s {
+  const char *str;
+  int prec;
+  int op;
+} lsim_cond_binop_t;
+
+/* Two-character operators before their one-character prefixes. */
+lsim_cond_binop_t lsim_cond_binops[] = {
+  {"||", 1, LSIM_COND_OP_OR}, {"&&", 2, LSIM_COND_OP_AND},
+  {"==", 6, LSIM_COND_OP_EQ}, {"!=", 6, LSIM_COND_OP_NE},
+  {"<=", 7, LSIM_COND_OP_LE}, {">=", 7, LSIM_COND_OP_GE},
+  {"|", 3, LSIM_COND_OP_BITOR}, {"^", 4, LSIM_COND_OP_BITXOR}, {"&", 5, LSIM_COND_OP_BITAND},
+  {"<", 7, LSIM_COND_OP_LT}, {">", 7, LSIM_COND_OP_GT},
+  {"+", 8, LSIM_COND_OP_ADD}, {"-", 8, LSIM_COND_OP_SUB},
+  {NULL, 0, 0}
+};
+
+typedef struct lsim_cond_parse_s {
+  lsim_t *lsim;
+  lsim_cond_t *cond;
+  const char *text;
+  const char *cur;
+  int depth;  /* Of the evaluation stack, as ops are emitted. */
+} lsim_cond_parse_t;
+
+
+ERR_F lsim_cond_emit(lsim_cond_parse_t *parse, int op, int num_bits, long first_out, uint64_t val) {
+  lsim_cond_t *cond = parse->cond;
+  if (cond->num_ops == cond->alloc_ops) {
+    int new_alloc = cond->alloc_ops ? cond->alloc_ops * 2 : 16;
+    lsim_cond_op_t *new_ops = realloc(cond->ops, new_alloc * sizeof(lsim_cond_op_t));
+    ERR_ASSRT(new_ops, LSIM_ERR_NOMEM);
+    cond->ops = new_ops;
+    cond->alloc_ops = new_alloc;
+  }
+  lsim_cond_op_t *cond_op = &cond->ops[cond->num_ops++];
+  cond_op->op = op;
+  cond_op->num_bits = num_bits;
+  cond_op->first_out = first_out;
+  cond_op->val = val;
+
+  if (op == LSIM_COND_OP_CONST || op == LSIM_COND_OP_TICKLET || op == LSIM_COND_OP_SIGNAL) {
+    parse->depth++;
+    if (parse->depth > LSIM_COND_MAX_DEPTH) {
+      ERR_THROW(LSIM_ERR_COMMAND, "Condition '%s' is nested too deeply", parse->text);
+    }
+  }
+  else if (op != LSIM_COND_OP_NOT && op != LSIM_COND_OP_BITNOT) {
+    parse->depth--;  /* Binary. */
+  }
+
+  return ERR_OK;
+}  /* lsim_cond_emit */
+
+
+void lsim_cond_skip_space(lsim_cond_parse_t *parse) {
+  while (isspace((unsigned char)*parse->cur)) {
+    parse->cur++;
+  }
+}  /* lsim_cond_skip_space */
+
+
+/* dev_name:out_id[num_bits] */
+ERR_F lsim_cond_signal(lsim_cond_parse_t *parse, const char *colon) {
+  lsim_t *lsim = parse->lsim;
+  lsim_cond_t *cond = parse->cond;
+  char dev_name[LSIM_NAME_MAX_PATTERN + 1];
+  size_t len = colon - parse->cur;
+  ERR_ASSRT(len <= LSIM_NAME_MAX_PATTERN, LSIM_ERR_COMMAND);
+  memcpy(dev_name, parse->cur, len);
+  dev_name[len] = '\0';
+
+  char out_id[32];
+  const char *id_start = colon + 1;
+  const char *id_end = id_start;
+  while (isalnum((unsigned char)*id_end) || *id_end == '_') {
+    id_end++;
+  }
+  len = id_end - id_start;
+  if (len == 0 || len >= sizeof(out_id)) {
+    ERR_THROW(LSIM_ERR_COMMAND, "Condition '%s': bad output id after '%s:'", parse->text, dev_name);
+  }
+  memcpy(out_id, id_start, len);
+  out_id[len] = '\0';
+  parse->cur = id_end;
+
+  long num_bits = 1;
+  if (*parse->cur == '[') {
+    char *end;
+    num_bits = strtol(parse->cur + 1, &end, 0);
+    if (*end != ']' || num_bits < 1 || num_bits > 64) {
+      ERR_THROW(LSIM_ERR_COMMAND, "Condition '%s': bad width for '%s:%s'", parse->text, dev_name, out_id);
+    }
+    parse->cur = end + 1;
+  }
+
+  lsim_dev_t *dev;
+  ERR(lsim_name_lookup(lsim, dev_name, &dev));
+  if (cond->num_outs + num_bits > cond->alloc_outs) {
+    long new_alloc = cond->alloc_outs ? cond->alloc_outs * 2 : 64;
+    while (new_alloc < cond->num_outs + num_bits) {
+      new_alloc *= 2;
+    }
+    lsim_dev_out_terminal_t **new_outs = realloc(cond->outs, new_alloc * sizeof(lsim_dev_out_terminal_t *));
+    ERR_ASSRT(new_outs, LSIM_ERR_NOMEM);
+    cond->outs = new_outs;
+    cond->alloc_outs = new_alloc;
+  }
+  int bit;
+  for (bit = 0; bit < num_bits; bit++) {
+    lsim_dev_out_terminal_t *out_terminal = NULL;
+    ERR(dev->get_out_terminal(lsim, dev, out_id, &out_terminal, bit));
+    if (out_terminal == NULL) {
+      ERR_THROW(LSIM_ERR_COMMAND, "Device '%s' has no output '%s' (bit %d)", dev_name, out_id, bit);
+    }
+    cond->outs[cond->num_outs + bit] = out_terminal;
+  }
+
+  ERR(lsim_cond_emit(parse, LSIM_COND_OP_SIGNAL, (int)num_bits, cond->num_outs, 0));
+  cond->num_outs += num_bits;
+
+  return ERR_OK;
+}  /* lsim_cond_signal */
+
+
+ERR_F lsim_cond_expr(lsim_cond_parse_t *parse, int min_prec);
+
+ERR_F lsim_cond_unary(lsim_cond_parse_t *parse) {
+  lsim_cond_skip_space(parse);
+  char c = *parse->cur;
+
+  if (c == '!' || c == '~') {
+    parse->cur++;
+    ERR(lsim_cond_unary(parse));
+    ERR(lsim_cond_emit(parse, (c == '!') ? LSIM_COND_OP_NOT : LSIM_COND_OP_BITNOT, 0, 0, 0));
+  }
+  else if (c == '(') {
+    parse->cur++;
+    ERR(lsim_cond_expr(parse, 1));
+    lsim_cond_skip_space(parse);
+    if (*parse->cur != ')') {
+      ERR_THROW(LSIM_ERR_COMMAND, "Condition '%s': missing ')' at '%s'", parse->text, parse->cur);
+    }
+    parse->cur++;
+  }
+  else if (isdigit((unsigned char)c)) {
+    char *end;
+    uint64_t val = strtoull(parse->cur, &end, 0);
+    parse->cur = end;
+    ERR(lsim_cond_emit(parse, LSIM_COND_OP_CONST, 0, 0, val));
+  }
+  else {
+    /* A device name ends at the colon; otherwise it's a keyword. */
+    const char *end = parse->cur;
+    while (isalnum((unsigned char)*end) || *end == '_' || *end == '-' || *end == '.') {
+      end++;
+    }
+    if (*end == ':' && end > parse->cur) {
+      ERR(lsim_cond_signal(parse, end));
+    }
+    else if (strncmp(parse->cur, "ticklet", 7) == 0 && ! (isalnum((unsigned char)parse->cur[7]) || parse->cur[7] == '_')) {
+      parse->cur += 7;
+      parse->cond->uses_ticklet = 1;
+      ERR(lsim_cond_emit(parse, LSIM_COND_OP_TICKLET, 0, 0, 0));
+    }
+    else {
+      ERR_THROW(LSIM_ERR_COMMAND, "Condition '%s': expected a value at '%s'", parse->text, parse->cur);
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_cond_unary */
+
+
+/* Precedence climbing over lsim_cond_binops. */
+ERR_F lsim_cond_expr(lsim_cond_parse_t *parse, int min_prec) {
+  ERR(lsim_cond_unary(parse));
+
+  while (1) {
+    lsim_cond_skip_space(parse);
+    lsim_cond_binop_t *binop;
+    for (binop = lsim_cond_binops; binop->str; binop++) {
+      if (strncmp(parse->cur, binop->str, strlen(binop->str)) == 0) {
+        break;
+      }
+    }
+    if (binop->str == NULL || binop->prec < min_prec) {
+      break;
+    }
+    parse->cur += strlen(binop->str);
+    ERR(lsim_cond_expr(parse, binop->prec + 1));
+    ERR(lsim_cond_emit(parse, binop->op, 0, 0, 0));
+  }
+
+  return ERR_OK;
+}  /* lsim_cond_expr */
+
+
+ERR_F lsim_cond_compile(lsim_t *lsim, const char *text, lsim_cond_t **rtn_cond) {
+  lsim_cond_parse_t parse;
+  parse.lsim = lsim;
+  parse.text = text;
+  parse.cur = text;
+  parse.depth = 0;
+  ERR(err_calloc((void **)&parse.cond, 1, sizeof(lsim_cond_t)));
+
+  err_t *err = lsim_cond_expr(&parse, 1);
+  if (err == ERR_OK) {
+    lsim_cond_skip_space(&parse);
+    if (*parse.cur != '\0') {
+      err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_COMMAND, "Condition '%s': unexpected '%s'", text, parse.cur);
+    }
+  }
+  if (err) {
+    lsim_cond_delete(parse.cond);
+    ERR_RETHROW(err, "Compiling condition '%s'", text);
+  }
+
+  *rtn_cond = parse.cond;
+  return ERR_OK;
+}  /* lsim_cond_compile */
+
+
+int lsim_cond_eval(lsim_t *lsim, lsim_cond_t *cond) {
+  uint64_t stack[LSIM_COND_MAX_DEPTH];
+  int top = -1;
+  cond->num_evals++;
+
+  int i;
+  for (i = 0; i < cond->num_ops; i++) {
+    lsim_cond_op_t *cond_op = &cond->ops[i];
+    uint64_t val;
+    int bit;
+    switch (cond_op->op) {
+    case LSIM_COND_OP_CONST: stack[++top] = cond_op->val; continue;
+    case LSIM_COND_OP_TICKLET: stack[++top] = (uint64_t)lsim->total_ticklets; continue;
+    case LSIM_COND_OP_SIGNAL:
+      val = 0;
+      for (bit = cond_op->num_bits - 1; bit >= 0; bit--) {
+        val = (val << 1) | (uint64_t)lsim_dev_out_state(lsim, cond->outs[cond_op->first_out + bit]);
+      }
+      stack[++top] = val;
+      continue;
+    case LSIM_COND_OP_NOT: stack[top] = ! stack[top]; continue;
+    case LSIM_COND_OP_BITNOT: stack[top] = ~stack[top]; continue;
+    }
+
+    /* Binary. */
+    uint64_t b = stack[top--];
+    uint64_t a = stack[top];
+    switch (cond_op->op) {
+    case LSIM_COND_OP_OR: a = a || b; break;
+    case LSIM_COND_OP_AND: a = a && b; break;
+    case LSIM_COND_OP_BITOR: a = a | b; break;
+    case LSIM_COND_OP_BITXOR: a = a ^ b; break;
+    case LSIM_COND_OP_BITAND: a = a & b; break;
+    case LSIM_COND_OP_EQ: a = a == b; break;
+    case LSIM_COND_OP_NE: a = a != b; break;
+    case LSIM_COND_OP_LE: a = a <= b; break;
+    case LSIM_COND_OP_GE: a = a >= b; break;
+    case LSIM_COND_OP_LT: a = a < b; break;
+    case LSIM_COND_OP_GT: a = a > b; break;
+    case LSIM_COND_OP_ADD: a = a + b; break;
+    case LSIM_COND_OP_SUB: a = a - b; break;
+    }
+    stack[top] = a;
+  }
+
+  return stack[0] != 0;
+}  /* lsim_cond_eval */
+
+
+/* Run ticklets until the condition is true after one (or max_ticklets
+ * have run). The nets it reads are marked in lsim->cond_nets, and
+ * lsim_dev_out_propagate() sets lsim->cond_dirty when one of them
+ * changes; the condition is evaluated after the first ticklet, then only
+ * after a ticklet that did that (or every ticklet, if it reads "ticklet"). */
+ERR_F lsim_cond_until(lsim_t *lsim, lsim_cond_t *cond, long max_ticklets, long *rtn_num_ticklets, int *rtn_met) {
+  ERR_ASSRT(lsim->power_on, LSIM_ERR_COMMAND);
+  ERR_ASSRT(lsim->cond_nets == NULL, LSIM_ERR_INTERNAL);
+
+  ERR(err_calloc((void **)&lsim->cond_nets, lsim->alloc_state_words, sizeof(uint64_t)));
+  long i;
+  for (i = 0; i < cond->num_outs; i++) {
+    lsim->cond_nets[LSIM_NET_WORD(cond->outs[i]->net_id)] |= LSIM_NET_MASK(cond->outs[i]->net_id);
+  }
+  lsim->cond_dirty = 1;  /* It may already be true, or read nets that never change. */
+
+  err_t *err = ERR_OK;
+  int met = 0;
+  long num_ticklets = 0;
+  while (num_ticklets < max_ticklets && ! met) {
+    err = lsim_dev_ticklet(lsim);
+    if (err) {
+      break;
+    }
+    num_ticklets++;
+    if (lsim->cond_dirty || cond->uses_ticklet) {
+      lsim->cond_dirty = 0;
+      met = lsim_cond_eval(lsim, cond);
+    }
+  }
+
+  free(lsim->cond_nets);
+  lsim->cond_nets = NULL;
+  if (err) {
+    ERR_RETHROW(err, "Ticklet %ld of until", num_ticklets);
+  }
+
+  *rtn_num_ticklets = num_ticklets;
+  *rtn_met = met;
+  return ERR_OK;
+}  /* lsim_cond_until */
+
+
+void lsim_cond_delete(lsim_cond_t *cond) {
+  if (cond) {
+    free(cond->ops);
+    free(cond->outs);
+    free(cond);
+  }
+}  /* lsim_cond_delete */
@@ -0,0 +1,76 @@
+/* lsim_cond.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_COND_H
+#define LSIM_COND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "err.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Deepest evaluation stack a condition may need. */
+#define LSIM_COND_MAX_DEPTH 32
+
+#define LSIM_COND_OP_CONST 1
+#define LSIM_COND_OP_TICKLET 2
+#define LSIM_COND_OP_SIGNAL 3  /* num_bits outs starting at first_out. */
+#define LSIM_COND_OP_NOT 4
+#define LSIM_COND_OP_BITNOT 5
+#define LSIM_COND_OP_OR 6
+#define LSIM_COND_OP_AND 7
+#define LSIM_COND_OP_BITOR 8
+#define LSIM_COND_OP_BITXOR 9
+#define LSIM_COND_OP_BITAND 10
+#define LSIM_COND_OP_EQ 11
+#define LSIM_COND_OP_NE 12
+#define LSIM_COND_OP_LE 13
+#define LSIM_COND_OP_GE 14
+#define LSIM_COND_OP_LT 15
+#define LSIM_COND_OP_GT 16
+#define LSIM_COND_OP_ADD 17
+#define LSIM_COND_OP_SUB 18
+
+typedef struct lsim_cond_op_s {
+  int op;  /* LSIM_COND_OP_xxx */
+  int num_bits;  /* SIGNAL */
+  long first_out;  /* SIGNAL: index into outs[]. */
+  uint64_t val;  /* CONST */
+} lsim_cond_op_t;
+
+/* A compiled condition: postfix ops over 64-bit values. */
+typedef struct lsim_cond_s {
+  lsim_cond_op_t *ops;
+  int num_ops;
+  int alloc_ops;
+  lsim_dev_out_terminal_t **outs;  /* Every net the condition reads. */
+  long num_outs;
+  long alloc_outs;
+  int uses_ticklet;  /* Then it's evaluated every ticklet. */
+  long num_evals;
+} lsim_cond_t;
+
+ERR_F lsim_cond_compile(lsim_t *lsim, const char *text, lsim_cond_t **rtn_cond);
+int lsim_cond_eval(lsim_t *lsim, lsim_cond_t *cond);
+ERR_F lsim_cond_until(lsim_t *lsim, lsim_cond_t *cond, long max_ticklets, long *rtn_num_ticklets, int *rtn_met);
+void lsim_cond_delete(lsim_cond_t *cond);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_COND_H
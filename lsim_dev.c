@@ -20,19 +20,125 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_state.h"
+#include "lsim_netlist.h"
+#include "lsim_vcd.h"
+#include "lsim_log.h"
+
+
+/* Carve a zeroed record out of the current chunk. Terminals (and the
+ * blocks built by lsim_devs_topo_create) are never freed individually;
+ * the chunks are released by lsim_delete. */
+ERR_F lsim_dev_chunk_alloc(lsim_t *lsim, size_t size, void **rtn_ptr) {
+  size = (size + 15) & ~(size_t)15;
+  ERR_ASSRT(size <= LSIM_TERMINAL_CHUNK_SIZE, LSIM_ERR_PARAM);
+  if (lsim->terminal_chunk == NULL || lsim->terminal_chunk_used + size > LSIM_TERMINAL_CHUNK_SIZE) {
+    ERR(lsim_bigalloc(lsim, LSIM_TERMINAL_CHUNK_SIZE, (void **)&lsim->terminal_chunk));
+    lsim->terminal_chunk_used = 0;
+  }
+
+  *rtn_ptr = &lsim->terminal_chunk[lsim->terminal_chunk_used];
+  lsim->terminal_chunk_used += size;
+
+  return ERR_OK;
+}  /* lsim_dev_chunk_alloc */
+
+
+/* Every device is created through this (once it's named), so that
+ * whole-netlist passes can walk lsim->dev_list instead of the name map. */
+ERR_F lsim_dev_register(lsim_t *lsim, lsim_dev_t *dev) {
+  if (lsim->num_devs == lsim->alloc_devs) {
+    long new_alloc = (lsim->alloc_devs == 0) ? 1024 : (lsim->alloc_devs * 2);
+    lsim_dev_t **new_list = realloc(lsim->dev_list, new_alloc * sizeof(lsim_dev_t *));
+    ERR_ASSRT(new_list, LSIM_ERR_NOMEM);
+    lsim->dev_list = new_list;
+    lsim->alloc_devs = new_alloc;
+  }
+
+  ERR(lsim_name_write(lsim, dev));
+  dev->index = lsim->num_devs;
+  lsim->dev_list[lsim->num_devs] = dev;
+  lsim->num_devs++;
+
+  return ERR_OK;
+}  /* lsim_dev_register */
+
+
+/* Terminals are created through these so that whole-netlist passes (like
+ * saving state or a netlist) can find every terminal without knowing device types. */
+ERR_F lsim_dev_out_terminal_create(lsim_t *lsim, lsim_dev_t *dev, lsim_dev_out_terminal_t **rtn_out_terminal) {
+  if (lsim->num_out_terminals == lsim->alloc_out_terminals) {
+    long new_alloc = (lsim->alloc_out_terminals == 0) ? 1024 : (lsim->alloc_out_terminals * 2);
+    lsim_dev_out_terminal_t **new_out_terminals = realloc(lsim->out_terminals, new_alloc * sizeof(lsim_dev_out_terminal_t *));
+    ERR_ASSRT(new_out_terminals, LSIM_ERR_NOMEM);
+    lsim->out_terminals = new_out_terminals;
+    lsim->alloc_out_terminals = new_alloc;
+
+    /* One state bit per possible net, plus net 0 (floating). */
+    long new_words = (new_alloc + 1 + 63) / 64;
+    uint64_t *new_out_states = realloc(lsim->out_states, new_words * sizeof(uint64_t));
+    ERR_ASSRT(new_out_states, LSIM_ERR_NOMEM);
+    lsim->out_states = new_out_states;
+    uint64_t *new_net_states = realloc(lsim->net_states, new_words * sizeof(uint64_t));
+    ERR_ASSRT(new_net_states, LSIM_ERR_NOMEM);
+    lsim->net_states = new_net_states;
+    memset(&lsim->out_states[lsim->alloc_state_words], 0, (new_words - lsim->alloc_state_words) * sizeof(uint64_t));
+    memset(&lsim->net_states[lsim->alloc_state_words], 0, (new_words - lsim->alloc_state_words) * sizeof(uint64_t));
+    lsim->alloc_state_words = new_words;
+  }
+
+  lsim_dev_out_terminal_t *out_terminal;
+  ERR(lsim_dev_chunk_alloc(lsim, sizeof(lsim_dev_out_terminal_t), (void **)&out_terminal));
+  out_terminal->dev = dev;
+
+  lsim->out_terminals[lsim->num_out_terminals] = out_terminal;
+  lsim->num_out_terminals++;
+  out_terminal->net_id = lsim->num_out_terminals;  /* Registry position + 1. */
+
+  *rtn_out_terminal = out_terminal;
+  return ERR_OK;
+}  /* lsim_dev_out_terminal_create */
+
+
+ERR_F lsim_dev_in_terminal_create(lsim_t *lsim, lsim_dev_t *dev, lsim_dev_in_terminal_t **rtn_in_terminal) {
+  if (lsim->num_in_terminals == lsim->alloc_in_terminals) {
+    long new_alloc = (lsim->alloc_in_terminals == 0) ? 1024 : (lsim->alloc_in_terminals * 2);
+    lsim_dev_in_terminal_t **new_in_terminals = realloc(lsim->in_terminals, new_alloc * sizeof(lsim_dev_in_terminal_t *));
+    ERR_ASSRT(new_in_terminals, LSIM_ERR_NOMEM);
+    lsim->in_terminals = new_in_terminals;
+    lsim->alloc_in_terminals = new_alloc;
+  }
+
+  lsim_dev_in_terminal_t *in_terminal;
+  ERR(lsim_dev_chunk_alloc(lsim, sizeof(lsim_dev_in_terminal_t), (void **)&in_terminal));
+  in_terminal->dev = dev;
+
+  lsim->in_terminals[lsim->num_in_terminals] = in_terminal;
+  in_terminal->serial = lsim->num_in_terminals;
+  lsim->num_in_terminals++;
+
+  *rtn_in_terminal = in_terminal;
+  return ERR_OK;
+}  /* lsim_dev_in_terminal_create */
 
 
 ERR_F lsim_dev_in_chain_add(lsim_dev_in_terminal_t **head, lsim_dev_in_terminal_t *in_terminal, lsim_dev_out_terminal_t *driving_out_terminal) {
   ERR_ASSRT(in_terminal, LSIM_ERR_INTERNAL);
 
+  /* Composite devices build input chains with no driver (net 0). */
+  long net_id = (driving_out_terminal) ? driving_out_terminal->net_id : 0;
+
   /* Assume in_terminal is a sub-chain. Find its tail.
    * Update driving_out_terminal as we go. */
   lsim_dev_in_terminal_t *in_tail = in_terminal;
   while (in_tail->next_in_terminal) {
     in_tail->driving_out_terminal = driving_out_terminal;
+    in_tail->net_id = net_id;
     in_tail = in_tail->next_in_terminal;
   }
   in_tail->driving_out_terminal = driving_out_terminal;
+  in_tail->net_id = net_id;
 
   /* Insert chain at head. */
   in_tail->next_in_terminal = *head;
@@ -42,6 +148,35 @@ ERR_F lsim_dev_in_chain_add(lsim_dev_in_terminal_t **head, lsim_dev_in_terminal_
 }  /* lsim_dev_in_chain_add */
 
 
+/* If the output's driven value differs from what its net last carried,
+ * update the net and trigger every device on its fanout chain. */
+ERR_F lsim_dev_out_propagate(lsim_t *lsim, lsim_dev_out_terminal_t *out_terminal) {
+  long word = LSIM_NET_WORD(out_terminal->net_id);
+  uint64_t diff = (lsim->out_states[word] ^ lsim->net_states[word]) & LSIM_NET_MASK(out_terminal->net_id);
+
+  if (diff) {
+    lsim->net_states[word] ^= diff;
+    if (lsim->cond_nets && (lsim->cond_nets[word] & diff)) {
+      lsim->cond_dirty = 1;  /* See lsim_cond_until(). */
+    }
+    if (lsim->vcd) {
+      ERR(lsim_vcd_change(lsim, out_terminal->net_id, (lsim->net_states[word] & diff) != 0));
+    }
+    LSIM_STATS_INC(out_terminal->dev, toggles);
+    lsim_dev_in_terminal_t *dst_in_terminal = out_terminal->in_terminal_list;
+    while (dst_in_terminal) {
+      LSIM_STATS_INC(out_terminal->dev, fanout);
+      ERR(lsim_dev_in_changed(lsim, dst_in_terminal->dev));
+
+      /* Propagate output to next connected device. */
+      dst_in_terminal = dst_in_terminal->next_in_terminal;
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_dev_out_propagate */
+
+
 ERR_F lsim_dev_out_changed(lsim_t *lsim, lsim_dev_t *dev) {
   /* If not already on the output changed list, add it. */
   if (! dev->out_changed) {
@@ -66,11 +201,30 @@ ERR_F lsim_dev_in_changed(lsim_t *lsim, lsim_dev_t *dev) {
 }  /* lsim_dev_in_changed */
 
 
+/* Empty the changed lists without running anything. */
+ERR_F lsim_dev_unschedule_all(lsim_t *lsim) {
+  while (lsim->in_changed_list) {
+    lsim_dev_t *cur_dev = lsim->in_changed_list;
+    lsim->in_changed_list = cur_dev->next_in_changed;
+    cur_dev->next_in_changed = NULL;
+    cur_dev->in_changed = 0;
+  }
+  while (lsim->out_changed_list) {
+    lsim_dev_t *cur_dev = lsim->out_changed_list;
+    lsim->out_changed_list = cur_dev->next_out_changed;
+    cur_dev->next_out_changed = NULL;
+    cur_dev->out_changed = 0;
+  }
+
+  return ERR_OK;
+}  /* lsim_dev_unschedule_all */
+
+
 ERR_F lsim_dev_connect(lsim_t *lsim, const char *src_dev_name, const char *src_out_id, const char *dst_dev_name, const char *dst_in_id, int bit_offset) {
   lsim_dev_t *src_dev;
-  ERR(hmap_slookup(lsim->devs, src_dev_name, (void**)&src_dev));
+  ERR(lsim_name_lookup(lsim, src_dev_name, &src_dev));
   lsim_dev_t *dst_dev;
-  ERR(hmap_slookup(lsim->devs, dst_dev_name, (void**)&dst_dev));
+  ERR(lsim_name_lookup(lsim, dst_dev_name, &dst_dev));
 
   lsim_dev_out_terminal_t *src_out_terminal;
   ERR(src_dev->get_out_terminal(lsim, src_dev, src_out_id, &src_out_terminal, bit_offset));
@@ -80,11 +234,26 @@ ERR_F lsim_dev_connect(lsim_t *lsim, const char *src_dev_name, const char *src_o
   /* Can't have two outputs driving the same input. */
   if (dst_in_terminal->driving_out_terminal != NULL) {
     ERR_THROW(LSIM_ERR_COMMAND, "Can't connect %s;%s to %s;%s, it's already connected to %s",
-              src_dev->name, src_out_id, dst_dev->name, dst_in_id, dst_in_terminal->driving_out_terminal->dev->name);
+              lsim_name_str(lsim, src_dev->name), src_out_id, lsim_name_str(lsim, dst_dev->name), dst_in_id, lsim_name_str(lsim, dst_in_terminal->driving_out_terminal->dev->name));
   }
   /* Make sure two outputs aren't driving the same input. */
   ERR_ASSRT(dst_in_terminal->driving_out_terminal == NULL, LSIM_ERR_COMMAND);
 
+  /* Composite devices' internal wiring is rebuilt by their create. A module
+   * instance is flattened in the recording, so its whole input chain is
+   * recorded (before the chain add relinks it). */
+  if (lsim->netlist_rec && lsim->creating == 0) {
+    if (dst_dev->type == LSIM_DEV_TYPE_MODULE) {
+      lsim_dev_in_terminal_t *member;
+      for (member = dst_in_terminal; member; member = member->next_in_terminal) {
+        ERR(lsim_netlist_record_conn(lsim, src_out_terminal, member));
+      }
+    }
+    else {
+      ERR(lsim_netlist_record_conn(lsim, src_out_terminal, dst_in_terminal));
+    }
+  }
+
   /* This input might be the head of a chain of inputs that need to be connected to this output. */
   ERR(lsim_dev_in_chain_add(&src_out_terminal->in_terminal_list, dst_in_terminal, src_out_terminal));
 
@@ -95,20 +264,24 @@ ERR_F lsim_dev_connect(lsim_t *lsim, const char *src_dev_name, const char *src_o
 ERR_F lsim_dev_delete(lsim_t *lsim, lsim_dev_t *dev) {
   ERR(dev->delete(lsim, dev));
 
+  /* Names are freed with their chunks (see lsim_delete). */
+  if (! dev->in_chunk) {
+    free(dev);
+  }
+
   return ERR_OK;
 }  /* lsim_dev_delete */
 
 
 ERR_F lsim_dev_delete_all(lsim_t *lsim) {
-  /* Loop through entire hash map, starting with first entry. */
-  hmap_entry_t *dev_entry = NULL;
-  do {
-    ERR(hmap_next(lsim->devs, &dev_entry));
-    if (dev_entry) {
-      lsim_dev_t *dev = dev_entry->value;
-      ERR(lsim_dev_delete(lsim, dev));
-    }
-  } while (dev_entry);
+  long i;
+  for (i = 0; i < lsim->num_devs; i++) {
+    ERR(lsim_dev_delete(lsim, lsim->dev_list[i]));
+  }
+  free(lsim->dev_list);
+  lsim->dev_list = NULL;
+  lsim->num_devs = 0;
+  lsim->alloc_devs = 0;
 
   return ERR_OK;
 }  /* lsim_dev_delete_all */
@@ -121,6 +294,7 @@ ERR_F lsim_dev_run_logic(lsim_t *lsim) {
   /* This loop visits every device on the "in_changed_list". Note that the
    * "run_logic" function does not add devices to that list (it adds
    * them to "out_changed_list"). So this can't loop infinitely. */
+  long num_runs = 0;
   while (lsim->in_changed_list) {
     /* Remove from input changed list. */
     lsim_dev_t *cur_dev = lsim->in_changed_list;
@@ -129,7 +303,15 @@ ERR_F lsim_dev_run_logic(lsim_t *lsim) {
     cur_dev->in_changed = 0;
 
     ERR(cur_dev->run_logic(lsim, cur_dev));
+    LSIM_STATS_INC(cur_dev, run_logic);
+#ifdef LSIM_STATS
+    if (! cur_dev->out_changed) {
+      LSIM_STATS_INC(cur_dev, no_change);
+    }
+#endif
+    num_runs++;
   }  /* while in_changed_list */
+  lsim->step_runs += num_runs;
 
   return ERR_OK;
 }  /* lsim_dev_run_logic */
@@ -159,53 +341,85 @@ ERR_F lsim_dev_engine_run(lsim_t *lsim) {
   if (! lsim->power_on) {
     return ERR_OK;
   }
-  long max_propagate_cycles;
-  ERR(cfg_get_long_val(lsim->cfg, "max_propagate_cycles", &max_propagate_cycles));
-  ERR_ASSRT(max_propagate_cycles > 0, LSIM_ERR_CONFIG);
-
   lsim->cur_step++;
-  if (lsim->verbosity_map & LSIM_VERBOSITY_MAP_STEP) {
-    printf(" Step %ld:\n", lsim->cur_step);
+  if ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_STEP) && ! lsim->replaying) {
+    lsim_log(lsim, LSIM_LOG_STEP, NULL, 0, lsim->cur_step);
+  }
+
+  if (lsim->step_stats) {
+    lsim_stats_step_begin(lsim);
   }
 
   lsim->cur_cycle = 0;
+  lsim->step_runs = 0;
   /* Loop while the logic states are still stabilizing. Note that this can
    * loop infinitely (e.g. a NAND oscillator), so the "max_propagate_cycles"
    * configuration parameter limits the loop count. */
   while (lsim->in_changed_list) {
     lsim->cur_cycle++;
-    if (lsim->verbosity_map & LSIM_VERBOSITY_MAP_CYCLE) {
-      printf("  Cycle %ld:\n", lsim->cur_cycle);
+    if ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_CYCLE) && ! lsim->replaying) {
+      lsim_log(lsim, LSIM_LOG_CYCLE, NULL, 0, lsim->cur_cycle);
     }
     /* Prevent infinite loops. */
-    ERR_ASSRT(lsim->cur_cycle <= max_propagate_cycles, LSIM_ERR_MAXLOOPS);
+    ERR_ASSRT(lsim->cur_cycle <= lsim->max_propagate_cycles, LSIM_ERR_MAXLOOPS);
 
     ERR(lsim_dev_run_logic(lsim));
     ERR(lsim_dev_propagate_outputs(lsim));
   }
 
+  if (lsim->step_stats) {
+    lsim_stats_step_end(lsim);
+  }
+
   return ERR_OK;
 }  /* lsim_dev_engine_run */
 
 
 ERR_F lsim_dev_power(lsim_t *lsim) {
+  /* Read once here, not on every engine run. */
+  ERR(cfg_get_long_val(lsim->cfg, "max_propagate_cycles", &lsim->max_propagate_cycles));
+  ERR_ASSRT(lsim->max_propagate_cycles > 0, LSIM_ERR_CONFIG);
+  long async_output;
+  ERR(cfg_get_long_val(lsim->cfg, "async_output", &async_output));
+  ERR_ASSRT(async_output >= LSIM_LOG_DIRECT && async_output <= LSIM_LOG_DROP, LSIM_ERR_CONFIG);
+  if (async_output != LSIM_LOG_DIRECT && lsim->log == NULL) {
+    ERR(lsim_log_start(lsim, (int)async_output));
+  }
+  long step_stats;
+  ERR(cfg_get_long_val(lsim->cfg, "step_stats", &step_stats));
+  if (step_stats) {
+    ERR(lsim_stats_step_init(lsim));
+  }
   lsim->power_on = 1;
   lsim->cur_ticklet = -1;
+  lsim->total_ticklets = 0;
   lsim->cur_step = -1;
 
-  /* Loop through entire hash map, starting with first entry. */
-  hmap_entry_t *dev_entry = NULL;
-  do {
-    ERR(hmap_next(lsim->devs, &dev_entry));
-    if (dev_entry) {
-      lsim_dev_t *cur_dev = dev_entry->value;
-      ERR_ASSRT(cur_dev->next_out_changed == NULL, LSIM_ERR_INTERNAL);
-      ERR_ASSRT(cur_dev->next_in_changed == NULL, LSIM_ERR_INTERNAL);
-      ERR(cur_dev->power(lsim, cur_dev));
-    }
-  } while (dev_entry);
+  /* All nets start at 0; the devices' power functions only need to
+   * trigger themselves. */
+  if (lsim->alloc_state_words > 0) {
+    memset(lsim->out_states, 0, lsim->alloc_state_words * sizeof(uint64_t));
+    memset(lsim->net_states, 0, lsim->alloc_state_words * sizeof(uint64_t));
+  }
 
-  ERR(lsim_dev_engine_run(lsim));
+  /* Power in reverse so that the in_changed list (which is pushed at the
+   * head) comes out in creation order. */
+  long i;
+  for (i = lsim->num_devs - 1; i >= 0; i--) {
+    lsim_dev_t *cur_dev = lsim->dev_list[i];
+    ERR_ASSRT(cur_dev->next_out_changed == NULL, LSIM_ERR_INTERNAL);
+    ERR_ASSRT(cur_dev->next_in_changed == NULL, LSIM_ERR_INTERNAL);
+    ERR(cur_dev->power(lsim, cur_dev));
+  }
+
+  int cached;
+  ERR(lsim_state_power_cache_load(lsim, &cached));
+  if (! cached) {
+    ERR(lsim_dev_engine_run(lsim));
+    ERR(lsim_state_power_cache_store(lsim));
+  }
+
+  ERR(lsim_state_history_reset(lsim));  /* Base snapshot for "back". */
 
   return ERR_OK;
 }  /* lsim_dev_power */
@@ -213,7 +427,7 @@ ERR_F lsim_dev_power(lsim_t *lsim) {
 
 ERR_F lsim_dev_loadmem(lsim_t *lsim, const char *dev_name, long addr, int num_words, uint64_t *words) {
   lsim_dev_t *dev;
-  ERR(hmap_slookup(lsim->devs, dev_name, (void**)&dev));
+  ERR(lsim_name_lookup(lsim, dev_name, &dev));
 
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MEM, LSIM_ERR_COMMAND);
 
@@ -222,13 +436,15 @@ ERR_F lsim_dev_loadmem(lsim_t *lsim, const char *dev_name, long addr, int num_wo
     dev->mem.words[addr + i] = words[i];
   }
 
+  ERR(lsim_state_history_event(lsim, LSIM_EVENT_LOADMEM, dev_name, 0, addr, num_words, words));
+
   return ERR_OK;
 }  /* lsim_dev_loadmem */
 
 
 ERR_F lsim_dev_move(lsim_t *lsim, const char *dev_name, long new_state) {
   lsim_dev_t *dev;
-  ERR(hmap_slookup(lsim->devs, dev_name, (void**)&dev));
+  ERR(lsim_name_lookup(lsim, dev_name, &dev));
 
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_SWTCH, LSIM_ERR_COMMAND);
 
@@ -237,34 +453,79 @@ ERR_F lsim_dev_move(lsim_t *lsim, const char *dev_name, long new_state) {
     ERR(lsim_dev_in_changed(lsim, dev));  /* Trigger to run the logic. */
   }
 
+  ERR(lsim_state_history_event(lsim, LSIM_EVENT_MOVE, dev_name, new_state, 0, 0, NULL));
+
   ERR(lsim_dev_engine_run(lsim));
 
   return ERR_OK;
 }  /* lsim_dev_move */
 
 
+/* Set a switch without running the logic, so that several can change
+ * together before lsim_dev_settle(). Both are recorded for "back", which
+ * replays them the same way. */
+ERR_F lsim_dev_poke(lsim_t *lsim, lsim_dev_t *dev, int new_state) {
+  ERR_ASSRT(dev->type == LSIM_DEV_TYPE_SWTCH, LSIM_ERR_COMMAND);
+
+  if (dev->swtch.swtch_state != new_state) {
+    dev->swtch.swtch_state = new_state;
+    ERR(lsim_dev_in_changed(lsim, dev));  /* Trigger to run the logic. */
+  }
+
+  if (lsim->snapshot_interval > 0 && ! lsim->replaying) {  /* Don't build the name otherwise. */
+    ERR(lsim_state_history_event(lsim, LSIM_EVENT_POKE, lsim_name_str(lsim, dev->name), new_state, 0, 0, NULL));
+  }
+
+  return ERR_OK;
+}  /* lsim_dev_poke */
+
+
+ERR_F lsim_dev_settle(lsim_t *lsim) {
+  ERR(lsim_state_history_event(lsim, LSIM_EVENT_SETTLE, "", 0, 0, 0, NULL));
+
+  ERR(lsim_dev_engine_run(lsim));
+
+  return ERR_OK;
+}  /* lsim_dev_settle */
+
+
 ERR_F lsim_dev_ticklet(lsim_t *lsim) {
-  long max_propagate_cycles;
-  ERR(cfg_get_long_val(lsim->cfg, "max_propagate_cycles", &max_propagate_cycles));
-  ERR_ASSRT(max_propagate_cycles > 0, LSIM_ERR_CONFIG);
   ERR_ASSRT(lsim->active_clk_dev, LSIM_ERR_COMMAND);
 
   lsim->cur_ticklet++;
-  if (lsim->verbosity_map & LSIM_VERBOSITY_MAP_TICKLET) {
-    printf(" Ticklet %ld\n", lsim->cur_ticklet);
+  if ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_TICKLET) && ! lsim->replaying) {
+    lsim_log(lsim, LSIM_LOG_TICKLET, NULL, 0, lsim->cur_ticklet);
   }
 
   ERR(lsim_dev_in_changed(lsim, lsim->active_clk_dev));
 
   ERR(lsim_dev_engine_run(lsim));
 
+  ERR(lsim_state_history_ticklet(lsim));
+
   return ERR_OK;
 }  /* lsim_dev_ticklet */
 
 
+/* "dev_name" can be a pattern (see lsim_name_match). */
 ERR_F lsim_dev_watch(lsim_t *lsim, const char *dev_name, int watch_level) {
+  if (lsim_name_is_pattern(dev_name)) {
+    lsim_dev_t **devs;
+    long num_devs;
+    ERR(lsim_name_match(lsim, dev_name, &devs, &num_devs));
+    if (num_devs == 0) {
+      ERR_THROW(HMAP_ERR_NOTFOUND, "No device matches '%s'", dev_name);
+    }
+    long i;
+    for (i = 0; i < num_devs; i++) {
+      devs[i]->watch_level = watch_level;
+    }
+    free(devs);
+    return ERR_OK;
+  }
+
   lsim_dev_t *dev;
-  ERR(hmap_slookup(lsim->devs, dev_name, (void**)&dev));
+  ERR(lsim_name_lookup(lsim, dev_name, &dev));
 
   dev->watch_level = watch_level;
 
@@ -14,6 +14,7 @@
 #define LSIM_DEV_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "err.h"
 #include "hmap.h"
 
@@ -33,30 +34,36 @@ typedef struct lsim_dev_in_terminal_s lsim_dev_in_terminal_t;
 struct lsim_dev_out_terminal_s {
   lsim_dev_t *dev;
   lsim_dev_in_terminal_t *in_terminal_list;
-  char id_prefix;
-  int id_index;
-  int state;  /* 0 or 1 */
+  long net_id;  /* Bit index into lsim->out_states/net_states; index into lsim->out_terminals + 1. */
 };
 
 struct lsim_dev_in_terminal_s {
   lsim_dev_t *dev;
   lsim_dev_in_terminal_t *next_in_terminal;
   lsim_dev_out_terminal_t *driving_out_terminal;
-  char id_prefix;
-  int id_index;
-  int state;  /* 0 or 1 */
+  long net_id;  /* Copy of driving_out_terminal->net_id (0 if floating). */
+  long serial;  /* Creation order (index into lsim->in_terminals). */
 };
 
 
+ERR_F lsim_dev_chunk_alloc(lsim_t *lsim, size_t size, void **rtn_ptr);
+ERR_F lsim_dev_register(lsim_t *lsim, lsim_dev_t *dev);
+ERR_F lsim_dev_out_terminal_create(lsim_t *lsim, lsim_dev_t *dev, lsim_dev_out_terminal_t **rtn_out_terminal);
+ERR_F lsim_dev_in_terminal_create(lsim_t *lsim, lsim_dev_t *dev, lsim_dev_in_terminal_t **rtn_in_terminal);
 ERR_F lsim_dev_in_chain_add(lsim_dev_in_terminal_t **head, lsim_dev_in_terminal_t *in_terminal, lsim_dev_out_terminal_t *driving_out_terminal);
+ERR_F lsim_dev_out_propagate(lsim_t *lsim, lsim_dev_out_terminal_t *out_terminal);
 ERR_F lsim_dev_out_changed(lsim_t *lsim, lsim_dev_t *dev);
 ERR_F lsim_dev_in_changed(lsim_t *lsim, lsim_dev_t *dev);
+ERR_F lsim_dev_unschedule_all(lsim_t *lsim);
 ERR_F lsim_dev_connect(lsim_t *lsim, const char *src_dev_name, const char *src_out_id, const char *dst_dev_name, const char *dst_in_id, int bit_offset);
 ERR_F lsim_dev_power(lsim_t *lsim);
 ERR_F lsim_dev_loadmem(lsim_t *lsim, const char *name, long addr, int num_words, uint64_t *words);
 ERR_F lsim_dev_move(lsim_t *lsim, const char *name, long new_state);
+ERR_F lsim_dev_poke(lsim_t *lsim, lsim_dev_t *dev, int new_state);
+ERR_F lsim_dev_settle(lsim_t *lsim);
 ERR_F lsim_dev_run_logic(lsim_t *lsim);
 ERR_F lsim_dev_propagate_outputs(lsim_t *lsim);
+ERR_F lsim_dev_engine_run(lsim_t *lsim);
 ERR_F lsim_dev_watch(lsim_t *lsim, const char *dev_name, int watch_level);
 ERR_F lsim_dev_ticklet(lsim_t *lsim);
 ERR_F lsim_dev_delete_all(lsim_t *lsim);
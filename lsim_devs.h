@@ -15,7 +15,9 @@
 
 #include "err.h"
 #include "hmap.h"
+#include "lsim.h"
 #include "lsim_dev.h"
+#include "lsim_stats.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +37,7 @@ extern "C" {
 #define LSIM_DEV_TYPE_PANEL 12
 #define LSIM_DEV_TYPE_ADDBIT 13
 #define LSIM_DEV_TYPE_ADDWORD 14
+#define LSIM_DEV_TYPE_MODULE 15
 
 
 /* Forward declarations. */
@@ -52,6 +55,7 @@ typedef struct lsim_dev_reg_s lsim_dev_reg_t;
 typedef struct lsim_dev_panel_s lsim_dev_panel_t;
 typedef struct lsim_dev_addbit_s lsim_dev_addbit_t;
 typedef struct lsim_dev_addword_s lsim_dev_addword_t;
+typedef struct lsim_dev_module_s lsim_dev_module_t;
 
 typedef struct lsim_dev_s lsim_dev_t;
 
@@ -159,15 +163,26 @@ struct lsim_dev_addword_s {
   lsim_dev_in_terminal_t *i_terminal;    /* Carry in */
 };
 
+struct lsim_dev_module_s {
+  lsim_module_t *module;  /* See lsim_module.h. */
+  lsim_dev_out_terminal_t **out_terminals;  /* Allocated array, per out port. */
+  lsim_dev_in_terminal_t **in_terminals;  /* Allocated array of chain heads, per in port. */
+};
+
 
 struct lsim_dev_s {
-  char *name;
+  lsim_name_t *name;  /* Use lsim_name_str() to print. */
   int out_changed;
   int in_changed;
   lsim_dev_t *next_out_changed;
   lsim_dev_t *next_in_changed;
   int type;  /* DEV_TYPE_... */
   int watch_level;  /* 0=none, 1=output change, 2=always print. */
+  long index;  /* Position in lsim->dev_list (creation order). */
+  int in_chunk;  /* Set if carved from a terminal chunk (see lsim_devs_topo.c). */
+#ifdef LSIM_STATS
+  lsim_dev_stats_t stats;
+#endif
   union {
     lsim_dev_probe_t probe;
     lsim_dev_gnd_t gnd;
@@ -183,6 +198,7 @@ struct lsim_dev_s {
     lsim_dev_panel_t panel;
     lsim_dev_addbit_t addbit;
     lsim_dev_addword_t addword;
+    lsim_dev_module_t module;
   };
   /* Type-specific methods (inheritance). */
   ERR_F (*get_out_terminal)(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset);
@@ -194,6 +210,68 @@ struct lsim_dev_s {
 };
 
 
+/* Net state is bit-packed, one bit per output terminal, indexed by the
+ * terminal's net_id. An input terminal has no state of its own; it reads
+ * the net_states bit of its driver. Net 0 is never driven, so a floating
+ * input reads as 0. */
+#define LSIM_NET_WORD(net_id) ((net_id) >> 6)
+#define LSIM_NET_MASK(net_id) ((uint64_t)1 << ((net_id) & 63))
+
+static inline int lsim_dev_out_state(lsim_t *lsim, lsim_dev_out_terminal_t *out_terminal) {
+  return (lsim->out_states[LSIM_NET_WORD(out_terminal->net_id)] & LSIM_NET_MASK(out_terminal->net_id)) != 0;
+}
+
+static inline void lsim_dev_out_set(lsim_t *lsim, lsim_dev_out_terminal_t *out_terminal, int state) {
+  if (state) {
+    lsim->out_states[LSIM_NET_WORD(out_terminal->net_id)] |= LSIM_NET_MASK(out_terminal->net_id);
+  } else {
+    lsim->out_states[LSIM_NET_WORD(out_terminal->net_id)] &= ~LSIM_NET_MASK(out_terminal->net_id);
+  }
+}
+
+static inline int lsim_dev_in_state(lsim_t *lsim, lsim_dev_in_terminal_t *in_terminal) {
+  return (lsim->net_states[LSIM_NET_WORD(in_terminal->net_id)] & LSIM_NET_MASK(in_terminal->net_id)) != 0;
+}
+
+
+/* Wiring of a composite device built from nands. One static table per
+ * device type is shared by every instance (see lsim_devs_topo.c). */
+typedef struct lsim_devs_topo_nand_s {
+  const char *suffix;  /* Sub-device is named "<instance>.<suffix>". */
+  int num_inputs;
+} lsim_devs_topo_nand_t;
+
+typedef struct lsim_devs_topo_wire_s {
+  int src_nand;  /* This nand's o0 ... */
+  int dst_nand;  /* ... drives this nand's i<dst_input>. */
+  int dst_input;
+} lsim_devs_topo_wire_t;
+
+typedef struct lsim_devs_topo_port_s {
+  size_t offset;  /* offsetof(lsim_dev_t, <type>.<x>_terminal). */
+  int nand;
+  int input;  /* In-port chain member; unused for out-ports. */
+} lsim_devs_topo_port_t;
+
+typedef struct lsim_devs_topo_s {
+  int num_nands;
+  const lsim_devs_topo_nand_t *nands;
+  int num_wires;
+  const lsim_devs_topo_wire_t *wires;
+  int num_outs;
+  const lsim_devs_topo_port_t *outs;
+  int num_ins;  /* In-port chain members, in chain-add order. */
+  const lsim_devs_topo_port_t *ins;
+  /* The composite's methods (see lsim_dev_s). */
+  ERR_F (*get_out_terminal)(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset);
+  ERR_F (*get_in_terminal)(lsim_t *lsim, lsim_dev_t *dev, const char *in_id, lsim_dev_in_terminal_t **in_terminal, int bit_offset);
+  ERR_F (*power)(lsim_t *lsim, lsim_dev_t *dev);
+  ERR_F (*run_logic)(lsim_t *lsim, lsim_dev_t *dev);
+  ERR_F (*propagate_outputs)(lsim_t *lsim, lsim_dev_t *dev);
+  ERR_F (*delete)(lsim_t *lsim, lsim_dev_t *dev);
+} lsim_devs_topo_t;
+
+
 ERR_F lsim_devs_probe_create(lsim_t *lsim, char *name, long flags);
 ERR_F lsim_devs_gnd_create(lsim_t *lsim, char *name);
 ERR_F lsim_devs_vcc_create(lsim_t *lsim, char *name);
@@ -201,6 +279,7 @@ ERR_F lsim_devs_swtch_create(lsim_t *lsim, char *name, int init_state);
 ERR_F lsim_devs_clk_create(lsim_t *lsim, char *name);
 ERR_F lsim_devs_led_create(lsim_t *lsim, char *name);
 ERR_F lsim_devs_nand_create(lsim_t *lsim, char *name, long num_inputs);
+ERR_F lsim_devs_nand_init(lsim_t *lsim, lsim_dev_t *dev, long num_inputs, lsim_dev_in_terminal_t **i_terminals);
 ERR_F lsim_devs_mem_create(lsim_t *lsim, char *dev_name, long num_addr, long num_data);
 ERR_F lsim_devs_srlatch_create(lsim_t *lsim, char *name);
 ERR_F lsim_devs_dflipflop_create(lsim_t *lsim, char *name);
@@ -208,6 +287,8 @@ ERR_F lsim_devs_reg_create(lsim_t *lsim, char *name, long num_bits);
 ERR_F lsim_devs_panel_create(lsim_t *lsim, char *name, long num_bits);
 ERR_F lsim_devs_addbit_create(lsim_t *lsim, char *name);
 ERR_F lsim_devs_addword_create(lsim_t *lsim, char *name, long num_bits);
+ERR_F lsim_devs_topo_create(lsim_t *lsim, const lsim_devs_topo_t *topo, char *name, int type, lsim_dev_t **rtn_dev);
+ERR_F lsim_devs_module_create(lsim_t *lsim, char *name, lsim_module_t *module);
 
 #ifdef __cplusplus
 }
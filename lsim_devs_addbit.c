@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <ctype.h>
 #include "err.h"
 #include "hmap.h"
@@ -94,8 +95,8 @@ ERR_F lsim_devs_addbit_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_ADDBIT, LSIM_ERR_INTERNAL);
 
-  free(dev->name);
-  free(dev);
+  /* This is a composite device. The underlying devices will be
+   * deleted on their own. Nothing to be done here. */
 
   return ERR_OK;
 }  /* lsim_devs_addbit_delete */
@@ -103,117 +104,59 @@ ERR_F lsim_devs_addbit_delete(lsim_t *lsim, lsim_dev_t *dev) {
 
 /* The addbit is a bit complex. Refer to the schematic:
  * https://raw.githubusercontent.com/fordsfords/lsim/refs/heads/main/addbit.svg */
-ERR_F lsim_devs_addbit_create(lsim_t *lsim, char *dev_name) {
-  /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+/* Shared by every addbit instance (see lsim_devs_topo.c). */
+lsim_devs_topo_nand_t lsim_devs_addbit_nands[] = {
+  {"nand_1", 2},  /* 0 */
+  {"nand_2", 2},  /* 1 */
+  {"nand_3", 2},  /* 2 */
+  {"nand_4", 2},  /* 3 */
+  {"nand_5", 2},  /* 4 */
+  {"nand_6", 2},  /* 5 */
+  {"nand_7", 2},  /* 6 */
+  {"nand_s", 2},  /* 7 */
+  {"nand_o", 2},  /* 8 */
+};
+lsim_devs_topo_wire_t lsim_devs_addbit_wires[] = {
+  {0, 1, 1},  /* 1 -> 2.i1 */
+  {0, 2, 0},  /* 1 -> 3.i0 */
+  {0, 8, 1},  /* 1 -> o.i1 */
+
+  {1, 3, 0},  /* 2 -> 4.i0 */
+  {2, 3, 1},  /* 3 -> 4.i1 */
+
+  {3, 4, 0},  /* 4 -> 5.i0 */
+  {3, 5, 0},  /* 4 -> 6.i0 */
+
+  {4, 5, 1},  /* 5 -> 6.i1 */
+  {4, 6, 0},  /* 5 -> 7.i0 */
+  {4, 8, 0},  /* 5 -> o.i0 */
+
+  {5, 7, 0},  /* 6 -> s.i0 */
+  {6, 7, 1},  /* 7 -> s.i1 */
+};
+lsim_devs_topo_port_t lsim_devs_addbit_outs[] = {
+  {offsetof(lsim_dev_t, addbit.s_terminal), 7, 0},
+  {offsetof(lsim_dev_t, addbit.o_terminal), 8, 0},
+};
+lsim_devs_topo_port_t lsim_devs_addbit_ins[] = {
+  {offsetof(lsim_dev_t, addbit.a_terminal), 0, 0},
+  {offsetof(lsim_dev_t, addbit.a_terminal), 1, 0},
+  {offsetof(lsim_dev_t, addbit.b_terminal), 0, 1},
+  {offsetof(lsim_dev_t, addbit.b_terminal), 2, 1},
+  {offsetof(lsim_dev_t, addbit.i_terminal), 4, 1},
+  {offsetof(lsim_dev_t, addbit.i_terminal), 6, 1},
+};
+lsim_devs_topo_t lsim_devs_addbit_topo = {
+  9, lsim_devs_addbit_nands, 12, lsim_devs_addbit_wires,
+  2, lsim_devs_addbit_outs, 6, lsim_devs_addbit_ins,
+  lsim_devs_addbit_get_out_terminal, lsim_devs_addbit_get_in_terminal, lsim_devs_addbit_power,
+  lsim_devs_addbit_run_logic, lsim_devs_addbit_propagate_outputs, lsim_devs_addbit_delete
+};
 
+
+ERR_F lsim_devs_addbit_create(lsim_t *lsim, char *dev_name) {
   lsim_dev_t *dev;
-  ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
-  dev->type = LSIM_DEV_TYPE_ADDBIT;
-
-  char *nand_1_name;
-  ERR(err_asprintf(&nand_1_name, "%s.nand_1", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_1_name, 2));
-  lsim_dev_t *nand_1_dev;
-  ERR(hmap_slookup(lsim->devs, nand_1_name, (void**)&nand_1_dev));
-
-  char *nand_2_name;
-  ERR(err_asprintf(&nand_2_name, "%s.nand_2", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_2_name, 2));
-  lsim_dev_t *nand_2_dev;
-  ERR(hmap_slookup(lsim->devs, nand_2_name, (void**)&nand_2_dev));
-
-  char *nand_3_name;
-  ERR(err_asprintf(&nand_3_name, "%s.nand_3", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_3_name, 2));
-  lsim_dev_t *nand_3_dev;
-  ERR(hmap_slookup(lsim->devs, nand_3_name, (void**)&nand_3_dev));
-
-  char *nand_4_name;
-  ERR(err_asprintf(&nand_4_name, "%s.nand_4", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_4_name, 2));
-  lsim_dev_t *nand_4_dev;
-  ERR(hmap_slookup(lsim->devs, nand_4_name, (void**)&nand_4_dev));
-
-  char *nand_5_name;
-  ERR(err_asprintf(&nand_5_name, "%s.nand_5", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_5_name, 2));
-  lsim_dev_t *nand_5_dev;
-  ERR(hmap_slookup(lsim->devs, nand_5_name, (void**)&nand_5_dev));
-
-  char *nand_6_name;
-  ERR(err_asprintf(&nand_6_name, "%s.nand_6", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_6_name, 2));
-  lsim_dev_t *nand_6_dev;
-  ERR(hmap_slookup(lsim->devs, nand_6_name, (void**)&nand_6_dev));
-
-  char *nand_7_name;
-  ERR(err_asprintf(&nand_7_name, "%s.nand_7", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_7_name, 2));
-  lsim_dev_t *nand_7_dev;
-  ERR(hmap_slookup(lsim->devs, nand_7_name, (void**)&nand_7_dev));
-
-  char *nand_s_name;
-  ERR(err_asprintf(&nand_s_name, "%s.nand_s", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_s_name, 2));
-  lsim_dev_t *nand_s_dev;
-  ERR(hmap_slookup(lsim->devs, nand_s_name, (void**)&nand_s_dev));
-
-  char *nand_o_name;
-  ERR(err_asprintf(&nand_o_name, "%s.nand_o", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_o_name, 2));
-  lsim_dev_t *nand_o_dev;
-  ERR(hmap_slookup(lsim->devs, nand_o_name, (void**)&nand_o_dev));
-
-  /* Make connections. */
-  ERR(lsim_dev_connect(lsim, nand_1_name, "o0", nand_2_name, "i1", 0));
-  ERR(lsim_dev_connect(lsim, nand_1_name, "o0", nand_3_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_1_name, "o0", nand_o_name, "i1", 0));
-
-  ERR(lsim_dev_connect(lsim, nand_2_name, "o0", nand_4_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_3_name, "o0", nand_4_name, "i1", 0));
-
-  ERR(lsim_dev_connect(lsim, nand_4_name, "o0", nand_5_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_4_name, "o0", nand_6_name, "i0", 0));
-
-  ERR(lsim_dev_connect(lsim, nand_5_name, "o0", nand_6_name, "i1", 0));
-  ERR(lsim_dev_connect(lsim, nand_5_name, "o0", nand_7_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_5_name, "o0", nand_o_name, "i0", 0));
-
-  ERR(lsim_dev_connect(lsim, nand_6_name, "o0", nand_s_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_7_name, "o0", nand_s_name, "i1", 0));
-
-  /* Save references to the "external" output terminals. */
-  dev->addbit.s_terminal = nand_s_dev->nand.o_terminal;
-  dev->addbit.o_terminal = nand_o_dev->nand.o_terminal;
-
-  /* Save references to the "external" input terminals. */
-  ERR(lsim_dev_in_chain_add(&dev->addbit.a_terminal, nand_1_dev->nand.i_terminals[0], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->addbit.a_terminal, nand_2_dev->nand.i_terminals[0], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->addbit.b_terminal, nand_1_dev->nand.i_terminals[1], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->addbit.b_terminal, nand_3_dev->nand.i_terminals[1], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->addbit.i_terminal, nand_5_dev->nand.i_terminals[1], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->addbit.i_terminal, nand_7_dev->nand.i_terminals[1], NULL));
-
-  /* Type-specific methods (inheritance). */
-  dev->get_out_terminal = lsim_devs_addbit_get_out_terminal;
-  dev->get_in_terminal = lsim_devs_addbit_get_in_terminal;
-  dev->power = lsim_devs_addbit_power;
-  dev->run_logic = lsim_devs_addbit_run_logic;
-  dev->propagate_outputs = lsim_devs_addbit_propagate_outputs;
-  dev->delete = lsim_devs_addbit_delete;
-
-  /* Write the addbit dev. */
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
-
-  free(nand_1_name);  free(nand_2_name);
-  free(nand_3_name);  free(nand_4_name);
-  free(nand_5_name);  free(nand_6_name);
-  free(nand_7_name);  free(nand_s_name);
-  free(nand_o_name);
+  ERR(lsim_devs_topo_create(lsim, &lsim_devs_addbit_topo, dev_name, LSIM_DEV_TYPE_ADDBIT, &dev));
 
   return ERR_OK;
 }  /* lsim_devs_addbit_create */
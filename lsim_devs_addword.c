@@ -20,6 +20,7 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
 
 
 ERR_F lsim_devs_addword_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -35,7 +36,7 @@ ERR_F lsim_devs_addword_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const ch
     bit_num += bit_offset;
     if (bit_num >= dev->addword.num_bits) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "addword %s output %s plus offset %d larger than last bit %d",
-                dev->name, out_id, bit_offset, dev->addword.num_bits - 1);
+                lsim_name_str(lsim, dev->name), out_id, bit_offset, dev->addword.num_bits - 1);
     }
     *out_terminal = dev->addword.s_terminals[bit_num];
   }
@@ -58,7 +59,7 @@ ERR_F lsim_devs_addword_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const cha
     bit_num += bit_offset;
     if (bit_num >= dev->addword.num_bits) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "addword %s output %s plus offset %d larger than last bit %d",
-                dev->name, in_id, bit_offset, dev->addword.num_bits - 1);
+                lsim_name_str(lsim, dev->name), in_id, bit_offset, dev->addword.num_bits - 1);
     }
     *in_terminal = dev->addword.a_terminals[bit_num];
   }
@@ -68,7 +69,7 @@ ERR_F lsim_devs_addword_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const cha
     bit_num += bit_offset;
     if (bit_num >= dev->addword.num_bits) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "addword %s output %s plus offset %d larger than last bit %d",
-                dev->name, in_id, bit_offset, dev->addword.num_bits - 1);
+                lsim_name_str(lsim, dev->name), in_id, bit_offset, dev->addword.num_bits - 1);
     }
     *in_terminal = dev->addword.b_terminals[bit_num];
   }
@@ -115,8 +116,11 @@ ERR_F lsim_devs_addword_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_ADDWORD, LSIM_ERR_INTERNAL);
 
-  free(dev->name);
-  free(dev);
+  /* This is a composite device. The underlying devices will be
+   * deleted on their own. */
+  free(dev->addword.s_terminals);
+  free(dev->addword.a_terminals);
+  free(dev->addword.b_terminals);
 
   return ERR_OK;
 }  /* lsim_devs_addword_delete */
@@ -126,16 +130,26 @@ ERR_F lsim_devs_addword_create(lsim_t *lsim, char *dev_name, long num_bits) {
   ERR_ASSRT(num_bits >= 1, LSIM_ERR_PARAM);
 
   /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
 
   lsim_dev_t *dev;
   ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+  dev->name = name;
   dev->type = LSIM_DEV_TYPE_ADDWORD;
   dev->addword.num_bits = num_bits;
 
+  /* Type-specific methods (inheritance). Set before registering,
+   * so that lsim_dev_delete_all() can delete a partly built device. */
+  dev->get_out_terminal = lsim_devs_addword_get_out_terminal;
+  dev->get_in_terminal = lsim_devs_addword_get_in_terminal;
+  dev->power = lsim_devs_addword_power;
+  dev->run_logic = lsim_devs_addword_run_logic;
+  dev->propagate_outputs = lsim_devs_addword_propagate_outputs;
+  dev->delete = lsim_devs_addword_delete;
+
+  ERR(lsim_dev_register(lsim, dev));  /* First, so that its parts are named under it. */
+
   ERR(err_calloc((void **)&dev->addword.s_terminals, num_bits, sizeof(lsim_dev_out_terminal_t *)));
   ERR(err_calloc((void **)&dev->addword.a_terminals, num_bits, sizeof(lsim_dev_in_terminal_t *)));
   ERR(err_calloc((void **)&dev->addword.b_terminals, num_bits, sizeof(lsim_dev_in_terminal_t *)));
@@ -147,7 +161,7 @@ ERR_F lsim_devs_addword_create(lsim_t *lsim, char *dev_name, long num_bits) {
     ERR(err_asprintf(&addbit_name, "%s.addbit.%d", dev_name, i));
     ERR(lsim_devs_addbit_create(lsim, addbit_name));
     lsim_dev_t *addbit_dev;
-    ERR(hmap_slookup(lsim->devs, addbit_name, (void **)&addbit_dev));
+    ERR(lsim_name_lookup(lsim, addbit_name, &addbit_dev));
 
     /* Save the "external" terminals. */
     dev->addword.s_terminals[i] = addbit_dev->addbit.s_terminal;
@@ -170,15 +184,5 @@ ERR_F lsim_devs_addword_create(lsim_t *lsim, char *dev_name, long num_bits) {
     free(addbit_name);
   }
 
-  /* Type-specific methods (inheritance). */
-  dev->get_out_terminal = lsim_devs_addword_get_out_terminal;
-  dev->get_in_terminal = lsim_devs_addword_get_in_terminal;
-  dev->power = lsim_devs_addword_power;
-  dev->run_logic = lsim_devs_addword_run_logic;
-  dev->propagate_outputs = lsim_devs_addword_propagate_outputs;
-  dev->delete = lsim_devs_addword_delete;
-
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
-
   return ERR_OK;
 }  /* lsim_devs_addword_create */
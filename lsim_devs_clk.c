@@ -20,6 +20,8 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_log.h"
 
 
 ERR_F lsim_devs_clk_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -59,9 +61,6 @@ ERR_F lsim_devs_clk_power(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_CLK, LSIM_ERR_INTERNAL);
 
-  dev->clk.R_terminal->state = 0;
-  dev->clk.q_terminal->state = 0;
-  dev->clk.Q_terminal->state = 0;
   /* Don't add clk to in_changed list because the logic is run explicitly. */
 
   return ERR_OK;
@@ -72,35 +71,35 @@ ERR_F lsim_devs_clk_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_CLK, LSIM_ERR_INTERNAL);
   /* Check for floating inputs. */
   if (dev->clk.R_terminal->driving_out_terminal == NULL) {
-    ERR_THROW(LSIM_ERR_COMMAND, "Clock %s: input R0 is floating", dev->name);
+    ERR_THROW(LSIM_ERR_COMMAND, "Clock %s: input R0 is floating", lsim_name_str(lsim, dev->name));
   }
 
   int out_changed = 0;
 
   /* Process reset. */
-  if (dev->clk.R_terminal->state == 0) {
-    if (dev->clk.q_terminal->state != 0 || dev->clk.Q_terminal->state != 1) {
+  if (lsim_dev_in_state(lsim, dev->clk.R_terminal) == 0) {
+    if (lsim_dev_out_state(lsim, dev->clk.q_terminal) != 0 || lsim_dev_out_state(lsim, dev->clk.Q_terminal) != 1) {
       out_changed = 1;
     }
-    dev->clk.q_terminal->state = 0;
-    dev->clk.Q_terminal->state = 1;
+    lsim_dev_out_set(lsim, dev->clk.q_terminal, 0);
+    lsim_dev_out_set(lsim, dev->clk.Q_terminal, 1);
     lsim->cur_ticklet = -1;
   }
   else {  /* Not reset. */
     /* Before first "ticklet" command, cur_ticklet is -1. Clock output 0. */
     int new_state = (lsim->cur_ticklet + 1) & 1;  /* Clock changes with each ticklet. */
-    if (dev->clk.q_terminal->state != new_state || dev->clk.Q_terminal->state != (1 - new_state)) {
+    if (lsim_dev_out_state(lsim, dev->clk.q_terminal) != new_state || lsim_dev_out_state(lsim, dev->clk.Q_terminal) != (1 - new_state)) {
       out_changed = 1;
-      dev->clk.q_terminal->state = new_state;
-      dev->clk.Q_terminal->state = 1 - new_state;  /* Invert. */
+      lsim_dev_out_set(lsim, dev->clk.q_terminal, new_state);
+      lsim_dev_out_set(lsim, dev->clk.Q_terminal, 1 - new_state);  /* Invert. */
     }
   } 
   if (out_changed) {
     ERR(lsim_dev_out_changed(lsim, dev));
   }
 
-  if (dev->watch_level >= 2 || (dev->watch_level == 1 && out_changed) || ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_OUT_CHG) && out_changed)) {
-    printf("  clk %s: q0=%d, Q0=%d\n", dev->name, dev->clk.q_terminal->state, dev->clk.Q_terminal->state);
+  if (! lsim->replaying && (dev->watch_level >= 2 || (dev->watch_level == 1 && out_changed) || ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_OUT_CHG) && out_changed))) {
+    lsim_log(lsim, LSIM_LOG_CLK, dev->name, lsim_dev_out_state(lsim, dev->clk.q_terminal) | (lsim_dev_out_state(lsim, dev->clk.Q_terminal) << 1), 0);
   }
 
   return ERR_OK;
@@ -110,33 +109,9 @@ ERR_F lsim_devs_clk_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
 ERR_F lsim_devs_clk_propagate_outputs(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_CLK, LSIM_ERR_INTERNAL);
 
-  int out_state = dev->clk.q_terminal->state;
-  lsim_dev_in_terminal_t *dst_in_terminal = dev->clk.q_terminal->in_terminal_list;
+  ERR(lsim_dev_out_propagate(lsim, dev->clk.q_terminal));
 
-  while (dst_in_terminal) {
-    if (dst_in_terminal->state != out_state) {
-      dst_in_terminal->state = out_state;
-      lsim_dev_t *dst_dev = dst_in_terminal->dev;
-      ERR(lsim_dev_in_changed(lsim, dst_dev));
-    }
-
-    /* Propagate output to next connected device. */
-    dst_in_terminal = dst_in_terminal->next_in_terminal;
-  }
-
-  out_state = dev->clk.Q_terminal->state;
-  dst_in_terminal = dev->clk.Q_terminal->in_terminal_list;
-
-  while (dst_in_terminal) {
-    if (dst_in_terminal->state != out_state) {
-      dst_in_terminal->state = out_state;
-      lsim_dev_t *dst_dev = dst_in_terminal->dev;
-      ERR(lsim_dev_in_changed(lsim, dst_dev));
-    }
-
-    /* Propagate output to next connected device. */
-    dst_in_terminal = dst_in_terminal->next_in_terminal;
-  }
+  ERR(lsim_dev_out_propagate(lsim, dev->clk.Q_terminal));
 
   return ERR_OK;
 }  /* lsim_devs_clk_propagate_outputs */
@@ -146,12 +121,7 @@ ERR_F lsim_devs_clk_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_CLK, LSIM_ERR_INTERNAL);
 
-  free(dev->clk.q_terminal);
-  free(dev->clk.Q_terminal);
-  free(dev->clk.R_terminal);
-
-  free(dev->name);
-  free(dev);
+  /* Terminals are freed with their chunks (see lsim_delete). */
 
   return ERR_OK;
 }  /* lsim_devs_clk_delete */
@@ -159,22 +129,18 @@ ERR_F lsim_devs_clk_delete(lsim_t *lsim, lsim_dev_t *dev) {
 
 ERR_F lsim_devs_clk_create(lsim_t *lsim, char *dev_name) {
   /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
 
   ERR_ASSRT(lsim->active_clk_dev == NULL, LSIM_ERR_COMMAND);  /* Can't have multiple clocks. */
 
   lsim_dev_t *dev;
   ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+  dev->name = name;
   dev->type = LSIM_DEV_TYPE_CLK;
-  ERR(err_calloc((void **)&(dev->clk.q_terminal), 1, sizeof(lsim_dev_out_terminal_t)));
-  dev->clk.q_terminal->dev = dev;
-  ERR(err_calloc((void **)&(dev->clk.Q_terminal), 1, sizeof(lsim_dev_out_terminal_t)));
-  dev->clk.Q_terminal->dev = dev;
-  ERR(err_calloc((void **)&(dev->clk.R_terminal), 1, sizeof(lsim_dev_in_terminal_t)));
-  dev->clk.R_terminal->dev = dev;
+  ERR(lsim_dev_out_terminal_create(lsim, dev, &dev->clk.q_terminal));
+  ERR(lsim_dev_out_terminal_create(lsim, dev, &dev->clk.Q_terminal));
+  ERR(lsim_dev_in_terminal_create(lsim, dev, &dev->clk.R_terminal));
 
   /* Type-specific methods (inheritance). */
   dev->get_out_terminal = lsim_devs_clk_get_out_terminal;
@@ -184,7 +150,7 @@ ERR_F lsim_devs_clk_create(lsim_t *lsim, char *dev_name) {
   dev->propagate_outputs = lsim_devs_clk_propagate_outputs;
   dev->delete = lsim_devs_clk_delete;
 
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
+  ERR(lsim_dev_register(lsim, dev));
 
   lsim->active_clk_dev = dev;  /* Make clock visible to lsim_dev_ticklet(). */
 
@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <ctype.h>
 #include "err.h"
 #include "hmap.h"
@@ -97,103 +98,63 @@ ERR_F lsim_devs_dflipflop_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_DFLIPFLOP, LSIM_ERR_INTERNAL);
 
-  free(dev->name);
-  free(dev);
+  /* This is a composite device. The underlying devices will be
+   * deleted on their own. Nothing to be done here. */
 
   return ERR_OK;
 }  /* lsim_devs_dflipflop_delete */
 
 
+/* Shared by every dflipflop instance (see lsim_devs_topo.c). */
+lsim_devs_topo_nand_t lsim_devs_dflipflop_nands[] = {
+  {"nand_q", 3},  /* 0 */
+  {"nand_Q", 3},  /* 1 */
+  {"nand_a", 3},  /* 2 */
+  {"nand_b", 3},  /* 3 */
+  {"nand_c", 3},  /* 4 */
+  {"nand_d", 3},  /* 5 */
+};
+lsim_devs_topo_wire_t lsim_devs_dflipflop_wires[] = {
+  {0, 1, 0},  /* q -> Q.i0 */
+  {1, 0, 2},  /* Q -> q.i2 */
+
+  {2, 3, 0},  /* a -> b.i0 */
+  {3, 2, 2},  /* b -> a.i2 */
+  {3, 4, 0},  /* b -> c.i0 */
+  {3, 0, 1},  /* b -> q.i1 */
+
+  {4, 5, 0},  /* c -> d.i0 */
+  {4, 1, 1},  /* c -> Q.i1 */
+  {5, 4, 2},  /* d -> c.i2 */
+  {5, 2, 1},  /* d -> a.i1 */
+};
+lsim_devs_topo_port_t lsim_devs_dflipflop_outs[] = {
+  {offsetof(lsim_dev_t, dflipflop.q_terminal), 0, 0},
+  {offsetof(lsim_dev_t, dflipflop.Q_terminal), 1, 0},
+};
+lsim_devs_topo_port_t lsim_devs_dflipflop_ins[] = {
+  {offsetof(lsim_dev_t, dflipflop.S_terminal), 2, 0},
+  {offsetof(lsim_dev_t, dflipflop.S_terminal), 0, 0},
+  {offsetof(lsim_dev_t, dflipflop.c_terminal), 3, 1},
+  {offsetof(lsim_dev_t, dflipflop.c_terminal), 4, 1},
+  {offsetof(lsim_dev_t, dflipflop.d_terminal), 5, 1},
+  {offsetof(lsim_dev_t, dflipflop.R_terminal), 3, 2},
+  {offsetof(lsim_dev_t, dflipflop.R_terminal), 5, 2},
+  {offsetof(lsim_dev_t, dflipflop.R_terminal), 1, 2},
+};
+lsim_devs_topo_t lsim_devs_dflipflop_topo = {
+  6, lsim_devs_dflipflop_nands, 10, lsim_devs_dflipflop_wires,
+  2, lsim_devs_dflipflop_outs, 8, lsim_devs_dflipflop_ins,
+  lsim_devs_dflipflop_get_out_terminal, lsim_devs_dflipflop_get_in_terminal, lsim_devs_dflipflop_power,
+  lsim_devs_dflipflop_run_logic, lsim_devs_dflipflop_propagate_outputs, lsim_devs_dflipflop_delete
+};
+
+
 /* The dflipflop is a bit complex. Refer to the schematic:
  * https://raw.githubusercontent.com/fordsfords/lsim/refs/heads/main/dflipflop.svg */
 ERR_F lsim_devs_dflipflop_create(lsim_t *lsim, char *dev_name) {
-  /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
-
   lsim_dev_t *dev;
-  ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
-  dev->type = LSIM_DEV_TYPE_DFLIPFLOP;
-
-  char *nand_q_name;
-  ERR(err_asprintf(&nand_q_name, "%s.nand_q", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_q_name, 3));
-  lsim_dev_t *nand_q_dev;
-  ERR(hmap_slookup(lsim->devs, nand_q_name, (void**)&nand_q_dev));
-
-  char *nand_Q_name;
-  ERR(err_asprintf(&nand_Q_name, "%s.nand_Q", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_Q_name, 3));
-  lsim_dev_t *nand_Q_dev;
-  ERR(hmap_slookup(lsim->devs, nand_Q_name, (void**)&nand_Q_dev));
-
-  char *nand_a_name;
-  ERR(err_asprintf(&nand_a_name, "%s.nand_a", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_a_name, 3));
-  lsim_dev_t *nand_a_dev;
-  ERR(hmap_slookup(lsim->devs, nand_a_name, (void**)&nand_a_dev));
-
-  char *nand_b_name;
-  ERR(err_asprintf(&nand_b_name, "%s.nand_b", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_b_name, 3));
-  lsim_dev_t *nand_b_dev;
-  ERR(hmap_slookup(lsim->devs, nand_b_name, (void**)&nand_b_dev));
-
-  char *nand_c_name;
-  ERR(err_asprintf(&nand_c_name, "%s.nand_c", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_c_name, 3));
-  lsim_dev_t *nand_c_dev;
-  ERR(hmap_slookup(lsim->devs, nand_c_name, (void**)&nand_c_dev));
-
-  char *nand_d_name;
-  ERR(err_asprintf(&nand_d_name, "%s.nand_d", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_d_name, 3));
-  lsim_dev_t *nand_d_dev;
-  ERR(hmap_slookup(lsim->devs, nand_d_name, (void**)&nand_d_dev));
-
-  /* Make connections. */
-  ERR(lsim_dev_connect(lsim, nand_q_name, "o0", nand_Q_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_Q_name, "o0", nand_q_name, "i2", 0));
-
-  ERR(lsim_dev_connect(lsim, nand_a_name, "o0", nand_b_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_b_name, "o0", nand_a_name, "i2", 0));
-  ERR(lsim_dev_connect(lsim, nand_b_name, "o0", nand_c_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_b_name, "o0", nand_q_name, "i1", 0));
-
-  ERR(lsim_dev_connect(lsim, nand_c_name, "o0", nand_d_name, "i0", 0));
-  ERR(lsim_dev_connect(lsim, nand_c_name, "o0", nand_Q_name, "i1", 0));
-  ERR(lsim_dev_connect(lsim, nand_d_name, "o0", nand_c_name, "i2", 0));
-  ERR(lsim_dev_connect(lsim, nand_d_name, "o0", nand_a_name, "i1", 0));
-
-  /* Save references to the "external" output terminals. */
-  dev->dflipflop.q_terminal = nand_q_dev->nand.o_terminal;
-  dev->dflipflop.Q_terminal = nand_Q_dev->nand.o_terminal;
-  /* Save references to the "external" input terminals. */
-  ERR(lsim_dev_in_chain_add(&dev->dflipflop.S_terminal, nand_a_dev->nand.i_terminals[0], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->dflipflop.S_terminal, nand_q_dev->nand.i_terminals[0], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->dflipflop.c_terminal, nand_b_dev->nand.i_terminals[1], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->dflipflop.c_terminal, nand_c_dev->nand.i_terminals[1], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->dflipflop.d_terminal, nand_d_dev->nand.i_terminals[1], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->dflipflop.R_terminal, nand_b_dev->nand.i_terminals[2], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->dflipflop.R_terminal, nand_d_dev->nand.i_terminals[2], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->dflipflop.R_terminal, nand_Q_dev->nand.i_terminals[2], NULL));
-
-  /* Type-specific methods (inheritance). */
-  dev->get_out_terminal = lsim_devs_dflipflop_get_out_terminal;
-  dev->get_in_terminal = lsim_devs_dflipflop_get_in_terminal;
-  dev->power = lsim_devs_dflipflop_power;
-  dev->run_logic = lsim_devs_dflipflop_run_logic;
-  dev->propagate_outputs = lsim_devs_dflipflop_propagate_outputs;
-  dev->delete = lsim_devs_dflipflop_delete;
-
-  /* Write the dflipflop dev. */
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
-
-  free(nand_q_name);  free(nand_Q_name);
-  free(nand_a_name);  free(nand_b_name);
-  free(nand_c_name);  free(nand_d_name);
+  ERR(lsim_devs_topo_create(lsim, &lsim_devs_dflipflop_topo, dev_name, LSIM_DEV_TYPE_DFLIPFLOP, &dev));
 
   return ERR_OK;
 }  /* lsim_devs_dflipflop_create */
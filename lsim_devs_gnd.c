@@ -20,6 +20,8 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_log.h"
 
 
 ERR_F lsim_devs_gnd_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -49,7 +51,6 @@ ERR_F lsim_devs_gnd_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *i
 ERR_F lsim_devs_gnd_power(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_GND, LSIM_ERR_INTERNAL);
 
-  dev->gnd.o_terminal->state = 0;
   ERR(lsim_dev_in_changed(lsim, dev));  /* Trigger to run the logic. */
 
   return ERR_OK;
@@ -60,16 +61,16 @@ ERR_F lsim_devs_gnd_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_GND, LSIM_ERR_INTERNAL);
 
   int out_changed = 0;
-  if (dev->gnd.o_terminal->state == 1) {
-    dev->gnd.o_terminal->state = 0;
+  if (lsim_dev_out_state(lsim, dev->gnd.o_terminal) == 1) {
+    lsim_dev_out_set(lsim, dev->gnd.o_terminal, 0);
     out_changed = 1;
   }
   if (out_changed) {
     ERR(lsim_dev_out_changed(lsim, dev));
   }
 
-  if (dev->watch_level >= 2 || (dev->watch_level == 1 && out_changed) || ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_OUT_CHG) && out_changed)) {
-    printf("  gnd %s: o0=%d\n", dev->name, dev->gnd.o_terminal->state);
+  if (! lsim->replaying && (dev->watch_level >= 2 || (dev->watch_level == 1 && out_changed) || ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_OUT_CHG) && out_changed))) {
+    lsim_log(lsim, LSIM_LOG_GND, dev->name, lsim_dev_out_state(lsim, dev->gnd.o_terminal), 0);
   }
 
   return ERR_OK;
@@ -79,19 +80,7 @@ ERR_F lsim_devs_gnd_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
 ERR_F lsim_devs_gnd_propagate_outputs(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_GND, LSIM_ERR_INTERNAL);
 
-  int out_state = dev->gnd.o_terminal->state;
-  lsim_dev_in_terminal_t *dst_in_terminal = dev->gnd.o_terminal->in_terminal_list;
-
-  while (dst_in_terminal) {
-    if (dst_in_terminal->state != out_state) {
-      dst_in_terminal->state = out_state;
-      lsim_dev_t *dst_dev = dst_in_terminal->dev;
-      ERR(lsim_dev_in_changed(lsim, dst_dev));
-    }
-
-    /* Propagate output to next connected device. */
-    dst_in_terminal = dst_in_terminal->next_in_terminal;
-  }
+  ERR(lsim_dev_out_propagate(lsim, dev->gnd.o_terminal));
 
   return ERR_OK;
 }  /* lsim_devs_gnd_propagate_outputs */
@@ -101,10 +90,7 @@ ERR_F lsim_devs_gnd_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_GND, LSIM_ERR_INTERNAL);
 
-  free(dev->gnd.o_terminal);
-
-  free(dev->name);
-  free(dev);
+  /* Terminals are freed with their chunks (see lsim_delete). */
 
   return ERR_OK;
 }  /* lsim_devs_gnd_delete */
@@ -112,16 +98,14 @@ ERR_F lsim_devs_gnd_delete(lsim_t *lsim, lsim_dev_t *dev) {
 
 ERR_F lsim_devs_gnd_create(lsim_t *lsim, char *dev_name) {
   /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
 
   lsim_dev_t *dev;
   ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+  dev->name = name;
   dev->type = LSIM_DEV_TYPE_GND;
-  ERR(err_calloc((void **)&(dev->gnd.o_terminal), 1, sizeof(lsim_dev_out_terminal_t)));
-  dev->gnd.o_terminal->dev = dev;
+  ERR(lsim_dev_out_terminal_create(lsim, dev, &dev->gnd.o_terminal));
 
   /* Type-specific methods (inheritance). */
   dev->get_out_terminal = lsim_devs_gnd_get_out_terminal;
@@ -131,7 +115,7 @@ ERR_F lsim_devs_gnd_create(lsim_t *lsim, char *dev_name) {
   dev->propagate_outputs = lsim_devs_gnd_propagate_outputs;
   dev->delete = lsim_devs_gnd_delete;
 
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
+  ERR(lsim_dev_register(lsim, dev));
 
   return ERR_OK;
 }  /* lsim_devs_gnd_create */
@@ -20,6 +20,8 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_log.h"
 
 
 ERR_F lsim_devs_led_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -52,7 +54,6 @@ ERR_F lsim_devs_led_power(lsim_t *lsim, lsim_dev_t *dev) {
   dev->led.illuminated = 0;
   dev->led.cur_step = -1;
   dev->led.changes_in_step = 0;
-  dev->led.i_terminal->state = 0;
   ERR(lsim_dev_in_changed(lsim, dev));  /* Trigger to run the logic. */
 
   return ERR_OK;
@@ -60,11 +61,10 @@ ERR_F lsim_devs_led_power(lsim_t *lsim, lsim_dev_t *dev) {
 
 
 ERR_F lsim_devs_led_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
-  (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_LED, LSIM_ERR_INTERNAL);
   /* Check for floating inputs. */
   if (dev->led.i_terminal->driving_out_terminal == NULL) {
-    ERR_THROW(LSIM_ERR_COMMAND, "Led %s: input i0 is floating", dev->name);
+    ERR_THROW(LSIM_ERR_COMMAND, "Led %s: input i0 is floating", lsim_name_str(lsim, dev->name));
   }
 
   /* Detect glitch-based flicker of LED (multiple transitions in same step).*/
@@ -73,12 +73,12 @@ ERR_F lsim_devs_led_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
     dev->led.cur_step = lsim->cur_step;
     dev->led.changes_in_step = 0;
   }
-  if (dev->led.i_terminal->state != dev->led.illuminated) {
-    dev->led.illuminated = dev->led.i_terminal->state;
+  if (lsim_dev_in_state(lsim, dev->led.i_terminal) != dev->led.illuminated) {
+    dev->led.illuminated = lsim_dev_in_state(lsim, dev->led.i_terminal);
     dev->led.changes_in_step++;
-    printf("Led %s: %s (ticklet %ld)%s\n",
-           dev->name, dev->led.illuminated ? "on" : "off", lsim->cur_ticklet,
-           (dev->led.changes_in_step > 1) ? " glitch" : "");
+    if (! lsim->replaying) {
+      lsim_log(lsim, LSIM_LOG_LED, dev->name, dev->led.illuminated | ((dev->led.changes_in_step > 1) << 1), lsim->cur_ticklet);
+    }
   }
 
   return ERR_OK;
@@ -99,10 +99,7 @@ ERR_F lsim_devs_led_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_LED, LSIM_ERR_INTERNAL);
 
-  free(dev->led.i_terminal);
-
-  free(dev->name);
-  free(dev);
+  /* Terminals are freed with their chunks (see lsim_delete). */
 
   return ERR_OK;
 }  /* lsim_devs_led_delete */
@@ -110,16 +107,14 @@ ERR_F lsim_devs_led_delete(lsim_t *lsim, lsim_dev_t *dev) {
 
 ERR_F lsim_devs_led_create(lsim_t *lsim, char *dev_name) {
   /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
 
   lsim_dev_t *dev;
   ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+  dev->name = name;
   dev->type = LSIM_DEV_TYPE_LED;
-  ERR(err_calloc((void **)&(dev->led.i_terminal), 1, sizeof(lsim_dev_in_terminal_t)));
-  dev->led.i_terminal->dev = dev;
+  ERR(lsim_dev_in_terminal_create(lsim, dev, &dev->led.i_terminal));
 
   /* Type-specific methods (inheritance). */
   dev->get_out_terminal = lsim_devs_led_get_out_terminal;
@@ -129,7 +124,7 @@ ERR_F lsim_devs_led_create(lsim_t *lsim, char *dev_name) {
   dev->propagate_outputs = lsim_devs_led_propagate_outputs;
   dev->delete = lsim_devs_led_delete;
 
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
+  ERR(lsim_dev_register(lsim, dev));
 
   return ERR_OK;
 }  /* lsim_devs_led_create */
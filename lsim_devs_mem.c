@@ -20,6 +20,8 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_log.h"
 
 
 ERR_F lsim_devs_mem_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -32,7 +34,7 @@ ERR_F lsim_devs_mem_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *
     bit_num += bit_offset;
     if (bit_num >= dev->mem.num_data) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "mem %s output %s plus offset %d larger than last bit %d",
-                dev->name, out_id, bit_offset, dev->mem.num_data - 1);
+                lsim_name_str(lsim, dev->name), out_id, bit_offset, dev->mem.num_data - 1);
     }
     *out_terminal = dev->mem.o_terminals[bit_num];
   }
@@ -52,7 +54,7 @@ ERR_F lsim_devs_mem_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *i
     input_num += bit_offset;
     if (input_num >= dev->mem.num_data) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "mem %s input %s plus offset %d larger than last bit %d",
-                dev->name, in_id, bit_offset, dev->mem.num_data - 1);
+                lsim_name_str(lsim, dev->name), in_id, bit_offset, dev->mem.num_data - 1);
     }
     *in_terminal = dev->mem.i_terminals[input_num];
   }
@@ -62,7 +64,7 @@ ERR_F lsim_devs_mem_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *i
     input_num += bit_offset;
     if (input_num >= dev->mem.num_addr) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "mem %s input %s plus offset %d larger than last bit %d",
-                dev->name, in_id, bit_offset, dev->mem.num_addr - 1);
+                lsim_name_str(lsim, dev->name), in_id, bit_offset, dev->mem.num_addr - 1);
     }
     *in_terminal = dev->mem.a_terminals[input_num];
   }
@@ -79,19 +81,6 @@ ERR_F lsim_devs_mem_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *i
 ERR_F lsim_devs_mem_power(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MEM, LSIM_ERR_INTERNAL);
 
-  int out_index;
-  for (out_index = 0; out_index < dev->mem.num_data; out_index++) {
-    dev->mem.o_terminals[out_index]->state = 0;
-  }
-
-  int in_index;
-  for (in_index = 0; in_index < dev->mem.num_data; in_index++) {
-    dev->mem.i_terminals[in_index]->state = 0;
-  }
-  for (in_index = 0; in_index < dev->mem.num_addr; in_index++) {
-    dev->mem.a_terminals[in_index]->state = 0;
-  }
-
   ERR(lsim_dev_in_changed(lsim, dev));  /* Trigger to run the logic. */
 
   long num_words = 1<<dev->mem.num_addr;
@@ -113,9 +102,9 @@ ERR_F lsim_devs_mem_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
   for (in_index = 0; in_index < dev->mem.num_addr; in_index++) {
     /* Check for floating inputs. */
     if (dev->mem.a_terminals[in_index]->driving_out_terminal == NULL) {
-      ERR_THROW(LSIM_ERR_COMMAND, "Mem %s: input a%d is floating", dev->name, in_index);
+      ERR_THROW(LSIM_ERR_COMMAND, "Mem %s: input a%d is floating", lsim_name_str(lsim, dev->name), in_index);
     }
-    if (dev->mem.a_terminals[in_index]->state == 1) {
+    if (lsim_dev_in_state(lsim, dev->mem.a_terminals[in_index]) == 1) {
       addr_val |= (1<<in_index);
     }
   }
@@ -124,13 +113,13 @@ ERR_F lsim_devs_mem_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
   uint64_t data_val = 0;
 
   /* Write (if requested). */
-  if (dev->mem.w_terminal->state) {
+  if (lsim_dev_in_state(lsim, dev->mem.w_terminal)) {
     for (in_index = 0; in_index < dev->mem.num_data; in_index++) {
       /* Check for floating inputs. */
       if (dev->mem.i_terminals[in_index]->driving_out_terminal == NULL) {
-        ERR_THROW(LSIM_ERR_COMMAND, "Mem %s: input i%d is floating", dev->name, in_index);
+        ERR_THROW(LSIM_ERR_COMMAND, "Mem %s: input i%d is floating", lsim_name_str(lsim, dev->name), in_index);
       }
-      if (dev->mem.i_terminals[in_index]->state) {
+      if (lsim_dev_in_state(lsim, dev->mem.i_terminals[in_index])) {
         data_val |= (1 << in_index);
       }
     }
@@ -148,17 +137,17 @@ ERR_F lsim_devs_mem_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
     if (data_val & (1<<out_index)) {
       new_val = 1;
     }
-    if (dev->mem.o_terminals[out_index]->state != new_val) {
+    if (lsim_dev_out_state(lsim, dev->mem.o_terminals[out_index]) != new_val) {
       out_changed = 1;
-      dev->mem.o_terminals[out_index]->state = new_val;
+      lsim_dev_out_set(lsim, dev->mem.o_terminals[out_index], new_val);
     }
   }
   if (out_changed) {
     ERR(lsim_dev_out_changed(lsim, dev));
   }
 
-  if (dev->watch_level >= 2 || (dev->watch_level == 1 && out_changed) || ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_OUT_CHG) && out_changed)) {
-    printf("  mem %s: o=%ld (0x%lx)\n", dev->name, data_val, data_val);
+  if (! lsim->replaying && (dev->watch_level >= 2 || (dev->watch_level == 1 && out_changed) || ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_OUT_CHG) && out_changed))) {
+    lsim_log(lsim, LSIM_LOG_MEM, dev->name, 0, (long)data_val);
   }
 
   return ERR_OK;
@@ -171,19 +160,7 @@ ERR_F lsim_devs_mem_propagate_outputs(lsim_t *lsim, lsim_dev_t *dev) {
   /* Propagate each output bit. */
   int out_index;
   for (out_index = 0; out_index < dev->mem.num_data; out_index++) {
-    int out_state = dev->mem.o_terminals[out_index]->state;
-    lsim_dev_in_terminal_t *dst_in_terminal = dev->mem.o_terminals[out_index]->in_terminal_list;
-
-    while (dst_in_terminal) {
-      if (dst_in_terminal->state != out_state) {
-        dst_in_terminal->state = out_state;
-        lsim_dev_t *dst_dev = dst_in_terminal->dev;
-        ERR(lsim_dev_in_changed(lsim, dst_dev));
-      }
-
-      /* Propagate output to next connected device. */
-      dst_in_terminal = dst_in_terminal->next_in_terminal;
-    }
+    ERR(lsim_dev_out_propagate(lsim, dev->mem.o_terminals[out_index]));
   }
 
   return ERR_OK;
@@ -191,28 +168,14 @@ ERR_F lsim_devs_mem_propagate_outputs(lsim_t *lsim, lsim_dev_t *dev) {
 
 
 ERR_F lsim_devs_mem_delete(lsim_t *lsim, lsim_dev_t *dev) {
-  (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MEM, LSIM_ERR_INTERNAL);
 
-  int i;
-  for (i = 0; i < dev->mem.num_data; i++) {
-    free(dev->mem.o_terminals[i]);
-    free(dev->mem.i_terminals[i]);
-  }
+  /* Terminals are freed with their chunks (see lsim_delete). */
   free(dev->mem.o_terminals);
   free(dev->mem.i_terminals);
-
-  for (i = 0; i < dev->mem.num_addr; i++) {
-    free(dev->mem.a_terminals[i]);
-  }
   free(dev->mem.a_terminals);
 
-  free(dev->mem.w_terminal);
-
-  free(dev->mem.words);
-
-  free(dev->name);
-  free(dev);
+  ERR(lsim_bigfree(lsim, dev->mem.words));
 
   return ERR_OK;
 }  /* lsim_devs_mem_delete */
@@ -223,13 +186,12 @@ ERR_F lsim_devs_mem_create(lsim_t *lsim, char *dev_name, long num_addr, long num
   ERR_ASSRT((num_addr >= 1) && (num_addr <= 18), LSIM_ERR_PARAM);
 
   /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
 
   lsim_dev_t *dev;
   ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+  dev->name = name;
   dev->type = LSIM_DEV_TYPE_MEM;
   dev->mem.num_data = num_data;
   dev->mem.num_addr = num_addr;
@@ -237,33 +199,29 @@ ERR_F lsim_devs_mem_create(lsim_t *lsim, char *dev_name, long num_addr, long num
 
   /* Allocate actual memory. */
   long num_words = 1<<num_addr;
-  ERR(err_calloc((void **)&(dev->mem.words), num_words, sizeof(uint64_t)));
+  ERR(lsim_bigalloc(lsim, num_words * sizeof(uint64_t), (void **)&(dev->mem.words)));
 
   /* data output terminals. */
   ERR(err_calloc((void **)&(dev->mem.o_terminals), num_data, sizeof(lsim_dev_out_terminal_t *)));
   long in_index;
   for (in_index = 0; in_index < dev->mem.num_data; in_index++) {
-    ERR(err_calloc((void **)&dev->mem.o_terminals[in_index], 1, sizeof(lsim_dev_out_terminal_t)));
-    dev->mem.o_terminals[in_index]->dev = dev;
+    ERR(lsim_dev_out_terminal_create(lsim, dev, &dev->mem.o_terminals[in_index]));
   }
 
   /* data input terminals. */
   ERR(err_calloc((void **)&(dev->mem.i_terminals), num_data, sizeof(lsim_dev_in_terminal_t *)));
   for (in_index = 0; in_index < dev->mem.num_data; in_index++) {
-    ERR(err_calloc((void **)&dev->mem.i_terminals[in_index], 1, sizeof(lsim_dev_in_terminal_t)));
-    dev->mem.i_terminals[in_index]->dev = dev;
+    ERR(lsim_dev_in_terminal_create(lsim, dev, &dev->mem.i_terminals[in_index]));
   }
 
   /* address input terminals. */
   ERR(err_calloc((void **)&(dev->mem.a_terminals), num_addr, sizeof(lsim_dev_in_terminal_t *)));
   for (in_index = 0; in_index < dev->mem.num_addr; in_index++) {
-    ERR(err_calloc((void **)&dev->mem.a_terminals[in_index], 1, sizeof(lsim_dev_in_terminal_t)));
-    dev->mem.a_terminals[in_index]->dev = dev;
+    ERR(lsim_dev_in_terminal_create(lsim, dev, &dev->mem.a_terminals[in_index]));
   }
 
   /* write input terminal. */
-  ERR(err_calloc((void **)&dev->mem.w_terminal, 1, sizeof(lsim_dev_in_terminal_t)));
-  dev->mem.w_terminal->dev = dev;
+  ERR(lsim_dev_in_terminal_create(lsim, dev, &dev->mem.w_terminal));
 
   /* Type-specific methods (inheritance). */
   dev->get_out_terminal = lsim_devs_mem_get_out_terminal;
@@ -273,7 +231,7 @@ ERR_F lsim_devs_mem_create(lsim_t *lsim, char *dev_name, long num_addr, long num
   dev->propagate_outputs = lsim_devs_mem_propagate_outputs;
   dev->delete = lsim_devs_mem_delete;
 
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
+  ERR(lsim_dev_register(lsim, dev));
 
   return ERR_OK;
 }  /* lsim_devs_mem_create */
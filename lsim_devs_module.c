@@ -0,0 +1,182 @@
+/* lsim_devs_module.c */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_netlist.h"
+#include "lsim_module.h"
+
+
+ERR_F lsim_devs_module_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
+  (void)lsim;
+  ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MODULE, LSIM_ERR_INTERNAL);
+
+  long port;
+  ERR(lsim_module_find_port(dev->module.module, 1, out_id, bit_offset, &port));
+  *out_terminal = dev->module.out_terminals[port];
+
+  return ERR_OK;
+}  /* lsim_devs_module_get_out_terminal */
+
+
+ERR_F lsim_devs_module_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *in_id, lsim_dev_in_terminal_t **in_terminal, int bit_offset) {
+  (void)lsim;
+  ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MODULE, LSIM_ERR_INTERNAL);
+
+  long port;
+  ERR(lsim_module_find_port(dev->module.module, 0, in_id, bit_offset, &port));
+  *in_terminal = dev->module.in_terminals[port];
+
+  return ERR_OK;
+}  /* lsim_devs_module_get_in_terminal */
+
+
+ERR_F lsim_devs_module_power(lsim_t *lsim, lsim_dev_t *dev) {
+  (void)lsim;
+  ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MODULE, LSIM_ERR_INTERNAL);
+
+  /* This is a composite device. The underlying devices will be
+   * processed on their own. Nothing to be done here. */
+
+  return ERR_OK;
+}  /* lsim_devs_module_power */
+
+
+ERR_F lsim_devs_module_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
+  (void)lsim;
+  ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MODULE, LSIM_ERR_INTERNAL);
+
+  ERR_THROW(LSIM_ERR_INTERNAL, "run logic should not be called for module");
+
+  return ERR_OK;
+}  /* lsim_devs_module_run_logic */
+
+
+ERR_F lsim_devs_module_propagate_outputs(lsim_t *lsim, lsim_dev_t *dev) {
+  (void)lsim;
+  ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MODULE, LSIM_ERR_INTERNAL);
+
+  ERR_THROW(LSIM_ERR_INTERNAL, "propagate outputs should not be called for module");
+
+  return ERR_OK;
+}  /* lsim_devs_module_propagate_outputs */
+
+
+ERR_F lsim_devs_module_delete(lsim_t *lsim, lsim_dev_t *dev) {
+  (void)lsim;
+  ERR_ASSRT(dev->type == LSIM_DEV_TYPE_MODULE, LSIM_ERR_INTERNAL);
+
+  /* The underlying devices will be deleted on their own. */
+  free(dev->module.out_terminals);
+  free(dev->module.in_terminals);
+
+  return ERR_OK;
+}  /* lsim_devs_module_delete */
+
+
+/* Clone the module's template. Names are "dev_name.<name in module>". */
+ERR_F lsim_devs_module_create(lsim_t *lsim, char *dev_name, lsim_module_t *module) {
+  /* Make sure name doesn't already exist. */
+  lsim_name_t *inst_name;
+  ERR(lsim_name_create(lsim, dev_name, &inst_name));
+
+  lsim_dev_t *dev;
+  ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
+  dev->name = inst_name;
+  dev->type = LSIM_DEV_TYPE_MODULE;
+  dev->module.module = module;
+
+  /* Type-specific methods (inheritance). Set before registering, so that
+   * lsim_dev_delete_all() can delete a partly built instance. */
+  dev->get_out_terminal = lsim_devs_module_get_out_terminal;
+  dev->get_in_terminal = lsim_devs_module_get_in_terminal;
+  dev->power = lsim_devs_module_power;
+  dev->run_logic = lsim_devs_module_run_logic;
+  dev->propagate_outputs = lsim_devs_module_propagate_outputs;
+  dev->delete = lsim_devs_module_delete;
+
+  ERR(lsim_dev_register(lsim, dev));  /* First, so that its parts are named under it. */
+
+  long out_base = lsim->num_out_terminals;
+  long in_base = lsim->num_in_terminals;
+  lsim_netlist_rec_t *rec = module->rec;
+
+  /* Devices. */
+  size_t prefix_len = strlen(dev_name);
+  size_t alloc_sub_name = prefix_len + 64;
+  char *sub_name = malloc(alloc_sub_name);
+  ERR_ASSRT(sub_name, LSIM_ERR_NOMEM);
+  memcpy(sub_name, dev_name, prefix_len);
+  sub_name[prefix_len] = '.';
+  long d;
+  for (d = 0; d < rec->num_devs; d++) {
+    const char *name = &rec->names[rec->devs[d].name_offset];
+    size_t name_len = strlen(name);
+    if (prefix_len + name_len + 2 > alloc_sub_name) {
+      alloc_sub_name = prefix_len + name_len + 64;
+      char *new_sub_name = realloc(sub_name, alloc_sub_name);
+      ERR_ASSRT(new_sub_name, LSIM_ERR_NOMEM);
+      sub_name = new_sub_name;
+    }
+    memcpy(&sub_name[prefix_len + 1], name, name_len + 1);
+    err_t *err = lsim_netlist_dev_create(lsim, rec->devs[d].type, sub_name, rec->devs[d].param1, rec->devs[d].param2);
+    if (err) {
+      free(sub_name);
+      ERR_RETHROW(err, "module %s instance %s", module->name, dev_name);
+    }
+  }
+  free(sub_name);
+  ERR_ASSRT(lsim->num_out_terminals - out_base == module->num_out_terminals, LSIM_ERR_INTERNAL);
+  ERR_ASSRT(lsim->num_in_terminals - in_base == module->num_in_terminals, LSIM_ERR_INTERNAL);
+
+  /* Internal connections. */
+  long c;
+  for (c = 0; c < rec->num_conns; c++) {
+    lsim_dev_out_terminal_t *out_terminal = lsim->out_terminals[out_base + rec->conns[c * 2]];
+    lsim_dev_in_terminal_t *in_terminal = lsim->in_terminals[in_base + rec->conns[c * 2 + 1]];
+    if (in_terminal->driving_out_terminal != out_terminal) {  /* Else already on an earlier chain. */
+      ERR(lsim_dev_in_chain_add(&out_terminal->in_terminal_list, in_terminal, out_terminal));
+    }
+    if (lsim->netlist_rec) {
+      ERR(lsim_netlist_record_conn(lsim, out_terminal, in_terminal));
+    }
+  }
+
+  /* Ports. An input port's chain is relinked in its recorded order, which
+   * matches any links made by composite devices inside. */
+  ERR(err_calloc((void **)&dev->module.out_terminals, module->num_out_ports + 1, sizeof(lsim_dev_out_terminal_t *)));
+  long p;
+  for (p = 0; p < module->num_out_ports; p++) {
+    dev->module.out_terminals[p] = lsim->out_terminals[out_base + module->out_ports[p].serials[0]];
+  }
+  ERR(err_calloc((void **)&dev->module.in_terminals, module->num_in_ports + 1, sizeof(lsim_dev_in_terminal_t *)));
+  for (p = 0; p < module->num_in_ports; p++) {
+    lsim_module_port_t *port = &module->in_ports[p];
+    long s;
+    for (s = port->num_serials - 1; s >= 0; s--) {
+      lsim_dev_in_terminal_t *in_terminal = lsim->in_terminals[in_base + port->serials[s]];
+      in_terminal->next_in_terminal = dev->module.in_terminals[p];
+      dev->module.in_terminals[p] = in_terminal;
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_devs_module_create */
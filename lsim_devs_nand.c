@@ -20,6 +20,8 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_log.h"
 
 
 ERR_F lsim_devs_nand_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -46,7 +48,7 @@ ERR_F lsim_devs_nand_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *
     input_num += bit_offset;
     if (input_num >= dev->nand.num_inputs) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "nand %s input %s plus offset %d larger than last bit %d",
-                dev->name, in_id, bit_offset, dev->nand.num_inputs - 1);
+                lsim_name_str(lsim, dev->name), in_id, bit_offset, dev->nand.num_inputs - 1);
     }
     *in_terminal = dev->nand.i_terminals[input_num];
   }
@@ -59,12 +61,6 @@ ERR_F lsim_devs_nand_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *
 ERR_F lsim_devs_nand_power(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_NAND, LSIM_ERR_INTERNAL);
 
-  dev->nand.o_terminal->state = 0;
-
-  int in_index;
-  for (in_index = 0; in_index < dev->nand.num_inputs; in_index++) {
-    dev->nand.i_terminals[in_index]->state = 0;
-  }
   ERR(lsim_dev_in_changed(lsim, dev));  /* Trigger to run the logic. */
 
   return ERR_OK;
@@ -79,9 +75,9 @@ ERR_F lsim_devs_nand_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
   for (input_index = 0; input_index < dev->nand.num_inputs; input_index++) {
     /* Check for floating inputs. */
     if (dev->nand.i_terminals[input_index]->driving_out_terminal == NULL) {
-      ERR_THROW(LSIM_ERR_COMMAND, "Nand %s: input i%d is floating", dev->name, input_index);
+      ERR_THROW(LSIM_ERR_COMMAND, "Nand %s: input i%d is floating", lsim_name_str(lsim, dev->name), input_index);
     }
-    if (dev->nand.i_terminals[input_index]->state == 0) {
+    if (lsim_dev_in_state(lsim, dev->nand.i_terminals[input_index]) == 0) {
       /* At least one input is 0; output is 1. */
       new_output = 1;
       break;
@@ -90,16 +86,16 @@ ERR_F lsim_devs_nand_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
 
   /* See if output changed. */
   int out_changed = 0;
-  if (dev->nand.o_terminal->state != new_output) {
-    dev->nand.o_terminal->state = new_output;
+  if (lsim_dev_out_state(lsim, dev->nand.o_terminal) != new_output) {
+    lsim_dev_out_set(lsim, dev->nand.o_terminal, new_output);
     out_changed = 1;
   }
   if (out_changed) {
     ERR(lsim_dev_out_changed(lsim, dev));
   }
 
-  if (dev->watch_level >= 2 || (dev->watch_level == 1 && out_changed) || ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_OUT_CHG) && out_changed)) {
-    printf("  nand %s: o0=%d\n", dev->name, dev->nand.o_terminal->state);
+  if (! lsim->replaying && (dev->watch_level >= 2 || (dev->watch_level == 1 && out_changed) || ((lsim->verbosity_map & LSIM_VERBOSITY_MAP_OUT_CHG) && out_changed))) {
+    lsim_log(lsim, LSIM_LOG_NAND, dev->name, lsim_dev_out_state(lsim, dev->nand.o_terminal), 0);
   }
 
   return ERR_OK;
@@ -109,19 +105,7 @@ ERR_F lsim_devs_nand_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
 ERR_F lsim_devs_nand_propagate_outputs(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_NAND, LSIM_ERR_INTERNAL);
 
-  int out_state = dev->nand.o_terminal->state;
-  lsim_dev_in_terminal_t *dst_in_terminal = dev->nand.o_terminal->in_terminal_list;
-
-  while (dst_in_terminal) {
-    if (dst_in_terminal->state != out_state) {
-      dst_in_terminal->state = out_state;
-      lsim_dev_t *dst_dev = dst_in_terminal->dev;
-      ERR(lsim_dev_in_changed(lsim, dst_dev));
-    }
-
-    /* Propagate output to next connected device. */
-    dst_in_terminal = dst_in_terminal->next_in_terminal;
-  }
+  ERR(lsim_dev_out_propagate(lsim, dev->nand.o_terminal));
 
   return ERR_OK;
 }  /* lsim_devs_nand_propagate_outputs */
@@ -131,43 +115,27 @@ ERR_F lsim_devs_nand_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_NAND, LSIM_ERR_INTERNAL);
 
-  free(dev->nand.o_terminal);
-
-  int i;
-  for (i = 0; i < dev->nand.num_inputs; i++) {
-    free(dev->nand.i_terminals[i]);
+  /* Terminals are freed with their chunks (see lsim_delete). */
+  if (! dev->in_chunk) {
+    free(dev->nand.i_terminals);
   }
-  free(dev->nand.i_terminals);
-
-  free(dev->name);
-  free(dev);
 
   return ERR_OK;
 }  /* lsim_devs_nand_delete */
 
 
-ERR_F lsim_devs_nand_create(lsim_t *lsim, char *dev_name, long num_inputs) {
-  ERR_ASSRT(num_inputs >= 1, LSIM_ERR_PARAM);
-
-  /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
-
-  lsim_dev_t *dev;
-  ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+/* Fill in a nand whose record (and i_terminals array) was allocated by the
+ * caller. Used directly by composites (see lsim_devs_topo.c). */
+ERR_F lsim_devs_nand_init(lsim_t *lsim, lsim_dev_t *dev, long num_inputs, lsim_dev_in_terminal_t **i_terminals) {
   dev->type = LSIM_DEV_TYPE_NAND;
 
-  ERR(err_calloc((void **)&(dev->nand.o_terminal), 1, sizeof(lsim_dev_out_terminal_t)));
-  dev->nand.o_terminal->dev = dev;
+  ERR(lsim_dev_out_terminal_create(lsim, dev, &dev->nand.o_terminal));
   dev->nand.num_inputs = num_inputs;
-  ERR(err_calloc((void **)&(dev->nand.i_terminals), num_inputs, sizeof(lsim_dev_in_terminal_t *)));
+  dev->nand.i_terminals = i_terminals;
 
   int in_index;
   for (in_index = 0; in_index < dev->nand.num_inputs; in_index++) {
-    ERR(err_calloc((void **)&dev->nand.i_terminals[in_index], 1, sizeof(lsim_dev_in_terminal_t)));
-    dev->nand.i_terminals[in_index]->dev = dev;
+    ERR(lsim_dev_in_terminal_create(lsim, dev, &dev->nand.i_terminals[in_index]));
   }
 
   /* Type-specific methods (inheritance). */
@@ -178,7 +146,26 @@ ERR_F lsim_devs_nand_create(lsim_t *lsim, char *dev_name, long num_inputs) {
   dev->propagate_outputs = lsim_devs_nand_propagate_outputs;
   dev->delete = lsim_devs_nand_delete;
 
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
+  return ERR_OK;
+}  /* lsim_devs_nand_init */
+
+
+ERR_F lsim_devs_nand_create(lsim_t *lsim, char *dev_name, long num_inputs) {
+  ERR_ASSRT(num_inputs >= 1, LSIM_ERR_PARAM);
+
+  /* Make sure name doesn't already exist. */
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
+
+  lsim_dev_t *dev;
+  ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
+  dev->name = name;
+
+  lsim_dev_in_terminal_t **i_terminals;
+  ERR(err_calloc((void **)&i_terminals, num_inputs, sizeof(lsim_dev_in_terminal_t *)));
+  ERR(lsim_devs_nand_init(lsim, dev, num_inputs, i_terminals));
+
+  ERR(lsim_dev_register(lsim, dev));
 
   return ERR_OK;
 }  /* lsim_devs_nand_create */
@@ -20,6 +20,7 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
 
 
 ERR_F lsim_devs_panel_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -32,7 +33,7 @@ ERR_F lsim_devs_panel_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char
     bit_num += bit_offset;
     if (bit_num >= dev->panel.num_bits) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "panel %s output %s plus offset %d larger than last bit %d",
-                dev->name, out_id, bit_offset, dev->panel.num_bits - 1);
+                lsim_name_str(lsim, dev->name), out_id, bit_offset, dev->panel.num_bits - 1);
     }
     *out_terminal = dev->panel.o_terminals[bit_num];
   }
@@ -52,7 +53,7 @@ ERR_F lsim_devs_panel_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char
     bit_num += bit_offset;
     if (bit_num >= dev->panel.num_bits) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "panel %s input %s plus offset %d larger than last bit %d",
-                dev->name, in_id, bit_offset, dev->panel.num_bits - 1);
+                lsim_name_str(lsim, dev->name), in_id, bit_offset, dev->panel.num_bits - 1);
     }
     *in_terminal = dev->panel.i_terminals[bit_num];
   } else {
@@ -98,8 +99,10 @@ ERR_F lsim_devs_panel_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_PANEL, LSIM_ERR_INTERNAL);
 
-  free(dev->name);
-  free(dev);
+  /* This is a composite device. The underlying devices will be
+   * deleted on their own. */
+  free(dev->panel.o_terminals);
+  free(dev->panel.i_terminals);
 
   return ERR_OK;
 }  /* lsim_devs_panel_delete */
@@ -109,16 +112,26 @@ ERR_F lsim_devs_panel_create(lsim_t *lsim, char *dev_name, long num_bits) {
   ERR_ASSRT(num_bits >= 1, LSIM_ERR_PARAM);
 
   /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
 
   lsim_dev_t *dev;
   ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+  dev->name = name;
   dev->type = LSIM_DEV_TYPE_PANEL;
   dev->panel.num_bits = num_bits;
 
+  /* Type-specific methods (inheritance). Set before registering,
+   * so that lsim_dev_delete_all() can delete a partly built device. */
+  dev->get_out_terminal = lsim_devs_panel_get_out_terminal;
+  dev->get_in_terminal = lsim_devs_panel_get_in_terminal;
+  dev->power = lsim_devs_panel_power;
+  dev->run_logic = lsim_devs_panel_run_logic;
+  dev->propagate_outputs = lsim_devs_panel_propagate_outputs;
+  dev->delete = lsim_devs_panel_delete;
+
+  ERR(lsim_dev_register(lsim, dev));  /* First, so that its parts are named under it. */
+
   ERR(err_calloc((void **)&dev->panel.o_terminals, num_bits, sizeof(lsim_dev_out_terminal_t *)));
   ERR(err_calloc((void **)&dev->panel.i_terminals, num_bits, sizeof(lsim_dev_in_terminal_t *)));
 
@@ -129,13 +142,13 @@ ERR_F lsim_devs_panel_create(lsim_t *lsim, char *dev_name, long num_bits) {
     ERR(err_asprintf(&swtch_name, "%s.swtch.%d", dev_name, i));
     ERR(lsim_devs_swtch_create(lsim, swtch_name, 0));
     lsim_dev_t *swtch_dev;
-    ERR(hmap_slookup(lsim->devs, swtch_name, (void **)&swtch_dev));
+    ERR(lsim_name_lookup(lsim, swtch_name, &swtch_dev));
 
     char *led_name;
     ERR(err_asprintf(&led_name, "%s.led.%d", dev_name, i));
     ERR(lsim_devs_led_create(lsim, led_name));
     lsim_dev_t *led_dev;
-    ERR(hmap_slookup(lsim->devs, led_name, (void **)&led_dev));
+    ERR(lsim_name_lookup(lsim, led_name, &led_dev));
 
     /* Save the "external" terminals. */
     dev->panel.o_terminals[i] = swtch_dev->swtch.o_terminal;
@@ -145,16 +158,5 @@ ERR_F lsim_devs_panel_create(lsim_t *lsim, char *dev_name, long num_bits) {
     free(led_name);
   }
 
-  /* Type-specific methods (inheritance). */
-  dev->get_out_terminal = lsim_devs_panel_get_out_terminal;
-  dev->get_in_terminal = lsim_devs_panel_get_in_terminal;
-  dev->power = lsim_devs_panel_power;
-  dev->run_logic = lsim_devs_panel_run_logic;
-  dev->propagate_outputs = lsim_devs_panel_propagate_outputs;
-  dev->delete = lsim_devs_panel_delete;
-
-  /* Write the panel dev. */
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
-
   return ERR_OK;
 }  /* lsim_devs_panel_create */
@@ -20,6 +20,8 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_log.h"
 
 
 ERR_F lsim_devs_probe_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -54,10 +56,8 @@ ERR_F lsim_devs_probe_power(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_PROBE, LSIM_ERR_INTERNAL);
 
   dev->probe.cur_step = 0;
-  dev->probe.d_terminal->state = 0;
   dev->probe.prev_d_state = 0;
   dev->probe.d_changes_in_step = 0;
-  dev->probe.c_terminal->state = 0;
   dev->probe.prev_c_state = 0;
   dev->probe.c_changes_in_step = 0;
   dev->probe.c_triggers_in_step = 0;
@@ -71,10 +71,10 @@ ERR_F lsim_devs_probe_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_PROBE, LSIM_ERR_INTERNAL);
   /* Check for floating inputs. */
   if (dev->probe.d_terminal->driving_out_terminal == NULL) {
-    ERR_THROW(LSIM_ERR_COMMAND, "Probe %s: input d0 is floating", dev->name);
+    ERR_THROW(LSIM_ERR_COMMAND, "Probe %s: input d0 is floating", lsim_name_str(lsim, dev->name));
   }
   if (dev->probe.c_terminal->driving_out_terminal == NULL) {
-    ERR_THROW(LSIM_ERR_COMMAND, "Probe %s: input c0 is floating", dev->name);
+    ERR_THROW(LSIM_ERR_COMMAND, "Probe %s: input c0 is floating", lsim_name_str(lsim, dev->name));
   }
 
   if (dev->probe.cur_step != lsim->cur_step) {
@@ -85,44 +85,50 @@ ERR_F lsim_devs_probe_run_logic(lsim_t *lsim, lsim_dev_t *dev) {
     dev->probe.cur_step = lsim->cur_step;
   }
 
-  if (dev->probe.d_terminal->state != dev->probe.prev_d_state) {
+  if (lsim_dev_in_state(lsim, dev->probe.d_terminal) != dev->probe.prev_d_state) {
     dev->probe.d_changes_in_step++;
   }
 
-  if (dev->probe.c_terminal->state != dev->probe.prev_c_state) {
+  if (lsim_dev_in_state(lsim, dev->probe.c_terminal) != dev->probe.prev_c_state) {
     dev->probe.c_changes_in_step++;
     if (dev->probe.c_changes_in_step > 1) {
-      printf("Warning: probe %s: control trigger glitch, step %ld\n", dev->name, lsim->cur_step);
+      if (! lsim->replaying) {
+        lsim_log(lsim, LSIM_LOG_PROBE_GLITCH, dev->name, 0, lsim->cur_step);
+      }
       lsim->total_warnings++;
     }
   }
 
   if (dev->probe.flags & LSIM_DEV_PROBE_FLAGS_RISING_EDGE) {
-    if (dev->probe.c_terminal->state && ! dev->probe.prev_c_state) {
+    if (lsim_dev_in_state(lsim, dev->probe.c_terminal) && ! dev->probe.prev_c_state) {
       /* Control edge rising trigger. */
       dev->probe.c_triggers_in_step++;
       if (dev->probe.d_changes_in_step > 0) {
         /* Data changes prior to */
         if (dev->probe.c_triggers_in_step >= 1) { /* first trigger. */
-          printf("Warning: probe %s: data changed before rising control trigger, step %ld\n", dev->name, lsim->cur_step);
+          if (! lsim->replaying) {
+            lsim_log(lsim, LSIM_LOG_PROBE_RISING, dev->name, 0, lsim->cur_step);
+          }
           lsim->total_warnings++;
         }
       }
     }
   }
   else {  /* Triggers on falling edge. */
-    if (! dev->probe.c_terminal->state && dev->probe.prev_c_state) {
+    if (! lsim_dev_in_state(lsim, dev->probe.c_terminal) && dev->probe.prev_c_state) {
       /* Control edge falling trigger. */
       dev->probe.c_triggers_in_step++;
       if (dev->probe.d_changes_in_step > 0) {
-        printf("Warning: probe %s: data changed before falling control trigger, step %ld\n", dev->name, lsim->cur_step);
+        if (! lsim->replaying) {
+          lsim_log(lsim, LSIM_LOG_PROBE_FALLING, dev->name, 0, lsim->cur_step);
+        }
         lsim->total_warnings++;
       }
     }
   }
 
-  dev->probe.prev_d_state = dev->probe.d_terminal->state;
-  dev->probe.prev_c_state = dev->probe.c_terminal->state;
+  dev->probe.prev_d_state = lsim_dev_in_state(lsim, dev->probe.d_terminal);
+  dev->probe.prev_c_state = lsim_dev_in_state(lsim, dev->probe.c_terminal);
 
   return ERR_OK;
 }  /* lsim_devs_probe_run_logic */
@@ -142,11 +148,7 @@ ERR_F lsim_devs_probe_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_PROBE, LSIM_ERR_INTERNAL);
 
-  free(dev->probe.d_terminal);
-  free(dev->probe.c_terminal);
-
-  free(dev->name);
-  free(dev);
+  /* Terminals are freed with their chunks (see lsim_delete). */
 
   return ERR_OK;
 }  /* lsim_devs_probe_delete */
@@ -154,19 +156,16 @@ ERR_F lsim_devs_probe_delete(lsim_t *lsim, lsim_dev_t *dev) {
 
 ERR_F lsim_devs_probe_create(lsim_t *lsim, char *dev_name, long flags) {
   /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
 
   lsim_dev_t *dev;
   ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+  dev->name = name;
   dev->type = LSIM_DEV_TYPE_PROBE;
   dev->probe.flags = flags;
-  ERR(err_calloc((void **)&(dev->probe.d_terminal), 1, sizeof(lsim_dev_in_terminal_t)));
-  dev->probe.d_terminal->dev = dev;
-  ERR(err_calloc((void **)&(dev->probe.c_terminal), 1, sizeof(lsim_dev_in_terminal_t)));
-  dev->probe.c_terminal->dev = dev;
+  ERR(lsim_dev_in_terminal_create(lsim, dev, &dev->probe.d_terminal));
+  ERR(lsim_dev_in_terminal_create(lsim, dev, &dev->probe.c_terminal));
 
   /* Type-specific methods (inheritance). */
   dev->get_out_terminal = lsim_devs_probe_get_out_terminal;
@@ -176,7 +175,7 @@ ERR_F lsim_devs_probe_create(lsim_t *lsim, char *dev_name, long flags) {
   dev->propagate_outputs = lsim_devs_probe_propagate_outputs;
   dev->delete = lsim_devs_probe_delete;
 
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
+  ERR(lsim_dev_register(lsim, dev));
 
   return ERR_OK;
 }  /* lsim_devs_probe_create */
@@ -20,6 +20,7 @@
 #include "lsim.h"
 #include "lsim_dev.h"
 #include "lsim_devs.h"
+#include "lsim_name.h"
 
 
 ERR_F lsim_devs_reg_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *out_id, lsim_dev_out_terminal_t **out_terminal, int bit_offset) {
@@ -32,7 +33,7 @@ ERR_F lsim_devs_reg_get_out_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *
     bit_num += bit_offset;
     if (bit_num >= dev->reg.num_bits) { /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "reg %s output %s plus offset %d larger than last bit %d",
-                dev->name, out_id, bit_offset, dev->reg.num_bits - 1);
+                lsim_name_str(lsim, dev->name), out_id, bit_offset, dev->reg.num_bits - 1);
     }
     *out_terminal = dev->reg.q_terminals[bit_num];
   }
@@ -59,7 +60,7 @@ ERR_F lsim_devs_reg_get_in_terminal(lsim_t *lsim, lsim_dev_t *dev, const char *i
     if (bit_num >= dev->reg.num_bits) {
       /* Use throw instead of assert for more useful error message. */
       ERR_THROW(LSIM_ERR_COMMAND, "reg %s input %s plus offset %d larger than last bit %d",
-                dev->name, in_id, bit_offset, dev->reg.num_bits-1);
+                lsim_name_str(lsim, dev->name), in_id, bit_offset, dev->reg.num_bits-1);
     }
     if (in_id[0] == 'd') {
       *in_terminal = dev->reg.d_terminals[bit_num];
@@ -107,8 +108,10 @@ ERR_F lsim_devs_reg_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_REG, LSIM_ERR_INTERNAL);
 
-  free(dev->name);
-  free(dev);
+  /* This is a composite device. The underlying devices will be
+   * deleted on their own. */
+  free(dev->reg.q_terminals);
+  free(dev->reg.d_terminals);
 
   return ERR_OK;
 }  /* lsim_devs_reg_delete */
@@ -118,16 +121,26 @@ ERR_F lsim_devs_reg_create(lsim_t *lsim, char *dev_name, long num_bits) {
   ERR_ASSRT(num_bits >= 1, LSIM_ERR_PARAM);
 
   /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
 
   lsim_dev_t *dev;
   ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
+  dev->name = name;
   dev->type = LSIM_DEV_TYPE_REG;
   dev->reg.num_bits = num_bits;
 
+  /* Type-specific methods (inheritance). Set before registering,
+   * so that lsim_dev_delete_all() can delete a partly built device. */
+  dev->get_out_terminal = lsim_devs_reg_get_out_terminal;
+  dev->get_in_terminal = lsim_devs_reg_get_in_terminal;
+  dev->power = lsim_devs_reg_power;
+  dev->run_logic = lsim_devs_reg_run_logic;
+  dev->propagate_outputs = lsim_devs_reg_propagate_outputs;
+  dev->delete = lsim_devs_reg_delete;
+
+  ERR(lsim_dev_register(lsim, dev));  /* First, so that its parts are named under it. */
+
   ERR(err_calloc((void **)&dev->reg.q_terminals, num_bits, sizeof(lsim_dev_out_terminal_t *)));
   ERR(err_calloc((void **)&dev->reg.d_terminals, num_bits, sizeof(lsim_dev_in_terminal_t *)));
 
@@ -135,7 +148,7 @@ ERR_F lsim_devs_reg_create(lsim_t *lsim, char *dev_name, long num_bits) {
   ERR(err_asprintf(&vcc_name, "%s.vcc", dev_name));
   ERR(lsim_devs_vcc_create(lsim, vcc_name));
   lsim_dev_t *vcc_dev;
-  ERR(hmap_slookup(lsim->devs, vcc_name, (void **)&vcc_dev));
+  ERR(lsim_name_lookup(lsim, vcc_name, &vcc_dev));
 
   /* Create N D-flipflops. */
   int i;
@@ -144,7 +157,7 @@ ERR_F lsim_devs_reg_create(lsim_t *lsim, char *dev_name, long num_bits) {
     ERR(err_asprintf(&dflipflop_name, "%s.dflipflop.%d", dev_name, i));
     ERR(lsim_devs_dflipflop_create(lsim, dflipflop_name));
     lsim_dev_t *dflipflop_dev;
-    ERR(hmap_slookup(lsim->devs, dflipflop_name, (void **)&dflipflop_dev));
+    ERR(lsim_name_lookup(lsim, dflipflop_name, &dflipflop_dev));
 
     /* Set input not needed; connect to VCC. */
     ERR(lsim_dev_connect(lsim, vcc_name, "o0", dflipflop_name, "S0", 0));
@@ -160,16 +173,6 @@ ERR_F lsim_devs_reg_create(lsim_t *lsim, char *dev_name, long num_bits) {
     free(dflipflop_name);
   }
 
-  /* Type-specific methods (inheritance). */
-  dev->get_out_terminal = lsim_devs_reg_get_out_terminal;
-  dev->get_in_terminal = lsim_devs_reg_get_in_terminal;
-  dev->power = lsim_devs_reg_power;
-  dev->run_logic = lsim_devs_reg_run_logic;
-  dev->propagate_outputs = lsim_devs_reg_propagate_outputs;
-  dev->delete = lsim_devs_reg_delete;
-
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
-
   free(vcc_name);
 
   return ERR_OK;
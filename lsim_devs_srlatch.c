@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <ctype.h>
 #include "err.h"
 #include "hmap.h"
@@ -91,60 +92,41 @@ ERR_F lsim_devs_srlatch_delete(lsim_t *lsim, lsim_dev_t *dev) {
   (void)lsim;
   ERR_ASSRT(dev->type == LSIM_DEV_TYPE_SRLATCH, LSIM_ERR_INTERNAL);
 
-  free(dev->name);
-  free(dev);
+  /* This is a composite device. The underlying devices will be
+   * deleted on their own. Nothing to be done here. */
 
   return ERR_OK;
 }  /* lsim_devs_srlatch_delete */
 
 
-ERR_F lsim_devs_srlatch_create(lsim_t *lsim, char *dev_name) {
-  /* Make sure name doesn't already exist. */
-  err_t *err;
-  err = hmap_slookup(lsim->devs, dev_name, NULL);
-  ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+/* Shared by every srlatch instance (see lsim_devs_topo.c). */
+lsim_devs_topo_nand_t lsim_devs_srlatch_nands[] = {
+  {"nand_q", 2},  /* 0 */
+  {"nand_Q", 2},  /* 1 */
+};
+lsim_devs_topo_wire_t lsim_devs_srlatch_wires[] = {
+  {0, 1, 1},  /* q -> Q.i1 */
+  {1, 0, 1},  /* Q -> q.i1 */
+};
+lsim_devs_topo_port_t lsim_devs_srlatch_outs[] = {
+  {offsetof(lsim_dev_t, srlatch.q_terminal), 0, 0},
+  {offsetof(lsim_dev_t, srlatch.Q_terminal), 1, 0},
+};
+lsim_devs_topo_port_t lsim_devs_srlatch_ins[] = {
+  {offsetof(lsim_dev_t, srlatch.S_terminal), 0, 0},
+  {offsetof(lsim_dev_t, srlatch.R_terminal), 1, 0},
+};
+lsim_devs_topo_t lsim_devs_srlatch_topo = {
+  2, lsim_devs_srlatch_nands, 2, lsim_devs_srlatch_wires,
+  2, lsim_devs_srlatch_outs, 2, lsim_devs_srlatch_ins,
+  lsim_devs_srlatch_get_out_terminal, lsim_devs_srlatch_get_in_terminal, lsim_devs_srlatch_power,
+  lsim_devs_srlatch_run_logic, lsim_devs_srlatch_propagate_outputs, lsim_devs_srlatch_delete
+};
 
+
+ERR_F lsim_devs_srlatch_create(lsim_t *lsim, char *dev_name) {
   lsim_dev_t *dev;
-  ERR(err_calloc((void **)&dev, 1, sizeof(lsim_dev_t)));
-  ERR(err_strdup(&(dev->name), dev_name));
-  dev->type = LSIM_DEV_TYPE_SRLATCH;
-
-  char *nand_q_name;
-  ERR(err_asprintf(&nand_q_name, "%s.nand_q", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_q_name, 2));
-  lsim_dev_t *nand_q_dev;
-  ERR(hmap_slookup(lsim->devs, nand_q_name, (void**)&nand_q_dev));
-
-  char *nand_Q_name;
-  ERR(err_asprintf(&nand_Q_name, "%s.nand_Q", dev_name));
-  ERR(lsim_devs_nand_create(lsim, nand_Q_name, 2));
-  lsim_dev_t *nand_Q_dev;
-  ERR(hmap_slookup(lsim->devs, nand_Q_name, (void**)&nand_Q_dev));
-
-  /* Make connections. */
-  ERR(lsim_dev_connect(lsim, nand_q_name, "o0", nand_Q_name, "i1", 0));
-  ERR(lsim_dev_connect(lsim, nand_Q_name, "o0", nand_q_name, "i1", 0));
-
-  /* Save the "external" output terminals. */
-  dev->srlatch.q_terminal = nand_q_dev->nand.o_terminal;
-  dev->srlatch.Q_terminal = nand_Q_dev->nand.o_terminal;
-  /* Save the "external" output terminals. */
-  ERR(lsim_dev_in_chain_add(&dev->srlatch.S_terminal, nand_q_dev->nand.i_terminals[0], NULL));
-  ERR(lsim_dev_in_chain_add(&dev->srlatch.R_terminal, nand_Q_dev->nand.i_terminals[0], NULL));
-
-  /* Type-specific methods (inheritance). */
-  dev->get_out_terminal = lsim_devs_srlatch_get_out_terminal;
-  dev->get_in_terminal = lsim_devs_srlatch_get_in_terminal;
-  dev->power = lsim_devs_srlatch_power;
-  dev->run_logic = lsim_devs_srlatch_run_logic;
-  dev->propagate_outputs = lsim_devs_srlatch_propagate_outputs;
-  dev->delete = lsim_devs_srlatch_delete;
-
-  /* Write the srlatch dev. */
-  ERR(hmap_swrite(lsim->devs, dev_name, dev));
-
-  free(nand_q_name);
-  free(nand_Q_name);
+  ERR(lsim_devs_topo_create(lsim, &lsim_devs_srlatch_topo, dev_name, LSIM_DEV_TYPE_SRLATCH, &dev));
 
   return ERR_OK;
 }  /* lsim_devs_srlatch_create */
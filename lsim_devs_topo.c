@@ -0,0 +1,98 @@
+/* lsim_devs_topo.c - composite devices built from a shared wiring table. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+
+
+/* Build one instance of a composite device. The wiring comes from "topo",
+ * a static table shared by every instance of the type; the instance itself
+ * is a single block carved from a terminal chunk that holds the composite's
+ * record, its nands and their i_terminals arrays. The nands' names are the
+ * table's suffixes interned under the composite's name. Nothing in the
+ * block is freed individually (see lsim_dev_delete).
+ * The nands are created, wired and registered in table order, so
+ * terminal serials and fanout chains come out the same as wiring them one
+ * lsim_dev_connect at a time. The composite is registered first, with
+ * its methods already set so that it can always be deleted. */
+ERR_F lsim_devs_topo_create(lsim_t *lsim, const lsim_devs_topo_t *topo, char *dev_name, int type, lsim_dev_t **rtn_dev) {
+  /* Make sure name doesn't already exist. */
+  lsim_name_t *name;
+  ERR(lsim_name_create(lsim, dev_name, &name));
+
+  size_t block_size = (1 + topo->num_nands) * sizeof(lsim_dev_t);
+  int n;
+  for (n = 0; n < topo->num_nands; n++) {
+    block_size += topo->nands[n].num_inputs * sizeof(lsim_dev_in_terminal_t *);
+  }
+  char *block;
+  ERR(lsim_dev_chunk_alloc(lsim, block_size, (void **)&block));
+
+  lsim_dev_t *dev = (lsim_dev_t *)block;
+  lsim_dev_t *nand_devs = &dev[1];
+  lsim_dev_in_terminal_t **i_terminals = (lsim_dev_in_terminal_t **)&nand_devs[topo->num_nands];
+
+  dev->name = name;
+  dev->type = type;
+  dev->in_chunk = 1;
+  dev->get_out_terminal = topo->get_out_terminal;
+  dev->get_in_terminal = topo->get_in_terminal;
+  dev->power = topo->power;
+  dev->run_logic = topo->run_logic;
+  dev->propagate_outputs = topo->propagate_outputs;
+  dev->delete = topo->delete;
+  ERR(lsim_dev_register(lsim, dev));
+
+  for (n = 0; n < topo->num_nands; n++) {
+    lsim_dev_t *nand_dev = &nand_devs[n];
+    ERR(lsim_name_child(lsim, name, topo->nands[n].suffix, &nand_dev->name));
+    nand_dev->in_chunk = 1;
+
+    ERR(lsim_devs_nand_init(lsim, nand_dev, topo->nands[n].num_inputs, i_terminals));
+    i_terminals += topo->nands[n].num_inputs;
+
+    ERR(lsim_dev_register(lsim, nand_dev));
+  }
+  ERR_ASSRT((char *)i_terminals == block + block_size, LSIM_ERR_INTERNAL);
+
+  /* Internal connections. */
+  int w;
+  for (w = 0; w < topo->num_wires; w++) {
+    const lsim_devs_topo_wire_t *wire = &topo->wires[w];
+    lsim_dev_out_terminal_t *src_out_terminal = nand_devs[wire->src_nand].nand.o_terminal;
+    lsim_dev_in_terminal_t *dst_in_terminal = nand_devs[wire->dst_nand].nand.i_terminals[wire->dst_input];
+    ERR_ASSRT(dst_in_terminal->driving_out_terminal == NULL, LSIM_ERR_INTERNAL);
+    ERR(lsim_dev_in_chain_add(&src_out_terminal->in_terminal_list, dst_in_terminal, src_out_terminal));
+  }
+
+  /* The "external" terminals. */
+  int p;
+  for (p = 0; p < topo->num_outs; p++) {
+    lsim_dev_out_terminal_t **port = (lsim_dev_out_terminal_t **)((char *)dev + topo->outs[p].offset);
+    *port = nand_devs[topo->outs[p].nand].nand.o_terminal;
+  }
+  for (p = 0; p < topo->num_ins; p++) {
+    lsim_dev_in_terminal_t **port = (lsim_dev_in_terminal_t **)((char *)dev + topo->ins[p].offset);
+    ERR(lsim_dev_in_chain_add(port, nand_devs[topo->ins[p].nand].nand.i_terminals[topo->ins[p].input], NULL));
+  }
+
+  *rtn_dev = dev;
+  return ERR_OK;
+}  /* lsim_devs_topo_create */
@@ -0,0 +1,164 @@
+/* lsim_handle.c - C API on pre-resolved handles. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_state.h"
+#include "lsim_handle.h"
+#include "lsim_log.h"
+
+
+/* A device handle is its position in lsim->dev_list, which is kept in
+ * creation order. Terminal handles index lsim->handle_outs/handle_ins,
+ * filled in as they're asked for. */
+
+ERR_F lsim_handle_dev(lsim_t *lsim, const char *dev_name, long *rtn_handle) {
+  lsim_dev_t *dev;
+  ERR(lsim_name_lookup(lsim, dev_name, &dev));
+
+  /* Name ids are in creation order too, so this is a binary search. */
+  long lo = 0;
+  long hi = lsim->num_devs - 1;
+  while (lo <= hi) {
+    long mid = (lo + hi) / 2;
+    uint32_t mid_id = lsim->dev_list[mid]->name->id;
+    if (mid_id == dev->name->id) {
+      *rtn_handle = mid;
+      return ERR_OK;
+    }
+    if (mid_id < dev->name->id) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  ERR_THROW(LSIM_ERR_INTERNAL, "Device '%s' not in dev_list", dev_name);
+}  /* lsim_handle_dev */
+
+
+/* Handles for bits 0..num_bits-1 of out_id (as in the "b;" command) are
+ * consecutive, starting at *rtn_first_handle. */
+ERR_F lsim_handle_out(lsim_t *lsim, const char *dev_name, const char *out_id, int num_bits, long *rtn_first_handle) {
+  ERR_ASSRT(num_bits >= 1 && num_bits <= 64, LSIM_ERR_PARAM);
+  lsim_dev_t *dev;
+  ERR(lsim_name_lookup(lsim, dev_name, &dev));
+
+  if (lsim->num_handle_outs + num_bits > lsim->alloc_handle_outs) {
+    long new_alloc = (lsim->alloc_handle_outs == 0) ? 64 : (lsim->alloc_handle_outs * 2);
+    while (new_alloc < lsim->num_handle_outs + num_bits) {
+      new_alloc *= 2;
+    }
+    lsim_dev_out_terminal_t **new_outs = realloc(lsim->handle_outs, new_alloc * sizeof(lsim_dev_out_terminal_t *));
+    ERR_ASSRT(new_outs, LSIM_ERR_NOMEM);
+    lsim->handle_outs = new_outs;
+    lsim->alloc_handle_outs = new_alloc;
+  }
+
+  int bit;
+  for (bit = 0; bit < num_bits; bit++) {
+    lsim_dev_out_terminal_t *out_terminal = NULL;
+    ERR(dev->get_out_terminal(lsim, dev, out_id, &out_terminal, bit));
+    if (out_terminal == NULL) {
+      ERR_THROW(LSIM_ERR_COMMAND, "Device '%s' has no output '%s' (bit %d)", dev_name, out_id, bit);
+    }
+    lsim->handle_outs[lsim->num_handle_outs + bit] = out_terminal;
+  }
+
+  *rtn_first_handle = lsim->num_handle_outs;
+  lsim->num_handle_outs += num_bits;
+  return ERR_OK;
+}  /* lsim_handle_out */
+
+
+ERR_F lsim_handle_in(lsim_t *lsim, const char *dev_name, const char *in_id, int num_bits, long *rtn_first_handle) {
+  ERR_ASSRT(num_bits >= 1 && num_bits <= 64, LSIM_ERR_PARAM);
+  lsim_dev_t *dev;
+  ERR(lsim_name_lookup(lsim, dev_name, &dev));
+
+  if (lsim->num_handle_ins + num_bits > lsim->alloc_handle_ins) {
+    long new_alloc = (lsim->alloc_handle_ins == 0) ? 64 : (lsim->alloc_handle_ins * 2);
+    while (new_alloc < lsim->num_handle_ins + num_bits) {
+      new_alloc *= 2;
+    }
+    lsim_dev_in_terminal_t **new_ins = realloc(lsim->handle_ins, new_alloc * sizeof(lsim_dev_in_terminal_t *));
+    ERR_ASSRT(new_ins, LSIM_ERR_NOMEM);
+    lsim->handle_ins = new_ins;
+    lsim->alloc_handle_ins = new_alloc;
+  }
+
+  int bit;
+  for (bit = 0; bit < num_bits; bit++) {
+    lsim_dev_in_terminal_t *in_terminal = NULL;
+    ERR(dev->get_in_terminal(lsim, dev, in_id, &in_terminal, bit));
+    if (in_terminal == NULL) {
+      ERR_THROW(LSIM_ERR_COMMAND, "Device '%s' has no input '%s' (bit %d)", dev_name, in_id, bit);
+    }
+    lsim->handle_ins[lsim->num_handle_ins + bit] = in_terminal;
+  }
+
+  *rtn_first_handle = lsim->num_handle_ins;
+  lsim->num_handle_ins += num_bits;
+  return ERR_OK;
+}  /* lsim_handle_in */
+
+
+/* Set a switch, like "m;" but without running the logic; any number of
+ * pokes can be made before lsim_handle_step(). "back" replays them the
+ * same way (see lsim_dev_poke). */
+ERR_F lsim_handle_poke(lsim_t *lsim, long dev_handle, int new_state) {
+  ERR_ASSRT(dev_handle >= 0 && dev_handle < lsim->num_devs, LSIM_ERR_PARAM);
+  ERR_ASSRT(new_state == 0 || new_state == 1, LSIM_ERR_PARAM);
+  lsim_dev_t *dev = lsim->dev_list[dev_handle];
+  ERR_ASSRT(dev->type == LSIM_DEV_TYPE_SWTCH, LSIM_ERR_PARAM);
+
+  ERR(lsim_dev_poke(lsim, dev, new_state));
+
+  return ERR_OK;
+}  /* lsim_handle_poke */
+
+
+/* Run the logic until it settles (what "m;" does after moving a switch). */
+ERR_F lsim_handle_step(lsim_t *lsim) {
+  err_t *err = lsim_dev_settle(lsim);
+  lsim_log_flush(lsim);  /* The caller's output comes after the run's. */
+  if (err) {
+    ERR_RETHROW(err, "Step");
+  }
+
+  return ERR_OK;
+}  /* lsim_handle_step */
+
+
+ERR_F lsim_handle_ticklet(lsim_t *lsim, long num_ticklets) {
+  ERR_ASSRT(num_ticklets >= 0, LSIM_ERR_PARAM);
+
+  err_t *err = ERR_OK;
+  long i;
+  for (i = 0; i < num_ticklets && err == ERR_OK; i++) {
+    err = lsim_dev_ticklet(lsim);
+  }
+  lsim_log_flush(lsim);  /* The caller's output comes after the run's. */
+  if (err) {
+    ERR_RETHROW(err, "Ticklet %ld", lsim->total_ticklets);
+  }
+
+  return ERR_OK;
+}  /* lsim_handle_ticklet */
@@ -0,0 +1,68 @@
+/* lsim_handle.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_HANDLE_H
+#define LSIM_HANDLE_H
+
+#include <stdint.h>
+#include "err.h"
+#include "lsim.h"
+#include "lsim_devs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Driving a simulation from C without text commands. Names are resolved
+ * to integer handles once; poke, step and peek then do no string work.
+ * Handles stay valid until lsim_delete(), across power-up. A typical testbench loop:
+ *
+ *   lsim_handle_dev(lsim, "rst", &rst);
+ *   lsim_handle_out(lsim, "acc", "q0", 16, &acc_q);
+ *   lsim_cmd_line(lsim, "p;");
+ *   lsim_handle_poke(lsim, rst, 1);
+ *   lsim_handle_step(lsim);
+ *   lsim_handle_ticklet(lsim, 1000000);
+ *   value = lsim_handle_peek_word(lsim, acc_q, 16);
+ */
+
+ERR_F lsim_handle_dev(lsim_t *lsim, const char *dev_name, long *rtn_handle);
+ERR_F lsim_handle_out(lsim_t *lsim, const char *dev_name, const char *out_id, int num_bits, long *rtn_first_handle);
+ERR_F lsim_handle_in(lsim_t *lsim, const char *dev_name, const char *in_id, int num_bits, long *rtn_first_handle);
+ERR_F lsim_handle_poke(lsim_t *lsim, long dev_handle, int new_state);
+ERR_F lsim_handle_step(lsim_t *lsim);
+ERR_F lsim_handle_ticklet(lsim_t *lsim, long num_ticklets);
+
+/* The peeks don't check their handles; use ones returned above. */
+static inline int lsim_handle_peek(lsim_t *lsim, long out_handle) {
+  return lsim_dev_out_state(lsim, lsim->handle_outs[out_handle]);
+}
+
+static inline int lsim_handle_peek_in(lsim_t *lsim, long in_handle) {
+  return lsim_dev_in_state(lsim, lsim->handle_ins[in_handle]);
+}
+
+/* Bit n of the result is handle first_handle + n. */
+static inline uint64_t lsim_handle_peek_word(lsim_t *lsim, long first_handle, int num_bits) {
+  uint64_t word = 0;
+  int bit;
+  for (bit = num_bits - 1; bit >= 0; bit--) {
+    word = (word << 1) | (uint64_t)lsim_dev_out_state(lsim, lsim->handle_outs[first_handle + bit]);
+  }
+  return word;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_HANDLE_H
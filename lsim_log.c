@@ -0,0 +1,239 @@
+/* lsim_log.c - engine messages, printed by a writer thread. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_name.h"
+#include "lsim_log.h"
+
+
+/* The engine doesn't format its messages: lsim_log() puts a small record
+ * in a ring and a writer thread formats and prints it. Anything else that
+ * prints to stdout first calls lsim_log_flush(), which waits until the
+ * ring is empty, so the output comes out in the same order as printing
+ * directly. Every command ends with a flush (see lsim_cmd_line_inplace()),
+ * so no names are created or devices deleted with records still queued. */
+
+
+void lsim_log_fprint(FILE *fp, const lsim_log_rec_t *rec, const char *name) {
+  switch (rec->type) {
+  case LSIM_LOG_STEP:
+    fprintf(fp, " Step %ld:\n", rec->num);
+    break;
+  case LSIM_LOG_CYCLE:
+    fprintf(fp, "  Cycle %ld:\n", rec->num);
+    break;
+  case LSIM_LOG_TICKLET:
+    fprintf(fp, " Ticklet %ld\n", rec->num);
+    break;
+  case LSIM_LOG_NAND:
+    fprintf(fp, "  nand %s: o0=%d\n", name, rec->val);
+    break;
+  case LSIM_LOG_SWTCH:
+    fprintf(fp, "  swtch %s: o0=%d\n", name, rec->val);
+    break;
+  case LSIM_LOG_VCC:
+    fprintf(fp, "  vcc %s: o0=%d\n", name, rec->val);
+    break;
+  case LSIM_LOG_GND:
+    fprintf(fp, "  gnd %s: o0=%d\n", name, rec->val);
+    break;
+  case LSIM_LOG_CLK:
+    fprintf(fp, "  clk %s: q0=%d, Q0=%d\n", name, rec->val & 1, (rec->val >> 1) & 1);
+    break;
+  case LSIM_LOG_MEM:
+    fprintf(fp, "  mem %s: o=%ld (0x%lx)\n", name, rec->num, rec->num);
+    break;
+  case LSIM_LOG_LED:
+    fprintf(fp, "Led %s: %s (ticklet %ld)%s\n", name, (rec->val & 1) ? "on" : "off", rec->num, (rec->val & 2) ? " glitch" : "");
+    break;
+  case LSIM_LOG_PROBE_GLITCH:
+    fprintf(fp, "Warning: probe %s: control trigger glitch, step %ld\n", name, rec->num);
+    break;
+  case LSIM_LOG_PROBE_RISING:
+    fprintf(fp, "Warning: probe %s: data changed before rising control trigger, step %ld\n", name, rec->num);
+    break;
+  case LSIM_LOG_PROBE_FALLING:
+    fprintf(fp, "Warning: probe %s: data changed before falling control trigger, step %ld\n", name, rec->num);
+    break;
+  default:
+    fprintf(fp, "Log: unknown record type %d\n", rec->type);
+  }
+}  /* lsim_log_fprint */
+
+
+/* Print a record from the engine's thread. */
+void lsim_log_print(lsim_t *lsim, const lsim_log_rec_t *rec) {
+  lsim_log_fprint(stdout, rec, (rec->name) ? lsim_name_str(lsim, rec->name) : "");
+}  /* lsim_log_print */
+
+
+/* Print the queued records in batches until told to stop. */
+void *lsim_log_writer(void *arg) {
+  lsim_log_t *log = (lsim_log_t *)arg;
+  char name_buf[1024];
+
+  pthread_mutex_lock(&log->lock);
+  while (1) {
+    uint64_t tail = atomic_load_explicit(&log->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&log->head, memory_order_acquire);
+    int urgent = log->sim_waiting || log->stopping;
+    if (head == tail) {
+      if (log->stopping) {
+        break;
+      }
+      if (log->sim_waiting) {
+        pthread_cond_broadcast(&log->cond);  /* Flushed. */
+      }
+    }
+    if (head == tail || (head - tail < LSIM_LOG_BATCH_RECS && ! urgent)) {
+      /* Sequentially consistent: if lsim_log() doesn't see the flag, this
+       * sees its new head. */
+      atomic_store(&log->writer_waiting, 1);
+      head = atomic_load(&log->head);
+      if (head == tail || (head - tail < LSIM_LOG_BATCH_RECS && ! urgent)) {
+        pthread_cond_wait(&log->cond, &log->lock);
+      }
+      atomic_store(&log->writer_waiting, 0);
+      continue;
+    }
+    pthread_mutex_unlock(&log->lock);
+
+    flockfile(stdout);
+    while (tail != head) {
+      const lsim_log_rec_t *rec = &log->recs[tail % LSIM_LOG_RING_RECS];
+      const char *name = (rec->name) ? lsim_name_str_r(log->lsim, rec->name, name_buf, sizeof(name_buf)) : "";
+      lsim_log_fprint(stdout, rec, name);
+      tail++;
+    }
+    funlockfile(stdout);
+    atomic_store_explicit(&log->tail, tail, memory_order_release);
+
+    pthread_mutex_lock(&log->lock);
+    if (log->sim_waiting) {
+      pthread_cond_broadcast(&log->cond);
+    }
+  }
+  pthread_mutex_unlock(&log->lock);
+
+  return NULL;
+}  /* lsim_log_writer */
+
+
+/* The ring is full (LSIM_LOG_BLOCK): wait for the writer to make room. */
+void lsim_log_wait(lsim_t *lsim) {
+  lsim_log_t *log = lsim->log;
+  pthread_mutex_lock(&log->lock);
+  log->sim_waiting = 1;
+  pthread_cond_broadcast(&log->cond);
+  while (atomic_load(&log->head) - atomic_load(&log->tail) >= LSIM_LOG_RING_RECS) {
+    pthread_cond_wait(&log->cond, &log->lock);
+  }
+  log->sim_waiting = 0;
+  pthread_mutex_unlock(&log->lock);
+}  /* lsim_log_wait */
+
+
+void lsim_log_wake(lsim_t *lsim) {
+  lsim_log_t *log = lsim->log;
+  pthread_mutex_lock(&log->lock);
+  pthread_cond_broadcast(&log->cond);
+  pthread_mutex_unlock(&log->lock);
+}  /* lsim_log_wake */
+
+
+/* Wait until everything queued is printed (and in stdout's buffer), so
+ * the caller's own output comes after it. */
+void lsim_log_flush(lsim_t *lsim) {
+  lsim_log_t *log = lsim->log;
+  if (log == NULL) {
+    return;
+  }
+  if (atomic_load(&log->head) != atomic_load(&log->tail)) {
+    pthread_mutex_lock(&log->lock);
+    log->sim_waiting = 1;
+    pthread_cond_broadcast(&log->cond);
+    while (atomic_load(&log->head) != atomic_load(&log->tail)) {
+      pthread_cond_wait(&log->cond, &log->lock);
+    }
+    log->sim_waiting = 0;
+    pthread_mutex_unlock(&log->lock);
+  }
+
+  if (log->num_dropped > 0) {
+    printf("Warning: %ld messages dropped (async_output=2)\n", log->num_dropped);
+    log->num_dropped = 0;
+  }
+}  /* lsim_log_flush */
+
+
+ERR_F lsim_log_start(lsim_t *lsim, int mode) {
+  ERR_ASSRT(lsim->log == NULL, LSIM_ERR_INTERNAL);
+  ERR_ASSRT(mode == LSIM_LOG_BLOCK || mode == LSIM_LOG_DROP, LSIM_ERR_PARAM);
+
+  lsim_log_t *log;
+  ERR(err_calloc((void **)&log, 1, sizeof(lsim_log_t)));
+  log->lsim = lsim;
+  log->mode = mode;
+  err_t *err = err_calloc((void **)&log->recs, LSIM_LOG_RING_RECS, sizeof(lsim_log_rec_t));
+  if (err) {
+    free(log);
+    ERR_RETHROW(err, "Log ring");
+  }
+  atomic_init(&log->head, 0);
+  atomic_init(&log->tail, 0);
+  atomic_init(&log->writer_waiting, 0);
+
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_cond_init(&log->cond, NULL);
+  if (pthread_create(&log->writer, NULL, lsim_log_writer, log) != 0) {
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->cond);
+    free(log->recs);
+    free(log);
+    ERR_THROW(LSIM_ERR_INTERNAL, "Can't start log writer thread");
+  }
+
+  lsim->log = log;
+  return ERR_OK;
+}  /* lsim_log_start */
+
+
+/* Print what's queued and end the writer. */
+ERR_F lsim_log_stop(lsim_t *lsim) {
+  lsim_log_t *log = lsim->log;
+  ERR_ASSRT(log, LSIM_ERR_INTERNAL);
+
+  lsim_log_flush(lsim);
+  pthread_mutex_lock(&log->lock);
+  log->stopping = 1;
+  pthread_cond_broadcast(&log->cond);
+  pthread_mutex_unlock(&log->lock);
+  pthread_join(log->writer, NULL);
+  pthread_mutex_destroy(&log->lock);
+  pthread_cond_destroy(&log->cond);
+
+  lsim->log = NULL;
+  free(log->recs);
+  free(log);
+
+  return ERR_OK;
+}  /* lsim_log_stop */
@@ -0,0 +1,122 @@
+/* lsim_log.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_LOG_H
+#define LSIM_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Messages the engine prints while running (watch, verbosity, leds,
+ * probe warnings), one record type per format. */
+#define LSIM_LOG_STEP 1  /* num=step */
+#define LSIM_LOG_CYCLE 2  /* num=cycle */
+#define LSIM_LOG_TICKLET 3  /* num=ticklet */
+#define LSIM_LOG_NAND 4  /* val=o0 */
+#define LSIM_LOG_SWTCH 5  /* val=o0 */
+#define LSIM_LOG_VCC 6  /* val=o0 */
+#define LSIM_LOG_GND 7  /* val=o0 */
+#define LSIM_LOG_CLK 8  /* val=q0 | Q0 << 1 */
+#define LSIM_LOG_MEM 9  /* num=o */
+#define LSIM_LOG_LED 10  /* val=on | glitch << 1, num=ticklet */
+#define LSIM_LOG_PROBE_GLITCH 11  /* num=step */
+#define LSIM_LOG_PROBE_RISING 12  /* num=step */
+#define LSIM_LOG_PROBE_FALLING 13  /* num=step */
+
+/* Config "async_output". */
+#define LSIM_LOG_DIRECT 0  /* printf from the engine. */
+#define LSIM_LOG_BLOCK 1  /* Writer thread; the engine waits when the ring is full. */
+#define LSIM_LOG_DROP 2  /* Writer thread; messages are dropped (and counted) when it's full. */
+
+/* Ring size in records (a power of 2). The writer is woken when this
+ * many are waiting, or when the output is needed (lsim_log_flush()). */
+#define LSIM_LOG_RING_RECS (64 * 1024)
+#define LSIM_LOG_BATCH_RECS 4096
+
+typedef struct lsim_log_rec_s {
+  int type;  /* LSIM_LOG_xxx */
+  int val;
+  const lsim_name_t *name;
+  long num;
+} lsim_log_rec_t;
+
+/* Single producer (the engine), single consumer (the writer thread). */
+struct lsim_log_s {
+  lsim_t *lsim;
+  int mode;  /* LSIM_LOG_BLOCK or LSIM_LOG_DROP. */
+  lsim_log_rec_t *recs;  /* LSIM_LOG_RING_RECS of them. */
+  _Atomic uint64_t head;  /* Next to fill; only the engine moves it. */
+  _Atomic uint64_t tail;  /* Next to print; only the writer moves it. */
+  _Atomic int writer_waiting;  /* Writer is (about to be) asleep. */
+  long num_dropped;  /* Since the last lsim_log_flush(). */
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int sim_waiting;  /* Under "lock": engine waits for the writer. */
+  int stopping;  /* Under "lock". */
+};
+
+ERR_F lsim_log_start(lsim_t *lsim, int mode);
+ERR_F lsim_log_stop(lsim_t *lsim);
+void lsim_log_flush(lsim_t *lsim);
+void lsim_log_print(lsim_t *lsim, const lsim_log_rec_t *rec);
+void lsim_log_wait(lsim_t *lsim);
+void lsim_log_wake(lsim_t *lsim);
+
+/* Print a message, or queue it for the writer thread. */
+static inline void lsim_log(lsim_t *lsim, int type, const lsim_name_t *name, int val, long num) {
+  lsim_log_t *log = lsim->log;
+  lsim_log_rec_t *rec;
+  if (log == NULL) {
+    lsim_log_rec_t direct_rec;
+    direct_rec.type = type;
+    direct_rec.val = val;
+    direct_rec.name = name;
+    direct_rec.num = num;
+    lsim_log_print(lsim, &direct_rec);
+    return;
+  }
+
+  uint64_t head = atomic_load_explicit(&log->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&log->tail, memory_order_acquire) >= LSIM_LOG_RING_RECS) {
+    if (log->mode == LSIM_LOG_DROP) {
+      log->num_dropped++;
+      return;
+    }
+    lsim_log_wait(lsim);
+  }
+  rec = &log->recs[head % LSIM_LOG_RING_RECS];
+  rec->type = type;
+  rec->val = val;
+  rec->name = name;
+  rec->num = num;
+  /* Sequentially consistent, paired with the writer setting writer_waiting
+   * before it looks at head (see lsim_log_writer()). */
+  atomic_store(&log->head, head + 1);
+  if (atomic_load(&log->writer_waiting) && head + 1 - atomic_load_explicit(&log->tail, memory_order_relaxed) >= LSIM_LOG_BATCH_RECS) {
+    lsim_log_wake(lsim);
+  }
+}  /* lsim_log */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_LOG_H
@@ -20,6 +20,8 @@
 #include "err.h"
 #include "lsim.h"
 #include "lsim_cmd.h"
+#include "lsim_netlist.h"
+#include "lsim_stats.h"
 
 #if defined(_WIN32)
 #define MY_SLEEP_MS(msleep_msecs) Sleep(msleep_msecs)
@@ -30,6 +32,8 @@
 
 /* Options */
 char *o_config_file = NULL;
+char *o_compile_file = NULL;
+char *o_netlist_file = NULL;
 
 /* Positional parameters. */
 char *p_cmd_file = NULL;
@@ -38,7 +42,7 @@ char *p_cmd_file = NULL;
 long global_error_reaction = 1;
 
 
-char usage_str[] = "Usage: lsim_main [-h] [-c config_file] command_file";
+char usage_str[] = "Usage: lsim_main [-h] [-c config_file] [-o compiled_netlist] [-n compiled_netlist] command_file";
 void usage(char *msg) {
   if (msg) fprintf(stderr, "\n%s\n\n", msg);
   fprintf(stderr, "%s\n", usage_str);
@@ -50,6 +54,10 @@ void help() {
     "where:\n"
     "  -h - print help\n"
     "  -c config_file - configuration file.\n"
+    "  -o compiled_netlist - after running command_file, write its define and\n"
+    "     connect commands to compiled_netlist.\n"
+    "  -n compiled_netlist - build the circuit from compiled_netlist before\n"
+    "     running command_file.\n"
     "command_file - can be set to '-' for stdin\n"
     "For details, see https://github.com/fordsfords/lsim\n",
     usage_str);
@@ -71,6 +79,18 @@ ERR_F parse_cmdline(int argc, char **argv) {
       if (o_config_file) { free(o_config_file); }  /* Free a previous setting. */
       ERR(err_strdup(&o_config_file, argv[opt]));
 
+    } else if (strcmp(argv[opt], "-o") == 0) {
+      opt++;  /* Step past -o to get to the compiled_netlist. */
+      ERR_ASSRT(opt < argc, LSIM_ERR_PARAM);
+      if (o_compile_file) { free(o_compile_file); }
+      ERR(err_strdup(&o_compile_file, argv[opt]));
+
+    } else if (strcmp(argv[opt], "-n") == 0) {
+      opt++;  /* Step past -n to get to the compiled_netlist. */
+      ERR_ASSRT(opt < argc, LSIM_ERR_PARAM);
+      if (o_netlist_file) { free(o_netlist_file); }
+      ERR(err_strdup(&o_netlist_file, argv[opt]));
+
     } else if (strcmp(argv[opt], "--") == 0) {
       opt++;  /* Step past "--". */
       break;  /* End of options. */
@@ -105,7 +125,21 @@ ERR_F lsim_main(int argc, char **argv) {
 
   ERR(lsim_create(&lsim, o_config_file));
 
+  if (o_compile_file) {
+    ERR(lsim_netlist_record_start(lsim));
+  }
+  if (o_netlist_file) {
+    ERR(lsim_netlist_load(lsim, o_netlist_file));
+  }
+
   ERR(lsim_cmd_file(lsim, p_cmd_file));
+  if (lsim->step_stats) {
+    ERR(lsim_stats_step_print(lsim));
+  }
+
+  if (o_compile_file) {
+    ERR(lsim_netlist_write(lsim, o_compile_file));
+  }
 
   ERR(lsim_delete(lsim));
 
@@ -0,0 +1,283 @@
+/* lsim_module.c - user-defined composite devices. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_netlist.h"
+#include "lsim_module.h"
+
+
+/* A module body is run once, into a private "scratch" lsim with netlist
+ * recording on. The recorded devices and connections, plus the terminal
+ * serials named by the port commands, are the template. An instance
+ * creates the recorded devices and wires them by serial (see
+ * lsim_devs_module.c), with no command parsing or connection lookups. */
+
+
+char *lsim_module_builtin_types[] = {
+  "probe", "gnd", "vcc", "swtch", "clk", "led", "nand", "mem", "srlatch",
+  "dflipflop", "reg", "panel", "addbit", "addword", NULL
+};
+
+
+void lsim_module_free(lsim_module_t *module) {
+  long p;
+  for (p = 0; p < module->num_in_ports; p++) {
+    free(module->in_ports[p].serials);
+  }
+  for (p = 0; p < module->num_out_ports; p++) {
+    free(module->out_ports[p].serials);
+  }
+  free(module->in_ports);
+  free(module->out_ports);
+  lsim_netlist_rec_free(module->rec);
+  free(module->name);
+  free(module);
+}  /* lsim_module_free */
+
+
+/* Start compiling a module. Commands for its body go to *rtn_scratch. */
+ERR_F lsim_module_begin(lsim_t *lsim, char *name, lsim_t **rtn_scratch) {
+  ERR_ASSRT(lsim->cur_module == NULL, LSIM_ERR_COMMAND);  /* No nested definitions. */
+  int i;
+  for (i = 0; lsim_module_builtin_types[i]; i++) {
+    if (strcmp(name, lsim_module_builtin_types[i]) == 0) {
+      ERR_THROW(LSIM_ERR_EXIST, "Module name '%s' is a built-in device type", name);
+    }
+  }
+  if (lsim->modules) {
+    err_t *err = hmap_slookup(lsim->modules, name, NULL);
+    ERR_ASSRT(err && err->code == HMAP_ERR_NOTFOUND, LSIM_ERR_EXIST);
+    err_dispose(err);
+  }
+
+  lsim_module_t *module;
+  ERR(err_calloc((void **)&module, 1, sizeof(lsim_module_t)));
+  ERR(err_strdup(&module->name, name));
+
+  /* lsim_create() sets the error reaction from its (default) config. */
+  long save_error_reaction = global_error_reaction;
+  lsim_t *scratch;
+  err_t *err = lsim_create(&scratch, NULL);
+  global_error_reaction = save_error_reaction;
+  if (err) {
+    lsim_module_free(module);
+    ERR_RETHROW(err, "module %s", name);
+  }
+  scratch->modules = lsim->modules;  /* Borrowed, for instances inside the body. */
+  scratch->cur_module = module;
+  ERR(lsim_netlist_record_start(scratch));
+
+  *rtn_scratch = scratch;
+  return ERR_OK;
+}  /* lsim_module_begin */
+
+
+ERR_F lsim_module_port_add(lsim_module_port_t *port, long serial) {
+  if (port->num_serials == port->alloc_serials) {
+    long new_alloc = port->alloc_serials ? port->alloc_serials * 2 : 4;
+    long *new_serials = realloc(port->serials, new_alloc * sizeof(long));
+    ERR_ASSRT(new_serials, LSIM_ERR_NOMEM);
+    port->serials = new_serials;
+    port->alloc_serials = new_alloc;
+  }
+  port->serials[port->num_serials] = serial;
+  port->num_serials++;
+
+  return ERR_OK;
+}  /* lsim_module_port_add */
+
+
+ERR_F lsim_module_port_id(const char *id, int bit_offset, char *rtn_prefix, int *rtn_index) {
+  ERR_ASSRT(isalpha((unsigned char)id[0]), LSIM_ERR_COMMAND);
+  long index;
+  ERR(err_atol(id + 1, &index));
+  index += bit_offset;
+  ERR_ASSRT(index >= 0, LSIM_ERR_COMMAND);
+
+  *rtn_prefix = id[0];
+  *rtn_index = (int)index;
+  return ERR_OK;
+}  /* lsim_module_port_id */
+
+
+ERR_F lsim_module_find_port(lsim_module_t *module, int is_out, const char *id, int bit_offset, long *rtn_port) {
+  char prefix;
+  int index;
+  ERR(lsim_module_port_id(id, bit_offset, &prefix, &index));
+
+  lsim_module_port_t *ports = is_out ? module->out_ports : module->in_ports;
+  long num_ports = is_out ? module->num_out_ports : module->num_in_ports;
+  long p;
+  for (p = 0; p < num_ports; p++) {
+    if (ports[p].id_prefix == prefix && ports[p].id_index == index) {
+      *rtn_port = p;
+      return ERR_OK;
+    }
+  }
+
+  ERR_THROW(LSIM_ERR_COMMAND, "Module %s has no %s '%c%d'", module->name, is_out ? "output" : "input", prefix, index);
+}  /* lsim_module_find_port */
+
+
+/* "in;" or "out;" inside a module body. An input port can be given more
+ * than once to fan out to several inputs. */
+ERR_F lsim_module_port(lsim_t *scratch, int is_out, char *port_id, char *dev_name, char *terminal_id) {
+  lsim_module_t *module = scratch->cur_module;
+  if (module == NULL) {
+    ERR_THROW(LSIM_ERR_COMMAND, "Port '%s' outside of a module", port_id);
+  }
+
+  char prefix;
+  int index;
+  ERR(lsim_module_port_id(port_id, 0, &prefix, &index));
+  lsim_dev_t *dev;
+  ERR(lsim_name_lookup(scratch, dev_name, &dev));
+
+  long p;
+  lsim_module_port_t *ports = is_out ? module->out_ports : module->in_ports;
+  long num_ports = is_out ? module->num_out_ports : module->num_in_ports;
+  for (p = 0; p < num_ports; p++) {
+    if (ports[p].id_prefix == prefix && ports[p].id_index == index) break;
+  }
+  if (p < num_ports && is_out) {
+    ERR_THROW(LSIM_ERR_EXIST, "Module %s output '%s' already defined", module->name, port_id);
+  }
+  if (p == num_ports) {  /* New port. */
+    long *alloc_ports = is_out ? &module->alloc_out_ports : &module->alloc_in_ports;
+    if (num_ports == *alloc_ports) {
+      long new_alloc = *alloc_ports ? *alloc_ports * 2 : 8;
+      ports = realloc(ports, new_alloc * sizeof(lsim_module_port_t));
+      ERR_ASSRT(ports, LSIM_ERR_NOMEM);
+      *alloc_ports = new_alloc;
+      if (is_out) { module->out_ports = ports; } else { module->in_ports = ports; }
+    }
+    memset(&ports[p], 0, sizeof(lsim_module_port_t));
+    ports[p].id_prefix = prefix;
+    ports[p].id_index = index;
+    if (is_out) { module->num_out_ports++; } else { module->num_in_ports++; }
+  }
+
+  if (is_out) {
+    lsim_dev_out_terminal_t *out_terminal;
+    ERR(dev->get_out_terminal(scratch, dev, terminal_id, &out_terminal, 0));
+    ERR(lsim_module_port_add(&ports[p], out_terminal->net_id - 1));
+  }
+  else {
+    lsim_dev_in_terminal_t *in_terminal;
+    ERR(dev->get_in_terminal(scratch, dev, terminal_id, &in_terminal, 0));
+    /* Composite inputs are chains; keep every member. */
+    for (; in_terminal; in_terminal = in_terminal->next_in_terminal) {
+      long q, s;
+      for (q = 0; q < module->num_in_ports; q++) {
+        for (s = 0; s < module->in_ports[q].num_serials; s++) {
+          if (module->in_ports[q].serials[s] == in_terminal->serial) {
+            ERR_THROW(LSIM_ERR_COMMAND, "Module %s: %s;%s is already an input port", module->name, dev_name, terminal_id);
+          }
+        }
+      }
+      ERR(lsim_module_port_add(&ports[p], in_terminal->serial));
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_module_port */
+
+
+/* Finish compiling; the module is then available to "d;". Deletes scratch
+ * whether or not it succeeds; on error, the module is discarded too. */
+ERR_F lsim_module_end(lsim_t *lsim, lsim_t *scratch) {
+  lsim_module_t *module = scratch->cur_module;
+  ERR_ASSRT(module, LSIM_ERR_INTERNAL);
+  err_t *err = ERR_OK;
+
+  /* Inputs driven inside the module can't also be ports. */
+  long p, s;
+  for (p = 0; p < module->num_in_ports && err == ERR_OK; p++) {
+    for (s = 0; s < module->in_ports[p].num_serials && err == ERR_OK; s++) {
+      if (scratch->in_terminals[module->in_ports[p].serials[s]]->driving_out_terminal) {
+        err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_COMMAND, "Module %s input '%c%d' is driven inside the module",
+                          module->name, module->in_ports[p].id_prefix, module->in_ports[p].id_index);
+      }
+    }
+  }
+  if (err) {
+    err_t *abort_err = lsim_module_abort(lsim, scratch);
+    if (abort_err) { err_dispose(abort_err); }
+    return err;
+  }
+
+  module->rec = scratch->netlist_rec;
+  scratch->netlist_rec = NULL;
+  module->num_out_terminals = scratch->num_out_terminals;
+  module->num_in_terminals = scratch->num_in_terminals;
+  scratch->cur_module = NULL;
+  scratch->modules = NULL;
+  err = lsim_delete(scratch);
+
+  if (err == ERR_OK && lsim->modules == NULL) {
+    err = hmap_create(&lsim->modules, 1009);
+  }
+  if (err == ERR_OK) {
+    err = hmap_swrite(lsim->modules, module->name, module);
+  }
+  if (err) {
+    err = err_rethrow_v(__FILE__, __LINE__, __func__, err, "module %s", module->name);
+    lsim_module_free(module);
+    return err;
+  }
+
+  return ERR_OK;
+}  /* lsim_module_end */
+
+
+/* Discard a module whose body failed. */
+ERR_F lsim_module_abort(lsim_t *lsim, lsim_t *scratch) {
+  (void)lsim;
+  if (scratch->cur_module) {
+    lsim_module_free(scratch->cur_module);
+    scratch->cur_module = NULL;
+  }
+  scratch->modules = NULL;
+  ERR(lsim_delete(scratch));
+
+  return ERR_OK;
+}  /* lsim_module_abort */
+
+
+ERR_F lsim_module_delete_all(lsim_t *lsim) {
+  if (lsim->modules == NULL) {
+    return ERR_OK;
+  }
+
+  hmap_entry_t *module_entry = NULL;
+  do {
+    ERR(hmap_next(lsim->modules, &module_entry));
+    if (module_entry) {
+      lsim_module_free(module_entry->value);
+    }
+  } while (module_entry);
+  ERR(hmap_delete(lsim->modules));
+  lsim->modules = NULL;
+
+  return ERR_OK;
+}  /* lsim_module_delete_all */
@@ -0,0 +1,58 @@
+/* lsim_module.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_MODULE_H
+#define LSIM_MODULE_H
+
+#include <stdint.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An external in or out id of a module, like "d3". */
+typedef struct lsim_module_port_s {
+  char id_prefix;
+  int id_index;
+  long *serials;  /* Out: the one output. In: every input on its chain, in order. */
+  long num_serials;
+  long alloc_serials;
+} lsim_module_port_t;
+
+/* Compiled template. Terminal serials are relative to the instance. */
+struct lsim_module_s {
+  char *name;
+  lsim_netlist_rec_t *rec;  /* Devices (names relative to the instance) and internal connections. */
+  long num_out_terminals;
+  long num_in_terminals;
+  lsim_module_port_t *in_ports;
+  long num_in_ports;
+  long alloc_in_ports;
+  lsim_module_port_t *out_ports;
+  long num_out_ports;
+  long alloc_out_ports;
+};
+
+ERR_F lsim_module_begin(lsim_t *lsim, char *name, lsim_t **rtn_scratch);
+ERR_F lsim_module_port(lsim_t *scratch, int is_out, char *port_id, char *dev_name, char *terminal_id);
+ERR_F lsim_module_end(lsim_t *lsim, lsim_t *scratch);
+ERR_F lsim_module_abort(lsim_t *lsim, lsim_t *scratch);
+ERR_F lsim_module_find_port(lsim_module_t *module, int is_out, const char *id, int bit_offset, long *rtn_port);
+ERR_F lsim_module_delete_all(lsim_t *lsim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_MODULE_H
@@ -0,0 +1,571 @@
+/* lsim_name.c - interned hierarchical device names. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "err.h"
+#include "hmap.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+
+
+/* Leaf strings and name nodes are carved from the terminal chunks and are
+ * only released by lsim_delete. The interning table is open addressed,
+ * holding leaf ids (0 is empty), and kept at most half full. */
+
+uint32_t lsim_name_hash(const char *str, size_t len) {
+  return hmap_murmur3_32(str, len, 0x6c656166);
+}  /* lsim_name_hash */
+
+
+/* Returns 0 if "str" (len chars, not necessarily terminated) was never
+ * interned. */
+uint32_t lsim_name_find_leaf(lsim_t *lsim, const char *str, size_t len) {
+  if (lsim->num_name_slots == 0) {
+    return 0;
+  }
+
+  uint32_t mask = lsim->num_name_slots - 1;
+  uint32_t slot = lsim_name_hash(str, len) & mask;
+  while (lsim->name_slots[slot] != 0) {
+    const char *leaf = lsim->name_leaves[lsim->name_slots[slot]];
+    if (strncmp(leaf, str, len) == 0 && leaf[len] == '\0') {
+      return lsim->name_slots[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  return 0;
+}  /* lsim_name_find_leaf */
+
+
+ERR_F lsim_name_intern(lsim_t *lsim, const char *str, size_t len, uint32_t *rtn_leaf_id) {
+  uint32_t leaf_id = lsim_name_find_leaf(lsim, str, len);
+  if (leaf_id != 0) {
+    *rtn_leaf_id = leaf_id;
+    return ERR_OK;
+  }
+
+  /* Leaf 0 is reserved, so there are num_name_leaves - 1 in use. */
+  if (lsim->num_name_leaves == 0) {
+    lsim->num_name_leaves = 1;
+  }
+  if (lsim->num_name_leaves >= lsim->alloc_name_leaves) {
+    uint32_t new_alloc = (lsim->alloc_name_leaves == 0) ? 1024 : (lsim->alloc_name_leaves * 2);
+    char **new_leaves = realloc(lsim->name_leaves, new_alloc * sizeof(char *));
+    ERR_ASSRT(new_leaves, LSIM_ERR_NOMEM);
+    lsim->name_leaves = new_leaves;
+    lsim->alloc_name_leaves = new_alloc;
+  }
+  if (lsim->num_name_leaves * 2 >= lsim->num_name_slots) {  /* Rehash. */
+    uint32_t new_num_slots = (lsim->num_name_slots == 0) ? 2048 : (lsim->num_name_slots * 2);
+    uint32_t *new_slots;
+    ERR(err_calloc((void **)&new_slots, new_num_slots, sizeof(uint32_t)));
+    uint32_t i;
+    for (i = 1; i < lsim->num_name_leaves; i++) {
+      uint32_t slot = lsim_name_hash(lsim->name_leaves[i], strlen(lsim->name_leaves[i])) & (new_num_slots - 1);
+      while (new_slots[slot] != 0) {
+        slot = (slot + 1) & (new_num_slots - 1);
+      }
+      new_slots[slot] = i;
+    }
+    free(lsim->name_slots);
+    lsim->name_slots = new_slots;
+    lsim->num_name_slots = new_num_slots;
+  }
+
+  char *leaf;
+  ERR(lsim_dev_chunk_alloc(lsim, len + 1, (void **)&leaf));
+  memcpy(leaf, str, len);
+  leaf[len] = '\0';
+
+  leaf_id = lsim->num_name_leaves;
+  lsim->name_leaves[leaf_id] = leaf;
+  lsim->num_name_leaves++;
+
+  uint32_t mask = lsim->num_name_slots - 1;
+  uint32_t slot = lsim_name_hash(str, len) & mask;
+  while (lsim->name_slots[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  lsim->name_slots[slot] = leaf_id;
+
+  *rtn_leaf_id = leaf_id;
+  return ERR_OK;
+}  /* lsim_name_intern */
+
+
+/* Device with leaf "leaf_id" directly under "parent", or NULL. */
+ERR_F lsim_name_key_dev(lsim_t *lsim, const lsim_name_t *parent, uint32_t leaf_id, lsim_dev_t **rtn_dev) {
+  lsim_name_key_t key = lsim_name_key(parent, leaf_id);
+  int found;
+  ERR(hmap_lookup_found(lsim->devs, &key, sizeof(key), (void **)rtn_dev, &found));
+
+  return ERR_OK;
+}  /* lsim_name_key_dev */
+
+
+/* Device whose name is "str" (len chars) directly under "parent", or NULL. */
+ERR_F lsim_name_find_dev(lsim_t *lsim, lsim_name_t *parent, const char *str, size_t len, lsim_dev_t **rtn_dev) {
+  *rtn_dev = NULL;
+  uint32_t leaf_id = lsim_name_find_leaf(lsim, str, len);
+  if (leaf_id == 0) {
+    return ERR_OK;
+  }
+
+  ERR(lsim_name_key_dev(lsim, parent, leaf_id, rtn_dev));
+
+  return ERR_OK;
+}  /* lsim_name_find_dev */
+
+
+/* Composite devices' internal names contain periods, but a leaf can too
+ * ("dflipflop.3" under a reg). Splits the way lsim_name_create does:
+ * descend into the shortest prefix that is a device, and the rest is the
+ * leaf. If the descent misses, the rest is tried as one leaf at this
+ * level (its prefix may have become a device after it was named). There's
+ * no backtracking into other splits, so each level is looked at once. */
+ERR_F lsim_name_find(lsim_t *lsim, lsim_name_t *parent, const char *str, size_t len, lsim_dev_t **rtn_dev) {
+  const char *dot = memchr(str, '.', len);
+  while (dot) {
+    size_t prefix_len = dot - str;
+    lsim_dev_t *dev;
+    ERR(lsim_name_find_dev(lsim, parent, str, prefix_len, &dev));
+    if (dev) {
+      ERR(lsim_name_find(lsim, dev->name, dot + 1, len - prefix_len - 1, rtn_dev));
+      if (*rtn_dev) {
+        return ERR_OK;
+      }
+      break;
+    }
+    dot = memchr(dot + 1, '.', len - prefix_len - 1);
+  }
+
+  ERR(lsim_name_find_dev(lsim, parent, str, len, rtn_dev));
+
+  return ERR_OK;
+}  /* lsim_name_find */
+
+
+ERR_F lsim_name_lookup(lsim_t *lsim, const char *full_name, lsim_dev_t **rtn_dev) {
+  lsim_dev_t *dev;
+  ERR(lsim_name_find(lsim, NULL, full_name, strlen(full_name), &dev));
+  if (dev == NULL) {
+    ERR_THROW(HMAP_ERR_NOTFOUND, "Device '%s' not found", full_name);
+  }
+
+  if (rtn_dev) {
+    *rtn_dev = dev;
+  }
+  return ERR_OK;
+}  /* lsim_name_lookup */
+
+
+/* New name "leaf" (len chars) under "parent". */
+ERR_F lsim_name_child_n(lsim_t *lsim, lsim_name_t *parent, const char *leaf, size_t len, lsim_name_t **rtn_name) {
+  uint32_t leaf_id;
+  ERR(lsim_name_intern(lsim, leaf, len, &leaf_id));
+
+  /* Make sure name doesn't already exist. */
+  lsim_name_key_t key = lsim_name_key(parent, leaf_id);
+  int found;
+  ERR(hmap_lookup_found(lsim->devs, &key, sizeof(key), NULL, &found));
+  ERR_ASSRT(! found, LSIM_ERR_EXIST);
+
+  lsim_name_t *name;
+  ERR(lsim_dev_chunk_alloc(lsim, sizeof(lsim_name_t), (void **)&name));
+  name->parent = parent;
+  name->leaf_id = leaf_id;
+  lsim->num_names++;
+  name->id = lsim->num_names;
+  lsim_name_t **siblings = (parent) ? &parent->first_child : &lsim->name_roots;
+  name->next_sibling = *siblings;
+  *siblings = name;
+
+  *rtn_name = name;
+  return ERR_OK;
+}  /* lsim_name_child_n */
+
+
+ERR_F lsim_name_child(lsim_t *lsim, lsim_name_t *parent, const char *leaf, lsim_name_t **rtn_name) {
+  ERR(lsim_name_child_n(lsim, parent, leaf, strlen(leaf), rtn_name));
+
+  return ERR_OK;
+}  /* lsim_name_child */
+
+
+/* Name for a new device. Composites write themselves to lsim->devs before
+ * creating their parts, so "reg1.dflipflop.3" lands under "reg1". A name
+ * whose prefix isn't a device (like a module instance replayed from a
+ * compiled netlist) is one top-level leaf. */
+ERR_F lsim_name_create(lsim_t *lsim, const char *full_name, lsim_name_t **rtn_name) {
+  /* Make sure name doesn't already exist. */
+  lsim_dev_t *dev;
+  ERR(lsim_name_find(lsim, NULL, full_name, strlen(full_name), &dev));
+  ERR_ASSRT(dev == NULL, LSIM_ERR_EXIST);
+
+  lsim_name_t *parent = NULL;
+  const char *start = full_name;
+  const char *dot = strchr(start, '.');
+  while (dot) {
+    ERR(lsim_name_find_dev(lsim, parent, start, dot - start, &dev));
+    if (dev) {
+      parent = dev->name;
+      start = dot + 1;
+      dot = strchr(start, '.');
+    }
+    else {
+      dot = strchr(dot + 1, '.');
+    }
+  }
+
+  ERR(lsim_name_child_n(lsim, parent, start, strlen(start), rtn_name));
+
+  return ERR_OK;
+}  /* lsim_name_create */
+
+
+ERR_F lsim_name_write(lsim_t *lsim, lsim_dev_t *dev) {
+  lsim_name_key_t key = lsim_name_key(dev->name->parent, dev->name->leaf_id);
+  ERR(hmap_write(lsim->devs, &key, sizeof(key), dev));
+
+  return ERR_OK;
+}  /* lsim_name_write */
+
+
+int lsim_name_is_pattern(const char *str) {
+  return strpbrk(str, "*?") != NULL;
+}  /* lsim_name_is_pattern */
+
+
+/* Pattern matching runs the pattern as an NFA over the names in the tree:
+ * a state is a position in the pattern, and the set of live states is
+ * carried from a name down to its children. Positions of "*" and "**"
+ * consume characters without advancing. */
+typedef struct lsim_name_states_s {
+  uint64_t bits[(LSIM_NAME_MAX_PATTERN + 64) / 64];
+} lsim_name_states_t;
+
+typedef struct lsim_name_matches_s {
+  lsim_dev_t **devs;
+  long num_devs;
+  long alloc_devs;
+} lsim_name_matches_t;
+
+
+void lsim_name_states_add(lsim_name_states_t *states, size_t pos) {
+  states->bits[pos / 64] |= (uint64_t)1 << (pos % 64);
+}  /* lsim_name_states_add */
+
+
+int lsim_name_states_has(const lsim_name_states_t *states, size_t pos) {
+  return (states->bits[pos / 64] >> (pos % 64)) & 1;
+}  /* lsim_name_states_has */
+
+
+int lsim_name_states_empty(const lsim_name_states_t *states) {
+  size_t w;
+  for (w = 0; w < sizeof(states->bits) / sizeof(states->bits[0]); w++) {
+    if (states->bits[w] != 0) return 0;
+  }
+  return 1;
+}  /* lsim_name_states_empty */
+
+
+/* A star can match nothing. Epsilon moves only go forward, so one pass
+ * in position order is enough. */
+void lsim_name_states_close(const char *pattern, size_t len, lsim_name_states_t *states) {
+  size_t pos;
+  for (pos = 0; pos < len; pos++) {
+    if (lsim_name_states_has(states, pos) && pattern[pos] == '*') {
+      lsim_name_states_add(states, (pattern[pos + 1] == '*') ? pos + 2 : pos + 1);
+    }
+  }
+}  /* lsim_name_states_close */
+
+
+lsim_name_states_t lsim_name_states_step(const char *pattern, size_t len, const lsim_name_states_t *states, char c) {
+  lsim_name_states_t next;
+  memset(&next, 0, sizeof(next));
+
+  size_t pos;
+  for (pos = 0; pos < len; pos++) {
+    if (! lsim_name_states_has(states, pos)) continue;
+    if (pattern[pos] == '*') {
+      if (pattern[pos + 1] == '*' || c != '.') {
+        lsim_name_states_add(&next, pos);
+      }
+    }
+    else if ((pattern[pos] == '?' && c != '.') || pattern[pos] == c) {
+      lsim_name_states_add(&next, pos + 1);
+    }
+  }
+  lsim_name_states_close(pattern, len, &next);
+
+  return next;
+}  /* lsim_name_states_step */
+
+
+/* Match a whole string (e.g. a signal name read from a file). */
+int lsim_name_match_str(const char *pattern, const char *str) {
+  size_t len = strlen(pattern);
+  if (len > LSIM_NAME_MAX_PATTERN) {
+    return 0;
+  }
+  lsim_name_states_t states;
+  memset(&states, 0, sizeof(states));
+  lsim_name_states_add(&states, 0);
+  lsim_name_states_close(pattern, len, &states);
+  while (*str != '\0' && ! lsim_name_states_empty(&states)) {
+    states = lsim_name_states_step(pattern, len, &states, *str);
+    str++;
+  }
+
+  return (*str == '\0' && lsim_name_states_has(&states, len));
+}  /* lsim_name_match_str */
+
+
+ERR_F lsim_name_matches_add(lsim_name_matches_t *matches, lsim_dev_t *dev) {
+  if (matches->num_devs == matches->alloc_devs) {
+    long new_alloc = (matches->alloc_devs == 0) ? 64 : (matches->alloc_devs * 2);
+    lsim_dev_t **new_devs = realloc(matches->devs, new_alloc * sizeof(lsim_dev_t *));
+    ERR_ASSRT(new_devs, LSIM_ERR_NOMEM);
+    matches->devs = new_devs;
+    matches->alloc_devs = new_alloc;
+  }
+  matches->devs[matches->num_devs] = dev;
+  matches->num_devs++;
+
+  return ERR_OK;
+}  /* lsim_name_matches_add */
+
+
+ERR_F lsim_name_match_under(lsim_t *lsim, const char *pattern, size_t len, lsim_name_t *parent, lsim_name_states_t states, lsim_name_matches_t *matches);
+
+/* "name" was reached with "states" live after its first "skip" characters;
+ * consume the rest of its leaf and report it and/or continue with its
+ * children. */
+ERR_F lsim_name_match_name(lsim_t *lsim, const char *pattern, size_t len, lsim_name_t *name, size_t skip, lsim_name_states_t states, lsim_name_matches_t *matches) {
+  const char *leaf = &lsim->name_leaves[name->leaf_id][skip];
+  while (*leaf != '\0' && ! lsim_name_states_empty(&states)) {
+    states = lsim_name_states_step(pattern, len, &states, *leaf);
+    leaf++;
+  }
+  if (*leaf != '\0') {
+    return ERR_OK;  /* Ran out of states. */
+  }
+
+  lsim_dev_t *dev;
+  if (lsim_name_states_has(&states, len)) {
+    ERR(lsim_name_key_dev(lsim, name->parent, name->leaf_id, &dev));
+    if (dev) {  /* NULL if creating the device failed. */
+      ERR(lsim_name_matches_add(matches, dev));
+    }
+  }
+
+  if (name->first_child) {
+    /* Cross the period between this name and its children. */
+    lsim_name_states_t next;
+    memset(&next, 0, sizeof(next));
+    size_t pos;
+    for (pos = 0; pos < len; pos++) {
+      if (! lsim_name_states_has(&states, pos)) continue;
+      if (pattern[pos] == '.') {
+        lsim_name_states_add(&next, pos + 1);
+      }
+      else if (pattern[pos] == '*' && pattern[pos + 1] == '*') {
+        lsim_name_states_add(&next, pos);
+      }
+    }
+    lsim_name_states_close(pattern, len, &next);
+    if (! lsim_name_states_empty(&next)) {
+      ERR(lsim_name_match_under(lsim, pattern, len, name, next, matches));
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_name_match_name */
+
+
+/* Match the names directly under "parent". When the pattern here starts
+ * with literal text, names that end within that text are found by hash
+ * (like lsim_name_find), and only names reaching the first wildcard are
+ * scanned, so a literal path costs one lookup per component. Once a
+ * device is found that way, names starting with it and a period are under
+ * it (see lsim_name_create), so the siblings aren't scanned at all. */
+ERR_F lsim_name_match_under(lsim_t *lsim, const char *pattern, size_t len, lsim_name_t *parent, lsim_name_states_t states, lsim_name_matches_t *matches) {
+  size_t start = 0;
+  while (start < len && ! lsim_name_states_has(&states, start)) {
+    start++;
+  }
+  lsim_name_states_t only_start;
+  memset(&only_start, 0, sizeof(only_start));
+  lsim_name_states_add(&only_start, start);
+
+  size_t literal_len = 0;
+  if (memcmp(&states, &only_start, sizeof(states)) == 0) {
+    literal_len = strcspn(&pattern[start], "*?");
+  }
+
+  int found_prefix = 0;
+  lsim_dev_t *dev;
+  size_t leaf_len;
+  for (leaf_len = 1; leaf_len <= literal_len; leaf_len++) {
+    if (start + leaf_len < len && pattern[start + leaf_len] != '.') continue;
+    ERR(lsim_name_find_dev(lsim, parent, &pattern[start], leaf_len, &dev));
+    if (dev) {
+      if (start + leaf_len < len) {
+        found_prefix = 1;
+      }
+      ERR(lsim_name_match_name(lsim, pattern, len, dev->name, 0, only_start, matches));
+    }
+  }
+  if ((start + literal_len == len && literal_len > 0) || found_prefix) {
+    return ERR_OK;  /* No wildcards left, or they're under a found device. */
+  }
+
+  /* Names not reaching the wildcard were looked up above; for the rest,
+   * the literal text is compared directly. */
+  if (literal_len > 0) {
+    memset(&states, 0, sizeof(states));
+    lsim_name_states_add(&states, start + literal_len);
+    lsim_name_states_close(pattern, len, &states);
+  }
+  lsim_name_t *name;
+  for (name = (parent) ? parent->first_child : lsim->name_roots; name; name = name->next_sibling) {
+    if (strncmp(lsim->name_leaves[name->leaf_id], &pattern[start], literal_len) == 0) {
+      ERR(lsim_name_match_name(lsim, pattern, len, name, literal_len, states, matches));
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_name_match_under */
+
+
+int lsim_name_match_cmp(const void *a, const void *b) {
+  uint32_t a_id = (*(lsim_dev_t *const *)a)->name->id;
+  uint32_t b_id = (*(lsim_dev_t *const *)b)->name->id;
+  return (a_id > b_id) - (a_id < b_id);
+}  /* lsim_name_match_cmp */
+
+
+/* Devices whose full names match "pattern", in creation order. The caller
+ * frees the returned array (NULL if there are no matches). */
+ERR_F lsim_name_match(lsim_t *lsim, const char *pattern, lsim_dev_t ***rtn_devs, long *rtn_num_devs) {
+  size_t len = strlen(pattern);
+  ERR_ASSRT(len <= LSIM_NAME_MAX_PATTERN, LSIM_ERR_PARAM);
+
+  lsim_name_states_t states;
+  memset(&states, 0, sizeof(states));
+  lsim_name_states_add(&states, 0);
+  lsim_name_states_close(pattern, len, &states);
+
+  lsim_name_matches_t matches;
+  memset(&matches, 0, sizeof(matches));
+  err_t *err = lsim_name_match_under(lsim, pattern, len, NULL, states, &matches);
+  if (err) {
+    free(matches.devs);
+    ERR_RETHROW(err, "pattern '%s'", pattern);
+  }
+
+  if (matches.num_devs > 1) {
+    qsort(matches.devs, matches.num_devs, sizeof(lsim_dev_t *), lsim_name_match_cmp);
+  }
+  *rtn_devs = matches.devs;
+  *rtn_num_devs = matches.num_devs;
+  return ERR_OK;
+}  /* lsim_name_match */
+
+
+size_t lsim_name_len(lsim_t *lsim, const lsim_name_t *name) {
+  size_t len = 0;
+  const lsim_name_t *node;
+  for (node = name; node; node = node->parent) {
+    len += strlen(lsim->name_leaves[node->leaf_id]) + 1;  /* Period or null. */
+  }
+  return len;
+}  /* lsim_name_len */
+
+
+/* Full name, built in the caller's buffer; usable from other threads while
+ * no names are being created. A name that doesn't fit is just its leaf. */
+const char *lsim_name_str_r(lsim_t *lsim, const lsim_name_t *name, char *buf, size_t buf_size) {
+  size_t len = lsim_name_len(lsim, name);
+  if (len > buf_size) {
+    return lsim->name_leaves[name->leaf_id];  /* Better than nothing. */
+  }
+
+  size_t pos = len - 1;
+  buf[pos] = '\0';
+  const lsim_name_t *node;
+  for (node = name; node; node = node->parent) {
+    const char *leaf = lsim->name_leaves[node->leaf_id];
+    size_t leaf_len = strlen(leaf);
+    pos -= leaf_len;
+    memcpy(&buf[pos], leaf, leaf_len);
+    if (node->parent) {
+      pos--;
+      buf[pos] = '.';
+    }
+  }
+
+  return buf;
+}  /* lsim_name_str_r */
+
+
+/* Full name, materialized for printing. Top-level names are returned as
+ * is; others are built in one of LSIM_NAME_BUFS buffers, used in turn. */
+const char *lsim_name_str(lsim_t *lsim, const lsim_name_t *name) {
+  if (name->parent == NULL) {
+    return lsim->name_leaves[name->leaf_id];
+  }
+
+  size_t len = lsim_name_len(lsim, name);
+  int buf_index = lsim->name_buf_next;
+  lsim->name_buf_next = (buf_index + 1) % LSIM_NAME_BUFS;
+  if (len > lsim->name_buf_sizes[buf_index]) {
+    char *new_buf = realloc(lsim->name_bufs[buf_index], len + 64);
+    if (new_buf == NULL) {
+      return lsim->name_leaves[name->leaf_id];  /* Better than nothing. */
+    }
+    lsim->name_bufs[buf_index] = new_buf;
+    lsim->name_buf_sizes[buf_index] = len + 64;
+  }
+
+  return lsim_name_str_r(lsim, name, lsim->name_bufs[buf_index], lsim->name_buf_sizes[buf_index]);
+}  /* lsim_name_str */
+
+
+ERR_F lsim_name_delete_all(lsim_t *lsim) {
+  /* Leaves and nodes are freed with their chunks (see lsim_delete). */
+  free(lsim->name_leaves);
+  lsim->name_leaves = NULL;
+  lsim->num_name_leaves = 0;
+  lsim->alloc_name_leaves = 0;
+  free(lsim->name_slots);
+  lsim->name_slots = NULL;
+  lsim->num_name_slots = 0;
+  lsim->num_names = 0;
+  lsim->name_roots = NULL;
+
+  int i;
+  for (i = 0; i < LSIM_NAME_BUFS; i++) {
+    free(lsim->name_bufs[i]);
+    lsim->name_bufs[i] = NULL;
+    lsim->name_buf_sizes[i] = 0;
+  }
+
+  return ERR_OK;
+}  /* lsim_name_delete_all */
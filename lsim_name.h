@@ -0,0 +1,71 @@
+/* lsim_name.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_NAME_H
+#define LSIM_NAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A device name is its enclosing device's name plus an interned leaf.
+ * "reg1.dflipflop.3.nand_q" is "nand_q" under "dflipflop.3" under "reg1";
+ * only "reg1" is stored per register, the other leaves once per design. */
+struct lsim_name_s {
+  lsim_name_t *parent;  /* NULL at top level. */
+  lsim_name_t *first_child;  /* Names directly under this one, newest first. */
+  lsim_name_t *next_sibling;  /* Top-level names start at lsim->name_roots. */
+  uint32_t id;  /* Creation order, from 1. */
+  uint32_t leaf_id;  /* Index into lsim->name_leaves. */
+};
+
+/* Patterns for lsim_name_match(): "*" matches within a name component,
+ * "**" also matches across periods, "?" matches one character. */
+#define LSIM_NAME_MAX_PATTERN 255
+
+/* The lsim->devs key: a name's parent and leaf. */
+typedef struct lsim_name_key_s {
+  uint32_t parent_id;  /* 0 at top level. */
+  uint32_t leaf_id;
+} lsim_name_key_t;
+
+ERR_F lsim_name_intern(lsim_t *lsim, const char *str, size_t len, uint32_t *rtn_leaf_id);
+uint32_t lsim_name_find_leaf(lsim_t *lsim, const char *str, size_t len);
+ERR_F lsim_name_child(lsim_t *lsim, lsim_name_t *parent, const char *leaf, lsim_name_t **rtn_name);
+ERR_F lsim_name_create(lsim_t *lsim, const char *full_name, lsim_name_t **rtn_name);
+ERR_F lsim_name_lookup(lsim_t *lsim, const char *full_name, lsim_dev_t **rtn_dev);
+ERR_F lsim_name_write(lsim_t *lsim, lsim_dev_t *dev);
+int lsim_name_is_pattern(const char *str);
+int lsim_name_match_str(const char *pattern, const char *str);
+ERR_F lsim_name_match(lsim_t *lsim, const char *pattern, lsim_dev_t ***rtn_devs, long *rtn_num_devs);
+size_t lsim_name_len(lsim_t *lsim, const lsim_name_t *name);
+const char *lsim_name_str_r(lsim_t *lsim, const lsim_name_t *name, char *buf, size_t buf_size);
+const char *lsim_name_str(lsim_t *lsim, const lsim_name_t *name);
+ERR_F lsim_name_delete_all(lsim_t *lsim);
+
+static inline lsim_name_key_t lsim_name_key(const lsim_name_t *parent, uint32_t leaf_id) {
+  lsim_name_key_t key;
+  key.parent_id = (parent) ? parent->id : 0;
+  key.leaf_id = leaf_id;
+  return key;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_NAME_H
@@ -0,0 +1,315 @@
+/* lsim_netlist.c - compiled (binary) netlists. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_state.h"
+#include "lsim_netlist.h"
+
+
+/* A compiled netlist replaces the define and connect commands. It holds
+ * the top-level defines (composite devices rebuild their insides, which is
+ * deterministic) and the user's connections as terminal serials. Loading
+ * it does no text parsing, name validation or name lookups for
+ * connections; the file is mmapped and walked in place. */
+
+
+ERR_F lsim_netlist_record_start(lsim_t *lsim) {
+  ERR_ASSRT(lsim->num_devs == 0, LSIM_ERR_COMMAND);  /* Must see every define. */
+  if (lsim->netlist_rec == NULL) {
+    ERR(err_calloc((void **)&lsim->netlist_rec, 1, sizeof(lsim_netlist_rec_t)));
+  }
+
+  return ERR_OK;
+}  /* lsim_netlist_record_start */
+
+
+void lsim_netlist_rec_free(lsim_netlist_rec_t *rec) {
+  if (rec) {
+    free(rec->devs);
+    free(rec->names);
+    free(rec->conns);
+    free(rec);
+  }
+}  /* lsim_netlist_rec_free */
+
+
+ERR_F lsim_netlist_record_delete(lsim_t *lsim) {
+  lsim_netlist_rec_free(lsim->netlist_rec);
+  lsim->netlist_rec = NULL;
+
+  return ERR_OK;
+}  /* lsim_netlist_record_delete */
+
+
+ERR_F lsim_netlist_record_dev(lsim_t *lsim, int type, const char *dev_name, long param1, long param2) {
+  lsim_netlist_rec_t *rec = lsim->netlist_rec;
+
+  if (rec->num_devs == rec->alloc_devs) {
+    long new_alloc = rec->alloc_devs ? rec->alloc_devs * 2 : 1024;
+    lsim_netlist_file_dev_t *new_devs = realloc(rec->devs, new_alloc * sizeof(lsim_netlist_file_dev_t));
+    ERR_ASSRT(new_devs, LSIM_ERR_NOMEM);
+    rec->devs = new_devs;
+    rec->alloc_devs = new_alloc;
+  }
+  size_t name_len = strlen(dev_name) + 1;
+  while (rec->names_size + name_len > rec->alloc_names) {
+    size_t new_alloc = rec->alloc_names ? rec->alloc_names * 2 : 16384;
+    char *new_names = realloc(rec->names, new_alloc);
+    ERR_ASSRT(new_names, LSIM_ERR_NOMEM);
+    rec->names = new_names;
+    rec->alloc_names = new_alloc;
+  }
+  ERR_ASSRT(rec->names_size + name_len <= UINT32_MAX, LSIM_ERR_PARAM);
+
+  lsim_netlist_file_dev_t *rec_dev = &rec->devs[rec->num_devs];
+  memset(rec_dev, 0, sizeof(*rec_dev));
+  rec_dev->type = type;
+  rec_dev->name_offset = (uint32_t)rec->names_size;
+  rec_dev->param1 = param1;
+  rec_dev->param2 = param2;
+  memcpy(&rec->names[rec->names_size], dev_name, name_len);
+  rec->names_size += name_len;
+  rec->num_devs++;
+
+  return ERR_OK;
+}  /* lsim_netlist_record_dev */
+
+
+/* Called by lsim_dev_connect() for connections made outside of a device
+ * create (i.e. not a composite device's internal wiring). */
+ERR_F lsim_netlist_record_conn(lsim_t *lsim, lsim_dev_out_terminal_t *out_terminal, lsim_dev_in_terminal_t *in_terminal) {
+  lsim_netlist_rec_t *rec = lsim->netlist_rec;
+
+  if (rec->num_conns == rec->alloc_conns) {
+    long new_alloc = rec->alloc_conns ? rec->alloc_conns * 2 : 4096;
+    int64_t *new_conns = realloc(rec->conns, new_alloc * 2 * sizeof(int64_t));
+    ERR_ASSRT(new_conns, LSIM_ERR_NOMEM);
+    rec->conns = new_conns;
+    rec->alloc_conns = new_alloc;
+  }
+  rec->conns[rec->num_conns * 2] = out_terminal->net_id - 1;
+  rec->conns[rec->num_conns * 2 + 1] = in_terminal->serial;
+  rec->num_conns++;
+
+  return ERR_OK;
+}  /* lsim_netlist_record_conn */
+
+
+ERR_F lsim_netlist_dev_create_type(lsim_t *lsim, int type, char *dev_name, long param1, long param2) {
+  switch (type) {
+  case LSIM_DEV_TYPE_PROBE: ERR(lsim_devs_probe_create(lsim, dev_name, param1)); break;
+  case LSIM_DEV_TYPE_GND: ERR(lsim_devs_gnd_create(lsim, dev_name)); break;
+  case LSIM_DEV_TYPE_VCC: ERR(lsim_devs_vcc_create(lsim, dev_name)); break;
+  case LSIM_DEV_TYPE_SWTCH: ERR(lsim_devs_swtch_create(lsim, dev_name, (int)param1)); break;
+  case LSIM_DEV_TYPE_LED: ERR(lsim_devs_led_create(lsim, dev_name)); break;
+  case LSIM_DEV_TYPE_CLK: ERR(lsim_devs_clk_create(lsim, dev_name)); break;
+  case LSIM_DEV_TYPE_NAND: ERR(lsim_devs_nand_create(lsim, dev_name, param1)); break;
+  case LSIM_DEV_TYPE_MEM: ERR(lsim_devs_mem_create(lsim, dev_name, param1, param2)); break;
+  case LSIM_DEV_TYPE_SRLATCH: ERR(lsim_devs_srlatch_create(lsim, dev_name)); break;
+  case LSIM_DEV_TYPE_DFLIPFLOP: ERR(lsim_devs_dflipflop_create(lsim, dev_name)); break;
+  case LSIM_DEV_TYPE_REG: ERR(lsim_devs_reg_create(lsim, dev_name, param1)); break;
+  case LSIM_DEV_TYPE_PANEL: ERR(lsim_devs_panel_create(lsim, dev_name, param1)); break;
+  case LSIM_DEV_TYPE_ADDBIT: ERR(lsim_devs_addbit_create(lsim, dev_name)); break;
+  case LSIM_DEV_TYPE_ADDWORD: ERR(lsim_devs_addword_create(lsim, dev_name, param1)); break;
+  default: ERR_THROW(LSIM_ERR_BADFILE, "Unknown device type %d", type);
+  }
+
+  return ERR_OK;
+}  /* lsim_netlist_dev_create_type */
+
+
+/* Create a top-level device (the define commands come through here). */
+ERR_F lsim_netlist_dev_create(lsim_t *lsim, int type, char *dev_name, long param1, long param2) {
+  lsim->creating++;
+  err_t *err = lsim_netlist_dev_create_type(lsim, type, dev_name, param1, param2);
+  lsim->creating--;
+  if (err) {
+    ERR_RETHROW(err, "Can't create '%s'", dev_name);
+  }
+
+  if (lsim->netlist_rec) {
+    ERR(lsim_netlist_record_dev(lsim, type, dev_name, param1, param2));
+  }
+
+  return ERR_OK;
+}  /* lsim_netlist_dev_create */
+
+
+ERR_F lsim_netlist_fwrite(lsim_t *lsim, FILE *fp) {
+  lsim_netlist_rec_t *rec = lsim->netlist_rec;
+  ERR_ASSRT(rec, LSIM_ERR_COMMAND);  /* Recording wasn't started. */
+
+  /* Group connections by output serial (CSR), keeping their order. */
+  uint64_t *conn_offsets;
+  ERR(err_calloc((void **)&conn_offsets, lsim->num_out_terminals + 1, sizeof(uint64_t)));
+  uint64_t *conn_ins;
+  ERR(err_calloc((void **)&conn_ins, rec->num_conns + 1, sizeof(uint64_t)));
+  long c;
+  for (c = 0; c < rec->num_conns; c++) {
+    conn_offsets[rec->conns[c * 2] + 1]++;
+  }
+  long s;
+  for (s = 0; s < lsim->num_out_terminals; s++) {
+    conn_offsets[s + 1] += conn_offsets[s];
+  }
+  uint64_t *fill;
+  ERR(err_calloc((void **)&fill, lsim->num_out_terminals + 1, sizeof(uint64_t)));
+  memcpy(fill, conn_offsets, lsim->num_out_terminals * sizeof(uint64_t));
+  for (c = 0; c < rec->num_conns; c++) {
+    conn_ins[fill[rec->conns[c * 2]]++] = (uint64_t)rec->conns[c * 2 + 1];
+  }
+  free(fill);
+
+  lsim_netlist_file_hdr_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, LSIM_NETLIST_FILE_MAGIC, 8);
+  hdr.version = LSIM_NETLIST_FILE_VERSION;
+  ERR(lsim_state_fingerprint(lsim, &hdr.fingerprint));
+  hdr.num_devs = rec->num_devs;
+  hdr.num_out_terminals = lsim->num_out_terminals;
+  hdr.num_in_terminals = lsim->num_in_terminals;
+  hdr.num_conns = rec->num_conns;
+  hdr.names_size = rec->names_size;
+
+  int ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+  ok = ok && (fwrite(rec->devs, sizeof(lsim_netlist_file_dev_t), rec->num_devs, fp) == (size_t)rec->num_devs);
+  ok = ok && (fwrite(conn_offsets, sizeof(uint64_t), lsim->num_out_terminals + 1, fp) == (size_t)lsim->num_out_terminals + 1);
+  ok = ok && (fwrite(conn_ins, sizeof(uint64_t), rec->num_conns, fp) == (size_t)rec->num_conns);
+  ok = ok && (fwrite(rec->names, 1, rec->names_size, fp) == rec->names_size);
+  free(conn_offsets);
+  free(conn_ins);
+  ERR_ASSRT(ok, LSIM_ERR_BADFILE);
+
+  return ERR_OK;
+}  /* lsim_netlist_fwrite */
+
+
+ERR_F lsim_netlist_write(lsim_t *lsim, const char *filename) {
+  FILE *fp = fopen(filename, "wb");
+  ERR_ASSRT(fp, LSIM_ERR_BADFILE);
+  err_t *err = lsim_netlist_fwrite(lsim, fp);
+  int ok = (fclose(fp) == 0);
+  if (err) {
+    ERR_RETHROW(err, "Error writing netlist file '%s'", filename);
+  }
+  if (! ok) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Error writing netlist file '%s'", filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_netlist_write */
+
+
+ERR_F lsim_netlist_build(lsim_t *lsim, const uint8_t *base, size_t file_size, const char *filename) {
+  ERR_ASSRT(file_size >= sizeof(lsim_netlist_file_hdr_t), LSIM_ERR_BADFILE);
+  const lsim_netlist_file_hdr_t *hdr = (const lsim_netlist_file_hdr_t *)base;
+  if (memcmp(hdr->magic, LSIM_NETLIST_FILE_MAGIC, 8) != 0 || hdr->version != LSIM_NETLIST_FILE_VERSION) {
+    ERR_THROW(LSIM_ERR_BADFILE, "'%s' is not an lsim netlist file", filename);
+  }
+
+  /* Each count is checked against what the file could hold before it's
+   * used in any arithmetic, so a bad header can't wrap the positions. */
+  size_t max_words = file_size / sizeof(uint64_t);
+  if (hdr->num_devs > file_size / sizeof(lsim_netlist_file_dev_t) || hdr->num_out_terminals >= max_words
+      || hdr->num_conns > max_words || hdr->names_size > file_size) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Netlist file '%s' is truncated", filename);
+  }
+  size_t devs_pos = sizeof(*hdr);
+  size_t offsets_pos = devs_pos + hdr->num_devs * sizeof(lsim_netlist_file_dev_t);
+  size_t ins_pos = offsets_pos + (hdr->num_out_terminals + 1) * sizeof(uint64_t);
+  size_t names_pos = ins_pos + hdr->num_conns * sizeof(uint64_t);
+  if (names_pos + hdr->names_size != file_size || hdr->names_size == 0 || base[file_size - 1] != '\0') {
+    ERR_THROW(LSIM_ERR_BADFILE, "Netlist file '%s' is truncated", filename);
+  }
+  const lsim_netlist_file_dev_t *devs = (const lsim_netlist_file_dev_t *)&base[devs_pos];
+  const uint64_t *conn_offsets = (const uint64_t *)&base[offsets_pos];
+  const uint64_t *conn_ins = (const uint64_t *)&base[ins_pos];
+  const char *names = (const char *)&base[names_pos];
+
+  uint64_t d;
+  for (d = 0; d < hdr->num_devs; d++) {
+    ERR_ASSRT(devs[d].name_offset < hdr->names_size, LSIM_ERR_BADFILE);
+    /* The create functions copy the name; they don't write to it. */
+    ERR(lsim_netlist_dev_create(lsim, devs[d].type, (char *)&names[devs[d].name_offset], devs[d].param1, devs[d].param2));
+  }
+  if ((uint64_t)lsim->num_out_terminals != hdr->num_out_terminals || (uint64_t)lsim->num_in_terminals != hdr->num_in_terminals) {
+    ERR_THROW(LSIM_ERR_MISMATCH, "Netlist file '%s' was built by a different lsim", filename);
+  }
+
+  ERR_ASSRT(conn_offsets[hdr->num_out_terminals] == hdr->num_conns, LSIM_ERR_BADFILE);
+  uint64_t s;
+  for (s = 0; s < hdr->num_out_terminals; s++) {
+    lsim_dev_out_terminal_t *out_terminal = lsim->out_terminals[s];
+    uint64_t c;
+    ERR_ASSRT(conn_offsets[s] <= conn_offsets[s + 1], LSIM_ERR_BADFILE);
+    for (c = conn_offsets[s]; c < conn_offsets[s + 1]; c++) {
+      ERR_ASSRT(conn_ins[c] < hdr->num_in_terminals, LSIM_ERR_BADFILE);
+      lsim_dev_in_terminal_t *in_terminal = lsim->in_terminals[conn_ins[c]];
+      /* A module port lists every input on its chain (see lsim_devs_module.c);
+       * an earlier head may have already brought this one along. */
+      if (in_terminal->driving_out_terminal != out_terminal) {
+        ERR_ASSRT(in_terminal->driving_out_terminal == NULL, LSIM_ERR_BADFILE);
+        ERR(lsim_dev_in_chain_add(&out_terminal->in_terminal_list, in_terminal, out_terminal));
+      }
+      if (lsim->netlist_rec) {
+        ERR(lsim_netlist_record_conn(lsim, out_terminal, in_terminal));
+      }
+    }
+  }
+
+  uint64_t fingerprint;
+  ERR(lsim_state_fingerprint(lsim, &fingerprint));
+  if (fingerprint != hdr->fingerprint) {
+    ERR_THROW(LSIM_ERR_MISMATCH, "Netlist file '%s' was built by a different lsim", filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_netlist_build */
+
+
+/* Build the netlist from a compiled file. Must be done before any define. */
+ERR_F lsim_netlist_load(lsim_t *lsim, const char *filename) {
+  ERR_ASSRT(lsim->num_devs == 0 && lsim->num_out_terminals == 0 && lsim->num_in_terminals == 0, LSIM_ERR_COMMAND);
+
+  int fd = open(filename, O_RDONLY);
+  ERR_ASSRT(fd >= 0, LSIM_ERR_BADFILE);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't read netlist file '%s'", filename);
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  ERR_ASSRT(base != MAP_FAILED, LSIM_ERR_BADFILE);
+
+  err_t *err = lsim_netlist_build(lsim, base, st.st_size, filename);
+  munmap(base, st.st_size);
+  if (err) {
+    ERR_RETHROW(err, "Loading '%s'", filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_netlist_load */
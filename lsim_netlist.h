@@ -0,0 +1,81 @@
+/* lsim_netlist.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_NETLIST_H
+#define LSIM_NETLIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LSIM_NETLIST_FILE_MAGIC "LSIMNETL"
+#define LSIM_NETLIST_FILE_VERSION 1
+
+/* Compiled netlist file layout (native byte order, 8-byte aligned):
+ *   lsim_netlist_file_hdr_t
+ *   lsim_netlist_file_dev_t devs[num_devs]  (top-level defines, in order)
+ *   uint64_t conn_offsets[num_out_terminals + 1]  (CSR by output serial)
+ *   uint64_t conn_ins[num_conns]  (input terminal serials)
+ *   char names[names_size]  (NUL-terminated device names) */
+typedef struct lsim_netlist_file_hdr_s {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t fingerprint;  /* lsim_state_fingerprint() of the built netlist. */
+  uint64_t num_devs;
+  uint64_t num_out_terminals;
+  uint64_t num_in_terminals;
+  uint64_t num_conns;
+  uint64_t names_size;
+} lsim_netlist_file_hdr_t;
+
+typedef struct lsim_netlist_file_dev_s {
+  int32_t type;  /* LSIM_DEV_TYPE_xxx */
+  uint32_t name_offset;  /* Into names[]. */
+  int64_t param1;
+  int64_t param2;
+} lsim_netlist_file_dev_t;
+
+/* Top-level defines and connects, recorded while the netlist is built. */
+struct lsim_netlist_rec_s {
+  lsim_netlist_file_dev_t *devs;
+  long num_devs;
+  long alloc_devs;
+  char *names;
+  size_t names_size;
+  size_t alloc_names;
+  int64_t *conns;  /* Pairs: output terminal serial, input terminal serial. */
+  long num_conns;
+  long alloc_conns;
+};
+
+void lsim_netlist_rec_free(lsim_netlist_rec_t *rec);
+ERR_F lsim_netlist_record_start(lsim_t *lsim);
+ERR_F lsim_netlist_record_delete(lsim_t *lsim);
+ERR_F lsim_netlist_dev_create(lsim_t *lsim, int type, char *dev_name, long param1, long param2);
+ERR_F lsim_netlist_record_conn(lsim_t *lsim, lsim_dev_out_terminal_t *out_terminal, lsim_dev_in_terminal_t *in_terminal);
+ERR_F lsim_netlist_fwrite(lsim_t *lsim, FILE *fp);
+ERR_F lsim_netlist_write(lsim_t *lsim, const char *filename);
+ERR_F lsim_netlist_build(lsim_t *lsim, const uint8_t *base, size_t file_size, const char *filename);
+ERR_F lsim_netlist_load(lsim_t *lsim, const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_NETLIST_H
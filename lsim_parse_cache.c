@@ -0,0 +1,337 @@
+/* lsim_parse_cache.c */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE  /* For realpath(), getpid(). */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_netlist.h"
+#include "lsim_parse_cache.h"
+
+
+/* The netlist part of a top-level command file is its leading define,
+ * connect, bus, include and loop lines (and comments). When "parse_cache_dir"
+ * is set, the netlist built by that part is stored along with hashes of
+ * those lines and of every file they include. A later run whose leading
+ * lines and includes are unchanged loads the netlist (see lsim_netlist.c)
+ * and only runs the remaining lines. If the netlist part ends inside an
+ * included file, nothing is cached. */
+
+
+/* FNV-1a. */
+uint64_t lsim_parse_cache_hash(uint64_t hash, int c) {
+  hash ^= (uint64_t)(unsigned char)c;
+  return hash * 0x100000001b3ULL;
+}  /* lsim_parse_cache_hash */
+
+
+/* Hash a file's first num_lines lines (or all of it if num_lines < 0). */
+ERR_F lsim_parse_cache_hash_file(const char *filename, long num_lines, uint64_t *rtn_hash, int *rtn_ok) {
+  *rtn_ok = 0;
+  FILE *fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return ERR_OK;  /* Missing file just doesn't match. */
+  }
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  long lines = 0;
+  int c;
+  while ((num_lines < 0 || lines < num_lines) && (c = getc(fp)) != EOF) {
+    hash = lsim_parse_cache_hash(hash, c);
+    if (c == '\n') {
+      lines++;
+    }
+  }
+  fclose(fp);
+
+  /* A last line without a newline still counts. */
+  *rtn_ok = (num_lines < 0 || lines == num_lines || lines == num_lines - 1);
+  *rtn_hash = hash;
+  return ERR_OK;
+}  /* lsim_parse_cache_hash_file */
+
+
+ERR_F lsim_parse_cache_entry_name(lsim_t *lsim, const char *filename, char **rtn_name) {
+  *rtn_name = NULL;
+  char *cache_dir;
+  ERR(cfg_get_str_val(lsim->cfg, "parse_cache_dir", &cache_dir));
+  if (cache_dir == NULL || strlen(cache_dir) == 0) {
+    return ERR_OK;  /* Disabled. */
+  }
+
+  char full_path[PATH_MAX];
+  const char *path = realpath(filename, full_path) ? full_path : filename;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  const char *p;
+  for (p = path; *p; p++) {
+    hash = lsim_parse_cache_hash(hash, *p);
+  }
+  ERR(err_asprintf(rtn_name, "%s/%016llx.lsimpc", cache_dir, (unsigned long long)hash));
+
+  return ERR_OK;
+}  /* lsim_parse_cache_entry_name */
+
+
+/* Try to build the netlist from a valid cache entry. */
+ERR_F lsim_parse_cache_try_load(lsim_t *lsim, const char *filename, const char *entry_name, long *rtn_skip_lines) {
+  FILE *fp = fopen(entry_name, "rb");
+  if (fp == NULL) {
+    return ERR_OK;
+  }
+  fseek(fp, 0, SEEK_END);
+  long entry_size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *entry = NULL;
+  if (entry_size > (long)sizeof(lsim_parse_cache_file_hdr_t)) {
+    entry = malloc(entry_size);
+  }
+  int ok = (entry != NULL) && (fread(entry, 1, entry_size, fp) == (size_t)entry_size);
+  fclose(fp);
+
+  lsim_parse_cache_file_hdr_t hdr;
+  if (ok) {
+    memcpy(&hdr, entry, sizeof(hdr));
+    ok = (memcmp(hdr.magic, LSIM_PARSE_CACHE_FILE_MAGIC, 8) == 0 && hdr.version == LSIM_PARSE_CACHE_FILE_VERSION);
+  }
+
+  /* From here on, errors go through err so that entry gets freed. */
+  err_t *err = ERR_OK;
+  uint64_t hash;
+  if (ok) {
+    err = lsim_parse_cache_hash_file(filename, (long)hdr.num_lines, &hash, &ok);
+    ok = ok && (hash == hdr.lines_hash);
+  }
+
+  size_t pos = sizeof(hdr);
+  uint32_t i;
+  for (i = 0; ok && err == ERR_OK && i < hdr.num_includes; i++) {
+    uint32_t name_len;
+    ok = (pos + sizeof(name_len) <= (size_t)entry_size);
+    if (ok) {
+      memcpy(&name_len, &entry[pos], sizeof(name_len));
+      pos += sizeof(name_len);
+      ok = (pos + name_len + sizeof(uint64_t) <= (size_t)entry_size);
+    }
+    char *include_name = NULL;
+    if (ok) {
+      err = err_calloc((void **)&include_name, 1, name_len + 1);
+    }
+    if (ok && err == ERR_OK) {
+      memcpy(include_name, &entry[pos], name_len);
+      pos += name_len;
+      uint64_t include_hash;
+      memcpy(&include_hash, &entry[pos], sizeof(include_hash));
+      pos += sizeof(include_hash);
+      err = lsim_parse_cache_hash_file(include_name, -1, &hash, &ok);
+      ok = ok && (hash == include_hash);
+    }
+    free(include_name);
+  }
+
+  if (ok && err == ERR_OK) {
+    /* Copy so that the netlist arrays are aligned. */
+    size_t netlist_size = entry_size - pos;
+    uint64_t *netlist;
+    err = err_calloc((void **)&netlist, 1, netlist_size + sizeof(uint64_t));
+    if (err == ERR_OK) {
+      memcpy(netlist, &entry[pos], netlist_size);
+      err = lsim_netlist_build(lsim, (uint8_t *)netlist, netlist_size, entry_name);
+      free(netlist);
+      if (err) {
+        err = err_rethrow_v(__FILE__, __LINE__, __func__, err, "Bad parse cache entry '%s'; delete it", entry_name);
+      }
+      else {
+        *rtn_skip_lines = (long)hdr.num_lines;
+      }
+    }
+  }
+
+  free(entry);
+  return err;
+}  /* lsim_parse_cache_try_load */
+
+
+/* Called at the start of a top-level command file. On a hit, the netlist
+ * is built and *rtn_skip_lines is the number of lines it replaces. On a
+ * miss, recording starts. */
+ERR_F lsim_parse_cache_open(lsim_t *lsim, const char *filename, long *rtn_skip_lines) {
+  *rtn_skip_lines = 0;
+  if (strcmp(filename, "-") == 0 || lsim->num_devs > 0 || lsim->parse_cache || lsim->netlist_rec) {
+    return ERR_OK;
+  }
+
+  char *entry_name;
+  ERR(lsim_parse_cache_entry_name(lsim, filename, &entry_name));
+  if (entry_name == NULL) {
+    return ERR_OK;
+  }
+
+  ERR(lsim_parse_cache_try_load(lsim, filename, entry_name, rtn_skip_lines));
+  if (*rtn_skip_lines > 0) {
+    free(entry_name);
+    return ERR_OK;
+  }
+
+  lsim_parse_cache_t *parse_cache;
+  ERR(err_calloc((void **)&parse_cache, 1, sizeof(lsim_parse_cache_t)));
+  parse_cache->entry_name = entry_name;
+  parse_cache->recording = 1;
+  parse_cache->rec_owned = (lsim->netlist_rec == NULL);
+  ERR(lsim_netlist_record_start(lsim));
+  lsim->parse_cache = parse_cache;
+
+  return ERR_OK;
+}  /* lsim_parse_cache_open */
+
+
+/* Called when a file is included while recording. */
+ERR_F lsim_parse_cache_include(lsim_t *lsim, const char *filename) {
+  lsim_parse_cache_t *parse_cache = lsim->parse_cache;
+  if (parse_cache == NULL || ! parse_cache->recording) {
+    return ERR_OK;
+  }
+
+  if (parse_cache->num_includes == parse_cache->alloc_includes) {
+    long new_alloc = parse_cache->alloc_includes ? parse_cache->alloc_includes * 2 : 16;
+    char **new_names = realloc(parse_cache->include_names, new_alloc * sizeof(char *));
+    ERR_ASSRT(new_names, LSIM_ERR_NOMEM);
+    parse_cache->include_names = new_names;
+    uint64_t *new_hashes = realloc(parse_cache->include_hashes, new_alloc * sizeof(uint64_t));
+    ERR_ASSRT(new_hashes, LSIM_ERR_NOMEM);
+    parse_cache->include_hashes = new_hashes;
+    parse_cache->alloc_includes = new_alloc;
+  }
+
+  int ok;
+  uint64_t hash;
+  ERR(lsim_parse_cache_hash_file(filename, -1, &hash, &ok));
+  ERR(err_strdup(&parse_cache->include_names[parse_cache->num_includes], filename));
+  parse_cache->include_hashes[parse_cache->num_includes] = hash;
+  parse_cache->num_includes++;
+
+  return ERR_OK;
+}  /* lsim_parse_cache_include */
+
+
+ERR_F lsim_parse_cache_store(lsim_t *lsim, const char *filename, long num_lines) {
+  lsim_parse_cache_t *parse_cache = lsim->parse_cache;
+
+  lsim_parse_cache_file_hdr_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, LSIM_PARSE_CACHE_FILE_MAGIC, 8);
+  hdr.version = LSIM_PARSE_CACHE_FILE_VERSION;
+  hdr.num_includes = (uint32_t)parse_cache->num_includes;
+  hdr.num_lines = num_lines;
+  int ok;
+  ERR(lsim_parse_cache_hash_file(filename, num_lines, &hdr.lines_hash, &ok));
+  ERR_ASSRT(ok, LSIM_ERR_BADFILE);
+
+  /* Write under a temporary name so that a concurrent run never sees a
+   * partial entry. */
+  char *tmp_name;
+  ERR(err_asprintf(&tmp_name, "%s.%ld.tmp", parse_cache->entry_name, (long)getpid()));
+  FILE *fp = fopen(tmp_name, "wb");
+  if (fp == NULL) {
+    free(tmp_name);
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't write parse cache entry '%s'", parse_cache->entry_name);
+  }
+  ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+  long i;
+  for (i = 0; ok && i < parse_cache->num_includes; i++) {
+    uint32_t name_len = (uint32_t)strlen(parse_cache->include_names[i]);
+    ok = (fwrite(&name_len, sizeof(name_len), 1, fp) == 1);
+    ok = ok && (fwrite(parse_cache->include_names[i], 1, name_len, fp) == name_len);
+    ok = ok && (fwrite(&parse_cache->include_hashes[i], sizeof(uint64_t), 1, fp) == 1);
+  }
+  err_t *err = ok ? lsim_netlist_fwrite(lsim, fp) : ERR_OK;
+  ok = (fclose(fp) == 0) && ok;
+  if (err || ! ok || rename(tmp_name, parse_cache->entry_name) != 0) {
+    remove(tmp_name);
+    free(tmp_name);
+    if (err) {
+      ERR_RETHROW(err, "Can't write parse cache entry '%s'", parse_cache->entry_name);
+    }
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't write parse cache entry '%s'", parse_cache->entry_name);
+  }
+  free(tmp_name);
+
+  return ERR_OK;
+}  /* lsim_parse_cache_store */
+
+
+ERR_F lsim_parse_cache_stop(lsim_t *lsim) {
+  lsim_parse_cache_t *parse_cache = lsim->parse_cache;
+  parse_cache->recording = 0;
+  if (parse_cache->rec_owned) {
+    ERR(lsim_netlist_record_delete(lsim));
+    parse_cache->rec_owned = 0;
+  }
+
+  return ERR_OK;
+}  /* lsim_parse_cache_stop */
+
+
+/* Called for each non-empty line before it runs. The first line that
+ * isn't part of a netlist ends the recording. */
+ERR_F lsim_parse_cache_line(lsim_t *lsim, const char *filename, const char *iline, long line_num, int top_level) {
+  lsim_parse_cache_t *parse_cache = lsim->parse_cache;
+  if (parse_cache == NULL || ! parse_cache->recording) {
+    return ERR_OK;
+  }
+
+  if (iline[0] == '#' || strncmp(iline, "d;", 2) == 0 || strncmp(iline, "c;", 2) == 0 ||
+      strncmp(iline, "b;", 2) == 0 || strncmp(iline, "i;", 2) == 0 ||
+      strncmp(iline, "for;", 4) == 0 || strcmp(iline, "endfor;") == 0) {
+    return ERR_OK;
+  }
+
+  if (top_level) {
+    ERR(lsim_parse_cache_store(lsim, filename, line_num - 1));
+  }
+  /* Else it ends inside an include, which can't be resumed. */
+  ERR(lsim_parse_cache_stop(lsim));
+
+  return ERR_OK;
+}  /* lsim_parse_cache_line */
+
+
+/* Called at the end of the top-level command file. */
+ERR_F lsim_parse_cache_close(lsim_t *lsim, const char *filename, long num_lines) {
+  lsim_parse_cache_t *parse_cache = lsim->parse_cache;
+  if (parse_cache == NULL) {
+    return ERR_OK;
+  }
+
+  if (parse_cache->recording) {  /* The whole file is a netlist. */
+    ERR(lsim_parse_cache_store(lsim, filename, num_lines));
+    ERR(lsim_parse_cache_stop(lsim));
+  }
+
+  long i;
+  for (i = 0; i < parse_cache->num_includes; i++) {
+    free(parse_cache->include_names[i]);
+  }
+  free(parse_cache->include_names);
+  free(parse_cache->include_hashes);
+  free(parse_cache->entry_name);
+  free(parse_cache);
+  lsim->parse_cache = NULL;
+
+  return ERR_OK;
+}  /* lsim_parse_cache_close */
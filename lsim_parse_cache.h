@@ -0,0 +1,61 @@
+/* lsim_parse_cache.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_PARSE_CACHE_H
+#define LSIM_PARSE_CACHE_H
+
+#include <stdint.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LSIM_PARSE_CACHE_FILE_MAGIC "LSIMPCAC"
+#define LSIM_PARSE_CACHE_FILE_VERSION 1
+
+/* Cache entry file layout (native byte order):
+ *   lsim_parse_cache_file_hdr_t
+ *   per include: uint32 name_len, name, uint64 content hash
+ *   compiled netlist (see lsim_netlist.h), to end of file */
+typedef struct lsim_parse_cache_file_hdr_s {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_includes;
+  uint64_t num_lines;  /* Leading lines of the top-level file covered. */
+  uint64_t lines_hash;  /* Hash of those lines. */
+} lsim_parse_cache_file_hdr_t;
+
+/* While the netlist part of a top-level command file is being run. */
+struct lsim_parse_cache_s {
+  char *entry_name;  /* Cache entry file to write. */
+  int recording;  /* Still in the netlist part. */
+  int rec_owned;  /* Netlist recording was started for the cache. */
+  char **include_names;
+  uint64_t *include_hashes;
+  long num_includes;
+  long alloc_includes;
+};
+
+ERR_F lsim_parse_cache_entry_name(lsim_t *lsim, const char *filename, char **rtn_name);
+ERR_F lsim_parse_cache_open(lsim_t *lsim, const char *filename, long *rtn_skip_lines);
+ERR_F lsim_parse_cache_include(lsim_t *lsim, const char *filename);
+ERR_F lsim_parse_cache_line(lsim_t *lsim, const char *filename, const char *iline, long line_num, int top_level);
+ERR_F lsim_parse_cache_stop(lsim_t *lsim);
+ERR_F lsim_parse_cache_close(lsim_t *lsim, const char *filename, long num_lines);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_PARSE_CACHE_H
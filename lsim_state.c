@@ -0,0 +1,849 @@
+/* lsim_state.c - simulation state images (save/restore, reverse stepping,
+ * power-up cache). */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE  /* For access(), getpid(). */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_state.h"
+#include "lsim_vcd.h"
+
+
+/* A state image holds everything needed to resume a powered-up circuit
+ * (the netlist itself must be rebuilt by the same commands):
+ *   int64 cur_ticklet, cur_step, total_warnings
+ *   int64 num_nets
+ *   uint64 out_states[], net_states[]  (one bit per net, creation order)
+ *   int64 num_dev_records
+ *   per device that has state: uint32 name_len, name, int32 type, payload
+ * A net's bit is its net_id, which follows output terminal creation order,
+ * so an image does not depend on the hash map layout and the state words
+ * are copied as they are. Native byte order. */
+
+typedef struct lsim_state_cursor_s {
+  uint8_t *buf;  /* NULL when only measuring the size. */
+  const uint8_t *rbuf;
+  size_t size;
+  size_t pos;
+} lsim_state_cursor_t;
+
+
+ERR_F lsim_state_put(lsim_state_cursor_t *cursor, const void *src, size_t len) {
+  if (cursor->buf) {
+    ERR_ASSRT(cursor->pos + len <= cursor->size, LSIM_ERR_INTERNAL);
+    memcpy(&cursor->buf[cursor->pos], src, len);
+  }
+  cursor->pos += len;
+
+  return ERR_OK;
+}  /* lsim_state_put */
+
+
+ERR_F lsim_state_put_i64(lsim_state_cursor_t *cursor, int64_t val) {
+  ERR(lsim_state_put(cursor, &val, sizeof(val)));
+  return ERR_OK;
+}  /* lsim_state_put_i64 */
+
+
+ERR_F lsim_state_get(lsim_state_cursor_t *cursor, void *dst, size_t len) {
+  ERR_ASSRT(cursor->pos + len <= cursor->size, LSIM_ERR_BADFILE);  /* Truncated. */
+  memcpy(dst, &cursor->rbuf[cursor->pos], len);
+  cursor->pos += len;
+
+  return ERR_OK;
+}  /* lsim_state_get */
+
+
+ERR_F lsim_state_get_i64(lsim_state_cursor_t *cursor, int64_t *val) {
+  ERR(lsim_state_get(cursor, val, sizeof(*val)));
+  return ERR_OK;
+}  /* lsim_state_get_i64 */
+
+
+uint64_t lsim_state_mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}  /* lsim_state_mix */
+
+
+uint64_t lsim_state_name_hash(const char *name) {
+  size_t len = strlen(name);
+  return ((uint64_t)hmap_murmur3_32(name, len, 0x4c53494d) << 32) | hmap_murmur3_32(name, len, 0x6e65746c);
+}  /* lsim_state_name_hash */
+
+
+/* Identifies the netlist: device names and types, and which output drives
+ * each input. Terms are summed so that the result doesn't depend on hash
+ * map or device order. */
+ERR_F lsim_state_fingerprint(lsim_t *lsim, uint64_t *rtn_fingerprint) {
+  uint64_t fingerprint = 0;
+  uint64_t num_devs = 0;
+
+  /* Module instances are flattened in compiled netlists, so only their
+   * underlying devices count. */
+  long i;
+  for (i = 0; i < lsim->num_devs; i++) {
+    lsim_dev_t *dev = lsim->dev_list[i];
+    if (dev->type != LSIM_DEV_TYPE_MODULE) {
+      num_devs++;
+      uint64_t extra = 0;
+      if (dev->type == LSIM_DEV_TYPE_MEM) {
+        extra = ((uint64_t)dev->mem.num_addr << 8) | (uint64_t)dev->mem.num_data;
+      }
+      fingerprint += lsim_state_mix(lsim_state_name_hash(lsim_name_str(lsim, dev->name)) ^ ((uint64_t)dev->type << 56) ^ (extra << 32));
+    }
+  }
+  fingerprint += lsim_state_mix(num_devs);
+  fingerprint += lsim_state_mix(((uint64_t)lsim->num_out_terminals << 32) ^ (uint64_t)lsim->num_in_terminals);
+
+  long t;
+  for (t = 0; t < lsim->num_out_terminals; t++) {
+    lsim_dev_out_terminal_t *out_terminal = lsim->out_terminals[t];
+    fingerprint += lsim_state_mix(lsim_state_name_hash(lsim_name_str(lsim, out_terminal->dev->name)) + 0x9e3779b97f4a7c15ULL * (uint64_t)out_terminal->net_id);
+  }
+  for (t = 0; t < lsim->num_in_terminals; t++) {
+    lsim_dev_in_terminal_t *in_terminal = lsim->in_terminals[t];
+    uint64_t driver = (in_terminal->driving_out_terminal) ? (uint64_t)in_terminal->driving_out_terminal->net_id : 0;
+    fingerprint += lsim_state_mix(lsim_state_name_hash(lsim_name_str(lsim, in_terminal->dev->name)) ^ ((uint64_t)t << 32) ^ (driver * 0xbf58476d1ce4e5b9ULL));
+  }
+
+  *rtn_fingerprint = fingerprint;
+  return ERR_OK;
+}  /* lsim_state_fingerprint */
+
+
+/* Per-device state. Devices not listed here have none beyond their nets. */
+ERR_F lsim_state_dev_put(lsim_state_cursor_t *cursor, lsim_dev_t *dev) {
+  switch (dev->type) {
+  case LSIM_DEV_TYPE_SWTCH:
+    ERR(lsim_state_put_i64(cursor, dev->swtch.swtch_state));
+    break;
+  case LSIM_DEV_TYPE_LED:
+    ERR(lsim_state_put_i64(cursor, dev->led.illuminated));
+    ERR(lsim_state_put_i64(cursor, dev->led.cur_step));
+    ERR(lsim_state_put_i64(cursor, dev->led.changes_in_step));
+    break;
+  case LSIM_DEV_TYPE_PROBE:
+    ERR(lsim_state_put_i64(cursor, dev->probe.cur_step));
+    ERR(lsim_state_put_i64(cursor, dev->probe.prev_d_state));
+    ERR(lsim_state_put_i64(cursor, dev->probe.d_changes_in_step));
+    ERR(lsim_state_put_i64(cursor, dev->probe.prev_c_state));
+    ERR(lsim_state_put_i64(cursor, dev->probe.c_changes_in_step));
+    ERR(lsim_state_put_i64(cursor, dev->probe.c_triggers_in_step));
+    break;
+  case LSIM_DEV_TYPE_MEM:
+    ERR(lsim_state_put(cursor, dev->mem.words, ((size_t)1 << dev->mem.num_addr) * sizeof(uint64_t)));
+    break;
+  default:
+    ERR_THROW(LSIM_ERR_INTERNAL, "Device type %d has no saved state", dev->type);
+  }
+
+  return ERR_OK;
+}  /* lsim_state_dev_put */
+
+
+ERR_F lsim_state_dev_get(lsim_state_cursor_t *cursor, lsim_dev_t *dev) {
+  int64_t val;
+
+  switch (dev->type) {
+  case LSIM_DEV_TYPE_SWTCH:
+    ERR(lsim_state_get_i64(cursor, &val));  dev->swtch.swtch_state = (int)val;
+    break;
+  case LSIM_DEV_TYPE_LED:
+    ERR(lsim_state_get_i64(cursor, &val));  dev->led.illuminated = (int)val;
+    ERR(lsim_state_get_i64(cursor, &val));  dev->led.cur_step = val;
+    ERR(lsim_state_get_i64(cursor, &val));  dev->led.changes_in_step = val;
+    break;
+  case LSIM_DEV_TYPE_PROBE:
+    ERR(lsim_state_get_i64(cursor, &val));  dev->probe.cur_step = val;
+    ERR(lsim_state_get_i64(cursor, &val));  dev->probe.prev_d_state = val;
+    ERR(lsim_state_get_i64(cursor, &val));  dev->probe.d_changes_in_step = val;
+    ERR(lsim_state_get_i64(cursor, &val));  dev->probe.prev_c_state = val;
+    ERR(lsim_state_get_i64(cursor, &val));  dev->probe.c_changes_in_step = val;
+    ERR(lsim_state_get_i64(cursor, &val));  dev->probe.c_triggers_in_step = val;
+    break;
+  case LSIM_DEV_TYPE_MEM:
+    ERR(lsim_state_get(cursor, dev->mem.words, ((size_t)1 << dev->mem.num_addr) * sizeof(uint64_t)));
+    break;
+  default:
+    ERR_THROW(LSIM_ERR_BADFILE, "Device type %d has no saved state", dev->type);
+  }
+
+  return ERR_OK;
+}  /* lsim_state_dev_get */
+
+
+int lsim_state_dev_has_state(lsim_dev_t *dev) {
+  return (dev->type == LSIM_DEV_TYPE_SWTCH || dev->type == LSIM_DEV_TYPE_LED ||
+          dev->type == LSIM_DEV_TYPE_PROBE || dev->type == LSIM_DEV_TYPE_MEM);
+}  /* lsim_state_dev_has_state */
+
+
+/* Write (or, if cursor->buf is NULL, just measure) a state image. */
+ERR_F lsim_state_write(lsim_t *lsim, lsim_state_cursor_t *cursor) {
+  ERR_ASSRT(lsim->power_on, LSIM_ERR_COMMAND);
+  /* Only valid between steps. */
+  ERR_ASSRT(lsim->in_changed_list == NULL && lsim->out_changed_list == NULL, LSIM_ERR_INTERNAL);
+
+  ERR(lsim_state_put_i64(cursor, lsim->cur_ticklet));
+  ERR(lsim_state_put_i64(cursor, lsim->cur_step));
+  ERR(lsim_state_put_i64(cursor, lsim->total_warnings));
+
+  long num_nets = lsim->num_out_terminals + 1;  /* Net 0 is floating. */
+  long num_words = (num_nets + 63) / 64;
+  ERR(lsim_state_put_i64(cursor, num_nets));
+  ERR_ASSRT(num_words <= lsim->alloc_state_words, LSIM_ERR_INTERNAL);
+  ERR(lsim_state_put(cursor, lsim->out_states, num_words * sizeof(uint64_t)));
+  ERR(lsim_state_put(cursor, lsim->net_states, num_words * sizeof(uint64_t)));
+
+  size_t num_records_pos = cursor->pos;
+  int64_t num_records = 0;
+  ERR(lsim_state_put_i64(cursor, num_records));  /* Filled in below. */
+
+  long i;
+  for (i = 0; i < lsim->num_devs; i++) {
+    lsim_dev_t *dev = lsim->dev_list[i];
+    if (lsim_state_dev_has_state(dev)) {
+      const char *name = lsim_name_str(lsim, dev->name);
+      uint32_t name_len = (uint32_t)strlen(name);
+      int32_t type = dev->type;
+      ERR(lsim_state_put(cursor, &name_len, sizeof(name_len)));
+      ERR(lsim_state_put(cursor, name, name_len));
+      ERR(lsim_state_put(cursor, &type, sizeof(type)));
+      ERR(lsim_state_dev_put(cursor, dev));
+      num_records++;
+    }
+  }
+
+  if (cursor->buf) {
+    memcpy(&cursor->buf[num_records_pos], &num_records, sizeof(num_records));
+  }
+
+  return ERR_OK;
+}  /* lsim_state_write */
+
+
+ERR_F lsim_state_size(lsim_t *lsim, size_t *rtn_size) {
+  lsim_state_cursor_t cursor;
+  memset(&cursor, 0, sizeof(cursor));
+
+  ERR(lsim_state_write(lsim, &cursor));
+
+  *rtn_size = cursor.pos;
+  return ERR_OK;
+}  /* lsim_state_size */
+
+
+ERR_F lsim_state_capture(lsim_t *lsim, void *image, size_t image_size) {
+  lsim_state_cursor_t cursor;
+  memset(&cursor, 0, sizeof(cursor));
+  cursor.buf = image;
+  cursor.size = image_size;
+
+  ERR(lsim_state_write(lsim, &cursor));
+  ERR_ASSRT(cursor.pos == image_size, LSIM_ERR_INTERNAL);
+
+  return ERR_OK;
+}  /* lsim_state_capture */
+
+
+ERR_F lsim_state_apply(lsim_t *lsim, const void *image, size_t image_size) {
+  ERR_ASSRT(lsim->power_on, LSIM_ERR_COMMAND);
+  ERR_ASSRT(lsim->in_changed_list == NULL && lsim->out_changed_list == NULL, LSIM_ERR_INTERNAL);
+  if (lsim->vcd) {  /* VCD time can't go backward. */
+    ERR(lsim_vcd_stop(lsim));
+  }
+
+  lsim_state_cursor_t cursor;
+  memset(&cursor, 0, sizeof(cursor));
+  cursor.rbuf = image;
+  cursor.size = image_size;
+
+  int64_t val;
+  ERR(lsim_state_get_i64(&cursor, &val));  lsim->cur_ticklet = val;
+  ERR(lsim_state_get_i64(&cursor, &val));  lsim->cur_step = val;
+  ERR(lsim_state_get_i64(&cursor, &val));  lsim->total_warnings = val;
+
+  int64_t num_nets;
+  ERR(lsim_state_get_i64(&cursor, &num_nets));
+  ERR_ASSRT(num_nets == lsim->num_out_terminals + 1, LSIM_ERR_BADFILE);
+  long num_words = (num_nets + 63) / 64;
+  ERR_ASSRT(num_words <= lsim->alloc_state_words, LSIM_ERR_INTERNAL);
+  ERR_ASSRT(cursor.pos + 2 * num_words * sizeof(uint64_t) <= cursor.size, LSIM_ERR_BADFILE);
+  memset(lsim->out_states, 0, lsim->alloc_state_words * sizeof(uint64_t));
+  memset(lsim->net_states, 0, lsim->alloc_state_words * sizeof(uint64_t));
+  ERR(lsim_state_get(&cursor, lsim->out_states, num_words * sizeof(uint64_t)));
+  ERR(lsim_state_get(&cursor, lsim->net_states, num_words * sizeof(uint64_t)));
+  /* Net 0 (floating) and bits past the last net stay clear. */
+  uint64_t last_mask = (num_nets & 63) ? (LSIM_NET_MASK(num_nets) - 1) : ~(uint64_t)0;
+  lsim->out_states[num_words - 1] &= last_mask;
+  lsim->net_states[num_words - 1] &= last_mask;
+  lsim->out_states[0] &= ~LSIM_NET_MASK(0);
+  lsim->net_states[0] &= ~LSIM_NET_MASK(0);
+
+  int64_t num_records;
+  ERR(lsim_state_get_i64(&cursor, &num_records));
+  int64_t record;
+  for (record = 0; record < num_records; record++) {
+    uint32_t name_len;
+    ERR(lsim_state_get(&cursor, &name_len, sizeof(name_len)));
+    ERR_ASSRT(cursor.pos + name_len <= cursor.size, LSIM_ERR_BADFILE);
+    char *name;
+    ERR(err_calloc((void **)&name, 1, name_len + 1));
+    int32_t type;
+    lsim_dev_t *dev;
+    err_t *err = lsim_state_get(&cursor, name, name_len);
+    if (err == ERR_OK) {
+      err = lsim_state_get(&cursor, &type, sizeof(type));
+    }
+    if (err == ERR_OK) {
+      err = lsim_name_lookup(lsim, name, &dev);
+      if (err) {
+        err = err_rethrow_v(__FILE__, __LINE__, __func__, err, "State image device '%s' not in netlist", name);
+      }
+    }
+    if (err == ERR_OK && dev->type != type) {
+      err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_BADFILE, "State image device '%s' type mismatch", name);
+    }
+    free(name);
+    if (err) {
+      return err;
+    }
+    ERR(lsim_state_dev_get(&cursor, dev));
+  }
+  ERR_ASSRT(cursor.pos == cursor.size, LSIM_ERR_BADFILE);
+
+  return ERR_OK;
+}  /* lsim_state_apply */
+
+
+/* Walk an image the way lsim_state_apply() does, changing nothing, so a
+ * bad file is rejected before the circuit is touched. */
+ERR_F lsim_state_check(lsim_t *lsim, const void *image, size_t image_size) {
+  lsim_state_cursor_t cursor;
+  memset(&cursor, 0, sizeof(cursor));
+  cursor.rbuf = image;
+  cursor.size = image_size;
+
+  int64_t val;
+  ERR(lsim_state_get_i64(&cursor, &val));  /* cur_ticklet */
+  ERR(lsim_state_get_i64(&cursor, &val));  /* cur_step */
+  ERR(lsim_state_get_i64(&cursor, &val));  /* total_warnings */
+
+  int64_t num_nets;
+  ERR(lsim_state_get_i64(&cursor, &num_nets));
+  ERR_ASSRT(num_nets == lsim->num_out_terminals + 1, LSIM_ERR_BADFILE);
+  long num_words = (num_nets + 63) / 64;
+  ERR_ASSRT(cursor.pos + 2 * num_words * sizeof(uint64_t) <= cursor.size, LSIM_ERR_BADFILE);
+  cursor.pos += 2 * num_words * sizeof(uint64_t);
+
+  int64_t num_records;
+  ERR(lsim_state_get_i64(&cursor, &num_records));
+  int64_t record;
+  for (record = 0; record < num_records; record++) {
+    uint32_t name_len;
+    ERR(lsim_state_get(&cursor, &name_len, sizeof(name_len)));
+    ERR_ASSRT(cursor.pos + name_len <= cursor.size, LSIM_ERR_BADFILE);
+    char *name;
+    ERR(err_calloc((void **)&name, 1, name_len + 1));
+    memcpy(name, &cursor.rbuf[cursor.pos], name_len);
+    cursor.pos += name_len;
+    int32_t type;
+    err_t *err = lsim_state_get(&cursor, &type, sizeof(type));
+    lsim_dev_t *dev = NULL;
+    if (err == ERR_OK) {
+      err = lsim_name_lookup(lsim, name, &dev);
+    }
+    if (err) {
+      free(name);
+      ERR_RETHROW(err, "State image device record %ld", (long)record);
+    }
+    if (dev->type != type || ! lsim_state_dev_has_state(dev)) {
+      err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_BADFILE, "State image device '%s' type mismatch", name);
+      free(name);
+      return err;
+    }
+    free(name);
+
+    lsim_state_cursor_t measure;  /* The payload's size, from the device. */
+    memset(&measure, 0, sizeof(measure));
+    ERR(lsim_state_dev_put(&measure, dev));
+    ERR_ASSRT(cursor.pos + measure.pos <= cursor.size, LSIM_ERR_BADFILE);
+    cursor.pos += measure.pos;
+  }
+  ERR_ASSRT(cursor.pos == cursor.size, LSIM_ERR_BADFILE);
+
+  return ERR_OK;
+}  /* lsim_state_check */
+
+
+/* File: magic, version, fingerprint, image size, then the image. */
+ERR_F lsim_state_save(lsim_t *lsim, const char *filename) {
+  uint64_t fingerprint;
+  ERR(lsim_state_fingerprint(lsim, &fingerprint));
+  size_t image_size;
+  ERR(lsim_state_size(lsim, &image_size));
+  uint8_t *image;
+  ERR(err_calloc((void **)&image, 1, image_size));
+  ERR(lsim_state_capture(lsim, image, image_size));
+
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    free(image);
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't create state file '%s'", filename);
+  }
+
+  uint32_t version = LSIM_STATE_FILE_VERSION;
+  uint32_t reserved = 0;
+  uint64_t size64 = image_size;
+  int ok = (fwrite(LSIM_STATE_FILE_MAGIC, 8, 1, fp) == 1);
+  ok = ok && (fwrite(&version, sizeof(version), 1, fp) == 1);
+  ok = ok && (fwrite(&reserved, sizeof(reserved), 1, fp) == 1);
+  ok = ok && (fwrite(&fingerprint, sizeof(fingerprint), 1, fp) == 1);
+  ok = ok && (fwrite(&size64, sizeof(size64), 1, fp) == 1);
+  ok = ok && (fwrite(image, image_size, 1, fp) == 1);
+  ok = (fclose(fp) == 0) && ok;
+  free(image);
+  if (! ok) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Error writing state file '%s'", filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_state_save */
+
+
+/* Read and check a state file; the caller frees *rtn_image. */
+ERR_F lsim_state_read(lsim_t *lsim, const char *filename, uint8_t **rtn_image, size_t *rtn_size) {
+  FILE *fp = fopen(filename, "rb");
+  ERR_ASSRT(fp, LSIM_ERR_BADFILE);
+
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t file_fingerprint;
+  uint64_t size64;
+  int ok = (fread(magic, 8, 1, fp) == 1);
+  ok = ok && (fread(&version, sizeof(version), 1, fp) == 1);
+  ok = ok && (fread(&reserved, sizeof(reserved), 1, fp) == 1);
+  ok = ok && (fread(&file_fingerprint, sizeof(file_fingerprint), 1, fp) == 1);
+  ok = ok && (fread(&size64, sizeof(size64), 1, fp) == 1);
+  if (! ok || memcmp(magic, LSIM_STATE_FILE_MAGIC, 8) != 0 || version != LSIM_STATE_FILE_VERSION) {
+    fclose(fp);
+    ERR_THROW(LSIM_ERR_BADFILE, "'%s' is not an lsim state file", filename);
+  }
+
+  uint64_t fingerprint;
+  err_t *err = lsim_state_fingerprint(lsim, &fingerprint);
+  if (err) {
+    fclose(fp);
+    ERR_RETHROW(err, "Reading '%s'", filename);
+  }
+  if (fingerprint != file_fingerprint) {
+    fclose(fp);
+    ERR_THROW(LSIM_ERR_MISMATCH, "State file '%s' was saved from a different netlist", filename);
+  }
+  struct stat st;
+  if (fstat(fileno(fp), &st) != 0 || size64 > (uint64_t)st.st_size) {
+    fclose(fp);
+    ERR_THROW(LSIM_ERR_BADFILE, "State file '%s' is truncated", filename);
+  }
+
+  uint8_t *image = malloc(size64 + 1);
+  if (image == NULL) {
+    fclose(fp);
+    ERR_THROW(LSIM_ERR_NOMEM, "Reading '%s'", filename);
+  }
+  ok = (fread(image, 1, size64, fp) == size64);
+  fclose(fp);
+  if (! ok) {
+    free(image);
+    ERR_THROW(LSIM_ERR_BADFILE, "State file '%s' is truncated", filename);
+  }
+
+  err = lsim_state_check(lsim, image, size64);
+  if (err) {
+    free(image);
+    ERR_RETHROW(err, "State file '%s'", filename);
+  }
+
+  *rtn_image = image;
+  *rtn_size = size64;
+  return ERR_OK;
+}  /* lsim_state_read */
+
+
+/* A file that doesn't fit this netlist is rejected before anything
+ * changes. */
+ERR_F lsim_state_restore(lsim_t *lsim, const char *filename) {
+  uint8_t *image;
+  size_t size;
+  ERR(lsim_state_read(lsim, filename, &image, &size));
+
+  err_t *err = lsim_state_apply(lsim, image, size);
+  free(image);
+  if (err) {
+    ERR_RETHROW(err, "Restoring '%s'", filename);
+  }
+
+  ERR(lsim_state_history_reset(lsim));  /* Can't go back past a restore. */
+
+  return ERR_OK;
+}  /* lsim_state_restore */
+
+
+/* History for reverse stepping: state images captured every
+ * "snapshot_interval" ticklets, plus a log of the moves and loadmems made
+ * between ticklets. Everything else is deterministic, so any past ticklet
+ * can be reached by applying the nearest earlier snapshot and replaying at
+ * most one interval. */
+
+ERR_F lsim_state_history_clear(lsim_t *lsim) {
+  long i;
+  for (i = 0; i < lsim->num_snapshots; i++) {
+    free(lsim->snapshots[i].image);
+  }
+  lsim->num_snapshots = 0;
+  lsim->snapshot_bytes = 0;
+
+  for (i = 0; i < lsim->num_events; i++) {
+    free(lsim->events[i].dev_name);
+    free(lsim->events[i].words);
+  }
+  lsim->num_events = 0;
+
+  return ERR_OK;
+}  /* lsim_state_history_clear */
+
+
+/* Drop every other snapshot (keeping the base) and double the interval. */
+ERR_F lsim_state_history_thin(lsim_t *lsim) {
+  long src, dst = 1;
+  for (src = 1; src < lsim->num_snapshots; src++) {
+    if (src & 1) {
+      lsim->snapshot_bytes -= lsim->snapshots[src].size;
+      free(lsim->snapshots[src].image);
+    }
+    else {
+      lsim->snapshots[dst++] = lsim->snapshots[src];
+    }
+  }
+  lsim->num_snapshots = dst;
+  lsim->snapshot_interval *= 2;
+
+  return ERR_OK;
+}  /* lsim_state_history_thin */
+
+
+ERR_F lsim_state_history_snapshot(lsim_t *lsim) {
+  size_t size;
+  ERR(lsim_state_size(lsim, &size));
+
+  /* The base snapshot is always kept; others must fit the budget. */
+  if (lsim->num_snapshots > 0) {
+    while (lsim->snapshot_bytes + size > lsim->snapshot_budget && lsim->num_snapshots > 1) {
+      ERR(lsim_state_history_thin(lsim));
+    }
+    if (lsim->snapshot_bytes + size > lsim->snapshot_budget) {
+      return ERR_OK;
+    }
+    if ((lsim->total_ticklets - lsim->snapshots[0].ticklet) % lsim->snapshot_interval != 0) {
+      return ERR_OK;  /* Thinning moved the grid. */
+    }
+  }
+
+  if (lsim->num_snapshots == lsim->alloc_snapshots) {
+    long new_alloc = lsim->alloc_snapshots ? lsim->alloc_snapshots * 2 : 64;
+    lsim_snapshot_t *new_snapshots = realloc(lsim->snapshots, new_alloc * sizeof(lsim_snapshot_t));
+    ERR_ASSRT(new_snapshots, LSIM_ERR_NOMEM);
+    lsim->snapshots = new_snapshots;
+    lsim->alloc_snapshots = new_alloc;
+  }
+
+  lsim_snapshot_t *snapshot = &lsim->snapshots[lsim->num_snapshots];
+  ERR(err_calloc((void **)&snapshot->image, 1, size));
+  ERR(lsim_state_capture(lsim, snapshot->image, size));
+  snapshot->size = size;
+  snapshot->ticklet = lsim->total_ticklets;
+  lsim->num_snapshots++;
+  lsim->snapshot_bytes += size;
+
+  return ERR_OK;
+}  /* lsim_state_history_snapshot */
+
+
+/* Start a new history at the current state (power-up or file restore). */
+ERR_F lsim_state_history_reset(lsim_t *lsim) {
+  ERR(lsim_state_history_clear(lsim));
+
+  ERR(cfg_get_long_val(lsim->cfg, "snapshot_interval", &lsim->snapshot_interval));
+  ERR_ASSRT(lsim->snapshot_interval >= 0, LSIM_ERR_CONFIG);
+  long snapshot_budget_mb;
+  ERR(cfg_get_long_val(lsim->cfg, "snapshot_budget_mb", &snapshot_budget_mb));
+  ERR_ASSRT(snapshot_budget_mb > 0, LSIM_ERR_CONFIG);
+  lsim->snapshot_budget = (size_t)snapshot_budget_mb * 1024 * 1024;
+
+  if (lsim->snapshot_interval > 0) {
+    ERR(lsim_state_history_snapshot(lsim));
+  }
+
+  return ERR_OK;
+}  /* lsim_state_history_reset */
+
+
+/* Called at the end of every ticklet. */
+ERR_F lsim_state_history_ticklet(lsim_t *lsim) {
+  lsim->total_ticklets++;
+
+  if (lsim->snapshot_interval > 0 && ! lsim->replaying && lsim->num_snapshots > 0) {
+    if ((lsim->total_ticklets - lsim->snapshots[0].ticklet) % lsim->snapshot_interval == 0) {
+      ERR(lsim_state_history_snapshot(lsim));
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_state_history_ticklet */
+
+
+ERR_F lsim_state_history_event(lsim_t *lsim, int type, const char *dev_name, long new_state, long addr, int num_words, uint64_t *words) {
+  if (lsim->snapshot_interval == 0 || lsim->replaying || ! lsim->power_on) {
+    return ERR_OK;
+  }
+
+  if (lsim->num_events == lsim->alloc_events) {
+    long new_alloc = lsim->alloc_events ? lsim->alloc_events * 2 : 64;
+    lsim_event_t *new_events = realloc(lsim->events, new_alloc * sizeof(lsim_event_t));
+    ERR_ASSRT(new_events, LSIM_ERR_NOMEM);
+    lsim->events = new_events;
+    lsim->alloc_events = new_alloc;
+  }
+
+  lsim_event_t *event = &lsim->events[lsim->num_events];
+  memset(event, 0, sizeof(*event));
+  event->ticklet = lsim->total_ticklets;
+  event->type = type;
+  ERR(err_strdup(&event->dev_name, dev_name));
+  event->new_state = new_state;
+  event->addr = addr;
+  event->num_words = num_words;
+  if (num_words > 0) {
+    ERR(err_calloc((void **)&event->words, num_words, sizeof(uint64_t)));
+    memcpy(event->words, words, num_words * sizeof(uint64_t));
+  }
+  lsim->num_events++;
+
+  return ERR_OK;
+}  /* lsim_state_history_event */
+
+
+ERR_F lsim_state_replay(lsim_t *lsim, long target) {
+  /* Nearest snapshot at or before the target. */
+  long s = lsim->num_snapshots - 1;
+  while (lsim->snapshots[s].ticklet > target) {
+    s--;
+  }
+  ERR(lsim_state_apply(lsim, lsim->snapshots[s].image, lsim->snapshots[s].size));
+  lsim->total_ticklets = lsim->snapshots[s].ticklet;
+
+  long e = 0;
+  while (e < lsim->num_events && lsim->events[e].ticklet < lsim->total_ticklets) {
+    e++;
+  }
+
+  /* Events logged at ticklet N happened after ticklet N completed, so they
+   * are replayed before ticklet N+1; those at the target are discarded. */
+  while (lsim->total_ticklets < target) {
+    while (e < lsim->num_events && lsim->events[e].ticklet == lsim->total_ticklets) {
+      lsim_event_t *event = &lsim->events[e];
+      if (event->type == LSIM_EVENT_MOVE) {
+        ERR(lsim_dev_move(lsim, event->dev_name, event->new_state));
+      }
+      else if (event->type == LSIM_EVENT_POKE) {
+        lsim_dev_t *dev;
+        ERR(lsim_name_lookup(lsim, event->dev_name, &dev));
+        ERR(lsim_dev_poke(lsim, dev, (int)event->new_state));
+      }
+      else if (event->type == LSIM_EVENT_SETTLE) {
+        ERR(lsim_dev_settle(lsim));
+      }
+      else {
+        ERR(lsim_dev_loadmem(lsim, event->dev_name, event->addr, event->num_words, event->words));
+      }
+      e++;
+    }
+    ERR(lsim_dev_ticklet(lsim));
+  }
+
+  return ERR_OK;
+}  /* lsim_state_replay */
+
+
+/* Go back num_ticklets. The history after that point is discarded; the
+ * simulation continues from there as if the later commands never ran. */
+ERR_F lsim_state_back(lsim_t *lsim, long num_ticklets) {
+  ERR_ASSRT(lsim->power_on, LSIM_ERR_COMMAND);
+  if (lsim->num_snapshots == 0) {
+    ERR_THROW(LSIM_ERR_COMMAND, "No history; set snapshot_interval before power-up");
+  }
+  long target = lsim->total_ticklets - num_ticklets;
+  if (num_ticklets < 0 || target < lsim->snapshots[0].ticklet) {
+    ERR_THROW(LSIM_ERR_COMMAND, "Can only go back %ld ticklets", lsim->total_ticklets - lsim->snapshots[0].ticklet);
+  }
+
+  lsim->replaying = 1;
+  err_t *err = lsim_state_replay(lsim, target);
+  lsim->replaying = 0;
+  if (err) {
+    ERR_RETHROW(err, "Replay to ticklet %ld failed", target);
+  }
+
+  /* Truncate the future. */
+  while (lsim->num_snapshots > 1 && lsim->snapshots[lsim->num_snapshots - 1].ticklet > target) {
+    lsim->num_snapshots--;
+    lsim->snapshot_bytes -= lsim->snapshots[lsim->num_snapshots].size;
+    free(lsim->snapshots[lsim->num_snapshots].image);
+  }
+  while (lsim->num_events > 0 && lsim->events[lsim->num_events - 1].ticklet >= target) {
+    lsim->num_events--;
+    free(lsim->events[lsim->num_events].dev_name);
+    free(lsim->events[lsim->num_events].words);
+  }
+
+  return ERR_OK;
+}  /* lsim_state_back */
+
+
+/* Power-up cache: the settled state right after power-up depends only on
+ * the netlist and on the switch positions and probe flags it started with,
+ * so it is saved as a state file named after those and reused by later
+ * runs, skipping the settle. */
+
+ERR_F lsim_state_power_cache_name(lsim_t *lsim, char **rtn_name) {
+  char *cache_dir;
+  ERR(cfg_get_str_val(lsim->cfg, "power_cache_dir", &cache_dir));
+  if (cache_dir == NULL || strlen(cache_dir) == 0) {
+    *rtn_name = NULL;  /* Disabled. */
+    return ERR_OK;
+  }
+
+  uint64_t key;
+  ERR(lsim_state_fingerprint(lsim, &key));
+  key += lsim_state_mix(LSIM_STATE_FILE_VERSION);
+  long i;
+  for (i = 0; i < lsim->num_devs; i++) {
+    lsim_dev_t *dev = lsim->dev_list[i];
+    if (dev->type == LSIM_DEV_TYPE_SWTCH) {
+      key += lsim_state_mix(lsim_state_name_hash(lsim_name_str(lsim, dev->name)) ^ (uint64_t)dev->swtch.swtch_state);
+    }
+    else if (dev->type == LSIM_DEV_TYPE_PROBE) {
+      key += lsim_state_mix(lsim_state_name_hash(lsim_name_str(lsim, dev->name)) ^ (uint64_t)dev->probe.flags);
+    }
+    else if (dev->type == LSIM_DEV_TYPE_MEM) {  /* Loaded before "p;". */
+      uint64_t mem_hash = lsim_state_name_hash(lsim_name_str(lsim, dev->name));
+      long addr;
+      for (addr = 0; addr < (1L << dev->mem.num_addr); addr++) {
+        mem_hash = lsim_state_mix(mem_hash ^ dev->mem.words[addr]);
+      }
+      key += lsim_state_mix(mem_hash);
+    }
+  }
+
+  ERR(err_asprintf(rtn_name, "%s/%016llx.lsimpwr", cache_dir, (unsigned long long)key));
+
+  return ERR_OK;
+}  /* lsim_state_power_cache_name */
+
+
+/* Called after the devices' power functions. If the settled state is in
+ * the cache, apply it instead of running the engine. A file that can't be
+ * used (corrupt, or from an older build) is a miss: the engine settles
+ * and lsim_state_power_cache_store() replaces it. */
+ERR_F lsim_state_power_cache_load(lsim_t *lsim, int *rtn_loaded) {
+  *rtn_loaded = 0;
+  char *cache_name;
+  ERR(lsim_state_power_cache_name(lsim, &cache_name));
+  if (cache_name == NULL) {
+    return ERR_OK;
+  }
+
+  uint8_t *image = NULL;
+  size_t size;
+  err_t *err = ERR_OK;
+  if (access(cache_name, R_OK) == 0) {
+    err = lsim_state_read(lsim, cache_name, &image, &size);
+    if (err) {
+      err_dispose(err);
+      err = ERR_OK;
+      image = NULL;
+    }
+  }
+  if (image) {  /* Checked, so this only fails on an internal error. */
+    err = lsim_dev_unschedule_all(lsim);
+    if (err == ERR_OK) {
+      err = lsim_state_apply(lsim, image, size);
+    }
+    free(image);
+    *rtn_loaded = (err == ERR_OK);
+  }
+  free(cache_name);
+  if (err) {
+    ERR_RETHROW(err, "Power cache");
+  }
+
+  return ERR_OK;
+}  /* lsim_state_power_cache_load */
+
+
+/* Called after the power-up settle. Written under a temporary name and
+ * renamed so that concurrent runs never see a partial file. */
+ERR_F lsim_state_power_cache_store(lsim_t *lsim) {
+  char *cache_name;
+  ERR(lsim_state_power_cache_name(lsim, &cache_name));
+  if (cache_name == NULL) {
+    return ERR_OK;
+  }
+
+  char *tmp_name;
+  err_t *err = err_asprintf(&tmp_name, "%s.%ld.tmp", cache_name, (long)getpid());
+  if (err) {
+    free(cache_name);
+    ERR_RETHROW(err, "Power cache");
+  }
+  err = lsim_state_save(lsim, tmp_name);
+  if (err == ERR_OK && rename(tmp_name, cache_name) != 0) {
+    err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_BADFILE, "Can't write power cache file '%s'", cache_name);
+  }
+  if (err) {
+    remove(tmp_name);
+  }
+  free(tmp_name);
+  free(cache_name);
+  if (err) {
+    ERR_RETHROW(err, "Power cache");
+  }
+
+  return ERR_OK;
+}  /* lsim_state_power_cache_store */
@@ -0,0 +1,71 @@
+/* lsim_state.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_STATE_H
+#define LSIM_STATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LSIM_STATE_FILE_MAGIC "LSIMSTAT"
+#define LSIM_STATE_FILE_VERSION 1
+
+#define LSIM_EVENT_MOVE 1
+#define LSIM_EVENT_LOADMEM 2
+#define LSIM_EVENT_POKE 3  /* A switch set without running the logic. */
+#define LSIM_EVENT_SETTLE 4  /* The logic run after one or more pokes. */
+
+struct lsim_snapshot_s {
+  long ticklet;  /* lsim->total_ticklets when captured. */
+  uint8_t *image;  /* From lsim_state_capture(). */
+  size_t size;
+};
+
+/* A user action between ticklets, recorded so "back" can replay it. */
+struct lsim_event_s {
+  long ticklet;  /* lsim->total_ticklets when it happened. */
+  int type;  /* LSIM_EVENT_xxx */
+  char *dev_name;
+  long new_state;  /* MOVE, POKE */
+  long addr;  /* LOADMEM */
+  int num_words;
+  uint64_t *words;
+};
+
+ERR_F lsim_state_fingerprint(lsim_t *lsim, uint64_t *rtn_fingerprint);
+ERR_F lsim_state_size(lsim_t *lsim, size_t *rtn_size);
+ERR_F lsim_state_capture(lsim_t *lsim, void *image, size_t image_size);
+ERR_F lsim_state_apply(lsim_t *lsim, const void *image, size_t image_size);
+ERR_F lsim_state_check(lsim_t *lsim, const void *image, size_t image_size);
+ERR_F lsim_state_save(lsim_t *lsim, const char *filename);
+ERR_F lsim_state_read(lsim_t *lsim, const char *filename, uint8_t **rtn_image, size_t *rtn_size);
+ERR_F lsim_state_restore(lsim_t *lsim, const char *filename);
+ERR_F lsim_state_history_clear(lsim_t *lsim);
+ERR_F lsim_state_history_reset(lsim_t *lsim);
+ERR_F lsim_state_history_ticklet(lsim_t *lsim);
+ERR_F lsim_state_history_event(lsim_t *lsim, int type, const char *dev_name, long new_state, long addr, int num_words, uint64_t *words);
+ERR_F lsim_state_back(lsim_t *lsim, long num_ticklets);
+ERR_F lsim_state_power_cache_name(lsim_t *lsim, char **rtn_name);
+ERR_F lsim_state_power_cache_load(lsim_t *lsim, int *rtn_loaded);
+ERR_F lsim_state_power_cache_store(lsim_t *lsim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_STATE_H
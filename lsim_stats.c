@@ -0,0 +1,427 @@
+/* lsim_stats.c - per-device activity counters and per-step histograms. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE  /* For clock_gettime(). */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_log.h"
+#include "lsim_stats.h"
+
+
+/* The counters are kept by the engine (lsim_dev_run_logic() and
+ * lsim_dev_out_propagate()). A composite device's work is done by its
+ * nands, so it's their counters that move. */
+
+#ifdef LSIM_STATS
+
+/* By LSIM_DEV_TYPE_xxx. */
+const char *lsim_stats_type_names[] = {
+  "?", "probe", "gnd", "vcc", "swtch", "led", "clk", "nand", "mem", "srlatch",
+  "dflipflop", "reg", "panel", "addbit", "addword", "module"
+};
+#define LSIM_STATS_NUM_TYPES ((int)(sizeof(lsim_stats_type_names) / sizeof(lsim_stats_type_names[0])))
+
+
+const char *lsim_stats_type_name(int type) {
+  return (type > 0 && type < LSIM_STATS_NUM_TYPES) ? lsim_stats_type_names[type] : "?";
+}  /* lsim_stats_type_name */
+
+
+/* Hottest first. */
+int lsim_stats_dev_cmp(const void *a, const void *b) {
+  const lsim_dev_t *dev_a = *(const lsim_dev_t * const *)a;
+  const lsim_dev_t *dev_b = *(const lsim_dev_t * const *)b;
+  if (dev_a->stats.run_logic != dev_b->stats.run_logic) {
+    return (dev_a->stats.run_logic < dev_b->stats.run_logic) ? 1 : -1;
+  }
+  return (dev_a->index > dev_b->index) - (dev_a->index < dev_b->index);
+}  /* lsim_stats_dev_cmp */
+
+
+void lsim_stats_type_totals(lsim_t *lsim, long *num_devs, lsim_dev_stats_t *totals) {
+  memset(num_devs, 0, LSIM_STATS_NUM_TYPES * sizeof(long));
+  memset(totals, 0, LSIM_STATS_NUM_TYPES * sizeof(lsim_dev_stats_t));
+  long i;
+  for (i = 0; i < lsim->num_devs; i++) {
+    lsim_dev_t *dev = lsim->dev_list[i];
+    int type = (dev->type > 0 && dev->type < LSIM_STATS_NUM_TYPES) ? dev->type : 0;
+    num_devs[type]++;
+    totals[type].run_logic += dev->stats.run_logic;
+    totals[type].no_change += dev->stats.no_change;
+    totals[type].toggles += dev->stats.toggles;
+    totals[type].fanout += dev->stats.fanout;
+  }
+}  /* lsim_stats_type_totals */
+
+#endif  /* LSIM_STATS */
+
+
+/* Print the top_n devices by run_logic calls, and totals by type. */
+ERR_F lsim_stats_print(lsim_t *lsim, long top_n) {
+#ifdef LSIM_STATS
+  ERR_ASSRT(top_n >= 0, LSIM_ERR_PARAM);
+
+  lsim_dev_t **devs;
+  ERR(err_calloc((void **)&devs, lsim->num_devs + 1, sizeof(lsim_dev_t *)));
+  long num_active = 0;
+  long i;
+  for (i = 0; i < lsim->num_devs; i++) {
+    if (lsim->dev_list[i]->stats.run_logic > 0) {
+      devs[num_active++] = lsim->dev_list[i];
+    }
+  }
+  qsort(devs, num_active, sizeof(lsim_dev_t *), lsim_stats_dev_cmp);
+
+  printf("Stats: ticklet %ld, step %ld, %ld of %ld devices ran\n", lsim->total_ticklets, lsim->cur_step, num_active, lsim->num_devs);
+  printf("%12s %12s %12s %12s  %s\n", "run_logic", "no_change", "toggles", "fanout", "device");
+  for (i = 0; i < num_active && i < top_n; i++) {
+    lsim_dev_stats_t *stats = &devs[i]->stats;
+    printf("%12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "  %s (%s)\n", stats->run_logic, stats->no_change, stats->toggles, stats->fanout,
+        lsim_name_str(lsim, devs[i]->name), lsim_stats_type_name(devs[i]->type));
+  }
+  free(devs);
+
+  long num_devs[LSIM_STATS_NUM_TYPES];
+  lsim_dev_stats_t totals[LSIM_STATS_NUM_TYPES];
+  lsim_stats_type_totals(lsim, num_devs, totals);
+  printf("%12s %12s %12s %12s  %s\n", "run_logic", "no_change", "toggles", "fanout", "type (devices)");
+  int type;
+  for (type = 0; type < LSIM_STATS_NUM_TYPES; type++) {
+    if (num_devs[type] > 0) {
+      printf("%12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "  %s (%ld)\n", totals[type].run_logic, totals[type].no_change, totals[type].toggles, totals[type].fanout,
+          lsim_stats_type_name(type), num_devs[type]);
+    }
+  }
+
+  return ERR_OK;
+#else
+  (void)lsim;
+  (void)top_n;
+  ERR_THROW(LSIM_ERR_COMMAND, "Stats not compiled in (build with LSIM_STATS=1 ./bld.sh)");
+#endif
+}  /* lsim_stats_print */
+
+
+/* Every device's counters, as JSON if the file name ends in ".json",
+ * else as CSV. */
+ERR_F lsim_stats_dump(lsim_t *lsim, const char *filename) {
+#ifdef LSIM_STATS
+  size_t len = strlen(filename);
+  int json = (len >= 5 && strcmp(&filename[len - 5], ".json") == 0);
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't create stats file '%s'", filename);
+  }
+
+  /* Device names are letters, digits, '_', '-' and '.', so need no quoting. */
+  int ok = 1;
+  if (json) {
+    ok = (fprintf(fp, "{\n  \"ticklet\": %ld,\n  \"step\": %ld,\n  \"devices\": [", lsim->total_ticklets, lsim->cur_step) > 0);
+  }
+  else {
+    ok = (fprintf(fp, "device,type,run_logic,no_change,toggles,fanout\n") > 0);
+  }
+  long i;
+  for (i = 0; i < lsim->num_devs && ok; i++) {
+    lsim_dev_t *dev = lsim->dev_list[i];
+    lsim_dev_stats_t *stats = &dev->stats;
+    if (json) {
+      ok = (fprintf(fp, "%s\n    {\"device\": \"%s\", \"type\": \"%s\", \"run_logic\": %" PRIu64 ", \"no_change\": %" PRIu64 ", \"toggles\": %" PRIu64 ", \"fanout\": %" PRIu64 "}",
+          (i > 0) ? "," : "", lsim_name_str(lsim, dev->name), lsim_stats_type_name(dev->type), stats->run_logic, stats->no_change, stats->toggles, stats->fanout) > 0);
+    }
+    else {
+      ok = (fprintf(fp, "%s,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+          lsim_name_str(lsim, dev->name), lsim_stats_type_name(dev->type), stats->run_logic, stats->no_change, stats->toggles, stats->fanout) > 0);
+    }
+  }
+  if (json && ok) {
+    long num_devs[LSIM_STATS_NUM_TYPES];
+    lsim_dev_stats_t totals[LSIM_STATS_NUM_TYPES];
+    lsim_stats_type_totals(lsim, num_devs, totals);
+    ok = (fprintf(fp, "\n  ],\n  \"types\": [") > 0);
+    int type;
+    int num_printed = 0;
+    for (type = 0; type < LSIM_STATS_NUM_TYPES && ok; type++) {
+      if (num_devs[type] > 0) {
+        ok = (fprintf(fp, "%s\n    {\"type\": \"%s\", \"devices\": %ld, \"run_logic\": %" PRIu64 ", \"no_change\": %" PRIu64 ", \"toggles\": %" PRIu64 ", \"fanout\": %" PRIu64 "}",
+            (num_printed > 0) ? "," : "", lsim_stats_type_name(type), num_devs[type], totals[type].run_logic, totals[type].no_change, totals[type].toggles, totals[type].fanout) > 0);
+        num_printed++;
+      }
+    }
+    ok = ok && (fprintf(fp, "\n  ]\n}\n") > 0);
+  }
+  ok = (fclose(fp) == 0) && ok;
+  if (! ok) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Error writing stats file '%s'", filename);
+  }
+
+  return ERR_OK;
+#else
+  (void)lsim;
+  (void)filename;
+  ERR_THROW(LSIM_ERR_COMMAND, "Stats not compiled in (build with LSIM_STATS=1 ./bld.sh)");
+#endif
+}  /* lsim_stats_dump */
+
+
+ERR_F lsim_stats_reset(lsim_t *lsim) {
+#ifdef LSIM_STATS
+  long i;
+  for (i = 0; i < lsim->num_devs; i++) {
+    memset(&lsim->dev_list[i]->stats, 0, sizeof(lsim_dev_stats_t));
+  }
+
+  return ERR_OK;
+#else
+  (void)lsim;
+  ERR_THROW(LSIM_ERR_COMMAND, "Stats not compiled in (build with LSIM_STATS=1 ./bld.sh)");
+#endif
+}  /* lsim_stats_reset */
+
+
+/* The step histograms are always compiled in; the engine only calls
+ * lsim_stats_step_begin/end() when lsim->step_stats is set. Steps
+ * replayed by "back" aren't counted. */
+
+ERR_F lsim_stats_step_init(lsim_t *lsim) {
+  lsim_step_stats_t *step_stats = lsim->step_stats;
+  if (step_stats == NULL) {
+    ERR(err_calloc((void **)&step_stats, 1, sizeof(lsim_step_stats_t)));
+    lsim->step_stats = step_stats;
+  }
+
+  /* max_propagate_cycles is re-read at each power-up. */
+  if (step_stats->cycle_steps == NULL || lsim->max_propagate_cycles > step_stats->max_cycles) {
+    long old_size = (step_stats->cycle_steps) ? step_stats->max_cycles + 1 : 0;
+    long new_size = lsim->max_propagate_cycles + 1;
+    uint64_t *cycle_steps = realloc(step_stats->cycle_steps, new_size * sizeof(uint64_t));
+    ERR_ASSRT(cycle_steps, LSIM_ERR_NOMEM);
+    memset(&cycle_steps[old_size], 0, (new_size - old_size) * sizeof(uint64_t));
+    step_stats->cycle_steps = cycle_steps;
+    step_stats->max_cycles = lsim->max_propagate_cycles;
+  }
+
+  return ERR_OK;
+}  /* lsim_stats_step_init */
+
+
+uint64_t lsim_stats_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}  /* lsim_stats_now_ns */
+
+
+void lsim_stats_hist_add(lsim_hist_t *hist, uint64_t val, long step) {
+  int bucket = 0;
+  uint64_t v;
+  for (v = val; v > 0; v >>= 1) {
+    bucket++;
+  }
+  hist->buckets[bucket]++;
+  hist->count++;
+  hist->sum += val;
+  if (val > hist->max || hist->count == 1) {
+    hist->max = val;
+    hist->max_step = step;
+  }
+}  /* lsim_stats_hist_add */
+
+
+void lsim_stats_step_begin(lsim_t *lsim) {
+  lsim->step_stats->start_ns = lsim_stats_now_ns();
+}  /* lsim_stats_step_begin */
+
+
+void lsim_stats_step_end(lsim_t *lsim) {
+  if (lsim->replaying) {
+    return;
+  }
+  lsim_step_stats_t *step_stats = lsim->step_stats;
+  uint64_t nanos = lsim_stats_now_ns() - step_stats->start_ns;
+
+  /* The engine stops at max_propagate_cycles, so this is in range. */
+  step_stats->cycle_steps[lsim->cur_cycle]++;
+  lsim_stats_hist_add(&step_stats->cycles, lsim->cur_cycle, lsim->cur_step);
+  lsim_stats_hist_add(&step_stats->runs, lsim->step_runs, lsim->cur_step);
+  lsim_stats_hist_add(&step_stats->nanos, nanos, lsim->cur_step);
+}  /* lsim_stats_step_end */
+
+
+/* Smallest value in a log2 bucket. */
+uint64_t lsim_stats_bucket_min(int bucket) {
+  return (bucket == 0) ? 0 : (uint64_t)1 << (bucket - 1);
+}  /* lsim_stats_bucket_min */
+
+
+uint64_t lsim_stats_bucket_max(int bucket) {
+  return (bucket == 0) ? 0 : ((uint64_t)1 << (bucket - 1)) * 2 - 1;
+}  /* lsim_stats_bucket_max */
+
+
+/* Smallest cycle count that covers "fraction" of the steps. The target
+ * step count is rounded up, and is at least one step. */
+long lsim_stats_cycle_pct(lsim_step_stats_t *step_stats, double fraction) {
+  double exact = fraction * step_stats->cycles.count;
+  uint64_t target = (uint64_t)exact;
+  if ((double)target < exact || (target == 0 && step_stats->cycles.count > 0)) {
+    target++;
+  }
+  uint64_t cum = 0;
+  long c;
+  for (c = 0; c < step_stats->max_cycles; c++) {
+    cum += step_stats->cycle_steps[c];
+    if (cum >= target) {
+      break;
+    }
+  }
+  return c;
+}  /* lsim_stats_cycle_pct */
+
+
+void lsim_stats_hist_print(const lsim_hist_t *hist, const char *what) {
+  printf("%s: mean %.1f, max %" PRIu64 " (step %ld)\n", what,
+      (hist->count > 0) ? (double)hist->sum / hist->count : 0.0, hist->max, hist->max_step);
+  printf("%23s %12s %7s %7s\n", what, "steps", "%", "cum%");
+  uint64_t cum = 0;
+  int bucket;
+  for (bucket = 0; bucket < LSIM_HIST_BUCKETS; bucket++) {
+    if (hist->buckets[bucket] > 0) {
+      cum += hist->buckets[bucket];
+      char range[48];
+      snprintf(range, sizeof(range), "%" PRIu64 "-%" PRIu64, lsim_stats_bucket_min(bucket), lsim_stats_bucket_max(bucket));
+      printf("%23s %12" PRIu64 " %6.1f%% %6.1f%%\n", range, hist->buckets[bucket],
+          100.0 * hist->buckets[bucket] / hist->count, 100.0 * cum / hist->count);
+    }
+  }
+}  /* lsim_stats_hist_print */
+
+
+ERR_F lsim_stats_step_print(lsim_t *lsim) {
+  lsim_step_stats_t *step_stats = lsim->step_stats;
+  if (step_stats == NULL) {
+    ERR_THROW(LSIM_ERR_COMMAND, "Step stats not collected (set step_stats=1 before power-up)");
+  }
+  lsim_log_flush(lsim);
+
+  printf("Step stats: %" PRIu64 " steps, max_propagate_cycles=%ld\n", step_stats->cycles.count, lsim->max_propagate_cycles);
+  if (step_stats->cycles.count == 0) {
+    return ERR_OK;
+  }
+
+  /* Cycles are few enough to count exactly; they size max_propagate_cycles. */
+  printf("cycles: mean %.1f, 50%% %ld, 99%% %ld, 99.9%% %ld, max %" PRIu64 " (step %ld, %.0f%% of max_propagate_cycles)\n",
+      (double)step_stats->cycles.sum / step_stats->cycles.count,
+      lsim_stats_cycle_pct(step_stats, 0.5), lsim_stats_cycle_pct(step_stats, 0.99), lsim_stats_cycle_pct(step_stats, 0.999),
+      step_stats->cycles.max, step_stats->cycles.max_step, 100.0 * step_stats->cycles.max / lsim->max_propagate_cycles);
+  printf("%23s %12s %7s %7s\n", "cycles", "steps", "%", "cum%");
+  uint64_t cum = 0;
+  long c;
+  for (c = 0; c <= step_stats->max_cycles; c++) {
+    if (step_stats->cycle_steps[c] > 0) {
+      cum += step_stats->cycle_steps[c];
+      printf("%23ld %12" PRIu64 " %6.1f%% %6.1f%%\n", c, step_stats->cycle_steps[c],
+          100.0 * step_stats->cycle_steps[c] / step_stats->cycles.count, 100.0 * cum / step_stats->cycles.count);
+    }
+  }
+  lsim_stats_hist_print(&step_stats->runs, "devices run");
+  lsim_stats_hist_print(&step_stats->nanos, "wall ns");
+
+  return ERR_OK;
+}  /* lsim_stats_step_print */
+
+
+int lsim_stats_hist_dump(FILE *fp, const lsim_hist_t *hist, const char *what) {
+  int ok = (fprintf(fp, "  \"%s\": {\"mean\": %.3f, \"max\": %" PRIu64 ", \"max_step\": %ld, \"buckets\": [", what,
+      (hist->count > 0) ? (double)hist->sum / hist->count : 0.0, hist->max, hist->max_step) > 0);
+  int bucket;
+  int num_printed = 0;
+  for (bucket = 0; bucket < LSIM_HIST_BUCKETS && ok; bucket++) {
+    if (hist->buckets[bucket] > 0) {
+      ok = (fprintf(fp, "%s\n    {\"min\": %" PRIu64 ", \"max\": %" PRIu64 ", \"steps\": %" PRIu64 "}", (num_printed > 0) ? "," : "",
+          lsim_stats_bucket_min(bucket), lsim_stats_bucket_max(bucket), hist->buckets[bucket]) > 0);
+      num_printed++;
+    }
+  }
+  return ok && (fprintf(fp, "\n  ]}") > 0);
+}  /* lsim_stats_hist_dump */
+
+
+/* As JSON. */
+ERR_F lsim_stats_step_dump(lsim_t *lsim, const char *filename) {
+  lsim_step_stats_t *step_stats = lsim->step_stats;
+  if (step_stats == NULL) {
+    ERR_THROW(LSIM_ERR_COMMAND, "Step stats not collected (set step_stats=1 before power-up)");
+  }
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't create step stats file '%s'", filename);
+  }
+
+  int ok = (fprintf(fp, "{\n  \"steps\": %" PRIu64 ",\n  \"max_propagate_cycles\": %ld,\n", step_stats->cycles.count, lsim->max_propagate_cycles) > 0);
+  ok = ok && (fprintf(fp, "  \"cycles\": {\"mean\": %.3f, \"max\": %" PRIu64 ", \"max_step\": %ld, \"steps_by_cycles\": [",
+      (step_stats->cycles.count > 0) ? (double)step_stats->cycles.sum / step_stats->cycles.count : 0.0,
+      step_stats->cycles.max, step_stats->cycles.max_step) > 0);
+  /* Index is the cycle count; stop at the highest one seen. */
+  long c;
+  for (c = 0; c <= (long)step_stats->cycles.max && ok; c++) {
+    ok = (fprintf(fp, "%s%" PRIu64, (c > 0) ? ", " : "", step_stats->cycle_steps[c]) > 0);
+  }
+  ok = ok && (fprintf(fp, "]},\n") > 0);
+  ok = ok && lsim_stats_hist_dump(fp, &step_stats->runs, "devices_run");
+  ok = ok && (fprintf(fp, ",\n") > 0);
+  ok = ok && lsim_stats_hist_dump(fp, &step_stats->nanos, "wall_ns");
+  ok = ok && (fprintf(fp, "\n}\n") > 0);
+  ok = (fclose(fp) == 0) && ok;
+  if (! ok) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Error writing step stats file '%s'", filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_stats_step_dump */
+
+
+ERR_F lsim_stats_step_reset(lsim_t *lsim) {
+  lsim_step_stats_t *step_stats = lsim->step_stats;
+  if (step_stats == NULL) {
+    ERR_THROW(LSIM_ERR_COMMAND, "Step stats not collected (set step_stats=1 before power-up)");
+  }
+
+  memset(step_stats->cycle_steps, 0, (step_stats->max_cycles + 1) * sizeof(uint64_t));
+  memset(&step_stats->cycles, 0, sizeof(lsim_hist_t));
+  memset(&step_stats->runs, 0, sizeof(lsim_hist_t));
+  memset(&step_stats->nanos, 0, sizeof(lsim_hist_t));
+
+  return ERR_OK;
+}  /* lsim_stats_step_reset */
+
+
+ERR_F lsim_stats_step_delete(lsim_t *lsim) {
+  if (lsim->step_stats) {
+    free(lsim->step_stats->cycle_steps);
+    free(lsim->step_stats);
+    lsim->step_stats = NULL;
+  }
+
+  return ERR_OK;
+}  /* lsim_stats_step_delete */
@@ -0,0 +1,79 @@
+/* lsim_stats.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_STATS_H
+#define LSIM_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-device activity counters, only in a build with -DLSIM_STATS
+ * ("LSIM_STATS=1 ./bld.sh"). Otherwise lsim_dev_t has no counters and
+ * LSIM_STATS_INC() is nothing. */
+typedef struct lsim_dev_stats_s {
+  uint64_t run_logic;  /* Times its logic ran. */
+  uint64_t no_change;  /* ... without changing an output. */
+  uint64_t toggles;  /* Output changes propagated. */
+  uint64_t fanout;  /* Inputs visited propagating them. */
+} lsim_dev_stats_t;
+
+#ifdef LSIM_STATS
+#  define LSIM_STATS_INC(dev, counter) ((dev)->stats.counter++)
+#else
+#  define LSIM_STATS_INC(dev, counter) ((void)0)
+#endif
+
+/* Engine histograms, per step, with config "step_stats=1". A log2
+ * histogram's bucket b counts the values with b significant bits:
+ * 0, 1, 2-3, 4-7, ... */
+#define LSIM_HIST_BUCKETS 65
+
+typedef struct lsim_hist_s {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  long max_step;  /* lsim->cur_step of the first step to reach max. */
+  uint64_t buckets[LSIM_HIST_BUCKETS];
+} lsim_hist_t;
+
+struct lsim_step_stats_s {
+  uint64_t start_ns;  /* Of the step being run. */
+  uint64_t *cycle_steps;  /* Steps by exact cycle count, [0..max_cycles]. */
+  long max_cycles;  /* lsim->max_propagate_cycles it was sized for. */
+  lsim_hist_t cycles;  /* Propagate cycles to settle. */
+  lsim_hist_t runs;  /* Devices whose logic ran. */
+  lsim_hist_t nanos;  /* Wall time. */
+};
+
+ERR_F lsim_stats_print(lsim_t *lsim, long top_n);
+ERR_F lsim_stats_dump(lsim_t *lsim, const char *filename);
+ERR_F lsim_stats_reset(lsim_t *lsim);
+ERR_F lsim_stats_step_init(lsim_t *lsim);
+void lsim_stats_step_begin(lsim_t *lsim);
+void lsim_stats_step_end(lsim_t *lsim);
+long lsim_stats_cycle_pct(lsim_step_stats_t *step_stats, double fraction);
+ERR_F lsim_stats_step_print(lsim_t *lsim);
+ERR_F lsim_stats_step_dump(lsim_t *lsim, const char *filename);
+ERR_F lsim_stats_step_reset(lsim_t *lsim);
+ERR_F lsim_stats_step_delete(lsim_t *lsim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_STATS_H
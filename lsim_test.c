@@ -12,9 +12,15 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
+#include <time.h>
 #if ! defined(_WIN32)
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 #include <pthread.h>
 #endif
 #include "err.h"
@@ -24,6 +30,18 @@
 #include "lsim_dev.h"
 #include "lsim_cmd.h"
 #include "lsim_devs.h"
+#include "lsim_state.h"
+#include "lsim_whatif.h"
+#include "lsim_netlist.h"
+#include "lsim_parse_cache.h"
+#include "lsim_name.h"
+#include "lsim_handle.h"
+#include "lsim_vector.h"
+#include "lsim_cond.h"
+#include "lsim_vcd.h"
+#include "lsim_wave.h"
+#include "lsim_log.h"
+#include "lsim_stats.h"
 
 #if defined(_WIN32)
 #define MY_SLEEP_MS(msleep_msecs) Sleep(msleep_msecs)
@@ -165,36 +183,36 @@ void test1() {
   E(lsim_cmd_line(lsim, "d;nand;MyNand;2;"));
 
   lsim_dev_t *nand_dev;
-  E(hmap_slookup(lsim->devs, "MyNand", (void **)&nand_dev));
+  E(lsim_name_lookup(lsim, "MyNand", &nand_dev));
   ASSRT(nand_dev);
   ASSRT(nand_dev->type == LSIM_DEV_TYPE_NAND);
   ASSRT(nand_dev->nand.num_inputs == 2);
-  ASSRT(nand_dev->nand.o_terminal->state == 0);
+  ASSRT(lsim_dev_out_state(lsim, nand_dev->nand.o_terminal) == 0);
   ASSRT(nand_dev->nand.o_terminal->in_terminal_list == NULL);
-  ASSRT(nand_dev->nand.i_terminals[0]->state == 0);
-  ASSRT(nand_dev->nand.i_terminals[1]->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, nand_dev->nand.i_terminals[0]) == 0);
+  ASSRT(lsim_dev_in_state(lsim, nand_dev->nand.i_terminals[1]) == 0);
 
   lsim_dev_t *vcc_dev;
-  E(hmap_slookup(lsim->devs, "MyVcc", (void **)&vcc_dev));
+  E(lsim_name_lookup(lsim, "MyVcc", &vcc_dev));
   ASSRT(vcc_dev);
   ASSRT(vcc_dev->type == LSIM_DEV_TYPE_VCC);
-  ASSRT(vcc_dev->vcc.o_terminal->state == 0);
+  ASSRT(lsim_dev_out_state(lsim, vcc_dev->vcc.o_terminal) == 0);
   ASSRT(vcc_dev->vcc.o_terminal->in_terminal_list == NULL);
 
   lsim_dev_t *vcc2_dev;
-  E(hmap_slookup(lsim->devs, "-My_Vcc2", (void **)&vcc2_dev));
+  E(lsim_name_lookup(lsim, "-My_Vcc2", &vcc2_dev));
   ASSRT(vcc2_dev);
   ASSRT(vcc2_dev->type == LSIM_DEV_TYPE_VCC);
-  ASSRT(vcc2_dev->vcc.o_terminal->state == 0);
+  ASSRT(lsim_dev_out_state(lsim, vcc2_dev->vcc.o_terminal) == 0);
   ASSRT(vcc2_dev->vcc.o_terminal->in_terminal_list == NULL);
 
   E(lsim_cmd_line(lsim, "c;-My_Vcc2;o0;MyNand;i0;"));
 
   lsim_dev_t *tmp_dev;
-  E(hmap_slookup(lsim->devs, "-My_Vcc2", (void **)&tmp_dev));
+  E(lsim_name_lookup(lsim, "-My_Vcc2", &tmp_dev));
   ASSRT(tmp_dev == vcc2_dev);
   ASSRT(vcc2_dev->type == LSIM_DEV_TYPE_VCC);
-  ASSRT(vcc2_dev->vcc.o_terminal->state == 0);
+  ASSRT(lsim_dev_out_state(lsim, vcc2_dev->vcc.o_terminal) == 0);
   ASSRT(vcc2_dev->vcc.o_terminal->in_terminal_list == nand_dev->nand.i_terminals[0]);
   ASSRT(nand_dev->nand.i_terminals[0]->next_in_terminal == NULL);
   ASSRT(nand_dev->nand.i_terminals[0]->driving_out_terminal == vcc2_dev->vcc.o_terminal);
@@ -218,16 +236,16 @@ void test1() {
   E(lsim_cmd_line(lsim, "c;my_gnd;o0;my_led;i0;"));
 
   lsim_dev_t *led_dev;
-  E(hmap_slookup(lsim->devs, "my_led", (void **)&led_dev));
+  E(lsim_name_lookup(lsim, "my_led", &led_dev));
   ASSRT(led_dev);
   ASSRT(led_dev->type == LSIM_DEV_TYPE_LED);
   ASSRT(led_dev->led.illuminated == 0);
-  ASSRT(led_dev->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, led_dev->led.i_terminal) == 0);
 
   ASSRT(led_dev);
   ASSRT(led_dev->type == LSIM_DEV_TYPE_LED);
   ASSRT(led_dev->led.illuminated == 0);
-  ASSRT(led_dev->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, led_dev->led.i_terminal) == 0);
 
   E(lsim_cmd_line(lsim, "v;1;"));
   E(lsim_cmd_line(lsim, "d;clk;my_clk;"));
@@ -239,15 +257,15 @@ void test1() {
   E(lsim_cmd_line(lsim, "c;Reset_sw;o0;my_clk;R0;"));
 
   lsim_dev_t *qled_dev;
-  E(hmap_slookup(lsim->devs, "qled", (void **)&qled_dev));
+  E(lsim_name_lookup(lsim, "qled", &qled_dev));
   ASSRT(qled_dev);
   ASSRT(qled_dev->led.illuminated == 0);
   lsim_dev_t *Qled_dev;
-  E(hmap_slookup(lsim->devs, "Qled", (void **)&Qled_dev));
+  E(lsim_name_lookup(lsim, "Qled", &Qled_dev));
   ASSRT(Qled_dev);
   ASSRT(Qled_dev->led.illuminated == 0);
   lsim_dev_t *clk_dev;
-  E(hmap_slookup(lsim->devs, "my_clk", (void **)&clk_dev));
+  E(lsim_name_lookup(lsim, "my_clk", &clk_dev));
   ASSRT(clk_dev);
 
   E(lsim_cmd_line(lsim, "t;1;"));
@@ -280,12 +298,12 @@ void test2() {
   E(lsim_cmd_line(lsim, "i;srlatch.lsim;"));
 
   lsim_dev_t *nand1_dev;
-  E(hmap_slookup(lsim->devs, "nand1", (void **)&nand1_dev));
-  ASSRT(nand1_dev->nand.o_terminal->state == 1);
+  E(lsim_name_lookup(lsim, "nand1", &nand1_dev));
+  ASSRT(lsim_dev_out_state(lsim, nand1_dev->nand.o_terminal) == 1);
 
   lsim_dev_t *nand2_dev;
-  E(hmap_slookup(lsim->devs, "nand2", (void **)&nand2_dev));
-  ASSRT(nand2_dev->nand.o_terminal->state == 0);
+  E(lsim_name_lookup(lsim, "nand2", &nand2_dev));
+  ASSRT(lsim_dev_out_state(lsim, nand2_dev->nand.o_terminal) == 0);
 
   E(lsim_delete(lsim));
 }  /* test2 */
@@ -312,12 +330,12 @@ void test3() {
   E(lsim_cmd_line(lsim, "m;swS;1;"));
 
   lsim_dev_t *ledq_dev;
-  E(hmap_slookup(lsim->devs, "ledq", (void **)&ledq_dev));
-  ASSRT(ledq_dev->led.i_terminal->state == 1);
+  E(lsim_name_lookup(lsim, "ledq", &ledq_dev));
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 1);
 
   lsim_dev_t *ledQ_dev;
-  E(hmap_slookup(lsim->devs, "ledQ", (void **)&ledQ_dev));
-  ASSRT(ledQ_dev->led.i_terminal->state == 0);
+  E(lsim_name_lookup(lsim, "ledQ", &ledQ_dev));
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 0);
 
   E(lsim_delete(lsim));
 }  /* test3 */
@@ -344,34 +362,34 @@ void test4() {
   E(lsim_cmd_line(lsim, "v;1;"));  /* Trace. */
 
   lsim_dev_t *ledq_dev;
-  E(hmap_slookup(lsim->devs, "ledq", (void **)&ledq_dev));
+  E(lsim_name_lookup(lsim, "ledq", &ledq_dev));
   lsim_dev_t *ledQ_dev;
-  E(hmap_slookup(lsim->devs, "ledQ", (void **)&ledQ_dev));
+  E(lsim_name_lookup(lsim, "ledQ", &ledQ_dev));
 
   E(lsim_cmd_line(lsim, "p;"));  /* Power-up. */
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "m;swR;1;"));  /* not reset. */
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "m;swd;1;"));
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "m;swc;0;"));  /* Clock falling edge. */
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "m;swc;1;"));  /* Clock rising edge. */
-  ASSRT(ledq_dev->led.i_terminal->state == 1);
-  ASSRT(ledQ_dev->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 0);
   E(lsim_cmd_line(lsim, "m;swd;0;"));  /* Data in 0. */
-  ASSRT(ledq_dev->led.i_terminal->state == 1);
-  ASSRT(ledQ_dev->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 0);
   E(lsim_cmd_line(lsim, "m;swc;0;"));  /* Clock falling edge. */
-  ASSRT(ledq_dev->led.i_terminal->state == 1);
-  ASSRT(ledQ_dev->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 0);
   E(lsim_cmd_line(lsim, "m;swc;1;"));  /* Clock rising edge. */
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
 
   E(lsim_delete(lsim));
 }  /* test4 */
@@ -400,37 +418,37 @@ void test5() {
   E(lsim_cmd_line(lsim, "v;1;"));  /* Trace. */
 
   lsim_dev_t *ledq_dev;
-  E(hmap_slookup(lsim->devs, "ledq", (void **)&ledq_dev));
+  E(lsim_name_lookup(lsim, "ledq", &ledq_dev));
   lsim_dev_t *ledQ_dev;
-  E(hmap_slookup(lsim->devs, "ledQ", (void **)&ledQ_dev));
+  E(lsim_name_lookup(lsim, "ledQ", &ledQ_dev));
 
   E(lsim_cmd_line(lsim, "p;"));  /* Power-up. */
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "t;1;"));  /* reset. */
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "m;swR;1;"));  /* not reset. */
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "t;1;"));
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "m;swd;1;"));
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "t;2;"));
-  ASSRT(ledq_dev->led.i_terminal->state == 1);
-  ASSRT(ledQ_dev->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 0);
   E(lsim_cmd_line(lsim, "m;swd;0;"));
-  ASSRT(ledq_dev->led.i_terminal->state == 1);
-  ASSRT(ledQ_dev->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 0);
   E(lsim_cmd_line(lsim, "t;2;"));
-  ASSRT(ledq_dev->led.i_terminal->state == 0);
-  ASSRT(ledQ_dev->led.i_terminal->state == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
   E(lsim_cmd_line(lsim, "m;swS;0;"));
-  ASSRT(ledq_dev->led.i_terminal->state == 1);
-  ASSRT(ledQ_dev->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 0);
 
   E(lsim_delete(lsim));
 }  /* test5 */
@@ -461,13 +479,13 @@ void test6() {
   E(lsim_cmd_line(lsim, "b;reg1;q1;pan1;i0;3;"));  /* Bus. */
 
   lsim_dev_t *led_reg0_dev;
-  E(hmap_slookup(lsim->devs, "led_reg0", (void **)&led_reg0_dev));
+  E(lsim_name_lookup(lsim, "led_reg0", &led_reg0_dev));
   lsim_dev_t *led0_dev;
-  E(hmap_slookup(lsim->devs, "pan1.led.0", (void **)&led0_dev));
+  E(lsim_name_lookup(lsim, "pan1.led.0", &led0_dev));
   lsim_dev_t *led1_dev;
-  E(hmap_slookup(lsim->devs, "pan1.led.1", (void **)&led1_dev));
+  E(lsim_name_lookup(lsim, "pan1.led.1", &led1_dev));
   lsim_dev_t *led2_dev;
-  E(hmap_slookup(lsim->devs, "pan1.led.2", (void **)&led2_dev));
+  E(lsim_name_lookup(lsim, "pan1.led.2", &led2_dev));
 
   /* E(lsim_cmd_line(lsim, "v;1;")); */  /* Trace. */
   E(lsim_cmd_line(lsim, "p;"));  /* Power-up. */
@@ -544,7 +562,7 @@ void test7() {
   E(lsim_cmd_line(lsim, "m;a_pan.swtch.1;1;"));  /* Memory location 2. */
 
   lsim_dev_t *mem_dev;
-  E(hmap_slookup(lsim->devs, "mem1", (void **)&mem_dev));
+  E(lsim_name_lookup(lsim, "mem1", &mem_dev));
   ASSRT(mem_dev);
   ASSRT(mem_dev->type == LSIM_DEV_TYPE_MEM);
   ASSRT(mem_dev->mem.words[0] == 0);
@@ -666,19 +684,19 @@ void test9() {
 
   E(lsim_cmd_line(lsim, "d;led;led_s;"));
   lsim_dev_t *led_s;
-  E(hmap_slookup(lsim->devs, "led_s", (void **)&led_s));
+  E(lsim_name_lookup(lsim, "led_s", &led_s));
   ASSRT(led_s);
   ASSRT(led_s->type == LSIM_DEV_TYPE_LED);
   ASSRT(led_s->led.illuminated == 0);
-  ASSRT(led_s->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, led_s->led.i_terminal) == 0);
 
   E(lsim_cmd_line(lsim, "d;led;led_o;"));
   lsim_dev_t *led_o;
-  E(hmap_slookup(lsim->devs, "led_o", (void **)&led_o));
+  E(lsim_name_lookup(lsim, "led_o", &led_o));
   ASSRT(led_o);
   ASSRT(led_o->type == LSIM_DEV_TYPE_LED);
   ASSRT(led_o->led.illuminated == 0);
-  ASSRT(led_o->led.i_terminal->state == 0);
+  ASSRT(lsim_dev_in_state(lsim, led_o->led.i_terminal) == 0);
 
   E(lsim_cmd_line(lsim, "c;sw_a;o0;adder;a0;"));
   E(lsim_cmd_line(lsim, "c;sw_b;o0;adder;b0;"));
@@ -734,11 +752,11 @@ void test10() {
   E(lsim_cmd_line(lsim, "c;gnd;o0;panelb;i2;"));
 
   lsim_dev_t *led0_dev;
-  E(hmap_slookup(lsim->devs, "panela.led.0", (void **)&led0_dev));
+  E(lsim_name_lookup(lsim, "panela.led.0", &led0_dev));
   lsim_dev_t *led1_dev;
-  E(hmap_slookup(lsim->devs, "panela.led.1", (void **)&led1_dev));
+  E(lsim_name_lookup(lsim, "panela.led.1", &led1_dev));
   lsim_dev_t *led2_dev;
-  E(hmap_slookup(lsim->devs, "panela.led.2", (void **)&led2_dev));
+  E(lsim_name_lookup(lsim, "panela.led.2", &led2_dev));
 
   E(lsim_cmd_line(lsim, "w;panela.swtch.0;1;"));
   E(lsim_cmd_line(lsim, "w;panela.swtch.1;1;"));
@@ -778,6 +796,2268 @@ void test10() {
 }  /* test10 */
 
 
+/* Same circuit as test5, checking the device list. */
+void test11() {
+  lsim_t *lsim;
+
+  E(lsim_create(&lsim, NULL));
+
+  E(lsim_cmd_line(lsim, "d;swtch;swd;0;"));
+  E(lsim_cmd_line(lsim, "d;swtch;swS;1;"));
+  E(lsim_cmd_line(lsim, "d;swtch;swR;0;"));
+  E(lsim_cmd_line(lsim, "d;clk;clock;"));
+  E(lsim_cmd_line(lsim, "d;led;ledq;"));
+  E(lsim_cmd_line(lsim, "d;led;ledQ;"));
+  E(lsim_cmd_line(lsim, "d;dflipflop;dflipflop1;"));
+  E(lsim_cmd_line(lsim, "c;swS;o0;dflipflop1;S0;"));
+  E(lsim_cmd_line(lsim, "c;swd;o0;dflipflop1;d0;"));
+  E(lsim_cmd_line(lsim, "c;swR;o0;dflipflop1;R0;"));
+  E(lsim_cmd_line(lsim, "c;swR;o0;clock;R0;"));
+  E(lsim_cmd_line(lsim, "c;clock;q0;dflipflop1;c0;"));
+  E(lsim_cmd_line(lsim, "c;dflipflop1;q0;ledq;i0;"));
+  E(lsim_cmd_line(lsim, "c;dflipflop1;Q0;ledQ;i0;"));
+
+  E(lsim_cmd_line(lsim, "p;"));  /* Power-up. */
+
+  lsim_dev_t *swd_dev;
+  E(lsim_name_lookup(lsim, "swd", &swd_dev));
+  lsim_dev_t *ledq_dev;
+  E(lsim_name_lookup(lsim, "ledq", &ledq_dev));
+  lsim_dev_t *ledQ_dev;
+  E(lsim_name_lookup(lsim, "ledQ", &ledQ_dev));
+  lsim_dev_t *dflipflop1_dev;
+  E(lsim_name_lookup(lsim, "dflipflop1", &dflipflop1_dev));
+  ASSRT(ledq_dev == lsim->dev_list[ledq_dev->index]);
+  ASSRT(ledq_dev->led.i_terminal->dev == ledq_dev);
+  ASSRT(lsim->active_clk_dev->type == LSIM_DEV_TYPE_CLK);
+  ASSRT(lsim->num_devs == 7 + 6);  /* The flip-flop's nands follow it. */
+  ASSRT(lsim->dev_list[0] == swd_dev && swd_dev->index == 0);  /* Creation order. */
+  ASSRT(lsim->dev_list[6] == dflipflop1_dev && dflipflop1_dev->index == 6);
+
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
+  E(lsim_cmd_line(lsim, "t;1;"));  /* reset. */
+  E(lsim_cmd_line(lsim, "m;swR;1;"));  /* not reset. */
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;swd;1;"));
+  E(lsim_cmd_line(lsim, "t;2;"));
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 1);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 0);
+  E(lsim_cmd_line(lsim, "m;swd;0;"));
+  E(lsim_cmd_line(lsim, "t;2;"));
+  ASSRT(lsim_dev_in_state(lsim, ledq_dev->led.i_terminal) == 0);
+  ASSRT(lsim_dev_in_state(lsim, ledQ_dev->led.i_terminal) == 1);
+
+  E(lsim_delete(lsim));
+}  /* test11 */
+
+
+/* Bit-packed net state. */
+void test12() {
+  lsim_t *lsim;
+
+  E(lsim_create(&lsim, NULL));
+
+  /* Enough outputs to spill into a second state word. */
+  int i;
+  for (i = 0; i < 70; i++) {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "d;swtch;sw%d;%d;", i, i & 1);
+    E(lsim_cmd_line(lsim, cmd));
+  }
+  E(lsim_cmd_line(lsim, "d;nand;nand1;2;"));
+  E(lsim_cmd_line(lsim, "d;led;led1;"));
+  E(lsim_cmd_line(lsim, "c;sw69;o0;nand1;i0;"));
+  E(lsim_cmd_line(lsim, "c;sw69;o0;nand1;i1;"));
+  E(lsim_cmd_line(lsim, "c;nand1;o0;led1;i0;"));
+
+  lsim_dev_t *sw69_dev;
+  E(lsim_name_lookup(lsim, "sw69", &sw69_dev));
+  lsim_dev_t *nand1_dev;
+  E(lsim_name_lookup(lsim, "nand1", &nand1_dev));
+  lsim_dev_t *led1_dev;
+  E(lsim_name_lookup(lsim, "led1", &led1_dev));
+
+  ASSRT(sw69_dev->swtch.o_terminal->net_id == 70);
+  ASSRT(nand1_dev->nand.i_terminals[0]->net_id == 70);
+  ASSRT(nand1_dev->nand.i_terminals[1]->net_id == 70);
+  ASSRT(led1_dev->led.i_terminal->net_id == nand1_dev->nand.o_terminal->net_id);
+
+  E(lsim_cmd_line(lsim, "p;"));
+  ASSRT(lsim_dev_out_state(lsim, sw69_dev->swtch.o_terminal) == 1);
+  ASSRT(lsim_dev_in_state(lsim, nand1_dev->nand.i_terminals[0]) == 1);
+  ASSRT(lsim_dev_in_state(lsim, led1_dev->led.i_terminal) == 0);
+  /* Nets 64-71 are sw63..sw69 (odd ones on) and nand1 (off). */
+  ASSRT(lsim->net_states[1] == 0x55);
+  ASSRT((lsim->net_states[0] & 1) == 0);  /* Net 0 (floating) is never driven. */
+
+  E(lsim_cmd_line(lsim, "m;sw69;0;"));
+  ASSRT(lsim_dev_in_state(lsim, nand1_dev->nand.i_terminals[1]) == 0);
+  ASSRT(lsim_dev_in_state(lsim, led1_dev->led.i_terminal) == 1);
+  ASSRT(memcmp(lsim->out_states, lsim->net_states, lsim->alloc_state_words * sizeof(uint64_t)) == 0);
+
+  E(lsim_delete(lsim));
+}  /* test12 */
+
+
+/* Huge-page backed netlist storage (falls back if not available). */
+void test13() {
+  lsim_t *lsim;
+
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "huge_pages=2", "test13", 0));
+  E(cfg_get_long_val(lsim->cfg, "huge_pages", &lsim->huge_pages));
+
+  E(lsim_cmd_line(lsim, "d;mem;mem1;16;8;"));
+  E(lsim_cmd_line(lsim, "d;panel;a_pan;16;"));
+  E(lsim_cmd_line(lsim, "d;panel;d_pan;8;"));
+  E(lsim_cmd_line(lsim, "d;swtch;w_sw;0;"));
+  E(lsim_cmd_line(lsim, "b;d_pan;o0;mem1;i0;8;"));
+  E(lsim_cmd_line(lsim, "b;mem1;o0;d_pan;i0;8;"));
+  E(lsim_cmd_line(lsim, "b;a_pan;o0;mem1;a0;16;"));
+  E(lsim_cmd_line(lsim, "b;a_pan;o0;a_pan;i0;16;"));
+  E(lsim_cmd_line(lsim, "c;w_sw;o0;mem1;w0;"));
+
+  /* The mem words and the first terminal chunk are big allocations. */
+  lsim_dev_t *mem_dev;
+  E(lsim_name_lookup(lsim, "mem1", &mem_dev));
+  int found_words = 0;
+  lsim_bigalloc_t *bigalloc;
+  for (bigalloc = lsim->bigallocs; bigalloc; bigalloc = bigalloc->next) {
+    if (bigalloc->ptr == mem_dev->mem.words) {
+      found_words = 1;
+      ASSRT(bigalloc->size >= (1 << 16) * sizeof(uint64_t));
+      if (bigalloc->mapped) {
+        ASSRT(bigalloc->size % LSIM_HUGE_PAGE_SIZE == 0);
+      }
+    }
+  }
+  ASSRT(found_words);
+  ASSRT(lsim->terminal_chunk != NULL);
+
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_name_lookup(lsim, "mem1", &mem_dev));
+  E(lsim_cmd_line(lsim, "l;mem1;0xbeef;0x5a;"));
+  ASSRT(mem_dev->mem.words[0xbeef] == 0x5a);
+
+  E(lsim_delete(lsim));
+
+  /* Small blocks aren't rounded up to a huge page. */
+  E(lsim_create(&lsim, NULL));
+  lsim->huge_pages = 1;
+  int i;
+  for (i = 0; i < 50; i++) {
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "d;mem;smem%d;4;8;", i);
+    E(lsim_cmd_line(lsim, cmd));
+  }
+  int num_small = 0;
+  for (bigalloc = lsim->bigallocs; bigalloc; bigalloc = bigalloc->next) {
+    if (bigalloc->size < LSIM_HUGE_PAGE_MIN) {
+      num_small++;
+      ASSRT(! bigalloc->mapped);
+    }
+  }
+  ASSRT(num_small == 50);  /* Plus one terminal chunk. */
+
+  /* Blocks can be freed in any order. */
+  void *blocks[4];
+  for (i = 0; i < 4; i++) {
+    E(lsim_bigalloc(lsim, 100 + i, &blocks[i]));
+    ASSRT(((uintptr_t)blocks[i] & (LSIM_BIGALLOC_HDR_SIZE - 1)) == 0);  /* Cache-line aligned. */
+  }
+  E(lsim_bigfree(lsim, blocks[1]));
+  E(lsim_bigfree(lsim, blocks[3]));  /* List head. */
+  E(lsim_bigfree(lsim, blocks[0]));
+  ASSRT(lsim->bigallocs->ptr == blocks[2]);
+  ASSRT(lsim->bigallocs->prev == NULL);
+  E(lsim_bigfree(lsim, blocks[2]));
+  int num_left = 0;
+  for (bigalloc = lsim->bigallocs; bigalloc; bigalloc = bigalloc->next) {
+    ASSRT(bigalloc->next == NULL || bigalloc->next->prev == bigalloc);
+    num_left++;
+  }
+  ASSRT(num_left == 51);
+
+  E(lsim_delete(lsim));
+}  /* test13 */
+
+
+char *test14_ctr[] = {
+  "d;vcc;vcc;", "d;swtch;Rst;0;", "d;clk;clock;", "c;Rst;o0;clock;R0;",
+  "d;dflipflop;ff1;", "c;Rst;o0;ff1;R0;", "c;vcc;o0;ff1;S0;", "c;ff1;Q0;ff1;d0;", "c;clock;Q0;ff1;c0;",
+  "d;dflipflop;ff2;", "c;Rst;o0;ff2;R0;", "c;vcc;o0;ff2;S0;", "c;ff2;Q0;ff2;d0;", "c;ff1;Q0;ff2;c0;",
+  "d;dflipflop;ff3;", "c;Rst;o0;ff3;R0;", "c;vcc;o0;ff3;S0;", "c;ff3;Q0;ff3;d0;", "c;ff2;Q0;ff3;c0;",
+  "d;led;led1;", "c;ff1;q0;led1;i0;", "d;led;led2;", "c;ff2;q0;led2;i0;", "d;led;led3;", "c;ff3;q0;led3;i0;",
+  "d;mem;mem1;4;4;", "d;panel;pan;4;", "d;swtch;w_sw;0;",
+  "b;pan;o0;mem1;a0;4;", "b;mem1;o0;pan;i0;4;", "b;pan;o0;mem1;i0;4;", "c;w_sw;o0;mem1;w0;",
+  NULL
+};
+
+int test14_count(lsim_t *lsim) {
+  int count = 0;
+  int i;
+  for (i = 3; i >= 1; i--) {
+    char name[8];
+    snprintf(name, sizeof(name), "led%d", i);
+    lsim_dev_t *led_dev;
+    E(lsim_name_lookup(lsim, name, &led_dev));
+    count = (count << 1) | led_dev->led.illuminated;
+  }
+  return count;
+}  /* test14_count */
+
+/* Save and restore simulation state. */
+void test14() {
+  lsim_t *lsim;
+  int i;
+
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, "t;5;"));
+  E(lsim_cmd_line(lsim, "l;mem1;3;0xa;"));
+  E(lsim_cmd_line(lsim, "m;pan.swtch.0;1;"));
+  E(lsim_cmd_line(lsim, "m;pan.swtch.1;1;"));  /* Address 3, reads 0xa. */
+  E(lsim_cmd_line(lsim, "save;test14.state;"));
+  long saved_ticklet = lsim->cur_ticklet;
+  long saved_step = lsim->cur_step;
+  E(lsim_cmd_line(lsim, "t;7;"));
+  int expected_count = test14_count(lsim);
+  E(lsim_delete(lsim));
+
+  /* Same netlist, different device layout. */
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "restore;test14.state;"));
+  ASSRT(lsim->cur_ticklet == saved_ticklet);
+  ASSRT(lsim->cur_step == saved_step);
+  lsim_dev_t *mem_dev;
+  E(lsim_name_lookup(lsim, "mem1", &mem_dev));
+  ASSRT(mem_dev->mem.words[3] == 0xa);
+  lsim_dev_t *led_dev;
+  E(lsim_name_lookup(lsim, "pan.led.3", &led_dev));
+  ASSRT(led_dev->led.illuminated == 1);  /* 0xa, bit 3. */
+  E(lsim_cmd_line(lsim, "t;7;"));
+  ASSRT(test14_count(lsim) == expected_count);
+  E(lsim_delete(lsim));
+
+  /* Different netlist is rejected. */
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "d;led;extra;"));
+  E(lsim_cmd_line(lsim, "c;vcc;o0;extra;i0;"));
+  E(lsim_cmd_line(lsim, "p;"));
+  err_t *err = lsim_cmd_line(lsim, "restore;test14.state;");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_MISMATCH);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+
+  /* An image naming a device that isn't there. */
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  size_t size;
+  E(lsim_state_size(lsim, &size));
+  uint8_t *image = malloc(size);
+  ASSRT(image);
+  E(lsim_state_capture(lsim, image, size));
+  size_t pos = 0;
+  while (pos + 4 <= size && memcmp(&image[pos], "led1", 4) != 0) {
+    pos++;
+  }
+  ASSRT(pos + 4 <= size);
+  image[pos + 3] = '9';
+  global_error_reaction = 2;
+  err = lsim_state_check(lsim, image, size);
+  ASSRT(err && err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+  err = lsim_state_apply(lsim, image, size);
+  ASSRT(err && err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+  global_error_reaction = 1;
+  free(image);
+  E(lsim_delete(lsim));
+
+  remove("test14.state");
+}  /* test14 */
+
+
+/* Signature of the test14 circuit's state, for comparing timelines. */
+long test15_sig(lsim_t *lsim) {
+  lsim_dev_t *mem_dev;
+  E(lsim_name_lookup(lsim, "mem1", &mem_dev));
+  long sig = test14_count(lsim);
+  sig = (sig << 4) | (long)mem_dev->mem.words[3];
+  sig = (sig << 16) | (lsim->cur_ticklet & 0xffff);
+  sig = (sig << 16) | (lsim->cur_step & 0xffff);
+  return sig;
+}  /* test15_sig */
+
+/* In-memory snapshots and reverse stepping. */
+void test15() {
+  lsim_t *lsim;
+  long sigs[17];
+  int i;
+
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "snapshot_interval=4", "test15", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  sigs[0] = test15_sig(lsim);
+  for (i = 1; i <= 16; i++) {
+    E(lsim_cmd_line(lsim, "t;1;"));
+    if (i == 1) {
+      E(lsim_cmd_line(lsim, "m;Rst;1;"));
+    }
+    if (i == 6) {
+      E(lsim_cmd_line(lsim, "l;mem1;3;0xa;"));
+      E(lsim_cmd_line(lsim, "m;pan.swtch.0;1;"));
+      E(lsim_cmd_line(lsim, "m;pan.swtch.1;1;"));
+    }
+    if (i == 11) {
+      E(lsim_cmd_line(lsim, "m;Rst;0;"));
+    }
+    if (i == 12) {
+      E(lsim_cmd_line(lsim, "m;Rst;1;"));
+    }
+    sigs[i] = test15_sig(lsim);  /* After the commands that followed. */
+  }
+  ASSRT(lsim->total_ticklets == 16);
+  ASSRT(lsim->num_snapshots == 5);  /* 0, 4, 8, 12, 16. */
+  ASSRT(lsim->num_events == 6);
+
+  /* Going back lands right after the ticklet, before the commands that
+   * followed it, so only compare where no commands ran. */
+  E(lsim_cmd_line(lsim, "back;3;"));
+  ASSRT(lsim->total_ticklets == 13);
+  ASSRT(test15_sig(lsim) == sigs[13]);
+  E(lsim_cmd_line(lsim, "back;3;"));
+  ASSRT(lsim->total_ticklets == 10);
+  ASSRT(test15_sig(lsim) == sigs[10]);
+  ASSRT(lsim->num_snapshots == 3);  /* Future discarded. */
+  ASSRT(lsim->num_events == 4);
+  E(lsim_cmd_line(lsim, "t;3;"));  /* Rst stays 1 this time. */
+  ASSRT(test15_sig(lsim) != sigs[13]);
+
+  E(lsim_cmd_line(lsim, "back;9;"));
+  ASSRT(lsim->total_ticklets == 4);
+  ASSRT(test15_sig(lsim) == sigs[4]);
+  lsim_dev_t *mem_dev;
+  E(lsim_name_lookup(lsim, "mem1", &mem_dev));
+  ASSRT(mem_dev->mem.words[3] == 0);  /* Before the loadmem. */
+
+  err_t *err = lsim_cmd_line(lsim, "back;5;");  /* Past power-up. */
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+
+  /* Small budget thins the snapshots. */
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "snapshot_interval=2", "test15", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  lsim->snapshot_budget = 3 * lsim->snapshots[0].size;
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  for (i = 2; i <= 16; i++) {
+    E(lsim_cmd_line(lsim, "t;1;"));
+    sigs[i] = test15_sig(lsim);
+  }
+  ASSRT(lsim->num_snapshots == 3);  /* 0, 8, 16. */
+  ASSRT(lsim->snapshot_interval == 8);
+  ASSRT(lsim->snapshots[1].ticklet == 8);
+  E(lsim_cmd_line(lsim, "back;9;"));
+  ASSRT(test15_sig(lsim) == sigs[7]);
+  E(lsim_delete(lsim));
+
+  /* Disabled by default. */
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "t;2;"));
+  err = lsim_cmd_line(lsim, "back;1;");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+}  /* test15 */
+
+
+/* Forked what-if variants. */
+void test16() {
+  lsim_t *lsim;
+  int i;
+
+  FILE *fp;
+  ASSRT(fp = fopen("test16a.lsim", "w"));
+  fprintf(fp, "t;4;\n");
+  fclose(fp);
+  ASSRT(fp = fopen("test16b.lsim", "w"));
+  fprintf(fp, "m;Rst;0;\nt;4;\n");
+  fclose(fp);
+  ASSRT(fp = fopen("test16c.lsim", "w"));
+  fprintf(fp, "m;nosuch;1;\n");
+  fclose(fp);
+
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "whatif_procs=2", "test16", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, "t;5;"));
+  long saved_step = lsim->cur_step;
+  int saved_count = test14_count(lsim);
+
+  char *scripts[] = { "test16a.lsim", "test16b.lsim", "test16c.lsim" };
+  lsim_whatif_result_t results[3];
+  E(lsim_whatif_run(lsim, 3, scripts, results));
+
+  ASSRT(results[0].status == LSIM_WHATIF_STATUS_OK);
+  ASSRT(results[0].cur_ticklet == 8);
+  ASSRT(results[0].leds_on == 1);  /* Count is 4. */
+  ASSRT(results[1].status == LSIM_WHATIF_STATUS_OK);
+  ASSRT(results[1].cur_ticklet == -1);  /* Held in reset. */
+  ASSRT(results[1].leds_on == 0);
+  ASSRT(results[2].status == LSIM_WHATIF_STATUS_DIED);  /* error_reaction=1 exits. */
+  ASSRT(results[2].exit_status == 1);
+
+  /* The parent is untouched. */
+  ASSRT(lsim->cur_step == saved_step);
+  ASSRT(test14_count(lsim) == saved_count);
+
+  ASSRT(fp = fopen("test16a.lsim.out", "r"));
+  char iline[256];
+  int found = 0;
+  while (fgets(iline, sizeof(iline), fp)) {
+    if (strstr(iline, "Led led3: on (ticklet 7)")) {
+      found = 1;
+    }
+  }
+  fclose(fp);
+  ASSRT(found);
+
+  /* Only room for one pipe: the second launch fails, and the first child
+   * is still reaped and its pipe closed. */
+  int probe = dup(0);
+  ASSRT(probe >= 0);
+  int probe2 = dup(0);
+  ASSRT(probe2 == probe + 1);
+  close(probe2);
+  close(probe);
+  struct rlimit saved_limit, limit;
+  ASSRT(getrlimit(RLIMIT_NOFILE, &saved_limit) == 0);
+  limit = saved_limit;
+  limit.rlim_cur = probe + 2;
+  ASSRT(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+  memset(results, 0, sizeof(results));
+  err_t *err = lsim_whatif_run(lsim, 3, scripts, results);
+  ASSRT(setrlimit(RLIMIT_NOFILE, &saved_limit) == 0);
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_INTERNAL);
+  err_dispose(err);
+  ASSRT(results[0].status == LSIM_WHATIF_STATUS_OK);
+  ASSRT(results[0].cur_ticklet == 8);
+  ASSRT(waitpid(-1, NULL, WNOHANG) < 0);  /* No children left. */
+  probe2 = dup(0);
+  ASSRT(probe2 == probe);
+  close(probe2);
+
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "whatif_procs=-1", "test16", 0));
+  err = lsim_cmd_line(lsim, "whatif;test16a.lsim;test16b.lsim;");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_CONFIG);
+  err_dispose(err);
+
+  E(lsim_delete(lsim));
+
+  remove("test16a.lsim"); remove("test16a.lsim.out");
+  remove("test16b.lsim"); remove("test16b.lsim.out");
+  remove("test16c.lsim"); remove("test16c.lsim.out");
+}  /* test16 */
+
+
+/* Power-up cache. */
+void test17() {
+  lsim_t *lsim;
+  int i;
+
+  mkdir("test17.cache", 0755);
+
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "power_cache_dir=test17.cache", "test17", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  char *cache_name;
+  E(lsim_state_power_cache_name(lsim, &cache_name));
+  ASSRT(access(cache_name, R_OK) != 0);
+  E(lsim_cmd_line(lsim, "p;"));
+  ASSRT(lsim->cur_cycle > 0);  /* Settled by the engine. */
+  ASSRT(access(cache_name, R_OK) == 0);
+  size_t size;
+  E(lsim_state_size(lsim, &size));
+  uint8_t *image1;
+  ASSRT(image1 = malloc(size));
+  E(lsim_state_capture(lsim, image1, size));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, "t;7;"));
+  int expected_count = test14_count(lsim);
+  E(lsim_delete(lsim));
+
+  /* Same netlist, different layout: loaded from the cache. */
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "power_cache_dir=test17.cache", "test17", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  ASSRT(lsim->cur_cycle == 0);  /* Engine didn't run. */
+  uint8_t *image2;
+  ASSRT(image2 = malloc(size));
+  E(lsim_state_capture(lsim, image2, size));
+  ASSRT(memcmp(image1, image2, size) == 0);
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, "t;7;"));
+  ASSRT(test14_count(lsim) == expected_count);
+  E(lsim_delete(lsim));
+
+  /* Different starting switch position is a different entry. */
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "power_cache_dir=test17.cache", "test17", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "m;w_sw;1;"));
+  char *cache_name2;
+  E(lsim_state_power_cache_name(lsim, &cache_name2));
+  ASSRT(strcmp(cache_name, cache_name2) != 0);
+  E(lsim_cmd_line(lsim, "p;"));
+  ASSRT(lsim->cur_cycle > 0);
+  E(lsim_delete(lsim));
+
+  /* So are different mem contents. */
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "power_cache_dir=test17.cache", "test17", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "l;mem1;0;5;"));
+  char *cache_name3;
+  E(lsim_state_power_cache_name(lsim, &cache_name3));
+  ASSRT(strcmp(cache_name, cache_name3) != 0);
+  E(lsim_delete(lsim));
+  free(cache_name3);
+
+  /* A corrupt file is a miss, and is replaced. */
+  FILE *fp = fopen(cache_name, "r+b");
+  ASSRT(fp);
+  ASSRT(fseek(fp, 32 + 24, SEEK_SET) == 0);  /* The image's num_nets. */
+  uint64_t junk = UINT64_C(0x5a5a5a5a5a5a5a5a);
+  ASSRT(fwrite(&junk, sizeof(junk), 1, fp) == 1);
+  fclose(fp);
+  for (i = 0; i < 2; i++) {
+    E(lsim_create(&lsim, NULL));
+    E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "power_cache_dir=test17.cache", "test17", 0));
+    for (int j = 0; test14_ctr[j]; j++) {
+      E(lsim_cmd_line(lsim, test14_ctr[j]));
+    }
+    E(lsim_cmd_line(lsim, "p;"));
+    ASSRT((lsim->cur_cycle > 0) == (i == 0));  /* Settled, then loaded. */
+    E(lsim_state_capture(lsim, image2, size));
+    ASSRT(memcmp(image1, image2, size) == 0);
+    E(lsim_delete(lsim));
+  }
+
+  remove(cache_name);
+  remove(cache_name2);
+  rmdir("test17.cache");
+  free(cache_name);
+  free(cache_name2);
+  free(image1);
+  free(image2);
+}  /* test17 */
+
+
+/* Compiled netlist. */
+void test18() {
+  lsim_t *lsim;
+  int i;
+
+  E(lsim_create(&lsim, NULL));
+  E(lsim_netlist_record_start(lsim));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  ASSRT(lsim->netlist_rec->num_devs == 12);  /* Top-level defines only. */
+  ASSRT(lsim->netlist_rec->num_conns == 29);  /* 17 c; plus 3 b; of 4 bits. */
+  E(lsim_netlist_write(lsim, "test18.lsimnet"));
+  uint64_t fingerprint;
+  E(lsim_state_fingerprint(lsim, &fingerprint));
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, "t;7;"));
+  int expected_count = test14_count(lsim);
+  E(lsim_delete(lsim));
+
+  E(lsim_create(&lsim, NULL));
+  E(lsim_netlist_load(lsim, "test18.lsimnet"));
+  uint64_t loaded_fingerprint;
+  E(lsim_state_fingerprint(lsim, &loaded_fingerprint));
+  ASSRT(loaded_fingerprint == fingerprint);
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, "t;7;"));
+  ASSRT(test14_count(lsim) == expected_count);
+
+  /* Only into an empty circuit. */
+  err_t *err = lsim_netlist_load(lsim, "test18.lsimnet");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+
+  /* Truncated file. */
+  FILE *fp;
+  char buf[4096];
+  ASSRT(fp = fopen("test18.lsimnet", "rb"));
+  size_t file_size = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  ASSRT(file_size > 8 && file_size < sizeof(buf));
+  ASSRT(fp = fopen("test18.lsimnet", "wb"));
+  ASSRT(fwrite(buf, 1, file_size - 8, fp) == file_size - 8);
+  fclose(fp);
+  E(lsim_create(&lsim, NULL));
+  err = lsim_netlist_load(lsim, "test18.lsimnet");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_BADFILE);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+
+  /* Counts that wrap the section sizes back to the right file size are
+   * rejected before anything is built. */
+  long count_offsets[] = {32, 48};  /* num_out_terminals, num_conns. */
+  int c;
+  for (c = 0; c < 2; c++) {
+    uint64_t count;
+    memcpy(&count, &buf[count_offsets[c]], 8);
+    count += UINT64_C(1) << 61;
+    memcpy(&buf[count_offsets[c]], &count, 8);
+    ASSRT(fp = fopen("test18.lsimnet", "wb"));
+    ASSRT(fwrite(buf, 1, file_size, fp) == file_size);
+    fclose(fp);
+    count -= UINT64_C(1) << 61;
+    memcpy(&buf[count_offsets[c]], &count, 8);
+    E(lsim_create(&lsim, NULL));
+    err = lsim_netlist_load(lsim, "test18.lsimnet");
+    ASSRT(err);
+    ASSRT(err->code == LSIM_ERR_BADFILE);
+    err_dispose(err);
+    ASSRT(lsim->num_devs == 0);
+    E(lsim_delete(lsim));
+  }
+
+  remove("test18.lsimnet");
+}  /* test18 */
+
+
+/* Parse cache. */
+void test19_write(const char *filename, int first, int last, const char *extra) {
+  FILE *fp;
+  int i;
+  ASSRT(fp = fopen(filename, "w"));
+  for (i = first; i < last; i++) {
+    fprintf(fp, "%s\n", test14_ctr[i]);
+  }
+  fprintf(fp, "%s", extra);
+  fclose(fp);
+}  /* test19_write */
+
+int test19_run(char *entry_name, long *rtn_ino) {
+  lsim_t *lsim;
+  struct stat st;
+
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "parse_cache_dir=test19.cache", "test19", 0));
+  E(lsim_cmd_file(lsim, "test19.lsim"));
+  ASSRT(lsim->parse_cache == NULL);
+  ASSRT(lsim->netlist_rec == NULL);
+  int count = test14_count(lsim);
+  E(lsim_delete(lsim));
+
+  ASSRT(stat(entry_name, &st) == 0);
+  *rtn_ino = (long)st.st_ino;
+  return count;
+}  /* test19_run */
+
+void test19() {
+  lsim_t *lsim;
+  int i;
+  long ino1, ino2;
+
+  mkdir("test19.cache", 0755);
+  for (i = 0; test14_ctr[i]; i++) { }
+  test19_write("test19_inc.lsim", 19, i, "");
+  test19_write("test19.lsim", 0, 19, "# Counter.\ni;test19_inc.lsim;\np;\nm;Rst;1;\nt;7;\n");
+
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "parse_cache_dir=test19.cache", "test19", 0));
+  char *entry_name;
+  E(lsim_parse_cache_entry_name(lsim, "test19.lsim", &entry_name));
+  ASSRT(access(entry_name, R_OK) != 0);
+  E(lsim_delete(lsim));
+
+  /* Miss writes the entry; hit leaves it alone. */
+  int expected_count = test19_run(entry_name, &ino1);
+  ASSRT(test19_run(entry_name, &ino2) == expected_count);
+  ASSRT(ino1 == ino2);
+
+  /* A changed include is a miss. */
+  test19_write("test19_inc.lsim", 19, i, "# Changed.\n");
+  ASSRT(test19_run(entry_name, &ino2) == expected_count);
+  ASSRT(ino1 != ino2);
+  ino1 = ino2;
+  ASSRT(test19_run(entry_name, &ino2) == expected_count);
+  ASSRT(ino1 == ino2);
+
+  /* So is a changed netlist line. Later lines don't matter. */
+  test19_write("test19.lsim", 0, 19, "i;test19_inc.lsim;\np;\nm;Rst;1;\nt;7;\n");
+  ASSRT(test19_run(entry_name, &ino2) == expected_count);
+  ASSRT(ino1 != ino2);
+  ino1 = ino2;
+  test19_write("test19.lsim", 0, 19, "i;test19_inc.lsim;\np;\nm;Rst;1;\nt;3;\nt;4;\n");
+  ASSRT(test19_run(entry_name, &ino2) == expected_count);
+  ASSRT(ino1 == ino2);
+
+  remove(entry_name);
+  free(entry_name);
+  remove("test19.lsim");
+  remove("test19_inc.lsim");
+  rmdir("test19.cache");
+}  /* test19 */
+
+
+/* Block reader: long lines, CR-LF, no final newline. */
+void test20() {
+  lsim_t *lsim;
+  FILE *fp;
+  char name[5001];
+  int i;
+
+  name[0] = 'n';
+  for (i = 1; i < 5000; i++) {
+    name[i] = 'a' + (i % 26);
+  }
+  name[5000] = '\0';
+
+  ASSRT(fp = fopen("test20.lsim", "w"));
+  fprintf(fp, "# Long name.\r\nd;vcc;vcc;\r\nd;nand;%s;2;\r\n", name);
+  fprintf(fp, "c;vcc;o0;%s;i0;\nc;vcc;o0;%s;i1;", name, name);  /* No final newline. */
+  fclose(fp);
+
+  E(lsim_create(&lsim, NULL));
+  E(lsim_cmd_file(lsim, "test20.lsim"));
+  lsim_dev_t *dev;
+  E(lsim_name_lookup(lsim, name, &dev));
+  ASSRT(dev->nand.i_terminals[1]->driving_out_terminal);
+  E(lsim_cmd_line(lsim, "p;"));
+  ASSRT(lsim_dev_out_state(lsim, dev->nand.o_terminal) == 0);
+
+  /* Fields are split in place. */
+  char cmd[] = "d;led;led1;";
+  E(lsim_cmd_line_inplace(lsim, cmd, strlen(cmd)));
+  E(lsim_name_lookup(lsim, "led1", &dev));
+  char bad_cmd[] = "d;bogus;x;";
+  err_t *err = lsim_cmd_line_inplace(lsim, bad_cmd, strlen(bad_cmd));
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+
+  remove("test20.lsim");
+}  /* test20 */
+
+
+/* for/endfor loops. */
+void test21() {
+  lsim_t *lsim;
+  FILE *fp;
+  lsim_dev_t *dev;
+
+  ASSRT(fp = fopen("test21.lsim", "w"));
+  fprintf(fp, "d;vcc;vcc;\nd;swtch;sw;0;\n"
+              "for;i;0;7;\n"
+              "d;nand;inv${i};1;\n"
+              "endfor;\n"
+              "c;sw;o0;inv0;i0;\n"
+              "for;i;1;7;\n"
+              "c;inv${i-1};o0;inv${i};i0;\n"
+              "endfor;\n"
+              "# Nested: 3 rows of 4.\n"
+              "for;r;0;2;\n"
+              "for;c;0;3;\n"
+              "d;led;led_${r*4+c};\n"
+              "c;inv${c};o0;led_${r * 4 + c};i0;\n"
+              "endfor;\n"
+              "endfor;\n"
+              "for;n;${2*3};${10-7%%4};\n"  /* 6 to 7. */
+              "d;vcc;x${n};\n"
+              "endfor;\n"
+              "for;n;1;0;\n"  /* Runs zero times. */
+              "d;vcc;y${n};\n"
+              "endfor;\n");
+  fclose(fp);
+
+  E(lsim_create(&lsim, NULL));
+  E(lsim_cmd_file(lsim, "test21.lsim"));
+  E(lsim_name_lookup(lsim, "inv7", &dev));
+  E(lsim_name_lookup(lsim, "led_11", &dev));
+  E(lsim_name_lookup(lsim, "x6", &dev));
+  E(lsim_name_lookup(lsim, "x7", &dev));
+  err_t *err = lsim_name_lookup(lsim, "x8", &dev);
+  ASSRT(err);
+  err_dispose(err);
+  err = lsim_name_lookup(lsim, "y1", &dev);
+  ASSRT(err);
+  err_dispose(err);
+  E(lsim_cmd_line(lsim, "p;"));
+  int r, c;
+  for (r = 0; r < 3; r++) {
+    for (c = 0; c < 4; c++) {
+      char name[16];
+      snprintf(name, sizeof(name), "led_%d", r * 4 + c);
+      E(lsim_name_lookup(lsim, name, &dev));
+      ASSRT(dev->led.illuminated == ((c & 1) == 0));  /* Inverter chain from 0. */
+    }
+  }
+
+  /* Only in files. */
+  err = lsim_cmd_line(lsim, "for;i;0;1;");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+
+  /* An error stops the loop. */
+  ASSRT(fp = fopen("test21.lsim", "w"));
+  fprintf(fp, "for;i;0;3;\nd;led;e${i};\nd;led;f${j};\nendfor;\nfor;i;0;1;\nd;led;g${i};\n");
+  fclose(fp);
+  E(lsim_create(&lsim, NULL));
+  global_error_reaction = 2;  /* After lsim_create() sets it from the config. */
+  E(lsim_cmd_file(lsim, "test21.lsim"));
+  E(lsim_name_lookup(lsim, "e0", &dev));
+  err = lsim_name_lookup(lsim, "e1", &dev);
+  ASSRT(err);
+  err_dispose(err);
+  err = lsim_name_lookup(lsim, "g0", &dev);  /* No endfor. */
+  ASSRT(err);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+  global_error_reaction = 1;
+
+  remove("test21.lsim");
+}  /* test21 */
+
+
+/* Modules. */
+void test22_check(lsim_t *lsim, int a, int b) {
+  char cmd[32];
+  lsim_dev_t *dev;
+  int i;
+
+  snprintf(cmd, sizeof(cmd), "m;sA;%d;", a);
+  E(lsim_cmd_line(lsim, cmd));
+  snprintf(cmd, sizeof(cmd), "m;sB;%d;", b);
+  E(lsim_cmd_line(lsim, cmd));
+  for (i = 0; i < 3; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "s%d", i);
+    E(lsim_name_lookup(lsim, name, &dev));
+    ASSRT(dev->led.illuminated == (a ^ b));
+    snprintf(name, sizeof(name), "c%d", i);
+    E(lsim_name_lookup(lsim, name, &dev));
+    ASSRT(dev->led.illuminated == (a & b));
+  }
+  E(lsim_name_lookup(lsim, "bus_led3", &dev));
+  ASSRT(dev->led.illuminated == a);  /* Inverted twice. */
+}  /* test22_check */
+
+void test22() {
+  lsim_t *lsim;
+  FILE *fp;
+  lsim_dev_t *dev;
+  err_t *err;
+
+  ASSRT(fp = fopen("test22.lsim", "w"));
+  fprintf(fp, "module;xor;\n"
+              "d;nand;n1;2;\nd;nand;n2;2;\nd;nand;n3;2;\nd;nand;n4;2;\n"
+              "c;n1;o0;n2;i1;\nc;n1;o0;n3;i0;\nc;n2;o0;n4;i0;\nc;n3;o0;n4;i1;\n"
+              "# Fan-out: each input goes to two nands.\n"
+              "in;i0;n1;i0;\nin;i0;n2;i0;\nin;i1;n1;i1;\nin;i1;n3;i1;\n"
+              "out;o0;n4;o0;\n"
+              "endmodule;\n"
+              "module;half;\n"  /* Nested. */
+              "d;xor;x;\nd;nand;a;2;\nd;nand;b;1;\nc;a;o0;b;i0;\n"
+              "in;i0;x;i0;\nin;i0;a;i0;\nin;i1;x;i1;\nin;i1;a;i1;\n"
+              "out;s0;x;o0;\nout;c0;b;o0;\n"
+              "endmodule;\n"
+              "module;inv4;\n"
+              "for;i;0;3;\nd;nand;n${i};1;\nin;i${i};n${i};i0;\nout;o${i};n${i};o0;\nendfor;\n"
+              "endmodule;\n"
+              "module;latch;\n"  /* Composite inputs are chains. */
+              "d;srlatch;l;\nin;S0;l;S0;\nin;R0;l;R0;\nout;q0;l;q0;\n"
+              "endmodule;\n"
+              "d;vcc;vcc;\nd;swtch;sA;0;\nd;swtch;sB;0;\n"
+              "for;i;0;2;\n"
+              "d;half;h${i};\nc;sA;o0;h${i};i0;\nc;sB;o0;h${i};i1;\n"
+              "d;led;s${i};\nd;led;c${i};\nc;h${i};s0;s${i};i0;\nc;h${i};c0;c${i};i0;\n"
+              "endfor;\n"
+              "d;inv4;ia;\nd;inv4;ib;\nb;ia;o0;ib;i0;4;\n"
+              "for;i;0;3;\nc;sA;o0;ia;i${i};\nd;led;bus_led${i};\nc;ib;o${i};bus_led${i};i0;\nendfor;\n"
+              "d;latch;lt;\nc;sA;o0;lt;S0;\nc;vcc;o0;lt;R0;\nd;led;lt_led;\nc;lt;q0;lt_led;i0;\n");
+  fclose(fp);
+
+  E(lsim_create(&lsim, NULL));
+  E(lsim_netlist_record_start(lsim));
+  E(lsim_cmd_file(lsim, "test22.lsim"));
+  E(lsim_name_lookup(lsim, "h2.x.n4", &dev));
+  ASSRT(dev->type == LSIM_DEV_TYPE_NAND);
+  E(lsim_name_lookup(lsim, "h2", &dev));
+  ASSRT(dev->type == LSIM_DEV_TYPE_MODULE);
+  /* Per half: itself + 6 nands (the nested xor is flattened into its template).
+   * Plus 6 leds, 2 inv4 of 5 each, 4 leds, latch + srlatch + its 2 nands + led. */
+  ASSRT(lsim->num_devs == 3 + 3 * 7 + 6 + 10 + 4 + 5);
+  ASSRT(lsim->netlist_rec->num_devs == 3 + 3 * 6 + 6 + 8 + 4 + 2);  /* Flattened. */
+  E(lsim_netlist_write(lsim, "test22.lsimnet"));
+  uint64_t fingerprint;
+  E(lsim_state_fingerprint(lsim, &fingerprint));
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_name_lookup(lsim, "lt_led", &dev));
+  ASSRT(dev->led.illuminated);  /* Set by S0=0. */
+  test22_check(lsim, 0, 0);
+  test22_check(lsim, 0, 1);
+  test22_check(lsim, 1, 0);
+  test22_check(lsim, 1, 1);
+  E(lsim_netlist_record_delete(lsim));
+  E(lsim_delete(lsim));
+
+  /* The compiled netlist has no modules, only what they made. */
+  E(lsim_create(&lsim, NULL));
+  E(lsim_netlist_load(lsim, "test22.lsimnet"));
+  uint64_t loaded_fingerprint;
+  E(lsim_state_fingerprint(lsim, &loaded_fingerprint));
+  ASSRT(loaded_fingerprint == fingerprint);
+  E(lsim_cmd_line(lsim, "p;"));
+  test22_check(lsim, 1, 0);
+  test22_check(lsim, 1, 1);
+  E(lsim_delete(lsim));
+
+  /* Errors. */
+  ASSRT(fp = fopen("test22.lsim", "w"));
+  fprintf(fp, "module;nand;\nendmodule;\n"  /* Built-in name. */
+              "module;m1;\nd;nand;n;1;\np;\nendmodule;\n"  /* Not a netlist. */
+              "module;m2;\nd;nand;n;1;\nd;vcc;v;\nc;v;o0;n;i0;\nin;i0;n;i0;\nendmodule;\n"  /* Driven inside. */
+              "module;m3;\nd;nand;n;1;\nin;i0;n;i0;\nout;o0;n;o0;\nendmodule;\n"
+              "module;m3;\nendmodule;\n"  /* Exists. */
+              "d;m3;a;\nd;m3;a;\n"  /* Instance exists. */
+              "d;vcc;v;\nc;v;o0;a;i1;\n"  /* No such port. */
+              "module;m4;\nd;nand;n;1;\n");  /* No endmodule. */
+  fclose(fp);
+  E(lsim_create(&lsim, NULL));
+  global_error_reaction = 2;  /* After lsim_create() sets it from the config. */
+  E(lsim_cmd_file(lsim, "test22.lsim"));
+  global_error_reaction = 1;
+  E(hmap_slookup(lsim->modules, "m3", (void **)&dev));
+  err = hmap_slookup(lsim->modules, "m1", (void **)&dev);
+  ASSRT(err);
+  err_dispose(err);
+  err = hmap_slookup(lsim->modules, "m2", (void **)&dev);
+  ASSRT(err);
+  err_dispose(err);
+  err = hmap_slookup(lsim->modules, "m4", (void **)&dev);
+  ASSRT(err);
+  err_dispose(err);
+  E(lsim_name_lookup(lsim, "a.n", &dev));
+
+  err = lsim_cmd_line(lsim, "in;i0;v;o0;");  /* Only in a module. */
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  err = lsim_cmd_line(lsim, "module;m5;");  /* Only in files. */
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  E(lsim_devs_swtch_create(lsim, "y.n", 0));
+  err = lsim_cmd_line(lsim, "d;m3;y;");  /* Its part's name is taken. */
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_EXIST);
+  err_dispose(err);
+  /* The partly built "y" stays until lsim_delete, and the earlier "y.n"
+   * still resolves now that its first part is a device. */
+  lsim_dev_t *y_dev;
+  E(lsim_name_lookup(lsim, "y", &y_dev));
+  ASSRT(y_dev->type == LSIM_DEV_TYPE_MODULE);
+  E(lsim_name_lookup(lsim, "y.n", &dev));
+  ASSRT(dev->type == LSIM_DEV_TYPE_SWTCH);
+  ASSRT(strcmp(lsim_name_str(lsim, dev->name), "y.n") == 0);
+  err = lsim_name_lookup(lsim, "y.m", &dev);
+  ASSRT(err);
+  ASSRT(err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+  E(lsim_delete(lsim));
+
+  remove("test22.lsim");
+  remove("test22.lsimnet");
+}  /* test22 */
+
+
+/* Composites built from shared wiring tables (lsim_devs_topo.c). */
+void test23() {
+  lsim_t *lsim;
+  err_t *err;
+
+  E(lsim_create(&lsim, NULL));
+
+  E(lsim_cmd_line(lsim, "d;vcc;v;"));
+  E(lsim_cmd_line(lsim, "d;gnd;g;"));
+  E(lsim_cmd_line(lsim, "d;addword;a;4;"));
+  E(lsim_cmd_line(lsim, "d;srlatch;s;"));
+  E(lsim_cmd_line(lsim, "d;led;l;"));
+  E(lsim_cmd_line(lsim, "c;v;o0;a;a0;"));  /* a=15 */
+  E(lsim_cmd_line(lsim, "c;v;o0;a;a1;"));
+  E(lsim_cmd_line(lsim, "c;v;o0;a;a2;"));
+  E(lsim_cmd_line(lsim, "c;v;o0;a;a3;"));
+  E(lsim_cmd_line(lsim, "c;v;o0;a;b0;"));  /* b=1 */
+  E(lsim_cmd_line(lsim, "c;g;o0;a;b1;"));
+  E(lsim_cmd_line(lsim, "c;g;o0;a;b2;"));
+  E(lsim_cmd_line(lsim, "c;g;o0;a;b3;"));
+  E(lsim_cmd_line(lsim, "c;g;o0;a;i0;"));
+  E(lsim_cmd_line(lsim, "c;v;o0;s;S0;"));
+  E(lsim_cmd_line(lsim, "c;g;o0;s;R0;"));
+  E(lsim_cmd_line(lsim, "c;a;o0;l;i0;"));
+
+  /* Sub-devices share the instance's block and are still found by name. */
+  lsim_dev_t *addbit_dev;
+  E(lsim_name_lookup(lsim, "a.addbit.3", &addbit_dev));
+  lsim_dev_t *nand_o_dev;
+  E(lsim_name_lookup(lsim, "a.addbit.3.nand_o", &nand_o_dev));
+  ASSRT(addbit_dev->in_chunk && nand_o_dev->in_chunk);
+  ASSRT(strcmp(lsim_name_str(lsim, nand_o_dev->name), "a.addbit.3.nand_o") == 0);
+  ASSRT(addbit_dev->addbit.o_terminal == nand_o_dev->nand.o_terminal);
+  ASSRT(addbit_dev->addbit.a_terminal->next_in_terminal->dev == addbit_dev + 1);  /* nand_1 */
+
+  err = lsim_cmd_line(lsim, "d;srlatch;s;");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_EXIST);
+  err_dispose(err);
+
+  E(lsim_cmd_line(lsim, "p;"));
+  lsim_dev_t *l_dev;
+  E(lsim_name_lookup(lsim, "l", &l_dev));
+  ASSRT(lsim_dev_in_state(lsim, l_dev->led.i_terminal) == 1);  /* 15+1 carries. */
+  lsim_dev_t *s_dev;
+  E(lsim_name_lookup(lsim, "s", &s_dev));
+  ASSRT(s_dev->in_chunk);
+  ASSRT(lsim_dev_out_state(lsim, s_dev->srlatch.q_terminal) == 0);  /* Set is active low. */
+  ASSRT(lsim_dev_out_state(lsim, s_dev->srlatch.Q_terminal) == 1);
+
+  /* Composites whose parts fail part way can still be deleted. */
+  E(lsim_devs_swtch_create(lsim, "r.dflipflop.1", 0));  /* Not a valid name in commands. */
+  E(lsim_devs_swtch_create(lsim, "w.addbit.2", 0));
+  E(lsim_devs_swtch_create(lsim, "pn.led.1", 0));
+  const char *partial_cmds[] = {"d;reg;r;4;", "d;addword;w;4;", "d;panel;pn;4;"};
+  int i;
+  for (i = 0; i < 3; i++) {
+    err = lsim_cmd_line(lsim, partial_cmds[i]);
+    ASSRT(err);
+    ASSRT(err->code == LSIM_ERR_EXIST);
+    err_dispose(err);
+  }
+
+  E(lsim_delete(lsim));
+}  /* test23 */
+
+
+/* Interned hierarchical names (lsim_name.c). */
+void test24() {
+  lsim_t *lsim;
+  err_t *err;
+
+  E(lsim_create(&lsim, NULL));
+
+  E(lsim_cmd_line(lsim, "d;dflipflop;f1;"));
+  E(lsim_cmd_line(lsim, "d;dflipflop;f2;"));
+  E(lsim_cmd_line(lsim, "d;reg;r;2;"));
+
+  /* Same leaf under different parents. */
+  lsim_dev_t *q1_dev;
+  E(lsim_name_lookup(lsim, "f1.nand_q", &q1_dev));
+  lsim_dev_t *q2_dev;
+  E(lsim_name_lookup(lsim, "f2.nand_q", &q2_dev));
+  ASSRT(q1_dev != q2_dev);
+  ASSRT(q1_dev->name->leaf_id == q2_dev->name->leaf_id);
+  ASSRT(q1_dev->name->parent != q2_dev->name->parent);
+  ASSRT(strcmp(lsim_name_str(lsim, q2_dev->name), "f2.nand_q") == 0);
+
+  /* A leaf containing a period ("dflipflop.1" under "r"). */
+  lsim_dev_t *dev;
+  E(lsim_name_lookup(lsim, "r.dflipflop.1.nand_Q", &dev));
+  ASSRT(strcmp(lsim_name_str(lsim, dev->name), "r.dflipflop.1.nand_Q") == 0);
+  ASSRT(strcmp(lsim_name_str(lsim, dev->name->parent->parent), "r") == 0);
+  ASSRT(dev->name->leaf_id == q1_dev->name->leaf_id + 1);  /* nand_q, then nand_Q. */
+
+  err = lsim_name_lookup(lsim, "f1.nand_x", &dev);
+  ASSRT(err);
+  ASSRT(err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+  err = lsim_name_lookup(lsim, "f3", &dev);
+  ASSRT(err);
+  ASSRT(err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+
+  lsim_name_t *name;
+  err = lsim_name_child(lsim, q1_dev->name->parent, "nand_q", &name);
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_EXIST);
+  err_dispose(err);
+  err = lsim_name_create(lsim, "r.dflipflop.0", &name);
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_EXIST);
+  err_dispose(err);
+
+  E(lsim_delete(lsim));
+}  /* test24 */
+
+
+/* Hash map growth, plus insert and lookup rates across table sizes. */
+void test25_rates(long num_keys) {
+  hmap_t *hmap;
+  uint64_t *keys;
+  ASSRT(keys = malloc(num_keys * sizeof(uint64_t)));
+  char *skeys;
+  ASSRT(skeys = malloc(num_keys * 32));
+  long k;
+  for (k = 0; k < num_keys; k++) {
+    keys[k] = ((uint64_t)(k / 7 + 1) << 32) | (uint64_t)(k % 7 + 1);  /* Like lsim_name_key_t. */
+    snprintf(&skeys[k * 32], 32, "r%ld.dflipflop.%ld", k / 64, k % 64);
+  }
+
+  E(hmap_create(&hmap, 1));  /* Grows all the way. */
+  clock_t start = clock();
+  for (k = 0; k < num_keys; k++) {
+    E(hmap_write(hmap, &keys[k], sizeof(uint64_t), &keys[k]));
+  }
+  double insert_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  start = clock();
+  for (k = 0; k < num_keys; k++) {
+    void *val;
+    E(hmap_lookup(hmap, &keys[k], sizeof(uint64_t), &val));
+    ASSRT(val == &keys[k]);
+  }
+  double lookup_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  E(hmap_delete(hmap));
+
+  E(hmap_create(&hmap, 1));
+  start = clock();
+  for (k = 0; k < num_keys; k++) {
+    E(hmap_swrite(hmap, &skeys[k * 32], &keys[k]));
+  }
+  double sinsert_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  start = clock();
+  for (k = 0; k < num_keys; k++) {
+    void *val;
+    E(hmap_slookup(hmap, &skeys[k * 32], &val));
+    ASSRT(val == &keys[k]);
+  }
+  double slookup_secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  ASSRT(hmap->num_entries == num_keys);
+  E(hmap_delete(hmap));
+
+  /* Avoid dividing by a zero time on a coarse clock. */
+  printf("hmap %8ld keys: 8-byte insert %6.1f M/s, lookup %6.1f M/s; string insert %6.1f M/s, lookup %6.1f M/s\n",
+    num_keys, num_keys / (insert_secs + 1e-9) / 1e6, num_keys / (lookup_secs + 1e-9) / 1e6,
+    num_keys / (sinsert_secs + 1e-9) / 1e6, num_keys / (slookup_secs + 1e-9) / 1e6);
+
+  free(skeys);
+  free(keys);
+}  /* test25_rates */
+
+void test25() {
+  hmap_t *hmap;
+  err_t *err;
+  long k;
+  void *val;
+
+  /* Every key stays visible while the table grows under it. */
+  E(hmap_create(&hmap, 1));
+  ASSRT(hmap->table_size == 16);
+  char skey[64];
+  for (k = 0; k < 5000; k++) {
+    snprintf(skey, sizeof(skey), "%s%ld", (k & 1) ? "a_name_longer_than_inline." : "n", k);
+    E(hmap_swrite(hmap, skey, (void *)(k + 1)));
+    if (hmap->old_table) {
+      /* Overwrite one not copied yet, and one that's in the new table. */
+      snprintf(skey, sizeof(skey), "%s%ld", (k & 1) ? "n" : "a_name_longer_than_inline.", k - 1);
+      E(hmap_swrite(hmap, skey, (void *)(k)));
+      snprintf(skey, sizeof(skey), "%s%ld", (k & 1) ? "a_name_longer_than_inline." : "n", k);
+      E(hmap_swrite(hmap, skey, (void *)(k + 1)));
+    }
+    long j;
+    for (j = (k < 50) ? 0 : k - 50; j <= k; j++) {
+      snprintf(skey, sizeof(skey), "%s%ld", (j & 1) ? "a_name_longer_than_inline." : "n", j);
+      E(hmap_slookup(hmap, skey, &val));
+      ASSRT(val == (void *)(j + 1));
+    }
+  }
+  ASSRT(hmap->num_entries == 5000);
+  ASSRT(hmap->table_size >= 5000);
+
+  err = hmap_slookup(hmap, "n5000", &val);
+  ASSRT(err);
+  ASSRT(err->code == HMAP_ERR_NOTFOUND);
+  ASSRT(val == NULL);
+  err_dispose(err);
+
+  /* A miss can also be reported without an error. */
+  int found = 1;
+  val = (void *)1;
+  E(hmap_lookup_found(hmap, "n5000", strlen("n5000") + 1, &val, &found));
+  ASSRT(found == 0);
+  ASSRT(val == NULL);
+  E(hmap_lookup_found(hmap, "n4998", strlen("n4998") + 1, &val, &found));
+  ASSRT(found == 1);
+  ASSRT(val == (void *)4999);
+
+  /* A walk sees each entry once, and may change values. */
+  hmap_entry_t *entry = NULL;
+  long num_seen = 0;
+  long sum = 0;
+  do {
+    E(hmap_next(hmap, &entry));
+    if (entry) {
+      num_seen++;
+      sum += (long)entry->value;
+      entry->value = (void *)((long)entry->value * 2);
+    }
+  } while (entry);
+  ASSRT(hmap->old_table == NULL);
+  ASSRT(num_seen == 5000);
+  ASSRT(sum == 5000L * 5001 / 2);
+  E(hmap_slookup(hmap, "a_name_longer_than_inline.4999", &val));
+  ASSRT(val == (void *)10000);
+  E(hmap_delete(hmap));
+
+  /* Deleting in the middle of growing frees each key once (see ASan). */
+  E(hmap_create(&hmap, 1));
+  for (k = 0; hmap->old_table == NULL || k < 20; k++) {
+    snprintf(skey, sizeof(skey), "a_name_longer_than_inline.%ld", k);
+    E(hmap_swrite(hmap, skey, NULL));
+  }
+  ASSRT(hmap->old_table != NULL);
+  E(hmap_delete(hmap));
+
+  for (k = 1000; k <= 1000000; k *= 10) {
+    test25_rates(k);
+  }
+}  /* test25 */
+
+
+/* Pattern watches (lsim_name_match). */
+void test26_count(lsim_t *lsim, const char *pattern, long expected) {
+  lsim_dev_t **devs;
+  long num_devs;
+  E(lsim_name_match(lsim, pattern, &devs, &num_devs));
+  if (num_devs != expected) {
+    printf("pattern '%s': %ld matches, expected %ld\n", pattern, num_devs, expected);
+  }
+  ASSRT(num_devs == expected);
+  long i;
+  for (i = 1; i < num_devs; i++) {
+    ASSRT(devs[i - 1]->name->id < devs[i]->name->id);  /* Creation order. */
+  }
+  free(devs);
+}  /* test26_count */
+
+void test26() {
+  lsim_t *lsim;
+  err_t *err;
+
+  E(lsim_create(&lsim, NULL));
+  E(lsim_cmd_line(lsim, "d;reg;r;4;"));
+  E(lsim_cmd_line(lsim, "d;dflipflop;f1;"));
+  E(lsim_cmd_line(lsim, "d;dflipflop;f2;"));
+  E(lsim_cmd_line(lsim, "d;dflipflop;f10;"));
+
+  test26_count(lsim, "r.dflipflop.*", 4);
+  test26_count(lsim, "r.dflipflop.*.nand_q", 4);
+  test26_count(lsim, "r.dflipflop.?.nand_?", 4 * 6);
+  test26_count(lsim, "r.*", 1);  /* Just "vcc"; "*" stops at periods. */
+  test26_count(lsim, "r.**", 1 + 4 + 4 * 6);
+  test26_count(lsim, "r**", 1 + 1 + 4 + 4 * 6);
+  test26_count(lsim, "f?", 2);
+  test26_count(lsim, "f*", 3);
+  test26_count(lsim, "f*.nand_Q", 3);
+  test26_count(lsim, "**.nand_Q", 4 + 3);
+  test26_count(lsim, "r.dflipflop.3.nand_q", 1);  /* No wildcards. */
+  test26_count(lsim, "x*", 0);
+
+  lsim_dev_t **devs;
+  long num_devs;
+  E(lsim_name_match(lsim, "**nand_q", &devs, &num_devs));
+  ASSRT(num_devs == 4 + 3);
+  ASSRT(strcmp(lsim_name_str(lsim, devs[0]->name), "r.dflipflop.0.nand_q") == 0);
+  ASSRT(strcmp(lsim_name_str(lsim, devs[6]->name), "f10.nand_q") == 0);
+  free(devs);
+
+  E(lsim_cmd_line(lsim, "w;r.dflipflop.*.nand_q;2;"));
+  lsim_dev_t *dev;
+  E(lsim_name_lookup(lsim, "r.dflipflop.2.nand_q", &dev));
+  ASSRT(dev->watch_level == 2);
+  E(lsim_name_lookup(lsim, "r.dflipflop.2.nand_Q", &dev));
+  ASSRT(dev->watch_level == 0);
+  E(lsim_name_lookup(lsim, "f1.nand_q", &dev));
+  ASSRT(dev->watch_level == 0);
+
+  err = lsim_cmd_line(lsim, "w;x*;1;");
+  ASSRT(err);
+  ASSRT(err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+
+  E(lsim_delete(lsim));
+}  /* test26 */
+
+
+/* The whole simulation state, for comparing two points in a run. */
+uint8_t *test27_image(lsim_t *lsim, size_t *rtn_size) {
+  uint8_t *image;
+  E(lsim_state_size(lsim, rtn_size));
+  image = malloc(*rtn_size);
+  ASSRT(image);
+  E(lsim_state_capture(lsim, image, *rtn_size));
+  return image;
+}  /* test27_image */
+
+/* Driving the counter and mem of test14 through handles. */
+void test27() {
+  lsim_t *lsim;
+  err_t *err;
+  int i;
+
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+
+  long rst;
+  E(lsim_handle_dev(lsim, "Rst", &rst));
+  ASSRT(strcmp(lsim_name_str(lsim, lsim->dev_list[rst]->name), "Rst") == 0);
+  long count_q;
+  E(lsim_handle_out(lsim, "ff1", "q0", 1, &count_q));
+  long handle;
+  E(lsim_handle_out(lsim, "ff2", "q0", 1, &handle));
+  ASSRT(handle == count_q + 1);  /* Consecutive, so one word. */
+  E(lsim_handle_out(lsim, "ff3", "q0", 1, &handle));
+  long led1_i;
+  E(lsim_handle_in(lsim, "led1", "i0", 1, &led1_i));
+  long pan_sw[4];
+  for (i = 0; i < 4; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "pan.swtch.%d", i);
+    E(lsim_handle_dev(lsim, name, &pan_sw[i]));
+  }
+  long mem_o;
+  E(lsim_handle_out(lsim, "mem1", "o0", 4, &mem_o));
+  long pan_i;
+  E(lsim_handle_in(lsim, "pan", "i0", 4, &pan_i));
+
+  E(lsim_cmd_line(lsim, "p;"));
+
+  E(lsim_handle_ticklet(lsim, 1));
+  E(lsim_handle_poke(lsim, rst, 1));
+  E(lsim_handle_step(lsim));
+  E(lsim_handle_ticklet(lsim, 5));
+  ASSRT(lsim_handle_peek_word(lsim, count_q, 3) == (uint64_t)test14_count(lsim));
+  ASSRT(lsim_handle_peek(lsim, count_q) == lsim_handle_peek_in(lsim, led1_i));
+  int count = (int)lsim_handle_peek_word(lsim, count_q, 3);
+  E(lsim_handle_ticklet(lsim, 2));
+  ASSRT((int)lsim_handle_peek_word(lsim, count_q, 3) == ((count + 1) & 7));
+
+  /* Two pokes, one step. */
+  E(lsim_cmd_line(lsim, "l;mem1;3;0xa;"));
+  E(lsim_handle_poke(lsim, pan_sw[0], 1));
+  E(lsim_handle_poke(lsim, pan_sw[1], 1));
+  ASSRT(lsim_handle_peek_word(lsim, mem_o, 4) != 0xa);  /* Not run yet. */
+  E(lsim_handle_step(lsim));
+  ASSRT(lsim_handle_peek_word(lsim, mem_o, 4) == 0xa);
+  ASSRT(lsim_handle_peek_in(lsim, pan_i + 1) == 1 && lsim_handle_peek_in(lsim, pan_i + 2) == 0);
+
+  global_error_reaction = 2;
+  err = lsim_handle_poke(lsim, 0, 1);  /* vcc isn't a switch. */
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_PARAM);
+  err_dispose(err);
+  err = lsim_handle_out(lsim, "ff1", "x0", 1, &handle);
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  err = lsim_handle_dev(lsim, "nosuch", &handle);
+  ASSRT(err);
+  ASSRT(err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+  global_error_reaction = 1;
+
+  E(lsim_delete(lsim));
+
+  /* "back" replays pokes the way they were made: all of them, then one
+   * settle (the step count is part of the state). */
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "snapshot_interval=4", "test27", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_handle_dev(lsim, "Rst", &rst));
+  for (i = 0; i < 4; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "pan.swtch.%d", i);
+    E(lsim_handle_dev(lsim, name, &pan_sw[i]));
+  }
+  E(lsim_handle_ticklet(lsim, 1));
+  E(lsim_handle_poke(lsim, rst, 1));
+  E(lsim_handle_poke(lsim, pan_sw[0], 1));
+  E(lsim_handle_poke(lsim, pan_sw[2], 1));
+  E(lsim_handle_step(lsim));
+  E(lsim_handle_ticklet(lsim, 2));
+  size_t size1, size2;
+  uint8_t *image1 = test27_image(lsim, &size1);
+  E(lsim_handle_ticklet(lsim, 3));
+  E(lsim_cmd_line(lsim, "back;3;"));
+  uint8_t *image2 = test27_image(lsim, &size2);
+  ASSRT(size1 == size2 && memcmp(image1, image2, size1) == 0);
+  free(image1);
+  free(image2);
+  E(lsim_delete(lsim));
+}  /* test27 */
+
+
+/* Build a powered-up test14 counter with a few words in mem1. */
+lsim_t *test28_sim() {
+  lsim_t *lsim;
+  int i;
+
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "l;mem1;0;1;2;3;4;5;6;7;8;9;10;11;12;13;14;15;"));
+  return lsim;
+}  /* test28_sim */
+
+/* Copy a vector file with "size" bytes at "offset" overwritten. */
+void test28_corrupt(const char *from, const char *to, long offset, uint64_t val, int size) {
+  static uint8_t buf[1 << 16];
+  FILE *fp = fopen(from, "rb");
+  ASSRT(fp);
+  size_t len = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  ASSRT(len < sizeof(buf) && offset + size <= (long)len);
+  if (size == 4) {
+    uint32_t val32 = (uint32_t)val;
+    memcpy(&buf[offset], &val32, 4);
+  }
+  else {
+    memcpy(&buf[offset], &val, 8);
+  }
+  fp = fopen(to, "wb");
+  ASSRT(fp);
+  ASSRT(fwrite(buf, 1, len, fp) == len);
+  fclose(fp);
+}  /* test28_corrupt */
+
+/* Vector files: record golden responses from one run, check another. */
+void test28() {
+  lsim_t *lsim;
+  err_t *err;
+  long num_vectors;
+  long num_mismatches;
+  int v;
+#define TEST28_VECTORS 1000
+
+  /* Golden run, driven through handles. */
+  lsim = test28_sim();
+  long rst, pan_sw[4], count_q, mem_o, handle;
+  E(lsim_handle_dev(lsim, "Rst", &rst));
+  for (v = 0; v < 4; v++) {
+    char name[32];
+    snprintf(name, sizeof(name), "pan.swtch.%d", v);
+    E(lsim_handle_dev(lsim, name, &pan_sw[v]));
+  }
+  E(lsim_handle_out(lsim, "ff1", "q0", 1, &count_q));
+  E(lsim_handle_out(lsim, "ff2", "q0", 1, &handle));
+  E(lsim_handle_out(lsim, "ff3", "q0", 1, &handle));
+  E(lsim_handle_out(lsim, "mem1", "o0", 4, &mem_o));
+
+  lsim_vector_writer_t *writer;
+  E(lsim_vector_writer_create(&writer, "test28.vec"));
+  E(lsim_vector_writer_in(writer, "Rst", 1));
+  E(lsim_vector_writer_in(writer, "pan", 4));
+  E(lsim_vector_writer_out(writer, "ff1", "q0", 1));
+  E(lsim_vector_writer_out(writer, "ff2", "q0", 1));
+  E(lsim_vector_writer_out(writer, "ff3", "q0", 1));
+  E(lsim_vector_writer_out(writer, "mem1", "o0", 4));
+  uint64_t expect[TEST28_VECTORS];
+  for (v = 0; v < TEST28_VECTORS; v++) {
+    uint64_t ins = (v >= 1) | (((v / 8) & 15) << 1);
+    E(lsim_handle_poke(lsim, rst, ins & 1));
+    int b;
+    for (b = 0; b < 4; b++) {
+      E(lsim_handle_poke(lsim, pan_sw[b], (ins >> (b + 1)) & 1));
+    }
+    E(lsim_handle_step(lsim));
+    E(lsim_handle_ticklet(lsim, 1));
+    expect[v] = lsim_handle_peek_word(lsim, count_q, 3) | (lsim_handle_peek_word(lsim, mem_o, 4) << 3);
+    E(lsim_vector_writer_add(writer, &ins, &expect[v], NULL));
+  }
+  E(lsim_vector_writer_close(writer));
+  ASSRT((expect[9] >> 3) == 2 && (expect[999] >> 3) == 13);  /* Address (v/8)&15 holds itself + 1. */
+  E(lsim_delete(lsim));
+
+  /* Replay matches. */
+  lsim = test28_sim();
+  E(lsim_vector_run(lsim, "test28.vec", &num_vectors, &num_mismatches));
+  ASSRT(num_vectors == TEST28_VECTORS);
+  ASSRT(num_mismatches == 0);
+  ASSRT(lsim->total_ticklets == TEST28_VECTORS);
+  E(lsim_delete(lsim));
+  lsim = test28_sim();
+  E(lsim_cmd_line(lsim, "vectors;test28.vec;"));
+  E(lsim_delete(lsim));
+
+  /* "back" into the vectors lands where the golden run was at that
+   * ticklet: each vector's inputs were replayed together. */
+  lsim = test28_sim();
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "snapshot_interval=8", "test28", 0));
+  E(lsim_state_history_reset(lsim));
+  E(lsim_cmd_line(lsim, "vectors;test28.vec;"));
+  E(lsim_cmd_line(lsim, "back;5;"));
+  size_t size1, size2;
+  uint8_t *image1 = test27_image(lsim, &size1);
+  E(lsim_delete(lsim));
+  lsim = test28_sim();
+  for (v = 0; v < TEST28_VECTORS - 5; v++) {
+    uint64_t ins = (v >= 1) | (((v / 8) & 15) << 1);
+    E(lsim_handle_poke(lsim, rst, ins & 1));
+    int b;
+    for (b = 0; b < 4; b++) {
+      E(lsim_handle_poke(lsim, pan_sw[b], (ins >> (b + 1)) & 1));
+    }
+    E(lsim_handle_step(lsim));
+    E(lsim_handle_ticklet(lsim, 1));
+  }
+  uint8_t *image2 = test27_image(lsim, &size2);
+  ASSRT(size1 == size2 && memcmp(image1, image2, size1) == 0);
+  free(image1);
+  free(image2);
+  E(lsim_delete(lsim));
+
+  /* One wrong expectation, one wrong but don't-care. */
+  E(lsim_vector_writer_create(&writer, "test28.vec"));
+  E(lsim_vector_writer_in(writer, "Rst", 1));
+  E(lsim_vector_writer_in(writer, "pan", 4));
+  E(lsim_vector_writer_out(writer, "ff1", "q0", 3));  /* A dflipflop has only q0. */
+  E(lsim_vector_writer_close(writer));
+  lsim = test28_sim();
+  global_error_reaction = 2;
+  err = lsim_vector_run(lsim, "test28.vec", &num_vectors, &num_mismatches);
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  global_error_reaction = 1;
+  E(lsim_delete(lsim));
+
+  E(lsim_vector_writer_create(&writer, "test28.vec"));
+  E(lsim_vector_writer_in(writer, "Rst", 1));
+  E(lsim_vector_writer_in(writer, "pan", 4));
+  E(lsim_vector_writer_out(writer, "ff1", "q0", 1));
+  E(lsim_vector_writer_out(writer, "ff2", "q0", 1));
+  E(lsim_vector_writer_out(writer, "ff3", "q0", 1));
+  E(lsim_vector_writer_out(writer, "mem1", "o0", 4));
+  for (v = 0; v < TEST28_VECTORS; v++) {
+    uint64_t ins = (v >= 1) | (((v / 8) & 15) << 1);
+    uint64_t care = UINT64_MAX;
+    if (v == 100) {
+      expect[v] ^= 0x8;  /* mem1 o0 bit 0. */
+    }
+    if (v == 200) {
+      expect[v] ^= 0x1;  /* ff1, but not cared about. */
+      care = ~(uint64_t)0x1;
+    }
+    E(lsim_vector_writer_add(writer, &ins, &expect[v], &care));
+  }
+  E(lsim_vector_writer_close(writer));
+
+  lsim = test28_sim();
+  E(lsim_vector_run(lsim, "test28.vec", &num_vectors, &num_mismatches));
+  ASSRT(num_vectors == TEST28_VECTORS);
+  ASSRT(num_mismatches == 1);
+  E(lsim_delete(lsim));
+  lsim = test28_sim();
+  global_error_reaction = 2;
+  err = lsim_cmd_line(lsim, "vectors;test28.vec;");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_MISMATCH);
+  err_dispose(err);
+  err = lsim_cmd_line(lsim, "vectors;lsim_test.c;");
+  ASSRT(err);
+  ASSRT(err->code == LSIM_ERR_BADFILE);
+  err_dispose(err);
+  global_error_reaction = 1;
+  E(lsim_delete(lsim));
+
+  /* Headers that don't match the signals, or the file. */
+  struct { long offset; uint64_t val; int size; } corrupt[] = {
+    {88, 5, 4},  /* "pan" 5 bits wide: wider than num_in_bits. */
+    {88, 3, 4},  /* Narrower. */
+    {56, UINT64_C(1) << 61, 8},  /* num_vectors: overflows the size. */
+    {16, UINT64_MAX, 8},  /* num_in_sigs. */
+    {48, UINT64_MAX - 4, 8},  /* names_size. */
+  };
+  int c;
+  for (c = 0; c < (int)(sizeof(corrupt) / sizeof(corrupt[0])); c++) {
+    test28_corrupt("test28.vec", "test28_bad.vec", corrupt[c].offset, corrupt[c].val, corrupt[c].size);
+    lsim = test28_sim();
+    global_error_reaction = 2;
+    err = lsim_vector_run(lsim, "test28_bad.vec", &num_vectors, &num_mismatches);
+    ASSRT(err);
+    ASSRT(err->code == LSIM_ERR_BADFILE);
+    err_dispose(err);
+    global_error_reaction = 1;
+    E(lsim_delete(lsim));
+  }
+
+  unlink("test28.vec");
+  unlink("test28_bad.vec");
+}  /* test28 */
+
+
+/* Conditions and "until". */
+void test29() {
+  lsim_t *lsim;
+  lsim_cond_t *cond;
+  err_t *err;
+  long num_ticklets;
+  int met;
+  int i;
+
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+
+  /* Constant expressions, C precedence. */
+  E(lsim_cond_compile(lsim, "1 + 2 == 3 && 4 | 1 == 5", &cond));
+  ASSRT(lsim_cond_eval(lsim, cond) == 1);  /* 4 | (1 == 5) */
+  lsim_cond_delete(cond);
+  E(lsim_cond_compile(lsim, "5 - 1 - 1 == 3 && ~0 == 0xffffffffffffffff && !(2 < 1)", &cond));
+  ASSRT(lsim_cond_eval(lsim, cond) == 1);
+  ASSRT(cond->uses_ticklet == 0 && cond->num_outs == 0);
+  lsim_cond_delete(cond);
+
+  /* Count of 5, evaluated only when a flip-flop output changes. */
+  E(lsim_cond_compile(lsim, "ff1:q0 && !ff2:q0 && ff3:q0", &cond));
+  ASSRT(cond->num_outs == 3);
+  E(lsim_cond_until(lsim, cond, 100, &num_ticklets, &met));
+  ASSRT(met);
+  ASSRT(test14_count(lsim) == 5);
+  ASSRT(cond->num_evals < num_ticklets);
+  lsim_cond_delete(cond);
+
+  /* Already true, on a net that never changes. */
+  E(lsim_cond_compile(lsim, "vcc:o0", &cond));
+  E(lsim_cond_until(lsim, cond, 20, &num_ticklets, &met));
+  ASSRT(met && num_ticklets == 1);
+  lsim_cond_delete(cond);
+  long total = lsim->total_ticklets;
+  E(lsim_cmd_line(lsim, "until;20;vcc:o0 == 1;"));
+  ASSRT(lsim->total_ticklets == total + 1);
+
+  E(lsim_cmd_line(lsim, "until;1000;ticklet >= 50;"));
+  ASSRT(lsim->total_ticklets == 50);
+  E(lsim_cmd_line(lsim, "until;1000;ff1:q0 + ff2:q0 + ff3:q0 == 0;"));
+  ASSRT(test14_count(lsim) == 0);
+
+  /* Buses. */
+  E(lsim_cmd_line(lsim, "l;mem1;3;0xa;"));
+  E(lsim_cmd_line(lsim, "m;pan.swtch.0;1;"));
+  E(lsim_cmd_line(lsim, "m;pan.swtch.1;1;"));
+  E(lsim_cond_compile(lsim, "mem1:o0[4] == 0xa && pan.swtch.0:o0 & (mem1:o0[4] >= 10)", &cond));
+  ASSRT(lsim_cond_eval(lsim, cond) == 1);
+  lsim_cond_delete(cond);
+  total = lsim->total_ticklets;
+  E(lsim_cmd_line(lsim, "until;10;mem1:o0[4] == 15;"));  /* Not met. */
+  ASSRT(lsim->total_ticklets == total + 10);
+  ASSRT(lsim->cond_nets == NULL);
+
+  global_error_reaction = 2;
+  err = lsim_cond_compile(lsim, "ff1:q0 &&", &cond);
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  err = lsim_cond_compile(lsim, "(1 == 1", &cond);
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  err = lsim_cond_compile(lsim, "ff1:q0 ff2:q0", &cond);
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  err = lsim_cond_compile(lsim, "ff1:q0[65]", &cond);
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  err = lsim_cond_compile(lsim, "nosuch:q0", &cond);
+  ASSRT(err && err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+  err = lsim_cmd_line(lsim, "until;0;1;");
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  global_error_reaction = 1;
+
+  E(lsim_delete(lsim));
+}  /* test29 */
+
+
+/* Replay a VCD file; returns the number of value changes after the
+ * header and leaves each code's final value in vals[] (by first char). */
+long test30_replay(const char *filename, int *vals, long *rtn_last_time) {
+  FILE *fp = fopen(filename, "r");
+  ASSRT(fp);
+  char line[256];
+  long num_changes = 0;
+  long last_time = -1;
+  int in_defs = 1;
+  while (fgets(line, sizeof(line), fp)) {
+    if (in_defs) {
+      in_defs = (strncmp(line, "$enddefinitions", 15) != 0);
+    }
+    else if (line[0] == '#') {
+      long t = atol(&line[1]);
+      ASSRT(t > last_time);  /* Increasing. */
+      last_time = t;
+    }
+    else if (line[0] == '0' || line[0] == '1') {
+      ASSRT(line[2] == '\n');  /* Single-character codes here. */
+      vals[(unsigned char)line[1]] = line[0] - '0';
+      num_changes++;
+    }
+  }
+  fclose(fp);
+  *rtn_last_time = last_time;
+  return num_changes;
+}  /* test30_replay */
+
+/* Send stdout to /dev/null for a long run whose LED messages would
+ * swamp the test log. Returns the fd to pass to test30_unquiet(). */
+int test30_quiet() {
+  fflush(stdout);
+  int saved_fd = dup(STDOUT_FILENO);
+  int fd = open("/dev/null", O_WRONLY);
+  ASSRT(saved_fd >= 0 && fd >= 0);
+  ASSRT(dup2(fd, STDOUT_FILENO) >= 0);
+  close(fd);
+  return saved_fd;
+}  /* test30_quiet */
+
+void test30_unquiet(int saved_fd) {
+  fflush(stdout);
+  ASSRT(dup2(saved_fd, STDOUT_FILENO) >= 0);
+  close(saved_fd);
+}  /* test30_unquiet */
+
+/* VCD dump. */
+void test30() {
+  lsim_t *lsim;
+  err_t *err;
+  int i;
+  int vals[256];
+  long last_time;
+
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+
+  E(lsim_cmd_line(lsim, "vcd;test30.vcd;ff?:q0 mem1:o0[4] ff1:q0;"));
+  ASSRT(lsim->vcd->num_sigs == 7);  /* ff1:q0 only once. */
+  E(lsim_cmd_line(lsim, "t;20;"));
+  E(lsim_cmd_line(lsim, "l;mem1;3;0xa;"));
+  E(lsim_cmd_line(lsim, "m;pan.swtch.0;1;"));
+  E(lsim_cmd_line(lsim, "m;pan.swtch.1;1;"));
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "vcdstop;"));
+  ASSRT(lsim->vcd == NULL);
+
+  FILE *fp = fopen("test30.vcd", "r");
+  ASSRT(fp);
+  char line[256];
+  int found = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    found += (strcmp(line, "$var wire 1 ! ff1.q0 $end\n") == 0);
+    found += (strcmp(line, "$var wire 1 ' mem1.o3 $end\n") == 0);
+  }
+  fclose(fp);
+  ASSRT(found == 2);
+
+  memset(vals, 0xff, sizeof(vals));
+  long num_changes = test30_replay("test30.vcd", vals, &last_time);
+  ASSRT(num_changes > 20);
+  ASSRT(last_time == lsim->total_ticklets);
+  ASSRT(vals['!'] + 2 * vals['"'] + 4 * vals['#'] == test14_count(lsim));
+  ASSRT(vals['$'] + 2 * vals['%'] + 4 * vals['&'] + 8 * vals['\''] == 0xa);
+
+  /* Every nand, long enough to go through all the buffers a few times. */
+  E(lsim_cmd_line(lsim, "vcd;test30.vcd;**:o0;"));
+  long num_sigs = lsim->vcd->num_sigs;
+  ASSRT(num_sigs > 20 && num_sigs < 94);  /* Single-character codes. */
+  int saved_fd = test30_quiet();
+  E(lsim_cmd_line(lsim, "t;1200000;"));
+  test30_unquiet(saved_fd);
+  E(lsim_cmd_line(lsim, "vcdstop;"));
+  memset(vals, 0xff, sizeof(vals));
+  num_changes = test30_replay("test30.vcd", vals, &last_time);
+  ASSRT(num_changes > LSIM_VCD_BUF_ENTRIES * LSIM_VCD_NUM_BUFS);
+  ASSRT(last_time == lsim->total_ticklets);
+
+  global_error_reaction = 2;
+  err = lsim_cmd_line(lsim, "vcdstop;");  /* Not dumping. */
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  err = lsim_cmd_line(lsim, "vcd;test30.vcd;nosuch*:o0;");
+  ASSRT(err && err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+  err = lsim_cmd_line(lsim, "vcd;test30.vcd;ff1;");
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  global_error_reaction = 1;
+  ASSRT(lsim->vcd == NULL);
+
+  /* Left running: lsim_delete() finishes the file. */
+  E(lsim_cmd_line(lsim, "vcd;test30.vcd;ff1:q0;"));
+  E(lsim_cmd_line(lsim, "t;4;"));
+  E(lsim_delete(lsim));
+  memset(vals, 0xff, sizeof(vals));
+  num_changes = test30_replay("test30.vcd", vals, &last_time);
+  ASSRT(num_changes == 1 + 2);  /* Initial value, then a toggle per 2 ticklets. */
+
+  unlink("test30.vcd");
+}  /* test30 */
+
+
+/* Run the counter with a dump of every nand, to a VCD or wave file. */
+void test31_sim(const char *dump_cmd, long num_ticklets) {
+  lsim_t *lsim;
+  int i;
+  char cmd[64];
+
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, dump_cmd));
+  snprintf(cmd, sizeof(cmd), "t;%ld;", num_ticklets);
+  int saved_fd = test30_quiet();
+  E(lsim_cmd_line(lsim, cmd));
+  test30_unquiet(saved_fd);
+  E(lsim_delete(lsim));
+}  /* test31_sim */
+
+/* What a wave query over [first, last] should print, worked out from the
+ * VCD file of the same run. */
+void test31_expect(const char *vcd_filename, long first, long last, FILE *out) {
+  FILE *fp = fopen(vcd_filename, "r");
+  ASSRT(fp);
+  char line[256];
+  char names[94][64];
+  int num_sigs = 0;
+  int vals[94];
+  int printed[94];
+  int started = 0;
+  long time = -1;
+  int s;
+  while (fgets(line, sizeof(line), fp)) {
+    if (strncmp(line, "$var wire 1 ", 12) == 0) {
+      ASSRT(line[12] == '!' + num_sigs);
+      ASSRT(sscanf(&line[14], "%63s", names[num_sigs]) == 1);
+      num_sigs++;
+    }
+    else if (line[0] == '0' || line[0] == '1') {
+      vals[line[1] - '!'] = line[0] - '0';
+    }
+    else if (line[0] == '#') {
+      long new_time = atol(&line[1]);
+      if (started && time <= last) {
+        for (s = 0; s < num_sigs; s++) {
+          if (vals[s] != printed[s]) {
+            fprintf(out, "%ld %s %d\n", time, names[s], vals[s]);
+            printed[s] = vals[s];
+          }
+        }
+      }
+      if (! started && time >= 0 && new_time > first) {
+        for (s = 0; s < num_sigs; s++) {
+          fprintf(out, "%ld %s %d\n", first, names[s], vals[s]);
+          printed[s] = vals[s];
+        }
+        started = 1;
+      }
+      time = new_time;
+    }
+  }
+  fclose(fp);
+}  /* test31_expect */
+
+int test31_same(const char *filename1, const char *filename2) {
+  FILE *fp1 = fopen(filename1, "r");
+  FILE *fp2 = fopen(filename2, "r");
+  ASSRT(fp1 && fp2);
+  int c1, c2;
+  do {
+    c1 = fgetc(fp1);
+    c2 = fgetc(fp2);
+  } while (c1 == c2 && c1 != EOF);
+  fclose(fp1);
+  fclose(fp2);
+  return (c1 == c2);
+}  /* test31_same */
+
+/* Wave file dump and query. */
+void test31() {
+  lsim_t *lsim;
+  err_t *err;
+  FILE *fp;
+  /* The last two run past the end of the dump. */
+  long windows[][2] = {{0, 5}, {1, 30}, {40000, 40100}, {99990, 200000}, {250000, 250000}};
+  int w;
+
+  test31_sim("vcd;test31.vcd;**:o0;", 100000);
+  test31_sim("wave;test31.wave;**:o0;", 100000);
+
+  fp = fopen("test31.wave", "rb");
+  ASSRT(fp);
+  lsim_wave_file_hdr_t hdr;
+  ASSRT(fread(&hdr, sizeof(hdr), 1, fp) == 1);
+  fclose(fp);
+  ASSRT(memcmp(hdr.magic, LSIM_WAVE_FILE_MAGIC, 8) == 0);
+  ASSRT(hdr.num_blocks > 10);  /* Queries below seek past most of them. */
+  ASSRT(hdr.start_time == 1 && hdr.end_time == 100001);
+
+  for (w = 0; w < (int)(sizeof(windows) / sizeof(windows[0])); w++) {
+    fp = fopen("test31.exp", "w");
+    ASSRT(fp);
+    /* Nothing is known before the dump started. */
+    test31_expect("test31.vcd", (windows[w][0] < 1) ? 1 : windows[w][0], windows[w][1], fp);
+    fclose(fp);
+    fp = fopen("test31.out", "w");
+    ASSRT(fp);
+    E(lsim_wave_query("test31.wave", "**", windows[w][0], windows[w][1], fp));
+    fclose(fp);
+    ASSRT(test31_same("test31.exp", "test31.out"));
+  }
+
+  /* Pattern selection. */
+  fp = fopen("test31.out", "w");
+  ASSRT(fp);
+  E(lsim_wave_query("test31.wave", "ff1.nand_q.o0  ff3.nand_Q.*", 50000, 50000, fp));
+  fclose(fp);
+  fp = fopen("test31.out", "r");
+  ASSRT(fp);
+  char line[256];
+  int num_lines = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    ASSRT(strncmp(line, "50000 ff1.nand_q.o0 ", 20) == 0 || strncmp(line, "50000 ff3.nand_Q.o0 ", 20) == 0);
+    num_lines++;
+  }
+  fclose(fp);
+  ASSRT(num_lines == 2);
+
+  E(lsim_create(&lsim, NULL));
+  global_error_reaction = 2;
+  err = lsim_cmd_line(lsim, "wavequery;test31.wave;0;10;nosuch*;");
+  ASSRT(err && err->code == HMAP_ERR_NOTFOUND);
+  err_dispose(err);
+  err = lsim_cmd_line(lsim, "wavequery;test31.vcd;0;10;**;");
+  ASSRT(err && err->code == LSIM_ERR_BADFILE);
+  err_dispose(err);
+  err = lsim_cmd_line(lsim, "wavequery;test31.wave;10;0;**;");
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  global_error_reaction = 1;
+  E(lsim_delete(lsim));
+
+  unlink("test31.vcd");
+  unlink("test31.wave");
+  unlink("test31.exp");
+  unlink("test31.out");
+}  /* test31 */
+
+
+/* Run the counter with everything printed, stdout going to a file. */
+long test32_run(const char *async_output, const char *filename) {
+  lsim_t *lsim;
+  int i;
+  char cfg_line[64];
+
+  fflush(stdout);
+  int saved_fd = dup(STDOUT_FILENO);
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSRT(saved_fd >= 0 && fd >= 0);
+  ASSRT(dup2(fd, STDOUT_FILENO) >= 0);
+
+  E(lsim_create(&lsim, NULL));
+  snprintf(cfg_line, sizeof(cfg_line), "async_output=%s", async_output);
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, cfg_line, "test32", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  ASSRT((lsim->log != NULL) == (strcmp(async_output, "0") != 0));
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, "w;ff2.**;1;"));
+  E(lsim_cmd_line(lsim, "v;15;"));
+  E(lsim_cmd_line(lsim, "t;10000;"));
+  E(lsim_cmd_line(lsim, "until;100;ff3:q0 == 0;"));  /* Prints after the run's output. */
+  E(lsim_cmd_line(lsim, "v;0;"));
+  E(lsim_handle_ticklet(lsim, 20));
+  printf("After the handle's ticklets\n");
+  E(lsim_delete(lsim));
+
+  fflush(stdout);
+  ASSRT(dup2(saved_fd, STDOUT_FILENO) >= 0);
+  close(saved_fd);
+  struct stat st;
+  ASSRT(fstat(fd, &st) == 0);
+  close(fd);
+  return (long)st.st_size;
+}  /* test32_run */
+
+/* Engine messages through the writer thread come out as printed directly. */
+void test32() {
+  long size0 = test32_run("0", "test32.0.out");
+  long size1 = test32_run("1", "test32.1.out");
+  ASSRT(size0 > 2000000);  /* More than a ring's worth of records. */
+  ASSRT(size1 == size0);
+  ASSRT(test31_same("test32.0.out", "test32.1.out"));
+
+  /* Dropping may or may not happen, but the output still ends right. */
+  test32_run("2", "test32.2.out");
+  FILE *fp = fopen("test32.2.out", "r");
+  ASSRT(fp);
+  char line[256];
+  char last_line[256] = "";
+  while (fgets(line, sizeof(line), fp)) {
+    strcpy(last_line, line);
+  }
+  fclose(fp);
+  ASSRT(strcmp(last_line, "After the handle's ticklets\n") == 0);
+
+  unlink("test32.0.out");
+  unlink("test32.1.out");
+  unlink("test32.2.out");
+}  /* test32 */
+
+
+/* Device activity counters ("LSIM_STATS=1 ./bld.sh" to test them). */
+void test33() {
+  lsim_t *lsim;
+  err_t *err;
+  int i;
+
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+
+#ifdef LSIM_STATS
+  E(lsim_cmd_line(lsim, "statsreset;"));
+  E(lsim_cmd_line(lsim, "t;16;"));
+  lsim_dev_t *dev;
+  E(lsim_name_lookup(lsim, "clock", &dev));
+  ASSRT(dev->stats.run_logic == 16);
+  ASSRT(dev->stats.toggles == 32);  /* q0 and Q0 each ticklet. */
+  ASSRT(dev->stats.no_change == 0);
+  E(lsim_name_lookup(lsim, "led1", &dev));
+  ASSRT(dev->stats.run_logic == 8);  /* ff1 toggles every other ticklet... */
+  ASSRT(dev->stats.no_change == 8);  /* ...and leds have no outputs. */
+  E(lsim_name_lookup(lsim, "led3", &dev));
+  ASSRT(dev->stats.run_logic == 2);
+  E(lsim_name_lookup(lsim, "ff1.nand_q", &dev));
+  ASSRT(dev->stats.run_logic == 16);
+  ASSRT(dev->stats.toggles == 8);
+  ASSRT(dev->stats.fanout == 8 * 2);  /* nand_Q and led1. */
+  E(lsim_cmd_line(lsim, "stats;3;"));
+
+  E(lsim_cmd_line(lsim, "statsdump;test33.json;"));
+  E(lsim_cmd_line(lsim, "statsdump;test33.csv;"));
+  FILE *fp = fopen("test33.csv", "r");
+  ASSRT(fp);
+  char line[256];
+  int found = 0;
+  int num_lines = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    found += (strncmp(line, "clock,clk,16,0,32,", 18) == 0);
+    num_lines++;
+  }
+  fclose(fp);
+  ASSRT(found == 1);
+  ASSRT(num_lines == lsim->num_devs + 1);
+  fp = fopen("test33.json", "r");
+  ASSRT(fp);
+  found = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    found += (strstr(line, "{\"device\": \"led3\", \"type\": \"led\", \"run_logic\": 2,") != NULL);
+    found += (strstr(line, "{\"type\": \"led\", \"devices\": 7, \"run_logic\": 14,") != NULL);
+  }
+  fclose(fp);
+  ASSRT(found == 2);
+  unlink("test33.json");
+  unlink("test33.csv");
+#else
+  global_error_reaction = 2;
+  err = lsim_cmd_line(lsim, "stats;10;");
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  global_error_reaction = 1;
+#endif
+
+  global_error_reaction = 2;
+  err = lsim_cmd_line(lsim, "stats;-1;");
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  global_error_reaction = 1;
+
+  E(lsim_delete(lsim));
+}  /* test33 */
+
+
+/* Per-step engine histograms. */
+void test34() {
+  lsim_t *lsim;
+  err_t *err;
+  int i;
+
+  E(lsim_create(&lsim, NULL));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  ASSRT(lsim->step_stats == NULL);  /* Off by default. */
+  global_error_reaction = 2;
+  err = lsim_cmd_line(lsim, "stepstats;");
+  ASSRT(err && err->code == LSIM_ERR_COMMAND);
+  err_dispose(err);
+  global_error_reaction = 1;
+  E(lsim_delete(lsim));
+
+  E(lsim_create(&lsim, NULL));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "step_stats=1", "test34", 0));
+  E(cfg_parse_line(lsim->cfg, CFG_MODE_UPDATE, "snapshot_interval=4", "test34", 0));
+  for (i = 0; test14_ctr[i]; i++) {
+    E(lsim_cmd_line(lsim, test14_ctr[i]));
+  }
+  E(lsim_cmd_line(lsim, "p;"));
+  lsim_step_stats_t *step_stats = lsim->step_stats;
+  ASSRT(step_stats);
+  ASSRT(step_stats->cycles.count == 1);  /* Power-up. */
+  ASSRT(step_stats->cycles.max > 0);
+  ASSRT(lsim_stats_cycle_pct(step_stats, 0.5) == (long)step_stats->cycles.max);  /* Not 0. */
+  ASSRT(step_stats->runs.max == (uint64_t)step_stats->runs.sum);
+  ASSRT(step_stats->runs.max_step == 0);
+  E(lsim_cmd_line(lsim, "t;1;"));
+  E(lsim_cmd_line(lsim, "m;Rst;1;"));
+  E(lsim_cmd_line(lsim, "t;16;"));
+  ASSRT(step_stats->cycles.count == (uint64_t)lsim->cur_step + 1);
+  ASSRT(step_stats->nanos.count == step_stats->cycles.count);
+  ASSRT(step_stats->cycles.max <= (uint64_t)lsim->max_propagate_cycles);
+  uint64_t total = 0;
+  uint64_t sum = 0;
+  long c;
+  for (c = 0; c <= step_stats->max_cycles; c++) {
+    total += step_stats->cycle_steps[c];
+    sum += c * step_stats->cycle_steps[c];
+  }
+  ASSRT(total == step_stats->cycles.count);
+  ASSRT(sum == step_stats->cycles.sum);
+  total = 0;
+  int bucket;
+  for (bucket = 0; bucket < LSIM_HIST_BUCKETS; bucket++) {
+    total += step_stats->runs.buckets[bucket];
+  }
+  ASSRT(total == step_stats->cycles.count);
+
+  /* Steps replayed by "back" aren't counted. */
+  uint64_t num_steps = step_stats->cycles.count;
+  E(lsim_cmd_line(lsim, "back;2;"));
+  ASSRT(step_stats->cycles.count == num_steps);
+  E(lsim_cmd_line(lsim, "stepstats;"));
+
+  E(lsim_cmd_line(lsim, "stepstatsdump;test34.json;"));
+  FILE *fp = fopen("test34.json", "r");
+  ASSRT(fp);
+  char line[256];
+  char expect[64];
+  snprintf(expect, sizeof(expect), "  \"steps\": %" PRIu64 ",\n", num_steps);
+  int found = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    found += (strcmp(line, expect) == 0);
+    found += (strncmp(line, "  \"cycles\": {", 13) == 0);
+    found += (strncmp(line, "  \"wall_ns\": {", 14) == 0);
+  }
+  fclose(fp);
+  ASSRT(found == 3);
+  unlink("test34.json");
+
+  E(lsim_cmd_line(lsim, "stepstatsreset;"));
+  ASSRT(step_stats->cycles.count == 0);
+  ASSRT(step_stats->cycle_steps[1] == 0);
+  E(lsim_cmd_line(lsim, "t;1;"));
+  ASSRT(step_stats->cycles.count == 1);
+
+  E(lsim_delete(lsim));
+}  /* test34 */
+
+
 int main(int argc, char **argv) {
   parse_cmdline(argc, argv);
 
@@ -831,5 +3111,121 @@ int main(int argc, char **argv) {
     printf("test10: success\n");
   }
 
+  if (o_testnum == 0 || o_testnum == 11) {
+    test11();
+    printf("test11: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 12) {
+    test12();
+    printf("test12: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 13) {
+    test13();
+    printf("test13: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 14) {
+    test14();
+    printf("test14: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 15) {
+    test15();
+    printf("test15: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 16) {
+    test16();
+    printf("test16: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 17) {
+    test17();
+    printf("test17: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 18) {
+    test18();
+    printf("test18: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 19) {
+    test19();
+    printf("test19: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 20) {
+    test20();
+    printf("test20: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 21) {
+    test21();
+    printf("test21: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 22) {
+    test22();
+    printf("test22: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 23) {
+    test23();
+    printf("test23: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 24) {
+    test24();
+    printf("test24: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 25) {
+    test25();
+    printf("test25: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 26) {
+    test26();
+    printf("test26: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 27) {
+    test27();
+    printf("test27: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 28) {
+    test28();
+    printf("test28: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 29) {
+    test29();
+    printf("test29: success\n");
+  }
+
+  if (o_testnum == 0 || o_testnum == 30) {
+    test30();
+    printf("test30: success\n");
+  }
+  if (o_testnum == 0 || o_testnum == 31) {
+    test31();
+    printf("test31: success\n");
+  }
+  if (o_testnum == 0 || o_testnum == 32) {
+    test32();
+    printf("test32: success\n");
+  }
+  if (o_testnum == 0 || o_testnum == 33) {
+    test33();
+    printf("test33: success\n");
+  }
+  if (o_testnum == 0 || o_testnum == 34) {
+    test34();
+    printf("test34: success\n");
+  }
+
   return 0;
 }  /* main */
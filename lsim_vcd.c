@@ -0,0 +1,428 @@
+/* lsim_vcd.c - VCD waveform dump, written by a background thread. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_vcd.h"
+#include "lsim_wave.h"
+
+
+/* While dumping, lsim_dev_out_propagate() appends each change of a dumped
+ * net to a buffer (see lsim_vcd_change()): no formatting and no I/O. Full
+ * buffers go to a writer thread that turns them into VCD text. The VCD
+ * time unit is one ticklet. Each dumped output is a 1-bit wire named
+ * "dev_name.out_id". With LSIM_VCD_FORMAT_WAVE the writer thread encodes
+ * the buffers into a wave file instead (see lsim_wave.c). */
+
+/* VCD identifier codes are base-94 in the printable characters. */
+#define LSIM_VCD_CODE_SIZE 8
+
+void lsim_vcd_code(long sig, char *code) {
+  int len = 0;
+  do {
+    code[len++] = (char)('!' + (sig % 94));
+    sig /= 94;
+  } while (sig > 0);
+  code[len] = '\0';
+}  /* lsim_vcd_code */
+
+
+ERR_F lsim_vcd_sig_add(lsim_t *lsim, lsim_vcd_t *vcd, lsim_dev_out_terminal_t *out_terminal, const char *dev_name, const char *out_id) {
+  (void)lsim;
+  ERR_ASSRT(out_terminal->net_id < vcd->num_sig_ids, LSIM_ERR_INTERNAL);
+  if (vcd->sig_ids[out_terminal->net_id] != 0) {
+    return ERR_OK;  /* Listed already. */
+  }
+
+  if (vcd->num_sigs == vcd->alloc_sigs) {
+    long new_alloc = vcd->alloc_sigs ? vcd->alloc_sigs * 2 : 256;
+    lsim_dev_out_terminal_t **new_sigs = realloc(vcd->sigs, new_alloc * sizeof(lsim_dev_out_terminal_t *));
+    ERR_ASSRT(new_sigs, LSIM_ERR_NOMEM);
+    vcd->sigs = new_sigs;
+    char **new_names = realloc(vcd->sig_names, new_alloc * sizeof(char *));
+    ERR_ASSRT(new_names, LSIM_ERR_NOMEM);
+    vcd->sig_names = new_names;
+    vcd->alloc_sigs = new_alloc;
+  }
+  vcd->sigs[vcd->num_sigs] = out_terminal;
+  ERR(err_asprintf(&vcd->sig_names[vcd->num_sigs], "%s.%s", dev_name, out_id));
+  vcd->num_sigs++;
+  vcd->sig_ids[out_terminal->net_id] = (uint32_t)vcd->num_sigs;
+
+  return ERR_OK;
+}  /* lsim_vcd_sig_add */
+
+
+/* One "dev_pattern:out_id[num_bits]" (num_bits defaults to 1). With a
+ * pattern, devices that don't have that output are skipped. */
+ERR_F lsim_vcd_signal(lsim_t *lsim, lsim_vcd_t *vcd, char *signal) {
+  char *colon = strrchr(signal, ':');
+  if (colon == NULL || colon == signal) {
+    ERR_THROW(LSIM_ERR_COMMAND, "VCD signal '%s' is not dev_name:out_id", signal);
+  }
+  *colon = '\0';
+  char *out_id = colon + 1;
+  long num_bits = 1;
+  char *bracket = strchr(out_id, '[');
+  if (bracket) {
+    char *end;
+    num_bits = strtol(bracket + 1, &end, 0);
+    if (end[0] != ']' || end[1] != '\0' || num_bits < 1) {
+      ERR_THROW(LSIM_ERR_COMMAND, "VCD signal '%s:%s' has a bad width", signal, out_id);
+    }
+    *bracket = '\0';
+  }
+
+  /* Bit n of "o0" is named "o<n>". */
+  size_t prefix_len = strlen(out_id);
+  while (prefix_len > 0 && isdigit((unsigned char)out_id[prefix_len - 1])) {
+    prefix_len--;
+  }
+  long id_num = atol(&out_id[prefix_len]);
+
+  lsim_dev_t **devs;
+  long num_devs;
+  int is_pattern = lsim_name_is_pattern(signal);
+  if (is_pattern) {
+    ERR(lsim_name_match(lsim, signal, &devs, &num_devs));
+  }
+  else {
+    ERR(err_calloc((void **)&devs, 1, sizeof(lsim_dev_t *)));
+    num_devs = 1;
+    err_t *err = lsim_name_lookup(lsim, signal, &devs[0]);
+    if (err) {
+      free(devs);
+      ERR_RETHROW(err, "VCD signal '%s'", signal);
+    }
+  }
+
+  err_t *err = ERR_OK;
+  long num_found = 0;
+  long d;
+  for (d = 0; d < num_devs && err == ERR_OK; d++) {
+    lsim_dev_t *dev = devs[d];
+    const char *dev_name = lsim_name_str(lsim, dev->name);
+    long bit;
+    for (bit = 0; bit < num_bits && err == ERR_OK; bit++) {
+      lsim_dev_out_terminal_t *out_terminal = NULL;
+      err = dev->get_out_terminal(lsim, dev, out_id, &out_terminal, (int)bit);
+      if (is_pattern && (err || out_terminal == NULL)) {
+        err_dispose(err);
+        err = ERR_OK;
+        break;  /* Not one of ours. */
+      }
+      if (err == ERR_OK && out_terminal == NULL) {
+        err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_COMMAND, "Device '%s' has no output '%s' (bit %ld)", dev_name, out_id, bit);
+      }
+      if (err == ERR_OK) {
+        char bit_id[64];
+        if (num_bits == 1) {
+          snprintf(bit_id, sizeof(bit_id), "%s", out_id);
+        }
+        else {
+          snprintf(bit_id, sizeof(bit_id), "%.*s%ld", (int)prefix_len, out_id, id_num + bit);
+        }
+        err = lsim_vcd_sig_add(lsim, vcd, out_terminal, lsim_name_str(lsim, dev->name), bit_id);
+        num_found++;
+      }
+    }
+  }
+  free(devs);
+  if (err) {
+    ERR_RETHROW(err, "VCD signal '%s:%s'", signal, out_id);
+  }
+  if (num_found == 0) {
+    ERR_THROW(HMAP_ERR_NOTFOUND, "No device matches VCD signal '%s:%s'", signal, out_id);
+  }
+
+  return ERR_OK;
+}  /* lsim_vcd_signal */
+
+
+/* Format queued buffers until told to stop. */
+void *lsim_vcd_writer(void *arg) {
+  lsim_vcd_t *vcd = (lsim_vcd_t *)arg;
+
+  char *codes = malloc(vcd->num_sigs * LSIM_VCD_CODE_SIZE);
+  size_t out_size = 1024 * 1024;
+  char *out = malloc(out_size);
+  long sig;
+  if (codes && out) {
+    for (sig = 0; sig < vcd->num_sigs; sig++) {
+      lsim_vcd_code(sig, &codes[sig * LSIM_VCD_CODE_SIZE]);
+    }
+  }
+
+  pthread_mutex_lock(&vcd->lock);
+  while (1) {
+    while (vcd->buf_lens[vcd->write_buf] == 0 && ! vcd->stopping) {
+      pthread_cond_wait(&vcd->cond, &vcd->lock);
+    }
+    long len = vcd->buf_lens[vcd->write_buf];
+    if (len == 0) {
+      break;  /* Stopping, and everything is written. */
+    }
+    int write_error = (codes == NULL || out == NULL || vcd->write_error);
+    pthread_mutex_unlock(&vcd->lock);
+
+    const uint64_t *buf = vcd->bufs[vcd->write_buf];
+    if (vcd->wave && ! write_error) {
+      err_t *err = lsim_wave_writer_entries(vcd->wave, buf, len);
+      write_error = (err != ERR_OK);
+      err_dispose(err);
+      len = 0;
+    }
+    size_t out_len = 0;
+    long i;
+    for (i = 0; i < len && ! write_error; i++) {
+      if (out_len + 32 > out_size) {
+        write_error = (fwrite(out, 1, out_len, vcd->fp) != out_len);
+        out_len = 0;
+      }
+      uint64_t entry = buf[i];
+      if (entry & LSIM_VCD_TIME_FLAG) {
+        out_len += sprintf(&out[out_len], "#%" PRIu64 "\n", entry & ~LSIM_VCD_TIME_FLAG);
+      }
+      else {
+        const char *code = &codes[(entry >> 1) * LSIM_VCD_CODE_SIZE];
+        out[out_len++] = (char)('0' + (entry & 1));
+        while (*code) {
+          out[out_len++] = *code++;
+        }
+        out[out_len++] = '\n';
+      }
+    }
+    if (out_len > 0 && ! write_error) {
+      write_error = (fwrite(out, 1, out_len, vcd->fp) != out_len);
+    }
+
+    pthread_mutex_lock(&vcd->lock);
+    vcd->write_error |= write_error;
+    vcd->buf_lens[vcd->write_buf] = 0;
+    vcd->write_buf = (vcd->write_buf + 1) % LSIM_VCD_NUM_BUFS;
+    pthread_cond_broadcast(&vcd->cond);
+  }
+  pthread_mutex_unlock(&vcd->lock);
+
+  free(codes);
+  free(out);
+  return NULL;
+}  /* lsim_vcd_writer */
+
+
+/* Hand the buffer being filled to the writer and move to the next one,
+ * waiting only if the writer hasn't finished with it yet. */
+ERR_F lsim_vcd_flush_buf(lsim_t *lsim) {
+  lsim_vcd_t *vcd = lsim->vcd;
+  if (vcd->fill_len == 0) {
+    return ERR_OK;
+  }
+
+  pthread_mutex_lock(&vcd->lock);
+  vcd->buf_lens[vcd->fill_buf] = vcd->fill_len;
+  pthread_cond_broadcast(&vcd->cond);
+  vcd->fill_buf = (vcd->fill_buf + 1) % LSIM_VCD_NUM_BUFS;
+  while (vcd->buf_lens[vcd->fill_buf] != 0) {
+    pthread_cond_wait(&vcd->cond, &vcd->lock);
+  }
+  int write_error = vcd->write_error;
+  pthread_mutex_unlock(&vcd->lock);
+  vcd->fill_len = 0;
+
+  if (write_error) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Error writing VCD file '%s'", vcd->filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_vcd_flush_buf */
+
+
+void lsim_vcd_free(lsim_vcd_t *vcd) {
+  long i;
+  for (i = 0; i < vcd->num_sigs; i++) {
+    free(vcd->sig_names[i]);
+  }
+  free(vcd->sig_names);
+  free(vcd->sigs);
+  free(vcd->sig_ids);
+  for (i = 0; i < LSIM_VCD_NUM_BUFS; i++) {
+    free(vcd->bufs[i]);
+  }
+  free(vcd->filename);
+  free(vcd);
+}  /* lsim_vcd_free */
+
+
+ERR_F lsim_vcd_header(lsim_t *lsim, lsim_vcd_t *vcd) {
+  FILE *fp = vcd->fp;
+  char code[LSIM_VCD_CODE_SIZE];
+  int ok = (fprintf(fp, "$version lsim $end\n$timescale 1ns $end\n$scope module lsim $end\n") > 0);
+  long sig;
+  for (sig = 0; sig < vcd->num_sigs && ok; sig++) {
+    lsim_vcd_code(sig, code);
+    ok = (fprintf(fp, "$var wire 1 %s %s $end\n", code, vcd->sig_names[sig]) > 0);
+  }
+  ok = ok && (fprintf(fp, "$upscope $end\n$enddefinitions $end\n#%ld\n$dumpvars\n", lsim->total_ticklets) > 0);
+  for (sig = 0; sig < vcd->num_sigs && ok; sig++) {
+    lsim_vcd_code(sig, code);
+    ok = (fprintf(fp, "%d%s\n", lsim_dev_out_state(lsim, vcd->sigs[sig]), code) > 0);
+  }
+  ok = ok && (fprintf(fp, "$end\n") > 0);
+  ERR_ASSRT(ok, LSIM_ERR_BADFILE);
+
+  return ERR_OK;
+}  /* lsim_vcd_header */
+
+
+ERR_F lsim_vcd_init(lsim_t *lsim, lsim_vcd_t *vcd, const char *signals) {
+  char *signals_copy;
+  ERR(err_strdup(&signals_copy, signals));
+  err_t *err = ERR_OK;
+  char *save_ptr;
+  char *signal = strtok_r(signals_copy, " \t", &save_ptr);
+  while (signal && err == ERR_OK) {
+    err = lsim_vcd_signal(lsim, vcd, signal);
+    signal = strtok_r(NULL, " \t", &save_ptr);
+  }
+  free(signals_copy);
+  if (err) {
+    ERR_RETHROW(err, "VCD signals '%s'", signals);
+  }
+  ERR_ASSRT(vcd->num_sigs > 0, LSIM_ERR_COMMAND);
+
+  int b;
+  for (b = 0; b < LSIM_VCD_NUM_BUFS; b++) {
+    vcd->bufs[b] = malloc(LSIM_VCD_BUF_ENTRIES * sizeof(uint64_t));
+    ERR_ASSRT(vcd->bufs[b], LSIM_ERR_NOMEM);
+  }
+
+  vcd->fp = fopen(vcd->filename, "wb");
+  if (vcd->fp == NULL) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't create VCD file '%s'", vcd->filename);
+  }
+  if (vcd->format == LSIM_VCD_FORMAT_WAVE) {
+    uint8_t *vals;
+    err = err_calloc((void **)&vals, (vcd->num_sigs + 7) / 8, 1);
+    long sig;
+    for (sig = 0; sig < vcd->num_sigs && err == ERR_OK; sig++) {
+      vals[sig / 8] |= (uint8_t)(lsim_dev_out_state(lsim, vcd->sigs[sig]) << (sig % 8));
+    }
+    if (err == ERR_OK) {
+      err = lsim_wave_writer_create(&vcd->wave, vcd->fp, vcd->num_sigs, vcd->sig_names, vals, lsim->total_ticklets);
+      free(vals);
+    }
+  }
+  else {
+    err = lsim_vcd_header(lsim, vcd);
+  }
+  if (err) {
+    fclose(vcd->fp);
+    ERR_RETHROW(err, "Writing VCD file '%s'", vcd->filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_vcd_init */
+
+
+/* Start dumping the given signals (space-separated
+ * "dev_name:out_id[num_bits]", dev_name can be a pattern) to a file.
+ * Their current values are written first. */
+ERR_F lsim_vcd_start(lsim_t *lsim, const char *filename, const char *signals, int format) {
+  ERR_ASSRT(lsim->power_on, LSIM_ERR_COMMAND);
+  ERR_ASSRT(lsim->vcd == NULL, LSIM_ERR_COMMAND);  /* One at a time. */
+  ERR_ASSRT(format == LSIM_VCD_FORMAT_VCD || format == LSIM_VCD_FORMAT_WAVE, LSIM_ERR_PARAM);
+
+  lsim_vcd_t *vcd;
+  ERR(err_calloc((void **)&vcd, 1, sizeof(lsim_vcd_t)));
+  vcd->format = format;
+  vcd->num_sig_ids = lsim->alloc_state_words * 64;
+  err_t *err = err_calloc((void **)&vcd->sig_ids, vcd->num_sig_ids, sizeof(uint32_t));
+  if (err == ERR_OK) {
+    err = err_strdup(&vcd->filename, filename);
+  }
+  if (err == ERR_OK) {
+    err = lsim_vcd_init(lsim, vcd, signals);
+  }
+  if (err) {
+    lsim_vcd_free(vcd);
+    ERR_RETHROW(err, "Starting VCD dump");
+  }
+  vcd->last_time = lsim->total_ticklets;
+
+  pthread_mutex_init(&vcd->lock, NULL);
+  pthread_cond_init(&vcd->cond, NULL);
+  if (pthread_create(&vcd->writer, NULL, lsim_vcd_writer, vcd) != 0) {
+    if (vcd->wave) {
+      err_dispose(lsim_wave_writer_close(vcd->wave, lsim->total_ticklets));
+    }
+    fclose(vcd->fp);
+    lsim_vcd_free(vcd);
+    ERR_THROW(LSIM_ERR_INTERNAL, "Can't start VCD writer thread");
+  }
+
+  lsim->vcd = vcd;
+  return ERR_OK;
+}  /* lsim_vcd_start */
+
+
+/* Write what's queued, end the writer and close the file. */
+ERR_F lsim_vcd_stop(lsim_t *lsim) {
+  lsim_vcd_t *vcd = lsim->vcd;
+  ERR_ASSRT(vcd, LSIM_ERR_COMMAND);
+
+  pthread_mutex_lock(&vcd->lock);
+  if (vcd->fill_len > 0) {
+    vcd->buf_lens[vcd->fill_buf] = vcd->fill_len;
+  }
+  vcd->stopping = 1;
+  pthread_cond_broadcast(&vcd->cond);
+  pthread_mutex_unlock(&vcd->lock);
+  pthread_join(vcd->writer, NULL);
+  pthread_mutex_destroy(&vcd->lock);
+  pthread_cond_destroy(&vcd->cond);
+
+  int ok = ! vcd->write_error;
+  if (vcd->wave) {
+    err_t *err = lsim_wave_writer_close(vcd->wave, lsim->total_ticklets);
+    ok = (err == ERR_OK) && ok;
+    err_dispose(err);
+  }
+  else if (lsim->total_ticklets > vcd->last_time) {  /* Marks the end of the dump. */
+    ok = (fprintf(vcd->fp, "#%ld\n", lsim->total_ticklets) > 0) && ok;
+  }
+  ok = (fclose(vcd->fp) == 0) && ok;
+  lsim->vcd = NULL;
+  char *filename = vcd->filename;
+  vcd->filename = NULL;
+  lsim_vcd_free(vcd);
+  if (! ok) {
+    err_t *err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_BADFILE, "Error writing VCD file '%s'", filename);
+    free(filename);
+    return err;
+  }
+  free(filename);
+
+  return ERR_OK;
+}  /* lsim_vcd_stop */
@@ -0,0 +1,98 @@
+/* lsim_vcd.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_VCD_H
+#define LSIM_VCD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "err.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Value changes are queued in buffers of this many entries; the writer
+ * thread formats full ones while the simulation fills the next. The
+ * simulation only waits if all of them are full. */
+#define LSIM_VCD_BUF_ENTRIES (1024 * 1024)
+#define LSIM_VCD_NUM_BUFS 4
+
+/* A buffer entry: a time (ticklet) or a signal's new value. */
+#define LSIM_VCD_TIME_FLAG (UINT64_C(1) << 63)
+#define LSIM_VCD_CHANGE(sig, val) (((uint64_t)(sig) << 1) | (uint64_t)(val))
+
+/* What the writer thread produces. */
+#define LSIM_VCD_FORMAT_VCD 0
+#define LSIM_VCD_FORMAT_WAVE 1  /* lsim_wave.h */
+
+struct lsim_vcd_s {
+  FILE *fp;
+  char *filename;
+  int format;  /* LSIM_VCD_FORMAT_xxx */
+  struct lsim_wave_writer_s *wave;  /* LSIM_VCD_FORMAT_WAVE */
+  uint32_t *sig_ids;  /* By net_id: signal number + 1, or 0 if not dumped. */
+  long num_sig_ids;
+  lsim_dev_out_terminal_t **sigs;  /* By signal number. */
+  char **sig_names;
+  long num_sigs;
+  long alloc_sigs;
+  long last_time;  /* Of the latest time entry queued. */
+  uint64_t *bufs[LSIM_VCD_NUM_BUFS];
+  int fill_buf;  /* Being filled by the simulation. */
+  long fill_len;
+  /* Shared with the writer thread, under "lock". */
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  long buf_lens[LSIM_VCD_NUM_BUFS];  /* Non-zero: full, waiting to be written. */
+  int write_buf;  /* Next one the writer takes. */
+  int stopping;
+  int write_error;
+};
+
+ERR_F lsim_vcd_start(lsim_t *lsim, const char *filename, const char *signals, int format);
+ERR_F lsim_vcd_stop(lsim_t *lsim);
+ERR_F lsim_vcd_flush_buf(lsim_t *lsim);
+
+/* Called by lsim_dev_out_propagate() for each net change while dumping. */
+static inline err_t *lsim_vcd_change(lsim_t *lsim, long net_id, int new_state) {
+  lsim_vcd_t *vcd = lsim->vcd;
+  uint32_t sig_id = vcd->sig_ids[net_id];
+  if (sig_id == 0) {
+    return ERR_OK;
+  }
+  if (vcd->fill_len + 2 > LSIM_VCD_BUF_ENTRIES) {
+    err_t *err = lsim_vcd_flush_buf(lsim);
+    if (err) {
+      return err;
+    }
+  }
+  uint64_t *buf = vcd->bufs[vcd->fill_buf];
+  if (lsim->total_ticklets != vcd->last_time) {
+    vcd->last_time = lsim->total_ticklets;
+    buf[vcd->fill_len++] = LSIM_VCD_TIME_FLAG | (uint64_t)vcd->last_time;
+  }
+  buf[vcd->fill_len++] = LSIM_VCD_CHANGE(sig_id - 1, new_state);
+
+  return ERR_OK;
+}  /* lsim_vcd_change */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_VCD_H
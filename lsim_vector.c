@@ -0,0 +1,421 @@
+/* lsim_vector.c - binary stimulus vectors with expected responses. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_name.h"
+#include "lsim_vector.h"
+#include "lsim_log.h"
+
+
+/* A vector file replaces a long run of "m;" and "t;" commands and the
+ * reading of LEDs. Each vector sets every declared switch, settles the
+ * logic, does one ticklet (if there's a clock), and compares the declared
+ * outputs against the expected bits. The signal names are resolved once;
+ * the vectors are mmapped and walked in place. */
+
+
+ERR_F lsim_vector_writer_name(lsim_vector_writer_t *writer, const char *str, uint32_t *rtn_offset) {
+  size_t len = strlen(str) + 1;
+  while (writer->hdr.names_size + len > writer->alloc_names) {
+    size_t new_alloc = writer->alloc_names ? writer->alloc_names * 2 : 1024;
+    char *new_names = realloc(writer->names, new_alloc);
+    ERR_ASSRT(new_names, LSIM_ERR_NOMEM);
+    writer->names = new_names;
+    writer->alloc_names = new_alloc;
+  }
+  memcpy(&writer->names[writer->hdr.names_size], str, len);
+  *rtn_offset = (uint32_t)writer->hdr.names_size;
+  writer->hdr.names_size += len;
+
+  return ERR_OK;
+}  /* lsim_vector_writer_name */
+
+
+ERR_F lsim_vector_writer_create(lsim_vector_writer_t **rtn_writer, const char *filename) {
+  lsim_vector_writer_t *writer;
+  ERR(err_calloc((void **)&writer, 1, sizeof(lsim_vector_writer_t)));
+  ERR(err_strdup(&writer->filename, filename));
+  memcpy(writer->hdr.magic, LSIM_VECTOR_FILE_MAGIC, 8);
+  writer->hdr.version = LSIM_VECTOR_FILE_VERSION;
+
+  uint32_t empty_offset;
+  ERR(lsim_vector_writer_name(writer, "", &empty_offset));  /* id_offset of ins. */
+
+  writer->fp = fopen(filename, "wb");
+  if (writer->fp == NULL) {
+    free(writer->names);
+    free(writer->filename);
+    free(writer);
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't create vector file '%s'", filename);
+  }
+
+  *rtn_writer = writer;
+  return ERR_OK;
+}  /* lsim_vector_writer_create */
+
+
+ERR_F lsim_vector_writer_sig(lsim_vector_writer_t *writer, const char *dev_name, const char *out_id, int num_bits) {
+  ERR_ASSRT(! writer->started, LSIM_ERR_COMMAND);  /* Signals come first. */
+  ERR_ASSRT(num_bits >= 1, LSIM_ERR_PARAM);
+
+  long num_sigs = (long)(writer->hdr.num_in_sigs + writer->hdr.num_out_sigs);
+  if (num_sigs == writer->alloc_sigs) {
+    long new_alloc = writer->alloc_sigs ? writer->alloc_sigs * 2 : 64;
+    lsim_vector_file_sig_t *new_sigs = realloc(writer->sigs, new_alloc * sizeof(lsim_vector_file_sig_t));
+    ERR_ASSRT(new_sigs, LSIM_ERR_NOMEM);
+    writer->sigs = new_sigs;
+    writer->alloc_sigs = new_alloc;
+  }
+  lsim_vector_file_sig_t *sig = &writer->sigs[num_sigs];
+  memset(sig, 0, sizeof(*sig));
+  ERR(lsim_vector_writer_name(writer, dev_name, &sig->name_offset));
+  if (out_id) {
+    ERR(lsim_vector_writer_name(writer, out_id, &sig->id_offset));
+  }
+  sig->num_bits = num_bits;
+
+  return ERR_OK;
+}  /* lsim_vector_writer_sig */
+
+
+/* All ins must be declared before the first out. */
+ERR_F lsim_vector_writer_in(lsim_vector_writer_t *writer, const char *dev_name, int num_bits) {
+  ERR_ASSRT(writer->hdr.num_out_sigs == 0, LSIM_ERR_COMMAND);
+  ERR(lsim_vector_writer_sig(writer, dev_name, NULL, num_bits));
+  writer->hdr.num_in_sigs++;
+  writer->hdr.num_in_bits += num_bits;
+
+  return ERR_OK;
+}  /* lsim_vector_writer_in */
+
+
+ERR_F lsim_vector_writer_out(lsim_vector_writer_t *writer, const char *dev_name, const char *out_id, int num_bits) {
+  ERR(lsim_vector_writer_sig(writer, dev_name, out_id, num_bits));
+  writer->hdr.num_out_sigs++;
+  writer->hdr.num_out_bits += num_bits;
+
+  return ERR_OK;
+}  /* lsim_vector_writer_out */
+
+
+/* Write everything up to the vectors. The header is rewritten at close
+ * with the final vector count. */
+ERR_F lsim_vector_writer_start(lsim_vector_writer_t *writer) {
+  static const char pad[8] = {0};
+  size_t pad_size = (8 - (writer->hdr.names_size & 7)) & 7;
+  long num_sigs = (long)(writer->hdr.num_in_sigs + writer->hdr.num_out_sigs);
+  writer->hdr.names_size += pad_size;
+
+  int ok = (fwrite(&writer->hdr, sizeof(writer->hdr), 1, writer->fp) == 1);
+  ok = ok && (fwrite(writer->sigs, sizeof(lsim_vector_file_sig_t), num_sigs, writer->fp) == (size_t)num_sigs);
+  ok = ok && (fwrite(writer->names, 1, writer->hdr.names_size - pad_size, writer->fp) == writer->hdr.names_size - pad_size);
+  ok = ok && (fwrite(pad, 1, pad_size, writer->fp) == pad_size);
+  if (! ok) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Error writing vector file '%s'", writer->filename);
+  }
+  writer->started = 1;
+
+  return ERR_OK;
+}  /* lsim_vector_writer_start */
+
+
+/* One vector. ins holds (num_in_bits + 63) / 64 words, expect and care
+ * (num_out_bits + 63) / 64 each. A NULL care compares every output. */
+ERR_F lsim_vector_writer_add(lsim_vector_writer_t *writer, const uint64_t *ins, const uint64_t *expect, const uint64_t *care) {
+  if (! writer->started) {
+    ERR(lsim_vector_writer_start(writer));
+  }
+  size_t in_words = (writer->hdr.num_in_bits + 63) / 64;
+  size_t out_words = (writer->hdr.num_out_bits + 63) / 64;
+
+  int ok = (fwrite(ins, sizeof(uint64_t), in_words, writer->fp) == in_words);
+  ok = ok && (fwrite(expect, sizeof(uint64_t), out_words, writer->fp) == out_words);
+  size_t w;
+  for (w = 0; w < out_words && ok; w++) {
+    uint64_t care_word = UINT64_MAX;
+    if (care) {
+      care_word = care[w];
+    }
+    if (w == out_words - 1 && (writer->hdr.num_out_bits & 63) != 0) {
+      care_word &= (UINT64_C(1) << (writer->hdr.num_out_bits & 63)) - 1;
+    }
+    ok = (fwrite(&care_word, sizeof(uint64_t), 1, writer->fp) == 1);
+  }
+  if (! ok) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Error writing vector file '%s'", writer->filename);
+  }
+  writer->hdr.num_vectors++;
+
+  return ERR_OK;
+}  /* lsim_vector_writer_add */
+
+
+/* Finish the file and free the writer (even on error). */
+ERR_F lsim_vector_writer_close(lsim_vector_writer_t *writer) {
+  err_t *err = ERR_OK;
+  if (! writer->started) {
+    err = lsim_vector_writer_start(writer);
+  }
+  int ok = (err == ERR_OK);
+  ok = ok && (fseek(writer->fp, 0, SEEK_SET) == 0);
+  ok = ok && (fwrite(&writer->hdr, sizeof(writer->hdr), 1, writer->fp) == 1);
+  ok = (fclose(writer->fp) == 0) && ok;
+
+  char *filename = writer->filename;
+  free(writer->sigs);
+  free(writer->names);
+  free(writer);
+  if (err) {
+    err = err_rethrow_v(__FILE__, __LINE__, __func__, err, "Closing vector file '%s'", filename);
+  }
+  else if (! ok) {
+    err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_BADFILE, "Error writing vector file '%s'", filename);
+  }
+  free(filename);
+
+  return err;
+}  /* lsim_vector_writer_close */
+
+
+/* Print the signals a vector got wrong (only called on a mismatch). */
+void lsim_vector_report(lsim_t *lsim, const lsim_vector_file_sig_t *out_sigs, uint64_t num_out_sigs, const char *names, long vector_num, const uint64_t *got, const uint64_t *expect, const uint64_t *care) {
+  uint64_t bit = 0;
+  uint64_t s;
+  for (s = 0; s < num_out_sigs; s++) {
+    uint64_t got_val = 0;
+    uint64_t expect_val = 0;
+    int bad = 0;
+    uint32_t b;
+    for (b = 0; b < out_sigs[s].num_bits; b++, bit++) {
+      uint64_t mask = UINT64_C(1) << (bit & 63);
+      if (b < 64) {
+        got_val |= (uint64_t)((got[bit / 64] & mask) != 0) << b;
+        expect_val |= (uint64_t)((expect[bit / 64] & mask) != 0) << b;
+      }
+      if ((got[bit / 64] ^ expect[bit / 64]) & care[bit / 64] & mask) {
+        bad = 1;
+      }
+    }
+    if (bad) {
+      lsim_log_flush(lsim);  /* After the leds this vector lit. */
+      printf("Vector %ld (ticklet %ld): %s;%s expected 0x%" PRIx64 ", got 0x%" PRIx64 "\n",
+          vector_num, lsim->total_ticklets, &names[out_sigs[s].name_offset], &names[out_sigs[s].id_offset], expect_val, got_val);
+    }
+  }
+}  /* lsim_vector_report */
+
+
+ERR_F lsim_vector_apply(lsim_t *lsim, const uint8_t *base, size_t file_size, const char *filename, long *rtn_num_vectors, long *rtn_num_mismatches) {
+  ERR_ASSRT(file_size >= sizeof(lsim_vector_file_hdr_t), LSIM_ERR_BADFILE);
+  const lsim_vector_file_hdr_t *hdr = (const lsim_vector_file_hdr_t *)base;
+  if (memcmp(hdr->magic, LSIM_VECTOR_FILE_MAGIC, 8) != 0 || hdr->version != LSIM_VECTOR_FILE_VERSION) {
+    ERR_THROW(LSIM_ERR_BADFILE, "'%s' is not an lsim vector file", filename);
+  }
+
+  /* Each count is checked against what the file could hold before it's
+   * used in any arithmetic, so a bad header can't overflow the sizes. */
+  size_t max_sigs = file_size / sizeof(lsim_vector_file_sig_t);
+  if (hdr->num_in_sigs > max_sigs || hdr->num_out_sigs > max_sigs - hdr->num_in_sigs || hdr->names_size > file_size) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Vector file '%s' is truncated", filename);
+  }
+  size_t sigs_pos = sizeof(*hdr);
+  size_t names_pos = sigs_pos + (hdr->num_in_sigs + hdr->num_out_sigs) * sizeof(lsim_vector_file_sig_t);
+  size_t vectors_pos = names_pos + hdr->names_size;
+  if (vectors_pos > file_size || hdr->names_size == 0 || (hdr->names_size & 7) != 0 || base[vectors_pos - 1] != '\0') {
+    ERR_THROW(LSIM_ERR_BADFILE, "Vector file '%s' is truncated", filename);
+  }
+  const lsim_vector_file_sig_t *sigs = (const lsim_vector_file_sig_t *)&base[sigs_pos];
+  const char *names = (const char *)&base[names_pos];
+  const uint64_t *vectors = (const uint64_t *)&base[vectors_pos];
+
+  /* The signals' widths must add up to the bit counts the arrays below
+   * are sized by. */
+  uint64_t in_bits = 0;
+  uint64_t out_bits = 0;
+  uint64_t s;
+  for (s = 0; s < hdr->num_in_sigs + hdr->num_out_sigs; s++) {
+    uint64_t *bits = (s < hdr->num_in_sigs) ? &in_bits : &out_bits;
+    uint64_t num_bits = (s < hdr->num_in_sigs) ? hdr->num_in_bits : hdr->num_out_bits;
+    if (sigs[s].num_bits > num_bits - *bits) {
+      ERR_THROW(LSIM_ERR_BADFILE, "Vector file '%s' has signals wider than its header", filename);
+    }
+    *bits += sigs[s].num_bits;
+  }
+  if (in_bits != hdr->num_in_bits || out_bits != hdr->num_out_bits) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Vector file '%s' has signals narrower than its header", filename);
+  }
+
+  uint64_t in_words = (hdr->num_in_bits + 63) / 64;
+  uint64_t out_words = (hdr->num_out_bits + 63) / 64;
+  uint64_t vector_words = in_words + 2 * out_words;
+  uint64_t max_vectors = (vector_words > 0) ? (file_size - vectors_pos) / sizeof(uint64_t) / vector_words : 0;
+  if (hdr->num_vectors > max_vectors || vectors_pos + hdr->num_vectors * vector_words * sizeof(uint64_t) != file_size) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Vector file '%s' is truncated", filename);
+  }
+
+  /* Resolve the names once. */
+  lsim_dev_t **in_devs = NULL;
+  lsim_dev_out_terminal_t **out_terminals = NULL;
+  uint64_t *got = NULL;
+  err_t *err = err_calloc((void **)&in_devs, hdr->num_in_bits + 1, sizeof(lsim_dev_t *));
+  if (err == ERR_OK) {
+    err = err_calloc((void **)&out_terminals, hdr->num_out_bits + 1, sizeof(lsim_dev_out_terminal_t *));
+  }
+  if (err == ERR_OK) {
+    err = err_calloc((void **)&got, out_words + 1, sizeof(uint64_t));
+  }
+  uint64_t bit = 0;
+  for (s = 0; s < hdr->num_in_sigs + hdr->num_out_sigs && err == ERR_OK; s++) {
+    if (s == hdr->num_in_sigs) {
+      bit = 0;
+    }
+    if (sigs[s].name_offset >= hdr->names_size || sigs[s].id_offset >= hdr->names_size) {
+      err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_BADFILE, "Vector file '%s' has a bad signal", filename);
+      break;
+    }
+    const char *dev_name = &names[sigs[s].name_offset];
+    lsim_dev_t *dev;
+    err = lsim_name_lookup(lsim, dev_name, &dev);
+    if (err) {
+      break;
+    }
+    uint32_t b;
+    if (s < hdr->num_in_sigs) {
+      if (dev->type == LSIM_DEV_TYPE_SWTCH && sigs[s].num_bits == 1) {
+        in_devs[bit++] = dev;
+      }
+      else if (dev->type == LSIM_DEV_TYPE_PANEL && sigs[s].num_bits == dev->panel.num_bits) {
+        for (b = 0; b < sigs[s].num_bits; b++) {
+          in_devs[bit++] = dev->panel.o_terminals[b]->dev;  /* Its switches. */
+        }
+      }
+      else {
+        err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_COMMAND, "Vector input '%s' is not a swtch or a %u-bit panel", dev_name, sigs[s].num_bits);
+      }
+    }
+    else {
+      for (b = 0; b < sigs[s].num_bits && err == ERR_OK; b++) {
+        lsim_dev_out_terminal_t *out_terminal = NULL;
+        err = dev->get_out_terminal(lsim, dev, &names[sigs[s].id_offset], &out_terminal, b);
+        if (err == ERR_OK && out_terminal == NULL) {
+          err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_COMMAND, "Device '%s' has no output '%s' (bit %u)", dev_name, &names[sigs[s].id_offset], b);
+        }
+        out_terminals[bit++] = out_terminal;
+      }
+    }
+  }
+
+  int resolved = (err == ERR_OK);
+
+  /* The loop: poke what changed, settle, tick, compare. */
+  long num_mismatches = 0;
+  uint64_t v;
+  for (v = 0; v < hdr->num_vectors && err == ERR_OK; v++) {
+    const uint64_t *ins = &vectors[v * vector_words];
+    const uint64_t *expect = &ins[in_words];
+    const uint64_t *care = &expect[out_words];
+
+    for (bit = 0; bit < hdr->num_in_bits; bit++) {
+      int new_state = (int)((ins[bit / 64] >> (bit & 63)) & 1);
+      lsim_dev_t *dev = in_devs[bit];
+      if (dev->swtch.swtch_state != new_state) {
+        err = lsim_dev_poke(lsim, dev, new_state);
+        if (err) {
+          break;
+        }
+      }
+    }
+    if (err == ERR_OK) {
+      err = lsim_dev_settle(lsim);
+    }
+    if (err == ERR_OK && lsim->active_clk_dev) {
+      err = lsim_dev_ticklet(lsim);
+    }
+    if (err) {
+      break;
+    }
+
+    memset(got, 0, out_words * sizeof(uint64_t));
+    for (bit = 0; bit < hdr->num_out_bits; bit++) {
+      got[bit / 64] |= (uint64_t)lsim_dev_out_state(lsim, out_terminals[bit]) << (bit & 63);
+    }
+    uint64_t w;
+    for (w = 0; w < out_words; w++) {
+      if ((got[w] ^ expect[w]) & care[w]) {
+        if (num_mismatches < LSIM_VECTOR_MAX_REPORTS) {
+          lsim_vector_report(lsim, &sigs[hdr->num_in_sigs], hdr->num_out_sigs, names, (long)v, got, expect, care);
+        }
+        num_mismatches++;
+        break;
+      }
+    }
+  }
+
+  free(in_devs);
+  free(out_terminals);
+  free(got);
+  if (err && ! resolved) {
+    ERR_RETHROW(err, "Signals of '%s'", filename);
+  }
+  if (err) {
+    ERR_RETHROW(err, "Vector %" PRIu64 " of '%s'", v, filename);
+  }
+
+  *rtn_num_vectors = (long)hdr->num_vectors;
+  *rtn_num_mismatches = num_mismatches;
+  return ERR_OK;
+}  /* lsim_vector_apply */
+
+
+/* Run a vector file against the powered-up circuit. A mismatch is a
+ * vector with any cared-for output bit wrong; the first
+ * LSIM_VECTOR_MAX_REPORTS of them are printed. */
+ERR_F lsim_vector_run(lsim_t *lsim, const char *filename, long *rtn_num_vectors, long *rtn_num_mismatches) {
+  ERR_ASSRT(lsim->power_on, LSIM_ERR_COMMAND);
+
+  int fd = open(filename, O_RDONLY);
+  ERR_ASSRT(fd >= 0, LSIM_ERR_BADFILE);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't read vector file '%s'", filename);
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  ERR_ASSRT(base != MAP_FAILED, LSIM_ERR_BADFILE);
+#ifdef MADV_SEQUENTIAL
+  madvise(base, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  err_t *err = lsim_vector_apply(lsim, base, st.st_size, filename, rtn_num_vectors, rtn_num_mismatches);
+  munmap(base, st.st_size);
+  if (err) {
+    ERR_RETHROW(err, "Running '%s'", filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_vector_run */
@@ -0,0 +1,85 @@
+/* lsim_vector.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_VECTOR_H
+#define LSIM_VECTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LSIM_VECTOR_FILE_MAGIC "LSIMVECT"
+#define LSIM_VECTOR_FILE_VERSION 1
+
+/* Mismatch lines printed per run; the rest are only counted. */
+#define LSIM_VECTOR_MAX_REPORTS 100
+
+/* Vector file layout (native byte order, 8-byte aligned):
+ *   lsim_vector_file_hdr_t
+ *   lsim_vector_file_sig_t sigs[num_in_sigs + num_out_sigs]  (ins first)
+ *   char names[names_size]  (NUL-terminated, padded to 8)
+ *   num_vectors records of
+ *     uint64_t ins[in_words], expect[out_words], care[out_words]
+ * where in_words = (num_in_bits + 63) / 64, out_words likewise. Bits are
+ * packed in signal order, bit 0 of a signal first. An input signal is a
+ * swtch (1 bit) or a panel (all its switches); an output signal is bits
+ * 0..num_bits-1 of a device output, as in the "b;" command. Only output
+ * bits set in "care" are compared. */
+typedef struct lsim_vector_file_hdr_s {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_in_sigs;
+  uint64_t num_out_sigs;
+  uint64_t num_in_bits;
+  uint64_t num_out_bits;
+  uint64_t names_size;
+  uint64_t num_vectors;
+} lsim_vector_file_hdr_t;
+
+typedef struct lsim_vector_file_sig_s {
+  uint32_t name_offset;  /* Device name, into names[]. */
+  uint32_t id_offset;  /* Output id (e.g. "q0"), into names[]; "" for ins. */
+  uint32_t num_bits;
+  uint32_t reserved;
+} lsim_vector_file_sig_t;
+
+/* Builds a vector file: declare the signals, then add vectors. */
+typedef struct lsim_vector_writer_s {
+  FILE *fp;
+  char *filename;
+  lsim_vector_file_hdr_t hdr;
+  lsim_vector_file_sig_t *sigs;
+  long alloc_sigs;
+  char *names;
+  size_t alloc_names;
+  int started;  /* Header written; no more signals. */
+} lsim_vector_writer_t;
+
+ERR_F lsim_vector_writer_create(lsim_vector_writer_t **rtn_writer, const char *filename);
+ERR_F lsim_vector_writer_in(lsim_vector_writer_t *writer, const char *dev_name, int num_bits);
+ERR_F lsim_vector_writer_out(lsim_vector_writer_t *writer, const char *dev_name, const char *out_id, int num_bits);
+ERR_F lsim_vector_writer_add(lsim_vector_writer_t *writer, const uint64_t *ins, const uint64_t *expect, const uint64_t *care);
+ERR_F lsim_vector_writer_close(lsim_vector_writer_t *writer);
+ERR_F lsim_vector_run(lsim_t *lsim, const char *filename, long *rtn_num_vectors, long *rtn_num_mismatches);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_VECTOR_H
@@ -0,0 +1,449 @@
+/* lsim_wave.c - indexed binary waveform files. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_name.h"
+#include "lsim_vcd.h"
+#include "lsim_wave.h"
+
+
+/* The "wave;" dump writes this instead of VCD text (see lsim_vcd.c for the
+ * capture side; the writer thread calls lsim_wave_writer_entries()).
+ * Changes are varint-coded in blocks, each starting with a snapshot of
+ * all values, and the index at the end gives each block's time range, so
+ * a query decodes only the blocks that overlap its window. */
+
+
+#define LSIM_WAVE_BIT(bits, sig) (((bits)[(sig) / 8] >> ((sig) % 8)) & 1)
+
+
+ERR_F lsim_wave_put(lsim_wave_writer_t *writer, uint64_t val) {
+  if (writer->block_len + 10 > writer->alloc_block) {
+    size_t new_alloc = writer->alloc_block * 2;
+    uint8_t *new_block = realloc(writer->block, new_alloc);
+    ERR_ASSRT(new_block, LSIM_ERR_NOMEM);
+    writer->block = new_block;
+    writer->alloc_block = new_alloc;
+  }
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    writer->block[writer->block_len++] = byte | ((val) ? 0x80 : 0);
+  } while (val);
+
+  return ERR_OK;
+}  /* lsim_wave_put */
+
+
+ERR_F lsim_wave_write(lsim_wave_writer_t *writer, const void *data, size_t size) {
+  ERR_ASSRT(fwrite(data, 1, size, writer->fp) == size, LSIM_ERR_BADFILE);
+  writer->file_pos += size;
+
+  return ERR_OK;
+}  /* lsim_wave_write */
+
+
+ERR_F lsim_wave_block_start(lsim_wave_writer_t *writer) {
+  memcpy(writer->block, writer->vals, writer->vals_size);
+  writer->block_len = writer->vals_size;
+  writer->block_changes = 0;
+  writer->block_first_time = writer->cur_time;
+  writer->block_time = writer->cur_time;
+  writer->prev_sig = 0;
+  writer->block_open = 1;
+
+  return ERR_OK;
+}  /* lsim_wave_block_start */
+
+
+ERR_F lsim_wave_block_end(lsim_wave_writer_t *writer) {
+  if ((uint64_t)writer->alloc_index == writer->hdr.num_blocks) {
+    long new_alloc = writer->alloc_index ? writer->alloc_index * 2 : 256;
+    lsim_wave_file_block_t *new_index = realloc(writer->index, new_alloc * sizeof(lsim_wave_file_block_t));
+    ERR_ASSRT(new_index, LSIM_ERR_NOMEM);
+    writer->index = new_index;
+    writer->alloc_index = new_alloc;
+  }
+  lsim_wave_file_block_t *entry = &writer->index[writer->hdr.num_blocks++];
+  entry->offset = writer->file_pos;
+  entry->size = writer->block_len;
+  entry->first_time = writer->block_first_time;
+  entry->last_time = writer->block_time;
+  ERR(lsim_wave_write(writer, writer->block, writer->block_len));
+  writer->block_open = 0;
+
+  return ERR_OK;
+}  /* lsim_wave_block_end */
+
+
+/* Names and initial values. The first block is started right away, so
+ * even a file with no changes has the values. */
+ERR_F lsim_wave_writer_create(lsim_wave_writer_t **rtn_writer, FILE *fp, long num_sigs, char **sig_names, const uint8_t *vals, long start_time) {
+  lsim_wave_writer_t *writer;
+  ERR(err_calloc((void **)&writer, 1, sizeof(lsim_wave_writer_t)));
+  writer->fp = fp;
+  memcpy(writer->hdr.magic, LSIM_WAVE_FILE_MAGIC, 8);
+  writer->hdr.version = LSIM_WAVE_FILE_VERSION;
+  writer->hdr.num_sigs = num_sigs;
+  writer->hdr.start_time = start_time;
+  long sig;
+  for (sig = 0; sig < num_sigs; sig++) {
+    writer->hdr.names_size += strlen(sig_names[sig]) + 1;
+  }
+  writer->hdr.names_size = (writer->hdr.names_size + 7) & ~(uint64_t)7;
+
+  writer->vals_size = (num_sigs + 7) / 8;
+  writer->alloc_block = writer->vals_size + 64 * 1024;
+  writer->vals = malloc(writer->vals_size);
+  writer->block = malloc(writer->alloc_block);
+  ERR_ASSRT(writer->vals && writer->block, LSIM_ERR_NOMEM);
+  memcpy(writer->vals, vals, writer->vals_size);
+  writer->cur_time = start_time;
+
+  ERR(lsim_wave_write(writer, &writer->hdr, sizeof(writer->hdr)));
+  size_t names_len = 0;
+  for (sig = 0; sig < num_sigs; sig++) {
+    size_t len = strlen(sig_names[sig]) + 1;
+    ERR(lsim_wave_write(writer, sig_names[sig], len));
+    names_len += len;
+  }
+  static const char pad[8] = {0};
+  ERR(lsim_wave_write(writer, pad, writer->hdr.names_size - names_len));
+  ERR(lsim_wave_block_start(writer));
+
+  *rtn_writer = writer;
+  return ERR_OK;
+}  /* lsim_wave_writer_create */
+
+
+/* Encode entries captured by lsim_vcd_change(). */
+ERR_F lsim_wave_writer_entries(lsim_wave_writer_t *writer, const uint64_t *entries, long num_entries) {
+  long i;
+  for (i = 0; i < num_entries; i++) {
+    uint64_t entry = entries[i];
+    if (entry & LSIM_VCD_TIME_FLAG) {
+      writer->cur_time = (int64_t)(entry & ~LSIM_VCD_TIME_FLAG);
+      continue;
+    }
+    uint64_t sig = entry >> 1;
+    if ((uint64_t)LSIM_WAVE_BIT(writer->vals, sig) == (entry & 1)) {
+      continue;  /* Only toggles are coded. */
+    }
+
+    if (! writer->block_open) {
+      ERR(lsim_wave_block_start(writer));
+    }
+    if (writer->cur_time != writer->block_time) {
+      ERR(lsim_wave_put(writer, ((uint64_t)(writer->cur_time - writer->block_time) << 1) | 1));
+      writer->block_time = writer->cur_time;
+    }
+    int64_t sig_delta = (int64_t)(sig - writer->prev_sig);
+    uint64_t zigzag = ((uint64_t)sig_delta << 1) ^ (uint64_t)(sig_delta >> 63);
+    ERR(lsim_wave_put(writer, zigzag << 1));
+    writer->prev_sig = sig;
+    writer->vals[sig / 8] ^= (uint8_t)(1 << (sig % 8));
+
+    writer->block_changes++;
+    if (writer->block_changes >= LSIM_WAVE_BLOCK_CHANGES) {
+      ERR(lsim_wave_block_end(writer));
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_wave_writer_entries */
+
+
+/* Write the index and the final header, and free the writer (the caller
+ * closes the file). */
+ERR_F lsim_wave_writer_close(lsim_wave_writer_t *writer, long end_time) {
+  err_t *err = ERR_OK;
+  if (writer->block_open) {
+    err = lsim_wave_block_end(writer);
+  }
+  if (err == ERR_OK && (writer->file_pos & 7) != 0) {
+    static const char pad[8] = {0};
+    err = lsim_wave_write(writer, pad, 8 - (writer->file_pos & 7));
+  }
+  if (err == ERR_OK) {
+    writer->hdr.index_offset = writer->file_pos;
+    writer->hdr.end_time = end_time;
+    err = lsim_wave_write(writer, writer->index, writer->hdr.num_blocks * sizeof(lsim_wave_file_block_t));
+  }
+  if (err == ERR_OK) {
+    int ok = (fseek(writer->fp, 0, SEEK_SET) == 0);
+    ok = ok && (fwrite(&writer->hdr, sizeof(writer->hdr), 1, writer->fp) == 1);
+    if (! ok) {
+      err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_BADFILE, "Can't finish wave file header");
+    }
+  }
+
+  free(writer->vals);
+  free(writer->block);
+  free(writer->index);
+  free(writer);
+  if (err) {
+    ERR_RETHROW(err, "Closing wave file");
+  }
+
+  return ERR_OK;
+}  /* lsim_wave_writer_close */
+
+
+/* State of a query as it decodes. */
+typedef struct lsim_wave_decode_s {
+  FILE *out;
+  long num_sigs;
+  const char **names;
+  uint8_t *selected;
+  uint8_t *vals;
+  uint8_t *printed;  /* Last value printed (selected signals). */
+  long *touched;  /* Selected signals changed in the current ticklet. */
+  uint8_t *is_touched;
+  long num_touched;
+  int started;  /* Initial values printed. */
+  int done;
+  int64_t time;
+  int64_t first_time;
+  int64_t last_time;
+} lsim_wave_decode_t;
+
+int lsim_wave_sig_cmp(const void *a, const void *b) {
+  long sig_a = *(const long *)a;
+  long sig_b = *(const long *)b;
+  return (sig_a > sig_b) - (sig_a < sig_b);
+}  /* lsim_wave_sig_cmp */
+
+
+/* Time moves from decode->time to new_time: finish the ticklet that's
+ * ending, printing its changes in signal order. A signal that glitches
+ * within a ticklet is printed only if its settled value differs. */
+void lsim_wave_advance(lsim_wave_decode_t *decode, int64_t new_time) {
+  if (decode->done || new_time == decode->time) {
+    return;
+  }
+  long sig;
+  if (decode->started) {
+    qsort(decode->touched, decode->num_touched, sizeof(long), lsim_wave_sig_cmp);
+    long t;
+    for (t = 0; t < decode->num_touched; t++) {
+      sig = decode->touched[t];
+      int val = LSIM_WAVE_BIT(decode->vals, sig);
+      if (val != decode->printed[sig]) {
+        fprintf(decode->out, "%" PRId64 " %s %d\n", decode->time, decode->names[sig], val);
+        decode->printed[sig] = (uint8_t)val;
+      }
+      decode->is_touched[sig] = 0;
+    }
+  }
+  decode->num_touched = 0;
+
+  if (! decode->started && new_time > decode->first_time) {
+    for (sig = 0; sig < decode->num_sigs; sig++) {
+      if (decode->selected[sig]) {
+        decode->printed[sig] = (uint8_t)LSIM_WAVE_BIT(decode->vals, sig);
+        fprintf(decode->out, "%" PRId64 " %s %d\n", decode->first_time, decode->names[sig], decode->printed[sig]);
+      }
+    }
+    decode->started = 1;
+  }
+  if (new_time > decode->last_time) {
+    decode->done = 1;
+  }
+  decode->time = new_time;
+}  /* lsim_wave_advance */
+
+
+ERR_F lsim_wave_decode_block(lsim_wave_decode_t *decode, const uint8_t *block, const lsim_wave_file_block_t *entry) {
+  lsim_wave_advance(decode, entry->first_time);
+
+  size_t pos = (decode->num_sigs + 7) / 8;
+  uint64_t sig = 0;
+  while (pos < entry->size && ! decode->done) {
+    uint64_t val = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+      ERR_ASSRT(pos < entry->size && shift < 64, LSIM_ERR_BADFILE);
+      byte = block[pos++];
+      val |= (uint64_t)(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+
+    if (val & 1) {
+      lsim_wave_advance(decode, decode->time + (int64_t)(val >> 1));
+    }
+    else {
+      uint64_t zigzag = val >> 1;
+      sig += (uint64_t)((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+      ERR_ASSRT(sig < (uint64_t)decode->num_sigs, LSIM_ERR_BADFILE);
+      decode->vals[sig / 8] ^= (uint8_t)(1 << (sig % 8));
+      if (decode->selected[sig] && decode->started && ! decode->is_touched[sig]) {
+        decode->is_touched[sig] = 1;
+        decode->touched[decode->num_touched++] = (long)sig;
+      }
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_wave_decode_block */
+
+
+/* Select signals, find the first block that reaches the window, and decode
+ * from there until the window ends. */
+ERR_F lsim_wave_query_apply(lsim_wave_decode_t *decode, const uint8_t *base, size_t size, const char *patterns) {
+  const lsim_wave_file_hdr_t *hdr = (const lsim_wave_file_hdr_t *)base;
+  ERR_ASSRT(size >= sizeof(*hdr), LSIM_ERR_BADFILE);
+  ERR_ASSRT(memcmp(hdr->magic, LSIM_WAVE_FILE_MAGIC, 8) == 0, LSIM_ERR_BADFILE);
+  ERR_ASSRT(hdr->version == LSIM_WAVE_FILE_VERSION, LSIM_ERR_BADFILE);
+  if (hdr->index_offset == 0) {
+    ERR_THROW(LSIM_ERR_BADFILE, "Wave file not finished (use wavestop)");
+  }
+  ERR_ASSRT(hdr->names_size <= size - sizeof(*hdr), LSIM_ERR_BADFILE);
+  ERR_ASSRT(hdr->index_offset <= size && (hdr->index_offset & 7) == 0, LSIM_ERR_BADFILE);
+  ERR_ASSRT(hdr->num_blocks > 0 && hdr->num_blocks <= (size - hdr->index_offset) / sizeof(lsim_wave_file_block_t), LSIM_ERR_BADFILE);
+  ERR_ASSRT(hdr->num_sigs > 0 && hdr->num_sigs <= hdr->names_size, LSIM_ERR_BADFILE);
+
+  /* Values outside the dump aren't known. */
+  if (decode->first_time < hdr->start_time) {
+    decode->first_time = hdr->start_time;
+  }
+  if (decode->last_time > hdr->end_time) {
+    decode->last_time = hdr->end_time;
+  }
+
+  decode->num_sigs = (long)hdr->num_sigs;
+  size_t vals_size = (decode->num_sigs + 7) / 8;
+  ERR(err_calloc((void **)&decode->names, decode->num_sigs, sizeof(char *)));
+  ERR(err_calloc((void **)&decode->selected, decode->num_sigs, 1));
+  ERR(err_calloc((void **)&decode->printed, decode->num_sigs, 1));
+  ERR(err_calloc((void **)&decode->is_touched, decode->num_sigs, 1));
+  ERR(err_calloc((void **)&decode->touched, decode->num_sigs, sizeof(long)));
+  ERR(err_calloc((void **)&decode->vals, vals_size, 1));
+
+  /* Names, and which of them the patterns pick. */
+  const char *name = (const char *)(base + sizeof(*hdr));
+  const char *names_end = name + hdr->names_size;
+  long num_selected = 0;
+  long sig;
+  for (sig = 0; sig < decode->num_sigs; sig++) {
+    const char *nul = memchr(name, '\0', names_end - name);
+    ERR_ASSRT(nul, LSIM_ERR_BADFILE);
+    decode->names[sig] = name;
+
+    char pattern[LSIM_NAME_MAX_PATTERN + 1];
+    const char *p = patterns;
+    while (*p != '\0' && ! decode->selected[sig]) {
+      size_t len = strcspn(p, " ");
+      if (len > 0) {
+        ERR_ASSRT(len <= LSIM_NAME_MAX_PATTERN, LSIM_ERR_PARAM);
+        memcpy(pattern, p, len);
+        pattern[len] = '\0';
+        decode->selected[sig] = (uint8_t)lsim_name_match_str(pattern, name);
+      }
+      p += len;
+      p += strspn(p, " ");
+    }
+    num_selected += decode->selected[sig];
+    name = nul + 1;
+  }
+  if (num_selected == 0) {
+    ERR_THROW(HMAP_ERR_NOTFOUND, "No signals match '%s'", patterns);
+  }
+
+  if (decode->first_time > decode->last_time) {
+    return ERR_OK;
+  }
+
+  /* The first block whose changes reach first_time. If none do, the last
+   * block has the values the window starts with. */
+  const lsim_wave_file_block_t *index = (const lsim_wave_file_block_t *)(base + hdr->index_offset);
+  uint64_t lo = 0;
+  uint64_t hi = hdr->num_blocks - 1;
+  while (lo < hi) {
+    uint64_t mid = (lo + hi) / 2;
+    if (index[mid].last_time >= decode->first_time) {
+      hi = mid;
+    }
+    else {
+      lo = mid + 1;
+    }
+  }
+
+  const lsim_wave_file_block_t *entry = &index[lo];
+  ERR_ASSRT(entry->size >= vals_size && entry->offset <= hdr->index_offset && entry->size <= hdr->index_offset - entry->offset, LSIM_ERR_BADFILE);
+  memcpy(decode->vals, base + entry->offset, vals_size);
+  /* The window can start in the gap before the block's first change. */
+  decode->time = (entry->first_time > decode->first_time) ? decode->first_time : entry->first_time;
+  uint64_t b;
+  for (b = lo; b < hdr->num_blocks && ! decode->done; b++) {
+    entry = &index[b];
+    ERR_ASSRT(entry->size >= vals_size && entry->offset <= hdr->index_offset && entry->size <= hdr->index_offset - entry->offset, LSIM_ERR_BADFILE);
+    ERR(lsim_wave_decode_block(decode, base + entry->offset, entry));
+  }
+  /* Past the last change: finish its ticklet, and print the initial values
+   * if the window starts after it. */
+  lsim_wave_advance(decode, INT64_MAX);
+
+  return ERR_OK;
+}  /* lsim_wave_query_apply */
+
+
+/* Print the selected signals' values over a window of ticklets: each
+ * signal's value at first_time, then "ticklet name value" for each
+ * change up to last_time. patterns is a space-separated list of
+ * lsim_name_match() patterns against the signal names in the file. */
+ERR_F lsim_wave_query(const char *filename, const char *patterns, long first_time, long last_time, FILE *out) {
+  ERR_ASSRT(first_time <= last_time, LSIM_ERR_PARAM);
+
+  int fd = open(filename, O_RDONLY);
+  ERR_ASSRT(fd >= 0, LSIM_ERR_BADFILE);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    ERR_THROW(LSIM_ERR_BADFILE, "Can't read wave file '%s'", filename);
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  ERR_ASSRT(base != MAP_FAILED, LSIM_ERR_BADFILE);
+
+  lsim_wave_decode_t decode;
+  memset(&decode, 0, sizeof(decode));
+  decode.out = out;
+  decode.first_time = first_time;
+  decode.last_time = last_time;
+  err_t *err = lsim_wave_query_apply(&decode, base, st.st_size, patterns);
+  munmap(base, st.st_size);
+  free(decode.names);
+  free(decode.selected);
+  free(decode.printed);
+  free(decode.is_touched);
+  free(decode.touched);
+  free(decode.vals);
+  if (err) {
+    ERR_RETHROW(err, "Querying '%s'", filename);
+  }
+
+  return ERR_OK;
+}  /* lsim_wave_query */
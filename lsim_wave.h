@@ -0,0 +1,90 @@
+/* lsim_wave.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ *
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_WAVE_H
+#define LSIM_WAVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LSIM_WAVE_FILE_MAGIC "LSIMWAVE"
+#define LSIM_WAVE_FILE_VERSION 1
+
+/* Value changes per block. A query decodes at most one block it doesn't
+ * need, plus the part of the window's last block before the window ends. */
+#define LSIM_WAVE_BLOCK_CHANGES 16384
+
+/* Wave file layout (native byte order):
+ *   lsim_wave_file_hdr_t
+ *   char names[names_size]  (NUL-terminated signal names, padded to 8)
+ *   blocks
+ *   lsim_wave_file_block_t index[num_blocks]  (at index_offset)
+ * A block starts with every signal's value at first_time (one bit per
+ * signal, (num_sigs + 7) / 8 bytes), followed by varints:
+ *   (time_delta << 1) | 1  time moves on by time_delta ticklets
+ *   (zigzag(sig - prev_sig) << 1)  signal sig toggles
+ * where prev_sig starts at 0 in each block. */
+typedef struct lsim_wave_file_hdr_s {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_sigs;
+  uint64_t names_size;
+  uint64_t num_blocks;
+  uint64_t index_offset;  /* 0 if the file wasn't finished. */
+  int64_t start_time;  /* Ticklet the dump started at. */
+  int64_t end_time;  /* Ticklet it ended at. */
+} lsim_wave_file_hdr_t;
+
+typedef struct lsim_wave_file_block_s {
+  uint64_t offset;
+  uint64_t size;
+  int64_t first_time;
+  int64_t last_time;
+} lsim_wave_file_block_t;
+
+typedef struct lsim_wave_writer_s {
+  FILE *fp;
+  lsim_wave_file_hdr_t hdr;
+  uint64_t file_pos;
+  uint8_t *vals;  /* Current value of each signal, a bit each. */
+  size_t vals_size;
+  uint8_t *block;  /* Being built. */
+  size_t block_len;
+  size_t alloc_block;
+  long block_changes;
+  int block_open;
+  int64_t block_first_time;
+  int64_t block_time;  /* Latest time encoded in the block. */
+  int64_t cur_time;  /* Latest time entry seen. */
+  uint64_t prev_sig;
+  lsim_wave_file_block_t *index;
+  long alloc_index;
+} lsim_wave_writer_t;
+
+ERR_F lsim_wave_writer_create(lsim_wave_writer_t **rtn_writer, FILE *fp, long num_sigs, char **sig_names, const uint8_t *vals, long start_time);
+ERR_F lsim_wave_writer_entries(lsim_wave_writer_t *writer, const uint64_t *entries, long num_entries);
+ERR_F lsim_wave_writer_close(lsim_wave_writer_t *writer, long end_time);
+ERR_F lsim_wave_query(const char *filename, const char *patterns, long first_time, long last_time, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_WAVE_H
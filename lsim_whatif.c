@@ -0,0 +1,187 @@
+/* lsim_whatif.c - run stimulus variants in forked copies of the simulator. */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "err.h"
+#include "hmap.h"
+#include "cfg.h"
+#include "lsim.h"
+#include "lsim_dev.h"
+#include "lsim_devs.h"
+#include "lsim_cmd.h"
+#include "lsim_whatif.h"
+#include "lsim_log.h"
+
+
+/* Each variant runs in a child created by fork(), so it starts from the
+ * parent's current state with the netlist, terminals and mem words shared
+ * copy-on-write; nothing is re-parsed or re-powered. A child's output goes
+ * to "<script>.out" and its summary comes back through a pipe. */
+
+
+/* Runs in the child. */
+ERR_F lsim_whatif_child(lsim_t *lsim, const char *script, lsim_whatif_result_t *result) {
+  char *out_name;
+  ERR(err_asprintf(&out_name, "%s.out", script));
+  ERR_ASSRT(freopen(out_name, "w", stdout), LSIM_ERR_BADFILE);
+  free(out_name);
+  ERR_ASSRT(dup2(fileno(stdout), fileno(stderr)) >= 0, LSIM_ERR_BADFILE);
+
+  lsim->vcd = NULL;  /* The parent's; its writer thread isn't in the child. */
+  lsim->log = NULL;  /* Same; the child prints directly. */
+  ERR(lsim_cmd_file(lsim, script));
+
+  result->cur_ticklet = lsim->cur_ticklet;
+  result->total_ticklets = lsim->total_ticklets;
+  result->total_warnings = lsim->total_warnings;
+  long i;
+  for (i = 0; i < lsim->num_devs; i++) {
+    lsim_dev_t *dev = lsim->dev_list[i];
+    if (dev->type == LSIM_DEV_TYPE_LED && dev->led.illuminated) {
+      result->leds_on++;
+    }
+  }
+
+  return ERR_OK;
+}  /* lsim_whatif_child */
+
+
+ERR_F lsim_whatif_run(lsim_t *lsim, int num_scripts, char **scripts, lsim_whatif_result_t *results) {
+  ERR_ASSRT(num_scripts > 0, LSIM_ERR_PARAM);
+
+  long max_procs;
+  ERR(cfg_get_long_val(lsim->cfg, "whatif_procs", &max_procs));
+  ERR_ASSRT(max_procs >= 0, LSIM_ERR_CONFIG);
+  if (max_procs == 0) {
+    max_procs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_procs < 1) {
+      max_procs = 1;
+    }
+  }
+
+  pid_t *pids;
+  ERR(err_calloc((void **)&pids, num_scripts, sizeof(pid_t)));
+  int *result_fds;
+  err_t *err = err_calloc((void **)&result_fds, num_scripts, sizeof(int));
+  if (err) {
+    free(pids);
+    ERR_RETHROW(err, "whatif");
+  }
+
+  /* Don't let the children inherit (and re-print) buffered output. */
+  lsim_log_flush(lsim);
+  fflush(NULL);
+
+  /* If a launch fails, no more are started; the ones already running are
+   * still reaped below before the error is returned. */
+  int num_launch = num_scripts;
+  int next = 0;
+  int running = 0;
+  int done = 0;
+  while (done < num_launch) {
+    while (running < max_procs && next < num_launch) {
+      int fds[2];
+      if (pipe(fds) != 0) {
+        err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_INTERNAL, "whatif: pipe for '%s' failed", scripts[next]);
+        num_launch = next;
+        break;
+      }
+      pid_t pid = fork();
+      if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_NOMEM, "whatif: fork for '%s' failed", scripts[next]);
+        num_launch = next;
+        break;
+      }
+      if (pid == 0) {  /* Child. */
+        close(fds[0]);
+        lsim_whatif_result_t result;
+        memset(&result, 0, sizeof(result));
+        err_t *child_err = lsim_whatif_child(lsim, scripts[next], &result);
+        if (child_err) {
+          result.status = LSIM_WHATIF_STATUS_ERROR;
+          snprintf(result.error_code, sizeof(result.error_code), "%s", child_err->code);
+          ERR_WARN_ON_ERR(child_err, stderr);
+        }
+        fflush(stdout);
+        fflush(stderr);
+        ssize_t len = write(fds[1], &result, sizeof(result));
+        _exit(len == sizeof(result) ? 0 : 1);
+      }
+      close(fds[1]);
+      pids[next] = pid;
+      result_fds[next] = fds[0];
+      running++;
+      next++;
+    }
+    if (done == num_launch) {
+      break;
+    }
+
+    int wstatus;
+    pid_t pid = waitpid(-1, &wstatus, 0);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (err == ERR_OK) {
+        err = err_throw_v(__FILE__, __LINE__, __func__, LSIM_ERR_INTERNAL, "whatif: waitpid failed");
+      }
+      break;
+    }
+    int i;
+    for (i = 0; i < next; i++) {
+      if (pids[i] == pid) {
+        break;
+      }
+    }
+    if (i == next) {
+      continue;  /* Not one of ours. */
+    }
+
+    /* The child wrote its summary before exiting, so it is in the pipe. */
+    ssize_t len = read(result_fds[i], &results[i], sizeof(results[i]));
+    if (len != sizeof(results[i])) {
+      memset(&results[i], 0, sizeof(results[i]));
+      results[i].status = LSIM_WHATIF_STATUS_DIED;
+      results[i].exit_status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+    }
+    close(result_fds[i]);
+    pids[i] = 0;
+    running--;
+    done++;
+  }
+
+  /* Only left open if waitpid() itself failed. */
+  int i;
+  for (i = 0; i < next; i++) {
+    if (pids[i] != 0) {
+      close(result_fds[i]);
+    }
+  }
+  free(pids);
+  free(result_fds);
+  if (err) {
+    ERR_RETHROW(err, "whatif");
+  }
+
+  return ERR_OK;
+}  /* lsim_whatif_run */
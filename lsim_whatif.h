@@ -0,0 +1,45 @@
+/* lsim_whatif.h */
+
+/* This work is dedicated to the public domain under CC0 1.0 Universal:
+ * http://creativecommons.org/publicdomain/zero/1.0/
+ * 
+ * To the extent possible under law, Steven Ford has waived all copyright
+ * and related or neighboring rights to this work. In other words, you can 
+ * use this code for any purpose without any restrictions.
+ * This work is published from: United States.
+ * Project home: https://github.com/fordsfords/lsim
+ */
+
+#ifndef LSIM_WHATIF_H
+#define LSIM_WHATIF_H
+
+#include <stdint.h>
+#include "err.h"
+#include "lsim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LSIM_WHATIF_STATUS_OK 0
+#define LSIM_WHATIF_STATUS_ERROR 1  /* Script returned an error. */
+#define LSIM_WHATIF_STATUS_DIED 2  /* Child exited without a summary. */
+
+/* Sent from each child to the parent through a pipe (< PIPE_BUF). */
+typedef struct lsim_whatif_result_s {
+  int32_t status;  /* LSIM_WHATIF_STATUS_xxx */
+  int32_t exit_status;  /* From waitpid(), for STATUS_DIED. */
+  int64_t cur_ticklet;
+  int64_t total_ticklets;
+  int64_t total_warnings;
+  int64_t leds_on;
+  char error_code[64];
+} lsim_whatif_result_t;
+
+ERR_F lsim_whatif_run(lsim_t *lsim, int num_scripts, char **scripts, lsim_whatif_result_t *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LSIM_WHATIF_H